@@ -70,18 +70,32 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
 
 /* Memory allocation related definitions. */
+#if T85_STATIC_ALLOC // static build, set by the T85_STATIC_ALLOC CMake option, see telemetry/static_alloc.h
+/* Our tasks and buffers are static, the heap is left to lwIP and cyw43 at startup */
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configTOTAL_HEAP_SIZE                   (32*1024)
+#define configUSE_MALLOC_FAILED_HOOK            1
+#else
 #define configSUPPORT_STATIC_ALLOCATION         0
-#define configSUPPORT_DYNAMIC_ALLOCATION        1
 #define configTOTAL_HEAP_SIZE                   (128*1024)
+#define configUSE_MALLOC_FAILED_HOOK            0
+#endif
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
 /* Hook function related definitions. */
 #define configCHECK_FOR_STACK_OVERFLOW          1
-#define configUSE_MALLOC_FAILED_HOOK            0
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+/* The RP2040 timer counts microseconds from boot, a 64-bit count does not wrap */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        time_us_64()
+#ifndef __ASSEMBLER__
+extern uint64_t time_us_64(void);
+#endif
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
@@ -104,10 +118,15 @@
 
 #if FREE_RTOS_KERNEL_SMP // set by the RP2040 SMP port of FreeRTOS
 /* SMP port only */
+#if T85_SMP // dual-core build, set by the T85_SMP CMake option
+#define configNUMBER_OF_CORES                   2
+#define configUSE_CORE_AFFINITY                 1
+#else
 #define configNUMBER_OF_CORES                   1
+#define configUSE_CORE_AFFINITY                 0
+#endif
 #define configTICK_CORE                         0
 #define configRUN_MULTIPLE_PRIORITIES           1
-#define configUSE_CORE_AFFINITY                 0
 // #define configUSE_PASSIVE_IDLE_HOOK             0
 #endif
 
@@ -139,6 +158,9 @@ to exclude the API function. */
 #define INCLUDE_xQueueGetMutexHolder            1
 
 /* A header file that defines trace macro can be included here. */
+#if T85_TRACE && !defined(__ASSEMBLER__) // schedule trace, set by the T85_TRACE CMake option
+#include "telemetry/trace.h"
+#endif
 
 #endif /* FREERTOS_CONFIG_H */
 
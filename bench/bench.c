@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include "bench.h"
+
+static uint64_t time_batch(bench_fn_t fn, void *context, uint32_t batch)
+{
+    uint64_t start = bench_clock_ns();
+    for (uint32_t i = 0; i < batch; i++)
+        fn(context);
+    return bench_clock_ns() - start;
+}
+
+void bench_run(const char *name, bench_fn_t fn, void *context, bench_result_t *result)
+{
+    uint32_t runs[BENCH_RUNS];
+    for (int i = 0; i < BENCH_WARMUP; i++)
+        fn(context); // caches, branch history and lazily set up state
+    uint32_t batch = 1;
+    while (batch < BENCH_MAX_BATCH && time_batch(fn, context, batch) < BENCH_BATCH_NS)
+        batch *= 2;
+
+    for (int i = 0; i < BENCH_RUNS; i++)
+    {
+        uint32_t ns = time_batch(fn, context, batch) / batch;
+        // insertion sort, the runs come out nearly sorted anyway
+        int j = i;
+        for (; j > 0 && runs[j - 1] > ns; j--)
+            runs[j] = runs[j - 1];
+        runs[j] = ns;
+    }
+    result->name = name;
+    result->runs = BENCH_RUNS;
+    result->batch = batch;
+    result->min_ns = runs[0];
+    result->median_ns = runs[BENCH_RUNS / 2];
+    result->max_ns = runs[BENCH_RUNS - 1];
+}
+
+int bench_format(const bench_result_t *result, char *text, size_t size)
+{
+    int len = snprintf(text, size, "[BENCH]case:%s\truns:%lu\tbatch:%lu\tmin_ns:%lu\tmedian_ns:%lu\tmax_ns:%lu\n", result->name,
+                       (unsigned long)result->runs, (unsigned long)result->batch, (unsigned long)result->min_ns,
+                       (unsigned long)result->median_ns, (unsigned long)result->max_ns);
+    return len < (int)size ? len : (int)size - 1;
+}
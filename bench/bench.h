@@ -0,0 +1,43 @@
+#ifndef BENCH_H
+#define BENCH_H
+// Micro-benchmarks of the firmware's hot paths, the same cases on the Pico
+// (the bench target, results on USB serial) and on the host (sim/, with the
+// HAL shim answering the hardware, or host/, with the stand-ins of host/tests).
+// See bench/bench_main.c for the cases and host/t85_bench_compare.cpp to
+// compare the results of two builds.
+//
+// bench_run calls a case BENCH_WARMUP times, then doubles a batch size until
+// one batch takes BENCH_BATCH_NS, so the 1 us timer of the Pico resolves a
+// call of a few cycles, and times BENCH_RUNS batches. A run is the batch
+// time over the batch size, the result is the min, median and max run.
+//
+// Results are one line per case, tab separated key:value pairs like the
+// telemetry:
+//   [BENCH]case:read_char  runs:31  batch:4096  min_ns:120  median_ns:121  max_ns:135
+// between a "[BENCH]begin platform:<p> build:<id>" and a "[BENCH]end" line.
+//
+// Pure logic with no Pico includes, so it builds on the host too.
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_WARMUP 16
+#define BENCH_RUNS 31 // odd, for a median
+#define BENCH_BATCH_NS 200000
+#define BENCH_MAX_BATCH (1u << 20)
+
+// Provided by the caller: a monotonic clock, any resolution of 1 us or better
+uint64_t bench_clock_ns(void);
+
+typedef void (*bench_fn_t)(void *context);
+
+typedef struct bench_result_t_
+{
+    const char *name;
+    uint32_t runs, batch;
+    uint32_t min_ns, median_ns, max_ns; // per call
+} bench_result_t;
+
+void bench_run(const char *name, bench_fn_t fn, void *context, bench_result_t *result);
+int bench_format(const bench_result_t *result, char *text, size_t size);
+
+#endif
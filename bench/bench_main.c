@@ -0,0 +1,171 @@
+// The bench target: times the firmware's hot paths with bench_run and prints
+// the results, see bench/bench.h. On the Pico the passes repeat every few
+// seconds on USB serial, so a terminal opened late still gets a whole pass.
+#include <math.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "magnometer.h"
+#include "ultrasonic.h"
+#include "irline.h"
+#include "motion.h"
+#include "control.h"
+#include "dlog.h"
+#include "bench.h"
+
+#ifndef BENCH_PLATFORM
+#define BENCH_PLATFORM "pico"
+#endif
+#ifndef BENCH_BUILD
+#define BENCH_BUILD "unknown"
+#endif
+#ifndef BENCH_PASSES
+#define BENCH_PASSES 0 // forever
+#endif
+#define BENCH_PASS_GAP_MS 5000
+
+// the car's wiring and move_task's setup, see taskmanager.c
+#define ECHO_PIN 12
+#define TRI_PIN 13
+#define BENCH_MAX_SPEED 6250
+#define BENCH_GAIN_DT 0.01f
+#define BENCH_SETTLE_STEPS 50
+#define BENCH_CODES_PER_CM (DIST_10CM / 10.0f)
+
+// results go here so the calls are not optimized away
+static volatile float sink_float;
+static volatile int sink_int;
+
+static control_t control;
+static control_input_t input;
+
+// control.h hooks, the bench has no map readers and does not time the planner
+void control_map_write_begin(void)
+{
+}
+
+void control_map_write_end(void)
+{
+}
+
+uint32_t control_time_us(void)
+{
+    return 0;
+}
+
+static void bench_heading(__unused void *context)
+{
+    sink_float = heading();
+}
+
+static void bench_getcm(__unused void *context)
+{
+    sink_float = getcm(TRI_PIN, ECHO_PIN);
+}
+
+// bar and space patterns of a few Code 39 characters, the lookup is a switch over both
+static void bench_read_char(__unused void *context)
+{
+    static const char codes[][2] = {{0b10001, 0b0100}, {0b01100, 0b0010}, {0b00011, 0b1000}, {0b00110, 0b0100}, {0b01010, 0b0001}};
+    static unsigned next = 0;
+    const char *code = codes[next++ % (sizeof(codes) / sizeof(codes[0]))];
+    sink_int = read_char(code[0], code[1]);
+}
+
+// what an ISR pays for a log message, and dlog_task for taking it back out
+static void bench_log_write(__unused void *context)
+{
+    dlog_record_t record;
+    DLOG_(DLOG_LEVEL_DEBUG, DLOG_BARCODE_BARS, 0b10001, 0b0100);
+    sink_int = dlog_take(&record);
+}
+
+static void bench_format_update(__unused void *context)
+{
+    char text[120];
+    sink_int = control_format_update(&control, &input, text, sizeof(text));
+}
+
+static void bench_bearing_error(__unused void *context)
+{
+    static float current = 0;
+    current = current < 355 ? current + 7 : current - 355;
+    sink_float = motion_bearing_error(current, 90);
+}
+
+// a straight longer than any bench, so the control code runs its straight-line path
+static void keep_driving(void)
+{
+    control_output_t output;
+    if (control.engine.active || motion_queued(&control.engine))
+        return;
+    motion_primitive_t straight = {.type = MOTION_STRAIGHT, .value = 100000000};
+    control_move(&control, true, true, &straight);
+    control_step(&control, &input, &output); // starts it
+}
+
+// the control work of one move_task period, the sensor reads, the status
+// line and the motor writes are timed by the other cases
+static void bench_move_iteration(__unused void *context)
+{
+    control_output_t output;
+    keep_driving();
+    input.motion.left_code += 3;
+    input.motion.right_code += 3;
+    input.motion.bearing = (input.motion.bearing + 1) % 4;
+    control_step(&control, &input, &output);
+    sink_int = output.motion.left_speed;
+}
+
+static const struct
+{
+    const char *name;
+    bench_fn_t fn;
+} cases[] = {
+    {"heading", bench_heading},
+    {"getcm", bench_getcm},
+    {"read_char", bench_read_char},
+    {"log_write", bench_log_write},
+    {"format_update", bench_format_update},
+    {"bearing_error", bench_bearing_error},
+    {"move_iteration", bench_move_iteration},
+};
+
+static void run_pass(void)
+{
+    char text[160];
+    bench_result_t result;
+    printf("[BENCH]begin platform:%s\tbuild:%s\n", BENCH_PLATFORM, BENCH_BUILD);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        bench_run(cases[i].name, cases[i].fn, NULL, &result);
+        bench_format(&result, text, sizeof(text));
+        fputs(text, stdout);
+    }
+    printf("[BENCH]end\n");
+    fflush(stdout);
+}
+
+int main()
+{
+    stdio_init_all();
+    dlog_init();
+    setup_ultrasonic_pins(TRI_PIN, ECHO_PIN);
+    initializeI2C();
+    initalize_acc();
+    initalize_mag();
+
+    control_init(&control, BENCH_MAX_SPEED, BENCH_GAIN_DT, BENCH_SETTLE_STEPS, BENCH_CODES_PER_CM);
+    control.engine.gains = (motion_gains_t){0.1f, 0, 0, 0.15f, 0.075f, 0.6f, 0.3f};
+    input.motion.dt = BENCH_GAIN_DT;
+    input.motion.obstacle_cm = INFINITY;
+    keep_driving(); // format_update prints the [MOV] line of a running move
+
+    for (int pass = 0; BENCH_PASSES == 0 || pass < BENCH_PASSES; pass++)
+    {
+        if (pass > 0)
+            sleep_ms(BENCH_PASS_GAP_MS);
+        run_pass();
+    }
+    return 0;
+}
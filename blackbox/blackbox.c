@@ -0,0 +1,246 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "blackbox.h"
+
+#define BLACKBOX_OFFSET (PICO_FLASH_SIZE_BYTES - BLACKBOX_FLASH_SIZE) // from the start of flash
+#define SAMPLES_PER_PAGE (FLASH_PAGE_SIZE / sizeof(blackbox_sample_t))
+#define CAPACITY ((BLACKBOX_FLASH_SIZE - BLACKBOX_HEADER_SIZE) / sizeof(blackbox_sample_t))
+
+static_assert(sizeof(blackbox_sample_t) == 32, "a page holds a whole number of samples");
+static_assert(BLACKBOX_HEADER_SIZE == FLASH_PAGE_SIZE, "the header is one page");
+static_assert(BLACKBOX_FLASH_SIZE % FLASH_SECTOR_SIZE == 0, "the region is erased in sectors");
+static_assert((BLACKBOX_RAM_SAMPLES & (BLACKBOX_RAM_SAMPLES - 1)) == 0, "BLACKBOX_RAM_SAMPLES must be a power of two");
+
+#if !PICO_NO_FLASH
+extern char __flash_binary_end; // end of the program image, from the linker script
+#endif
+
+// samples from move_task to blackbox_task, head written only by blackbox_add, tail only by the task
+static blackbox_sample_t ring[BLACKBOX_RAM_SAMPLES];
+static volatile uint32_t ring_head = 0, ring_tail = 0;
+static volatile uint8_t state = BLACKBOX_IDLE;
+static volatile bool arm_requested = false, stop_requested = false;
+static volatile blackbox_stats_t stats;
+static uint32_t write_offset; // next page to program, from the start of the region
+static uint8_t page[FLASH_PAGE_SIZE];
+static TaskHandle_t blackbox_handle = NULL;
+
+static const uint8_t *region(void)
+{
+    return (const uint8_t *)(XIP_BASE + BLACKBOX_OFFSET);
+}
+
+static bool erased(const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        if (data[i] != 0xff)
+            return false;
+    return true;
+}
+
+void blackbox_init(void)
+{
+#if !PICO_NO_FLASH
+    if ((uintptr_t)&__flash_binary_end - XIP_BASE > BLACKBOX_OFFSET)
+        panic("the program runs into the black box region, lower BLACKBOX_FLASH_SIZE");
+#endif
+    blackbox_header_t header;
+    memcpy(&header, region(), sizeof(header));
+    if (header.magic != BLACKBOX_MAGIC || header.version != BLACKBOX_VERSION || header.sample_size != sizeof(blackbox_sample_t))
+        return;
+    // samples are programmed in order into an erased region, the first erased slot ends them
+    const uint8_t *samples = region() + BLACKBOX_HEADER_SIZE;
+    uint32_t low = 0, high = CAPACITY;
+    while (low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+        if (erased(samples + mid * sizeof(blackbox_sample_t), sizeof(blackbox_sample_t)))
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    stats.flushed = low;
+    state = BLACKBOX_STOPPED;
+}
+
+typedef struct flash_op_t_
+{
+    bool erase;
+    uint32_t offset;
+    const uint8_t *data;
+} flash_op_t;
+
+static void flash_op(void *param)
+{
+    const flash_op_t *op = param;
+    if (op->erase)
+        flash_range_erase(BLACKBOX_OFFSET + op->offset, FLASH_SECTOR_SIZE);
+    else
+        flash_range_program(BLACKBOX_OFFSET + op->offset, op->data, FLASH_PAGE_SIZE);
+}
+
+// run one flash operation with nothing executing from flash, interrupts masked
+// here and the other core parked in SMP builds, returns the stall
+static uint32_t flash_locked(bool erase, uint32_t offset, const uint8_t *data)
+{
+    flash_op_t op = {erase, offset, data};
+    uint32_t start_us = time_us_32();
+    int result = flash_safe_execute(flash_op, &op, 100);
+    if (result != PICO_OK)
+        panic("black box flash %s at %" PRIu32 " failed: %d", erase ? "erase" : "program", offset, result);
+    return time_us_32() - start_us;
+}
+
+// erase the region a sector at a time, letting the other tasks run between sectors
+static void erase_region(void)
+{
+    uint32_t start_us = time_us_32();
+    for (uint32_t offset = 0; offset < BLACKBOX_FLASH_SIZE; offset += FLASH_SECTOR_SIZE)
+    {
+        flash_locked(true, offset, NULL);
+        vTaskDelay(1);
+    }
+    memset((void *)&stats, 0, sizeof(stats));
+    stats.erase_us = time_us_32() - start_us;
+
+    blackbox_header_t header = {BLACKBOX_MAGIC, BLACKBOX_VERSION, sizeof(blackbox_sample_t), time_us_32()};
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &header, sizeof(header));
+    flash_locked(false, 0, page);
+    write_offset = BLACKBOX_HEADER_SIZE;
+}
+
+// program the next page from the ring, a partial one only when flushing
+static void write_page(bool flush)
+{
+    uint32_t pending = ring_head - ring_tail;
+    __dmb();
+    if (pending == 0 || (pending < SAMPLES_PER_PAGE && !flush))
+        return;
+    uint32_t n = pending < SAMPLES_PER_PAGE ? pending : SAMPLES_PER_PAGE;
+    memset(page, 0xff, sizeof(page));
+    for (uint32_t i = 0; i < n; i++)
+        memcpy(page + i * sizeof(blackbox_sample_t), &ring[(ring_tail + i) & (BLACKBOX_RAM_SAMPLES - 1)], sizeof(blackbox_sample_t));
+    __dmb();
+    ring_tail += n;
+
+    uint32_t stall_us = flash_locked(false, write_offset, page);
+    write_offset += FLASH_PAGE_SIZE;
+    if (stats.flushed == 0)
+        stats.first_us = ((const blackbox_sample_t *)page)->time_us;
+    stats.last_us = ((const blackbox_sample_t *)page)[n - 1].time_us;
+    stats.flushed += n;
+    stats.pages++;
+    stats.total_page_us += stall_us;
+    if (stall_us > stats.max_page_us)
+        stats.max_page_us = stall_us;
+    if (write_offset >= BLACKBOX_FLASH_SIZE)
+        state = BLACKBOX_STOPPED; // full, the region is only erased by the next arm
+}
+
+// programs the samples move_task adds, at most one page each time it is woken, so
+// move_task sees at most one page of stall per period
+void blackbox_task(__unused void *params)
+{
+    blackbox_handle = xTaskGetCurrentTaskHandle();
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (arm_requested)
+        {
+            state = BLACKBOX_ERASING;
+            erase_region();
+            ring_tail = ring_head; // nothing was added while erasing
+            arm_requested = false;
+            stop_requested = false;
+            state = BLACKBOX_RECORDING;
+            continue;
+        }
+        if (state != BLACKBOX_RECORDING)
+            continue;
+        if (stop_requested)
+        {
+            state = BLACKBOX_STOPPED; // blackbox_add takes no more, the rest is flushed a page at a time
+            while (ring_head != ring_tail && write_offset < BLACKBOX_FLASH_SIZE)
+            {
+                write_page(true);
+                vTaskDelay(1);
+            }
+            stop_requested = false;
+            continue;
+        }
+        write_page(false);
+    }
+}
+
+void blackbox_add(const blackbox_sample_t *sample)
+{
+    if (state != BLACKBOX_RECORDING)
+        return;
+    stats.added++;
+    uint32_t head = ring_head;
+    if (head - ring_tail >= BLACKBOX_RAM_SAMPLES)
+    {
+        stats.dropped++; // blackbox_task is behind, keep the samples it has
+        return;
+    }
+    ring[head & (BLACKBOX_RAM_SAMPLES - 1)] = *sample;
+    __dmb();
+    ring_head = head + 1;
+    if (blackbox_handle)
+        xTaskNotifyGive(blackbox_handle);
+}
+
+bool blackbox_arm(void)
+{
+    if (state == BLACKBOX_ERASING || arm_requested || !blackbox_handle)
+        return false;
+    arm_requested = true;
+    xTaskNotifyGive(blackbox_handle);
+    return true;
+}
+
+void blackbox_stop(void)
+{
+    if (state != BLACKBOX_RECORDING || !blackbox_handle)
+        return;
+    stop_requested = true;
+    xTaskNotifyGive(blackbox_handle);
+}
+
+uint32_t blackbox_size(void)
+{
+    if (state == BLACKBOX_IDLE || state == BLACKBOX_ERASING)
+        return 0;
+    return BLACKBOX_HEADER_SIZE + stats.flushed * sizeof(blackbox_sample_t);
+}
+
+uint32_t blackbox_read(uint32_t offset, uint8_t *out, uint32_t size)
+{
+    uint32_t total = blackbox_size();
+    if (offset >= total)
+        return 0;
+    uint32_t n = total - offset < size ? total - offset : size;
+    memcpy(out, region() + offset, n);
+    return n;
+}
+
+// status and the measured cost: sample rate into flash and the stall of each page program
+int blackbox_format(char *text, size_t size)
+{
+    static const char *const names[] = {"idle", "erasing", "recording", "stopped"};
+    uint32_t span_us = stats.last_us - stats.first_us;
+    float rate = span_us ? (stats.flushed - 1) * 1e6f / span_us : 0;
+    int len = snprintf(text, size, "[BB]%s\tsamples:%" PRIu32 "/%" PRIu32 "\tadded:%" PRIu32 "\tdropped:%" PRIu32 "\trate:%.1f/s\tpage us max:%" PRIu32 " avg:%" PRIu32 "\terase ms:%" PRIu32 "\n",
+                       names[state], stats.flushed, (uint32_t)CAPACITY, stats.added, stats.dropped, rate, stats.max_page_us,
+                       stats.pages ? stats.total_page_us / stats.pages : 0, stats.erase_us / 1000);
+    return len < (int)size ? len : (int)size - 1;
+}
@@ -0,0 +1,104 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+// Black-box recorder: move_task's state every period, kept in flash so it
+// survives a lost Wi-Fi link, a full telemetry lane or a reset.
+//
+// move_task adds a 32-byte sample a period with blackbox_add, which only
+// copies it into a RAM ring and wakes blackbox_task. The task programs the
+// ring to a reserved region at the end of flash one 256-byte page at a time.
+// Programming stops execution from flash, so it runs with interrupts masked
+// on this core and, in SMP builds, the other core locked out; each page is
+// one stall of about 0.5 ms (3 ms worst case for the W25Q16 on the Pico W),
+// and at most one page is written per control period, so move_task is never
+// held up by more than one page. A page holds 8 samples, so at 100 Hz the
+// task keeps up using an eighth of the periods.
+//
+// Erasing a 4 KB sector stalls for 45 ms or more, too long for a moving car,
+// so "bb arm" erases the whole region up front, while the car is parked (about
+// 6 s for 512 KB, a sector at a time with a tick between them), and
+// the recording then fills it once and stops: BLACKBOX_FLASH_SIZE / 32 bytes
+// samples, 160 s at 100 Hz for 512 KB. The region starts with a header page,
+// after a reset blackbox_init finds the end of the samples again, so the log
+// can be read with "bb dump" once the car is back on the network.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef BLACKBOX_FLASH_SIZE
+#define BLACKBOX_FLASH_SIZE (512 * 1024) // at the end of flash, a whole number of sectors
+#endif
+#define BLACKBOX_RAM_SAMPLES 256 // 2.5 s at 100 Hz before samples are dropped, a power of two
+#define BLACKBOX_MAGIC 0x42423538u // "85BB"
+#define BLACKBOX_VERSION 1
+#define BLACKBOX_HEADER_SIZE 256 // the header page, samples follow it
+
+#define BLACKBOX_FLAG_LEFT_IR 0x01
+#define BLACKBOX_FLAG_RIGHT_IR 0x02
+#define BLACKBOX_FLAG_LINE_VALID 0x04
+#define BLACKBOX_FLAG_CLIENT 0x08 // a TCP client was connected
+#define BLACKBOX_OBSTACLE_NONE 0xffff
+
+// One control period, little-endian, 32 bytes
+typedef struct blackbox_sample_t_
+{
+    uint32_t time_us; // release of the period, time_us_32()
+    int32_t left_code; // encoder codes, low 32 bits
+    int32_t right_code;
+    int16_t bearing;
+    int16_t target_bearing;
+    uint16_t left_speed; // PWM levels driven
+    uint16_t right_speed;
+    uint16_t obstacle_cm; // BLACKBOX_OBSTACLE_NONE without a fresh echo
+    int16_t line_offset;  // analog line offset * 32767
+    int16_t error;        // distance or bearing error * 10
+    uint16_t dt_us;       // measured period
+    uint8_t drive;        // motion_drive_t
+    char mode;            // move_mode
+    uint8_t flags;        // BLACKBOX_FLAG_*
+    uint8_t events;       // MOTION_EVENT_*
+} blackbox_sample_t;
+
+// First page of the region
+typedef struct blackbox_header_t_
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sample_size;
+    uint32_t armed_us; // time_us_32() at "bb arm"
+} blackbox_header_t;
+
+typedef enum
+{
+    BLACKBOX_IDLE,      // nothing recorded since boot or the last erase
+    BLACKBOX_ERASING,   // "bb arm" is erasing the region
+    BLACKBOX_RECORDING,
+    BLACKBOX_STOPPED,   // "bb stop", the region filled, or a log found at boot
+} blackbox_state_t;
+
+// Counters, written only by blackbox_task and blackbox_add
+typedef struct blackbox_stats_t_
+{
+    uint32_t added;   // samples given to blackbox_add while recording
+    uint32_t dropped; // lost because the RAM ring was full
+    uint32_t flushed; // samples in flash, the header page not counted
+    uint32_t pages;
+    uint32_t max_page_us;   // longest stall of one page program
+    uint32_t total_page_us;
+    uint32_t erase_us;      // time "bb arm" took to erase
+    uint32_t first_us, last_us; // time_us of the first and last sample flushed
+} blackbox_stats_t;
+
+// reads the region's header and finds where the samples end, before the scheduler starts
+void blackbox_init(void);
+void blackbox_task(void *params);
+void blackbox_add(const blackbox_sample_t *sample); // from move_task, never blocks
+
+// from network_task, blackbox_task does the flash work
+bool blackbox_arm(void);  // erase the region and record, false while erasing
+void blackbox_stop(void); // flush what is left in RAM and stop
+// bytes of the log, the header page and the samples in flash, and a copy of some of them
+uint32_t blackbox_size(void);
+uint32_t blackbox_read(uint32_t offset, uint8_t *out, uint32_t size);
+int blackbox_format(char *text, size_t size);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include "control.h"
+
+void control_init(control_t *control, uint16_t max_speed, float gain_dt, uint16_t settle_steps, float codes_per_cm)
+{
+    memset(control, 0, sizeof(*control));
+    motion_init(&control->engine, max_speed, gain_dt, settle_steps);
+    control->codes_per_cm = codes_per_cm;
+    control->map_goal_x = MAZE_NO_GOAL;
+}
+
+// drop the queued route and hold the current heading
+static void halt(control_t *control)
+{
+    motion_primitive_t stop = {.type = MOTION_STOP};
+    motion_flush(&control->engine);
+    motion_push(&control->engine, &stop);
+}
+
+bool control_move(control_t *control, bool flush, bool append, const motion_primitive_t *primitive)
+{
+    if (flush)
+    {
+        motion_flush(&control->engine);
+        control->map_driving = false; // stop and new routes end map driving too
+    }
+    if (!append)
+        return true;
+    motion_primitive_t copy = *primitive;
+    return motion_push(&control->engine, &copy);
+}
+
+void control_mission(control_t *control, const mission_program_t *program, uint32_t barcode_count)
+{
+    bool was_running = control->mission.running;
+    mission_load(&control->mission, program);
+    control->barcodes_at_start = barcode_count;
+    if (was_running || !control->mission.running)
+    {
+        // drop the route the old script queued
+        halt(control);
+        control->map_driving = false;
+    }
+}
+
+void control_map(control_t *control, const map_cmd_t *cmd)
+{
+    if (cmd->op == MAP_RESET)
+    {
+        // north is the heading the car holds now
+        control_map_write_begin();
+        maze_reset(&control->maze, cmd->args[0], cmd->args[1], cmd->args[2], cmd->args[3], cmd->args[4], control->engine.target_bearing);
+        control_map_write_end();
+        control->map_route = (control->engine.pos_left + control->engine.pos_right) / 2;
+        control->map_driving = false;
+        return;
+    }
+    control->map_driving = control->maze.width && (cmd->op == MAP_GOTO || cmd->args[0]);
+    control->map_goal_x = cmd->op == MAP_GOTO ? cmd->args[0] : MAZE_NO_GOAL;
+    control->map_goal_y = cmd->args[1];
+    if (cmd->op == MAP_EXPLORE && !control->map_driving)
+        halt(control);
+    if (control->map_driving)
+        motion_flush(&control->engine); // planned in control_step, from the map as it is after that step
+}
+
+// plan on the map to the goal cell or the nearest unknown cell and queue the route in place of the current one
+static bool queue_maze_route(control_t *control)
+{
+    static maze_plan_t plan;
+    motion_primitive_t route[MOTION_QUEUE_SIZE];
+    uint32_t start_us = control_time_us();
+    bool found = maze_plan(&control->maze, control->map_goal_x, control->map_goal_y, &plan);
+    control->plan_us = control_time_us() - start_us;
+    if (!found)
+        return false;
+    // a route longer than the queue is planned again from where it ends
+    uint8_t count = maze_primitives(&control->maze, &plan, control->engine.target_bearing, control->codes_per_cm, route, MOTION_QUEUE_SIZE);
+    motion_flush(&control->engine);
+    for (uint8_t i = 0; i < count; i++)
+        motion_push(&control->engine, &route[i]);
+    control->plan_length = plan.length;
+    control->plan_expanded = plan.expanded;
+    control->plan_moves = count;
+    return true;
+}
+
+// odometry every step, echoes while not rotating in place, and a new route when the last one ran out
+static uint8_t map_step(control_t *control, const control_input_t *in, uint8_t drive)
+{
+    motion_engine_t *engine = &control->engine;
+    float route = (engine->pos_left + engine->pos_right) / 2;
+    bool new_echo = in->echo_valid && in->echo_us != control->mapped_echo && drive != MOTION_DRIVE_CW && drive != MOTION_DRIVE_CCW;
+    control_map_write_begin();
+    maze_odometry(&control->maze, (route - control->map_route) / control->codes_per_cm, in->motion.bearing);
+    if (new_echo)
+        maze_range(&control->maze, in->echo_cm, CONTROL_RANGE_MAX_CM, in->motion.bearing);
+    control_map_write_end();
+    control->map_route = route;
+    if (new_echo)
+        control->mapped_echo = in->echo_us;
+
+    // the route ran out or an obstacle dropped it, plan again with what the map has learned
+    uint8_t x, y;
+    if (!control->map_driving || engine->active || motion_queued(engine))
+        return 0;
+    if (control->map_goal_x != MAZE_NO_GOAL && maze_cell(&control->maze, &x, &y) && x == control->map_goal_x && y == control->map_goal_y)
+    {
+        control->map_driving = false;
+        return CONTROL_MAP_ARRIVED;
+    }
+    if (queue_maze_route(control))
+        return CONTROL_MAP_PLANNED;
+    control->map_driving = false;
+    return control->map_goal_x == MAZE_NO_GOAL ? CONTROL_MAP_EXPLORED : CONTROL_MAP_NO_PATH;
+}
+
+void control_step(control_t *control, const control_input_t *in, control_output_t *out)
+{
+    out->mission_events = 0;
+    out->map_events = 0;
+    if (control->mission.running)
+    {
+        const char *barcode = in->barcode_count == control->barcodes_at_start ? "" : in->barcode;
+        mission_sensors_t sensors = {in->motion.obstacle_cm, in->motion.left_ir_black, in->motion.right_ir_black, barcode};
+        out->mission_events = mission_step(&control->mission, &control->engine, &sensors); // bounded, MISSION_STEPS_PER_TICK
+    }
+    out->motion_events = motion_step(&control->engine, &in->motion, &out->motion);
+    if (control->maze.width)
+        out->map_events = map_step(control, in, out->motion.drive);
+}
+
+int control_format_update(const control_t *control, const control_input_t *in, char *text, size_t size)
+{
+    const motion_engine_t *engine = &control->engine;
+    int len;
+    if (engine->active)
+        len = snprintf(text, size, "[MOV]id:%u\tmode:%c\tprogress:%u\tq:%u\terr:%.1f\tctrl:%.2f\tlc:%lld\tlr:%lld\tcb:%d\ttb:%d\n",
+                       engine->current.id, motion_mode(engine), motion_progress(engine), motion_queued(engine), engine->error,
+                       engine->control, (long long)in->motion.left_code, (long long)in->motion.right_code, in->motion.bearing,
+                       engine->target_bearing);
+    else
+        len = snprintf(text, size, "[P]lc:%lld\tlr:%lld\tcb:%d\ttb:%d\n", (long long)in->motion.left_code,
+                       (long long)in->motion.right_code, in->motion.bearing, engine->target_bearing);
+    return len < (int)size ? len : (int)size - 1;
+}
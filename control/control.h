@@ -0,0 +1,98 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+// One control period of move_task: the route commands, the mission script,
+// the motion engine and the maze map, with the FreeRTOS and Pico parts left
+// to the caller.
+//
+// move_task receives commands and hands them over with control_move,
+// control_mission and control_map, reads the sensors into a control_input_t,
+// sets the gains and calls control_step, then drives the motors with the
+// output and reports the events. The host replay tool runs the same calls on
+// a recorded log, see recorder/recorder.h, so what it computes is what the
+// car computed.
+//
+// control_t has no pointers, a copy of it is a complete snapshot of the
+// control state. Pure logic with no Pico includes, so it builds on the host too.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "motion.h"
+#include "mission.h"
+#include "maze.h"
+
+#define CONTROL_BARCODE_SIZE 10  // payload of the last barcode, ISR_EVENT_DATA_SIZE
+#define CONTROL_RANGE_MAX_CM 150 // farther echoes are too wide to place in a map cell
+
+// Map requests
+typedef enum
+{
+    MAP_RESET,   // args: width, height, cell cm, x, y
+    MAP_GOTO,    // args: x, y
+    MAP_EXPLORE, // args: on
+} map_op_t;
+
+typedef struct map_cmd_t_
+{
+    uint8_t op; // map_op_t
+    uint8_t args[5];
+} map_cmd_t;
+
+// Sensor readings for one period
+typedef struct control_input_t_
+{
+    motion_input_t motion;
+    uint32_t barcode_count; // barcodes read since boot, barcode is the last one
+    char barcode[CONTROL_BARCODE_SIZE];
+    bool echo_valid; // an ultrasonic echo was ever timed, echo_cm is the last one
+    float echo_cm;
+    uint32_t echo_us; // when it was timed, a new value is a new echo for the map
+} control_input_t;
+
+// control_step() map events
+#define CONTROL_MAP_PLANNED 0x01  // a route was planned, see plan_*
+#define CONTROL_MAP_ARRIVED 0x02  // map driving reached its goal cell
+#define CONTROL_MAP_EXPLORED 0x04 // exploring found no unknown cell it can reach
+#define CONTROL_MAP_NO_PATH 0x08  // the goal cell cannot be reached
+
+typedef struct control_output_t_
+{
+    motion_output_t motion;
+    uint8_t motion_events;  // MOTION_EVENT_*
+    uint8_t mission_events; // MISSION_EVENT_*
+    uint8_t map_events;     // CONTROL_MAP_*
+} control_output_t;
+
+typedef struct control_t_
+{
+    motion_engine_t engine;
+    mission_t mission;
+    uint32_t barcodes_at_start; // the barcode condition only sees barcodes read during the mission
+    maze_t maze;
+    float codes_per_cm;
+    bool map_driving; // replan to map_goal whenever the route runs out
+    uint8_t map_goal_x, map_goal_y;
+    float map_route;      // route position the map has the odometry up to
+    uint32_t mapped_echo; // timestamp of the last echo put on the map
+    // the last plan, for telemetry
+    uint16_t plan_length, plan_expanded;
+    uint8_t plan_moves;
+    uint32_t plan_us;
+} control_t;
+
+// Provided by the caller: map writes are bracketed for readers on other
+// tasks, and the planner is timed with control_time_us
+void control_map_write_begin(void);
+void control_map_write_end(void);
+uint32_t control_time_us(void);
+
+void control_init(control_t *control, uint16_t max_speed, float gain_dt, uint16_t settle_steps, float codes_per_cm);
+// false if the queue was full and primitive was dropped
+bool control_move(control_t *control, bool flush, bool append, const motion_primitive_t *primitive);
+// an empty program stops the running one, barcode_count is the count when it was received
+void control_mission(control_t *control, const mission_program_t *program, uint32_t barcode_count);
+void control_map(control_t *control, const map_cmd_t *cmd);
+void control_step(control_t *control, const control_input_t *in, control_output_t *out);
+// move_task's once-a-second status line, "[MOV]..." while a primitive runs and "[P]..." otherwise
+int control_format_update(const control_t *control, const control_input_t *in, char *text, size_t size);
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
+#include "hardware/sync.h"
 
 int timeout = 26100;
 
@@ -11,6 +12,8 @@ volatile absolute_time_t startTime;
 volatile absolute_time_t endTime;
 volatile uint64_t pulseLength;
 volatile bool echo_received;
+volatile uint32_t echo_count;  // echoes timed so far
+volatile uint32_t echo_end_us; // when the last one ended
 
 void echocallback(uint32_t events)
 {
@@ -23,7 +26,8 @@ void echocallback(uint32_t events)
         endTime = get_absolute_time();
 
         pulseLength = absolute_time_diff_us(startTime, endTime);
-        
+        echo_end_us = to_us_since_boot(endTime);
+        echo_count++;
     }
 }
 
@@ -45,6 +49,20 @@ void setup_ultrasonic_pins(uint trigPin, uint echoPin)
 
 }
 
+// Distance of the last echo and when it ended, returns how many echoes were
+// timed so far, so a caller can tell whether its last ping came back.
+// The echo ISR must run on the caller's core.
+uint32_t ultrasonic_echo(float *cm, uint32_t *end_us)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    uint64_t length = pulseLength;
+    uint32_t count = echo_count;
+    *end_us = echo_end_us;
+    restore_interrupts(irq);
+    *cm = length / 29 / 2;
+    return count;
+}
+
 double getcm(uint trigPin, uint echoPin)
 {
     sendpulse(trigPin, echoPin);
@@ -1,6 +1,9 @@
 #ifndef ultrasonic_h
 #define ultrasonic_h
+#include <stdint.h>
 void echocallback(uint32_t events);
 void setup_ultrasonic_pins(int trigPin, int echoPin);
 double getcm(int trigPin, int echoPin);
+void sendpulse(int trigPin, int echoPin);
+uint32_t ultrasonic_echo(float *cm, uint32_t *end_us);
 #endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Compares the bench results of two builds, see bench/bench.h.
+//
+//   t85_bench_compare [--threshold percent] <before> <after>
+//
+// The files are saved output of the bench target, USB serial from the Pico
+// or stdout of the host build; lines other than [BENCH] lines are ignored.
+// A file may hold several passes, a case's median is then the median of its
+// pass medians. Prints a line per case with both medians and the change, and
+// flags cases whose median grew by more than the threshold (5% by default).
+//
+// Exit status 0 if no case got slower, 1 if one did, 2 if a file could not be
+// read or holds no results.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Results {
+    std::string platform, build;
+    std::vector<std::string> order; // cases in the order the bench ran them
+    std::map<std::string, std::vector<unsigned long>> medians;
+};
+
+int usage()
+{
+    fprintf(stderr, "usage: t85_bench_compare [--threshold percent] <before> <after>\n");
+    return 2;
+}
+
+// value of "key:" in a tab separated line
+bool field(const std::string &line, const std::string &key, std::string &value)
+{
+    size_t at = line.find(key + ":");
+    if (at == std::string::npos)
+        return false;
+    at += key.size() + 1;
+    value = line.substr(at, line.find('\t', at) - at);
+    while (!value.empty() && (value.back() == '\r' || value.back() == '\n'))
+        value.pop_back();
+    return true;
+}
+
+bool load(const char *path, Results &results)
+{
+    std::ifstream in(path);
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    std::string line, name, median;
+    while (std::getline(in, line)) {
+        size_t at = line.find("[BENCH]");
+        if (at == std::string::npos)
+            continue;
+        line = line.substr(at);
+        if (line.compare(0, 12, "[BENCH]begin") == 0) {
+            field(line, "platform", results.platform);
+            field(line, "build", results.build);
+        } else if (field(line, "case", name) && field(line, "median_ns", median)) {
+            if (!results.medians.count(name))
+                results.order.push_back(name);
+            results.medians[name].push_back(strtoul(median.c_str(), nullptr, 10));
+        }
+    }
+    if (results.order.empty()) {
+        fprintf(stderr, "%s: no [BENCH] results\n", path);
+        return false;
+    }
+    return true;
+}
+
+unsigned long median(std::vector<unsigned long> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    double threshold = 5;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else
+            return usage();
+    }
+    if (i + 2 != argc)
+        return usage();
+
+    Results before, after;
+    if (!load(argv[i], before) || !load(argv[i + 1], after))
+        return 2;
+    printf("before: %s build %s\n", before.platform.c_str(), before.build.c_str());
+    printf("after:  %s build %s\n", after.platform.c_str(), after.build.c_str());
+    if (before.platform != after.platform)
+        printf("note: different platforms, the changes compare the machines too\n");
+
+    printf("%-16s %12s %12s %9s\n", "case", "before ns", "after ns", "change");
+    int slower = 0;
+    for (const std::string &name : before.order) {
+        unsigned long a = median(before.medians[name]);
+        if (!after.medians.count(name)) {
+            printf("%-16s %12lu %12s\n", name.c_str(), a, "-");
+            continue;
+        }
+        unsigned long b = median(after.medians[name]);
+        double change = a ? (b - (double)a) * 100 / a : 0;
+        bool flag = change > threshold;
+        slower += flag;
+        printf("%-16s %12lu %12lu %+8.1f%%%s\n", name.c_str(), a, b, change, flag ? "  slower" : "");
+    }
+    for (const std::string &name : after.order)
+        if (!before.medians.count(name))
+            printf("%-16s %12s %12lu\n", name.c_str(), "-", median(after.medians[name]));
+    return slower ? 1 : 0;
+}
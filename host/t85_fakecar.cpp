@@ -0,0 +1,363 @@
+// Stand-in for the car's TCP server, so t85ctl and other tools can be tried
+// without a car. Speaks the same protocol on the same port: every command is
+// answered with "ack\n" and "sub"/"unsub" pick telemetry topics. Like the
+// car, each read from a client is one command, cut to CMD_SIZE bytes and
+// matched by prefix with its line ending, if any, left on. Motion
+// commands (fwd, bar, turncw, turnccw, stop, go) run through the firmware's
+// motion engine against a simple wheel and compass model, with the same [MOV]
+// and [P] lines on the motion and heading topics, so routes take about as long
+// as on the car. Mission scripts ("mission begin", "m <line>", "mission run",
+// "mission stop") run through the firmware's interpreter with [MSN] status on
+// the mission topic; the fake car sees no obstacles, lines or barcodes.
+// "#<id> " commands get a traced ack with timestamps from the host clock, the
+// ack delay split between queue and actuation for motion commands.
+//
+//   t85_fakecar [port] [ack delay us]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include "mission.h"
+#include "motion.h"
+}
+
+namespace {
+
+constexpr double STEP_S = 0.01;            // control period, as CONTROL_LOOP_HZ 100
+constexpr uint16_t MAX_SPEED = 6250;       // DEFAULT_SPEED
+constexpr double CODES_PER_S = 200;        // wheel speed at full PWM
+constexpr double DEG_PER_CODE = 0.9;       // heading change per code of wheel speed difference
+constexpr size_t CMD_SIZE = 64;            // wifi.h, the rest of a read is ignored
+
+// Wheels that follow their PWM level with some lag, encoders that count up in
+// both directions and a compass that follows the wheel speed difference
+struct Model {
+    double left = 0, right = 0;     // encoder codes
+    double v_left = 0, v_right = 0; // signed codes/s
+    double bearing = 0;
+
+    void step(const motion_output_t &out)
+    {
+        double l = out.left_speed * CODES_PER_S / MAX_SPEED;
+        double r = out.right_speed * CODES_PER_S / MAX_SPEED;
+        switch (out.drive) {
+        case MOTION_DRIVE_FORWARD: break;
+        case MOTION_DRIVE_BACKWARD: l = -l; r = -r; break;
+        case MOTION_DRIVE_CW: r = -r; break;
+        case MOTION_DRIVE_CCW: l = -l; break;
+        default: l = r = 0; break;
+        }
+        v_left += (l - v_left) * 0.2;
+        v_right += (r - v_right) * 0.2;
+        left += std::fabs(v_left) * STEP_S;
+        right += std::fabs(v_right) * STEP_S;
+        bearing = std::fmod(bearing + (v_left - v_right) * STEP_S * DEG_PER_CODE + 360, 360);
+    }
+};
+
+// one step of a go route, same syntax as the car: s<codes> b<codes> t<degrees> a<codes>,<degrees> w<ms> x, arcs only drive forward
+bool parse_primitive(const std::string &token, motion_primitive_t &p)
+{
+    p = motion_primitive_t{};
+    const char *c = token.c_str();
+    char *end;
+    switch (c[0]) {
+    case 's': p.type = MOTION_STRAIGHT; break;
+    case 'b': p.type = MOTION_STRAIGHT; p.flags = MOTION_FLAG_NO_LINE; break;
+    case 't': p.type = MOTION_TURN; break;
+    case 'a': p.type = MOTION_ARC; break;
+    case 'w': p.type = MOTION_WAIT; break;
+    case 'x': p.type = MOTION_STOP; return c[1] == '\0';
+    default: return false;
+    }
+    p.value = strtol(c + 1, &end, 10);
+    if (end == c + 1)
+        return false;
+    if (p.type == MOTION_ARC) {
+        if (*end != ',')
+            return false;
+        p.arg = strtol(end + 1, &end, 10);
+        if (p.value < 0)
+            return false;
+    }
+    return *end == '\0';
+}
+
+// queue the primitives of a motion command, false if it is not one
+bool queue_motion(motion_engine_t &engine, const std::string &cmd)
+{
+    motion_primitive_t p{};
+    if (cmd.compare(0, 6, "turncw") == 0) {
+        p.type = MOTION_TURN;
+        p.value = 90;
+    } else if (cmd.compare(0, 7, "turnccw") == 0) {
+        p.type = MOTION_TURN;
+        p.value = -90;
+    } else if (cmd.compare(0, 4, "stop") == 0) {
+        p.type = MOTION_STOP;
+        motion_flush(&engine);
+    } else if (cmd.compare(0, 3, "fwd") == 0) {
+        p.type = MOTION_STRAIGHT;
+        p.value = atoi(cmd.c_str() + 3);
+    } else if (cmd.compare(0, 3, "bar") == 0) {
+        p.type = MOTION_STRAIGHT;
+        p.flags = MOTION_FLAG_NO_LINE;
+        p.value = 200;
+    } else if (cmd.compare(0, 3, "go ") == 0) {
+        std::string route = cmd.substr(3);
+        char *save;
+        for (char *token = strtok_r(&route[0], " \t\r\n", &save); token; token = strtok_r(nullptr, " \t\r\n", &save))
+            if (!parse_primitive(token, p) || !motion_push(&engine, &p))
+                break;
+        return true;
+    } else {
+        return false;
+    }
+    motion_push(&engine, &p);
+    return true;
+}
+
+enum Topic : unsigned {
+    MOTION = 0x01,
+    HEADING = 0x02,
+    CALIBRATION = 0x04,
+    BARCODE = 0x08,
+    MISSION = 0x20,
+    ALL = 0x2f,
+};
+
+struct Peer {
+    int fd;
+    unsigned topics = ALL;
+};
+
+unsigned parse_topics(const std::string &list)
+{
+    std::istringstream in(list);
+    std::string word;
+    unsigned mask = 0;
+    while (in >> word) {
+        if (word == "motion")
+            mask |= MOTION;
+        else if (word == "heading")
+            mask |= HEADING;
+        else if (word == "calibration")
+            mask |= CALIBRATION;
+        else if (word == "barcode")
+            mask |= BARCODE;
+        else if (word == "mission")
+            mask |= MISSION;
+        else if (word == "all")
+            mask |= ALL;
+    }
+    return mask;
+}
+
+// stands in for the car's time_us_32()
+uint32_t now_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void write_all(int fd, const std::string &s)
+{
+    size_t sent = 0;
+    while (sent < s.size()) {
+        ssize_t n = send(fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        sent += n;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int port = argc > 1 ? atoi(argv[1]) : 4242;
+    int ack_delay_us = argc > 2 ? atoi(argv[2]) : 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 4) < 0) {
+        perror("listen");
+        return 1;
+    }
+    printf("fake car listening on port %d\n", port);
+    fflush(stdout);
+
+    std::vector<Peer> peers;
+    motion_engine_t engine;
+    motion_init(&engine, MAX_SPEED, STEP_S, 0.5 / STEP_S);
+    engine.gains = {0.1f, 0, 0, 0.15f, 0.075f, 0.6f, 0.3f};
+    Model model;
+    mission_compiler_t compiler;
+    mission_t mission;
+    mission_compile_begin(&compiler);
+    mission_load(&mission, &compiler.program);
+    auto next_step = std::chrono::steady_clock::now();
+    auto next_update = next_step;
+    auto publish = [&](unsigned topic, const char *line) {
+        for (const Peer &p : peers)
+            if (p.topics & topic)
+                write_all(p.fd, line);
+    };
+    for (;;) {
+        std::vector<pollfd> fds{{listener, POLLIN, 0}};
+        for (const Peer &p : peers)
+            fds.push_back({p.fd, POLLIN, 0});
+        poll(fds.data(), fds.size(), 5);
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                peers.push_back({fd});
+            }
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            Peer &peer = peers[i - 1];
+            char buf[1500];
+            ssize_t n = recv(peer.fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                close(peer.fd);
+                peer.fd = -1;
+                continue;
+            }
+            // as tcp_server_client_recv and tcp_server_handle_command
+            std::string cmd(buf, std::min<size_t>(n, CMD_SIZE));
+            uint32_t rx_us = now_us();
+            unsigned long id = 0;
+            bool traced = false;
+            if (cmd[0] == '#') {
+                char *end;
+                id = strtoul(cmd.c_str() + 1, &end, 10);
+                traced = end != cmd.c_str() + 1;
+                while (*end == ' ')
+                    end++;
+                cmd.erase(0, end - cmd.c_str());
+            }
+            auto starts = [&cmd](const char *prefix) { return cmd.compare(0, strlen(prefix), prefix) == 0; };
+            bool motion = false;
+            unsigned period_ms;
+            if (cmd.size() > 6 && starts("unsub "))
+                peer.topics &= ~parse_topics(cmd.substr(6));
+            else if (cmd.size() > 4 && starts("sub "))
+                peer.topics |= parse_topics(cmd.substr(4));
+            else if (starts("stats")) {
+                if (!starts("stats off") && sscanf(cmd.c_str(), "stats on %u", &period_ms) != 1)
+                    write_all(peer.fd, "[STATS]heap free:0\tmin:0\n");
+            } else {
+                motion = queue_motion(engine, cmd);
+                if (starts("mission begin"))
+                    mission_compile_begin(&compiler);
+                else if (starts("m ") && !mission_compile_line(&compiler, cmd.c_str() + 2))
+                    write_all(peer.fd, "[MSN]error line " + std::to_string(compiler.line) + ": " + compiler.error + "\n");
+                else if (starts("mission run") || starts("mission stop")) {
+                    mission_program_t none{};
+                    bool run = starts("mission run");
+                    if (run && !mission_compile_end(&compiler)) {
+                        write_all(peer.fd, "[MSN]error line " + std::to_string(compiler.line) + ": " + compiler.error + "\n");
+                    } else {
+                        bool was_running = mission.running;
+                        mission_load(&mission, run ? &compiler.program : &none);
+                        if (was_running || !mission.running) {
+                            motion_primitive_t halt{};
+                            halt.type = MOTION_STOP;
+                            motion_flush(&engine);
+                            motion_push(&engine, &halt);
+                        }
+                        publish(MISSION, mission.running ? ("[MSN]start len:" + std::to_string(mission.program.len) + "\n").c_str() : "[MSN]stopped\n");
+                    }
+                    if (run)
+                        mission_compile_begin(&compiler);
+                }
+            }
+            if (ack_delay_us)
+                std::this_thread::sleep_for(std::chrono::microseconds(ack_delay_us));
+            if (traced) {
+                char ack[80];
+                uint32_t dsp_us = motion ? rx_us + ack_delay_us / 2 : 0;
+                uint32_t act_us = motion ? now_us() : 0;
+                snprintf(ack, sizeof(ack), "ack #%lu rx:%lu dsp:%lu act:%lu\n", id, (unsigned long)rx_us,
+                         (unsigned long)dsp_us, (unsigned long)act_us);
+                write_all(peer.fd, ack);
+            } else {
+                write_all(peer.fd, "ack\n");
+            }
+        }
+        peers.erase(std::remove_if(peers.begin(), peers.end(), [](const Peer &p) { return p.fd < 0; }), peers.end());
+
+        auto now = std::chrono::steady_clock::now();
+        char line[160];
+        while (now >= next_step) {
+            next_step += std::chrono::microseconds((int)(STEP_S * 1e6));
+            motion_input_t input{(float)STEP_S, (int64_t)model.left, (int64_t)model.right, (int)model.bearing, 1000, false, false, false, 0};
+            motion_output_t output;
+            mission_sensors_t sensors{input.obstacle_cm, false, false, ""};
+            uint8_t mission_events = mission_step(&mission, &engine, &sensors);
+            if (mission_events & MISSION_EVENT_SAY) {
+                snprintf(line, sizeof(line), "[MSN]say %s\n", mission.say_text);
+                publish(MISSION, line);
+            }
+            if (mission_events & MISSION_EVENT_DONE) {
+                snprintf(line, sizeof(line), "[MSN]done ticks:%lu\n", (unsigned long)mission.ticks);
+                publish(MISSION, line);
+            }
+            uint8_t events = motion_step(&engine, &input, &output);
+            model.step(output);
+            if (events & MOTION_EVENT_OBSTACLE)
+                publish(MOTION, "[MOV]obstacle\n");
+            if (events & MOTION_EVENT_DONE) {
+                snprintf(line, sizeof(line), "[MOV]done id:%u\n", engine.done_id);
+                publish(MOTION, line);
+            }
+            if (events & MOTION_EVENT_STARTED) {
+                snprintf(line, sizeof(line), "[MOV]start id:%u\tmode:%c\tq:%u\n", engine.current.id, motion_mode(&engine), motion_queued(&engine));
+                publish(MOTION, line);
+            }
+            if (events & MOTION_EVENT_IDLE)
+                publish(MOTION, "[MOV]idle\n");
+        }
+        if (now >= next_update) {
+            next_update = now + std::chrono::milliseconds(100);
+            if (engine.active)
+                snprintf(line, sizeof(line), "[MOV]id:%u\tmode:%c\tprogress:%u\tq:%u\terr:%.1f\tctrl:%.2f\tlc:%lld\tlr:%lld\tcb:%d\ttb:%d\n",
+                         engine.current.id, motion_mode(&engine), motion_progress(&engine), motion_queued(&engine), engine.error,
+                         engine.control, (long long)model.left, (long long)model.right, (int)model.bearing, engine.target_bearing);
+            else
+                snprintf(line, sizeof(line), "[P]lc:%lld\tlr:%lld\tcb:%d\ttb:%d\n", (long long)model.left, (long long)model.right,
+                         (int)model.bearing, engine.target_bearing);
+            publish(motion_mode(&engine) == 't' ? HEADING : MOTION, line);
+            if (mission.running) {
+                snprintf(line, sizeof(line), "[MSN]pc:%u\tticks:%lu\n", mission.pc, (unsigned long)mission.ticks);
+                publish(MISSION, line);
+            }
+        }
+    }
+}
@@ -0,0 +1,194 @@
+// Replays a control log from the car through the firmware's control code and
+// compares the motor commands with the ones the car sent.
+//
+//   t85_replay [--gains tp,ti,td,dp,dd,lp,ld] [--resync] [--csv file] <log file>
+//
+// The log is saved with "t85ctl capture" after "rec on", see
+// recorder/recorder.h. Replay starts at the first keyframe left in the log,
+// feeds every command, gain change and period's inputs to control_step as
+// fast as it runs, and diffs each period's drive and wheel speeds and events.
+// An unchanged build reproduces the log exactly, the first divergence points
+// at what a code change did to a real run. --gains replays with other gains
+// to see what a tuning change does on the same inputs, the car's later inputs
+// still follow its own driving, so compare the first seconds. --resync
+// restarts from each keyframe, so one divergence does not hide the rest.
+// --csv writes one line per period: time, recorded and replayed drive and
+// speeds.
+//
+// Exit status 0 if every period matched, 1 if one diverged, 2 if the log
+// could not be read. The log holds control_t as the car laid it out, build
+// this on a host with the same alignment, x86_64 for the RP2040.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "control.h"
+#include "recorder.h"
+}
+
+// control.h hooks, the replay has no readers to fence and times nothing
+extern "C" void control_map_write_begin(void) {}
+extern "C" void control_map_write_end(void) {}
+extern "C" uint32_t control_time_us(void) { return 0; }
+
+namespace {
+
+int usage()
+{
+    fprintf(stderr, "usage: t85_replay [--gains tp,ti,td,dp,dd,lp,ld] [--resync] [--csv file] <log file>\n");
+    return 2;
+}
+
+bool parse_gains(const char *text, motion_gains_t &gains)
+{
+    return sscanf(text, "%f,%f,%f,%f,%f,%f,%f", &gains.turn_p, &gains.turn_i, &gains.turn_d, &gains.dist_p,
+                  &gains.dist_d, &gains.line_p, &gains.line_d) == 7;
+}
+
+bool same(const control_output_t &a, const control_output_t &b)
+{
+    return a.motion.drive == b.motion.drive && a.motion.left_speed == b.motion.left_speed &&
+           a.motion.right_speed == b.motion.right_speed && a.motion_events == b.motion_events &&
+           a.mission_events == b.mission_events && a.map_events == b.map_events;
+}
+
+void print_output(const char *label, const control_output_t &out)
+{
+    printf("  %-8s drive:%u left:%u right:%u events motion:%#x mission:%#x map:%#x\n", label, out.motion.drive,
+           out.motion.left_speed, out.motion.right_speed, out.motion_events, out.mission_events, out.map_events);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    motion_gains_t override_gains{};
+    bool override = false, resync = false;
+    const char *csv_path = nullptr;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--gains") && i + 1 < argc) {
+            if (!parse_gains(argv[++i], override_gains))
+                return usage();
+            override = true;
+        } else if (!strcmp(argv[i], "--resync")) {
+            resync = true;
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (i + 1 != argc)
+        return usage();
+
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+        perror(argv[i]);
+        return 2;
+    }
+    std::vector<uint8_t> log((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    FILE *csv = nullptr;
+    if (csv_path && !(csv = fopen(csv_path, "w"))) {
+        perror(csv_path);
+        return 2;
+    }
+    if (csv)
+        fprintf(csv, "time_ms,drive,left,right,replay_drive,replay_left,replay_right\n");
+
+    // a few kB each, off the stack
+    static recorder_reader_t reader;
+    static recorder_entry_t entry;
+    static control_t control;
+    if (!recorder_reader_init(&reader, log.data(), log.size())) {
+        fprintf(stderr, "%s: not a control log of version %d\n", argv[i], RECORDER_VERSION);
+        return 2;
+    }
+
+    bool started = false;
+    motion_gains_t gains{};
+    uint32_t first_us = 0, last_us = 0;
+    unsigned long steps = 0, diverged = 0, keyframes = 0, commands = 0;
+    long first_step = -1;
+    int max_speed_error = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (recorder_next(&reader, &entry)) {
+        switch (entry.type) {
+        case RECORD_KEYFRAME:
+            keyframes++;
+            if (!started || resync)
+                control = entry.control;
+            if (!started)
+                first_us = entry.time_us;
+            gains = entry.gains;
+            started = true;
+            break;
+        case RECORD_GAINS:
+            gains = entry.gains;
+            break;
+        case RECORD_MOVE:
+            control_move(&control, entry.move.flush, entry.move.append, &entry.move.primitive);
+            commands++;
+            break;
+        case RECORD_MISSION:
+            control_mission(&control, &entry.program, entry.barcode_count);
+            commands++;
+            break;
+        case RECORD_MAP:
+            control_map(&control, &entry.map);
+            commands++;
+            break;
+        case RECORD_STEP: {
+            control_output_t out;
+            control.engine.gains = override ? override_gains : gains;
+            control_step(&control, &entry.input, &out);
+            last_us = entry.time_us;
+            int error = std::max(abs(out.motion.left_speed - entry.output.motion.left_speed),
+                                 abs(out.motion.right_speed - entry.output.motion.right_speed));
+            max_speed_error = std::max(max_speed_error, error);
+            if (!same(out, entry.output)) {
+                if (first_step < 0) {
+                    first_step = steps;
+                    printf("first divergence at period %lu, %.3f s into the log\n", steps,
+                           (uint32_t)(entry.time_us - first_us) / 1e6);
+                    print_output("car", entry.output);
+                    print_output("replay", out);
+                }
+                diverged++;
+            }
+            if (csv)
+                fprintf(csv, "%.3f,%u,%u,%u,%u,%u,%u\n", (uint32_t)(entry.time_us - first_us) / 1e3,
+                        entry.output.motion.drive, entry.output.motion.left_speed, entry.output.motion.right_speed,
+                        out.motion.drive, out.motion.left_speed, out.motion.right_speed);
+            steps++;
+            break;
+        }
+        default:
+            break; // barcodes are folded into the step inputs by the reader
+        }
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    if (csv)
+        fclose(csv);
+    if (reader.pos != reader.size)
+        fprintf(stderr, "stopped at byte %zu of %zu: a corrupt record, or a keyframe from a build with another control_t "
+                        "layout\n", reader.pos, reader.size);
+    if (!started) {
+        fprintf(stderr, "no keyframe in the log\n");
+        return 2;
+    }
+
+    double log_s = (uint32_t)(last_us - first_us) / 1e6;
+    printf("%lu periods over %.2f s, %lu keyframes, %lu commands, %u bytes before the first keyframe\n", steps, log_s,
+           keyframes, commands, (unsigned)reader.skipped);
+    printf("replayed in %.3f s, %.0fx real time\n", wall_s, wall_s > 0 ? log_s / wall_s : 0);
+    printf("%lu periods diverged, largest wheel speed difference %d\n", diverged, max_speed_error);
+    return diverged ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+// Converts a schedule trace from the car, see telemetry/trace.h, to Chrome
+// trace JSON for chrome://tracing or ui.perfetto.dev.
+//
+//   t85_trace <dump file> <json file>
+//
+// The dump is what "t85ctl schedule" saved. Each core is a process with a
+// track of the tasks it ran, a slice from switch in to switch out named after
+// the task, with instant events where a task blocked (and on what) or was
+// made ready, and a track of the GPIO IRQ handlers it ran. Times are us from
+// the oldest record.
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "trace.h"
+
+namespace {
+
+std::string block_name(int type)
+{
+    switch (type) {
+    case TRACE_BLOCK_QUEUE_RECEIVE: return "queue receive";
+    case TRACE_BLOCK_QUEUE_SEND: return "queue send";
+    case TRACE_BLOCK_BUFFER_RECEIVE: return "buffer receive";
+    case TRACE_BLOCK_BUFFER_SEND: return "buffer send";
+    case TRACE_BLOCK_NOTIFY: return "notify";
+    default: return "delay";
+    }
+}
+
+int usage()
+{
+    fprintf(stderr, "usage: t85_trace <dump file> <json file>\n");
+    return 2;
+}
+
+std::string quoted(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= ' ')
+            out += c;
+    }
+    return out + "\"";
+}
+
+struct Writer {
+    FILE *out;
+    bool first = true;
+
+    void event(const std::string &fields)
+    {
+        fprintf(out, "%s\n{%s}", first ? "" : ",", fields.c_str());
+        first = false;
+    }
+    void thread_name(int pid, int tid, const std::string &name)
+    {
+        event("\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + std::to_string(pid) + ",\"tid\":" +
+              std::to_string(tid) + ",\"args\":{\"name\":" + quoted(name) + "}");
+    }
+    void process_name(int pid, const std::string &name)
+    {
+        event("\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" + std::to_string(pid) + ",\"args\":{\"name\":" +
+              quoted(name) + "}");
+    }
+    void slice(int pid, int tid, const std::string &name, uint64_t ts, uint64_t dur)
+    {
+        event("\"ph\":\"X\",\"name\":" + quoted(name) + ",\"pid\":" + std::to_string(pid) + ",\"tid\":" +
+              std::to_string(tid) + ",\"ts\":" + std::to_string(ts) + ",\"dur\":" + std::to_string(dur));
+    }
+    void instant(int pid, int tid, const std::string &name, uint64_t ts)
+    {
+        event("\"ph\":\"i\",\"s\":\"t\",\"name\":" + quoted(name) + ",\"pid\":" + std::to_string(pid) + ",\"tid\":" +
+              std::to_string(tid) + ",\"ts\":" + std::to_string(ts));
+    }
+};
+
+// the tracks of a core's process
+enum { TASKS_TRACK = 1, IRQ_TRACK = 2 };
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+        return usage();
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        perror(argv[1]);
+        return 2;
+    }
+    std::string dump((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    trace_dump_header_t header{};
+    if (dump.size() >= sizeof(header))
+        memcpy(&header, dump.data(), sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d schedule trace\n", argv[1], TRACE_VERSION);
+        return 2;
+    }
+    size_t names_end = sizeof(header) + header.name_count * sizeof(trace_name_t);
+    if (dump.size() < names_end + (size_t)header.record_count * sizeof(trace_record_t)) {
+        fprintf(stderr, "%s: truncated, %zu bytes\n", argv[1], dump.size());
+        return 2;
+    }
+
+    std::map<std::pair<int, int>, std::string> names; // (kind, id)
+    for (size_t at = sizeof(header); at < names_end; at += sizeof(trace_name_t)) {
+        trace_name_t name;
+        memcpy(&name, dump.data() + at, sizeof(name));
+        names[{name.kind, name.id}] = std::string(name.name, strnlen(name.name, TRACE_NAME_SIZE));
+    }
+    auto name_of = [&](int kind, int id) {
+        auto found = names.find({kind, id});
+        if (found != names.end())
+            return found->second;
+        if (kind == TRACE_NAME_OBJECT && (id & TRACE_OBJECT_UNNAMED)) {
+            char text[16];
+            snprintf(text, sizeof(text), "obj %04x", id & ~TRACE_OBJECT_UNNAMED);
+            return std::string(text);
+        }
+        return std::string(kind == TRACE_NAME_IRQ ? "irq " : "task ") + std::to_string(id);
+    };
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        perror(argv[2]);
+        return 2;
+    }
+    Writer writer{out};
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (int core = 0; core < 2; core++) {
+        writer.process_name(core, "core " + std::to_string(core));
+        writer.thread_name(core, TASKS_TRACK, "tasks");
+        writer.thread_name(core, IRQ_TRACK, "GPIO IRQs");
+    }
+
+    // time_us_32 wraps every 71 minutes, records are in order to within an IRQ handler
+    int64_t now = 0, first = 0;
+    uint32_t last_us = 0;
+    int running[2] = {-1, -1}; // task switched in on each core
+    uint64_t since[2] = {0, 0};
+    for (uint32_t i = 0; i < header.record_count; i++) {
+        trace_record_t record;
+        memcpy(&record, dump.data() + names_end + i * sizeof(record), sizeof(record));
+        if (i == 0)
+            last_us = record.time_us;
+        now += (int32_t)(record.time_us - last_us);
+        last_us = record.time_us;
+        if (i == 0)
+            first = now;
+        uint64_t ts = now > first ? now - first : 0; // an IRQ entered before the first record
+        int core = record.type & TRACE_CORE_BIT ? 1 : 0;
+        int type = record.type & ~TRACE_CORE_BIT;
+        switch (type) {
+        case TRACE_SWITCH_IN:
+            running[core] = record.task;
+            since[core] = ts;
+            break;
+        case TRACE_SWITCH_OUT:
+            // the oldest records may switch out a task whose switch in was overwritten
+            writer.slice(core, TASKS_TRACK, name_of(TRACE_NAME_TASK, record.task), running[core] == record.task ? since[core] : 0,
+                         running[core] == record.task ? ts - since[core] : ts);
+            running[core] = -1;
+            break;
+        case TRACE_READY:
+            writer.instant(core, TASKS_TRACK, "ready " + name_of(TRACE_NAME_TASK, record.task), ts);
+            break;
+        case TRACE_BLOCK_QUEUE_RECEIVE:
+        case TRACE_BLOCK_QUEUE_SEND:
+        case TRACE_BLOCK_BUFFER_RECEIVE:
+        case TRACE_BLOCK_BUFFER_SEND:
+            writer.instant(core, TASKS_TRACK, "block " + block_name(type) + " " + name_of(TRACE_NAME_OBJECT, record.arg), ts);
+            break;
+        case TRACE_BLOCK_NOTIFY:
+        case TRACE_BLOCK_DELAY:
+            writer.instant(core, TASKS_TRACK, "block " + block_name(type), ts);
+            break;
+        case TRACE_IRQ:
+            writer.slice(core, IRQ_TRACK, name_of(TRACE_NAME_IRQ, record.task), ts, record.arg);
+            break;
+        default:
+            fprintf(stderr, "record %u: unknown type %d\n", i, type);
+            break;
+        }
+    }
+    uint64_t end = now > first ? now - first : 0;
+    for (int core = 0; core < 2; core++)
+        if (running[core] >= 0)
+            writer.slice(core, TASKS_TRACK, name_of(TRACE_NAME_TASK, running[core]), since[core], end - since[core]);
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    printf("%u records over %.3f s, %u lost before the dump, written to %s\n", header.record_count, end / 1e6,
+           header.lost, argv[2]);
+    return 0;
+}
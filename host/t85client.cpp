@@ -0,0 +1,236 @@
+#include "t85client.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include "stats.h"
+
+namespace t85 {
+
+uint64_t wall_time_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    if (samples_.empty())
+        return 0;
+    std::vector<uint64_t> sorted(samples_);
+    size_t i = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + i, sorted.end());
+    return sorted[i];
+}
+
+uint64_t Histogram::min() const
+{
+    return samples_.empty() ? 0 : *std::min_element(samples_.begin(), samples_.end());
+}
+
+uint64_t Histogram::max() const
+{
+    return samples_.empty() ? 0 : *std::max_element(samples_.begin(), samples_.end());
+}
+
+std::string Histogram::report(const std::string &label) const
+{
+    std::ostringstream out;
+    out << label << " n=" << count() << " min=" << min() << "us p50=" << percentile(0.5)
+        << "us p99=" << percentile(0.99) << "us p999=" << percentile(0.999) << "us max=" << max() << "us\n";
+    if (samples_.empty())
+        return out.str();
+    // log2 buckets: [2^k, 2^(k+1)) microseconds
+    std::vector<size_t> buckets(64, 0);
+    for (uint64_t s : samples_)
+        buckets[s ? 63 - __builtin_clzll(s) : 0]++;
+    size_t first = 0, last = 63;
+    while (!buckets[first])
+        first++;
+    while (!buckets[last])
+        last--;
+    size_t peak = *std::max_element(buckets.begin(), buckets.end());
+    for (size_t k = first; k <= last; k++) {
+        char range[48];
+        snprintf(range, sizeof(range), "  %8llu-%-8llu us ", 1ull << k, (2ull << k) - 1);
+        out << range << std::string(buckets[k] * 50 / peak, '#') << ' ' << buckets[k] << '\n';
+    }
+    return out.str();
+}
+
+bool parse_ack(const std::string &line, AckTrace &trace)
+{
+    unsigned long id, rx, dsp, act;
+    if (sscanf(line.c_str(), "ack #%lu rx:%lu dsp:%lu act:%lu", &id, &rx, &dsp, &act) != 4)
+        return false;
+    trace.id = id;
+    trace.rx_us = rx;
+    trace.dsp_us = dsp;
+    trace.act_us = act;
+    return true;
+}
+
+Client::~Client()
+{
+    close();
+}
+
+bool Client::connect(const std::string &host, uint16_t port, int timeout_ms)
+{
+    close();
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        return false;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int rc = ::connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc < 0 && errno != EINPROGRESS) {
+        ::close(fd);
+        return false;
+    }
+    pollfd pfd{fd, POLLOUT, 0};
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (::poll(&pfd, 1, timeout_ms) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+        ::close(fd);
+        return false;
+    }
+    // the car handles one command per segment, do not let them coalesce
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fd_ = fd;
+    return true;
+}
+
+void Client::close()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    rx_.clear();
+    pending_.clear();
+}
+
+bool Client::send(const std::string &command)
+{
+    if (fd_ < 0)
+        return false;
+    pending_.push_back(Clock::now());
+    size_t sent = 0;
+    while (sent < command.size()) {
+        ssize_t n = ::send(fd_, command.data() + sent, command.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            pollfd pfd{fd_, POLLOUT, 0};
+            ::poll(&pfd, 1, 100);
+            continue;
+        }
+        if (n <= 0) {
+            close();
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+int64_t Client::command(const std::string &command, int timeout_ms, std::string *ack_line)
+{
+    uint64_t want = acks_ + pending_.size() + 1;
+    if (!send(command))
+        return -1;
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (acks_ < want) {
+        int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0 || !poll(left))
+            return -1;
+    }
+    if (ack_line)
+        *ack_line = last_ack_;
+    return last_rtt_;
+}
+
+bool Client::poll(int timeout_ms)
+{
+    if (fd_ < 0)
+        return false;
+    pollfd pfd{fd_, POLLIN, 0};
+    int rc = ::poll(&pfd, 1, timeout_ms);
+    if (rc < 0)
+        return errno == EINTR;
+    if (rc == 0)
+        return true;
+    char buf[4096];
+    ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return true;
+        close();
+        return false;
+    }
+    rx_.append(buf, n);
+    dispatch();
+    return true;
+}
+
+void Client::dispatch()
+{
+    static const uint32_t magic = STATS_MAGIC;
+    for (;;) {
+        // binary stats frames carry their own length after the magic and version
+        if (rx_.size() >= 4 && memcmp(rx_.data(), &magic, 4) == 0) {
+            if (rx_.size() < 8)
+                return;
+            uint16_t length;
+            memcpy(&length, rx_.data() + 6, 2);
+            if (rx_.size() < length)
+                return;
+            if (telemetry_handler_)
+                telemetry_handler_({wall_time_us(), true, rx_.substr(0, length)});
+            rx_.erase(0, length);
+            continue;
+        }
+        size_t nl = rx_.find('\n');
+        if (nl == std::string::npos)
+            return;
+        std::string line = rx_.substr(0, nl);
+        rx_.erase(0, nl + 1);
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.compare(0, 3, "ack") == 0) {
+            int64_t rtt = -1;
+            if (!pending_.empty()) {
+                rtt = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pending_.front()).count();
+                pending_.pop_front();
+            }
+            acks_++;
+            last_ack_ = line;
+            last_rtt_ = rtt;
+            if (ack_handler_)
+                ack_handler_(line, rtt);
+        } else if (telemetry_handler_) {
+            telemetry_handler_({wall_time_us(), false, line});
+        }
+    }
+}
+
+} // namespace t85
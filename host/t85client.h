@@ -0,0 +1,104 @@
+// Client library for the car's TCP control protocol (port 4242).
+//
+// Commands are plain text ("fwd100", "turncw", "setp1.50", ...) and every one
+// is answered with a line starting with "ack", in order. Everything else the
+// car sends is telemetry: text lines, or binary stats_report_t frames for
+// clients subscribed to the stats topic.
+//
+// A command prefixed with "#<id> " is traced: its ack is
+// "ack #<id> rx:<us> dsp:<us> act:<us>" with the car's microsecond clock at
+// receipt, dispatch to move_task and first motor actuation. The ack of a
+// traced motion command is sent after actuation and can overtake the acks of
+// commands sent after it, so keep one traced command in flight at a time.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace t85 {
+
+using Clock = std::chrono::steady_clock;
+
+// Microseconds since the Unix epoch, for session files
+uint64_t wall_time_us();
+
+// Collects latency samples and reports percentiles
+class Histogram {
+public:
+    void add(uint64_t us) { samples_.push_back(us); }
+    size_t count() const { return samples_.size(); }
+    uint64_t percentile(double p) const;
+    uint64_t min() const;
+    uint64_t max() const;
+    // Summary line plus a log2-bucketed bar chart
+    std::string report(const std::string &label) const;
+
+private:
+    std::vector<uint64_t> samples_;
+};
+
+// Car-side timestamps from the ack of a traced command, 0 for stages the
+// command did not go through. They wrap with the car's 32-bit clock, take
+// differences in uint32_t.
+struct AckTrace {
+    uint32_t id = 0;
+    uint32_t rx_us = 0;
+    uint32_t dsp_us = 0;
+    uint32_t act_us = 0;
+};
+
+// Parses a traced ack, false for a plain "ack"
+bool parse_ack(const std::string &line, AckTrace &trace);
+
+// A message from the car that is not an ack
+struct Telemetry {
+    uint64_t wall_us; // when it arrived, wall clock
+    bool binary;      // stats_report_t frame instead of a text line
+    std::string data; // the line without its newline, or the raw frame
+};
+
+class Client {
+public:
+    using TelemetryHandler = std::function<void(const Telemetry &)>;
+
+    Client() = default;
+    ~Client();
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    bool connect(const std::string &host, uint16_t port, int timeout_ms = 3000);
+    void close();
+    bool connected() const { return fd_ >= 0; }
+
+    // Send one command without waiting for its ack
+    bool send(const std::string &command);
+    // Send one command and wait for its ack, returns the round trip in
+    // microseconds or -1 on timeout or disconnect. ack_line gets the full ack.
+    int64_t command(const std::string &command, int timeout_ms = 2000, std::string *ack_line = nullptr);
+    // Read from the socket for up to timeout_ms, dispatching telemetry and acks
+    bool poll(int timeout_ms);
+
+    void on_telemetry(TelemetryHandler handler) { telemetry_handler_ = std::move(handler); }
+    // Called for every ack with its round trip time
+    void on_ack(std::function<void(const std::string &, int64_t)> handler) { ack_handler_ = std::move(handler); }
+
+    size_t pending() const { return pending_.size(); }
+
+private:
+    void dispatch();
+
+    int fd_ = -1;
+    std::string rx_;
+    std::deque<Clock::time_point> pending_; // send times of unacknowledged commands
+    TelemetryHandler telemetry_handler_;
+    std::function<void(const std::string &, int64_t)> ack_handler_;
+    std::string last_ack_;
+    int64_t last_rtt_ = -1;
+    uint64_t acks_ = 0;
+};
+
+} // namespace t85
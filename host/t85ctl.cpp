@@ -0,0 +1,538 @@
+// Command line client for the car, replacing plink in a loop (sth.cmd).
+//
+//   t85ctl [--host H] [--port P] send <command>...
+//   t85ctl [--host H] [--port P] bench <command> [count]
+//   t85ctl [--host H] [--port P] trace <command> [count]
+//   t85ctl [--host H] [--port P] route <step>...
+//   t85ctl [--host H] [--port P] mission <script file>
+//   t85ctl [--host H] [--port P] map [interval ms]
+//   t85ctl [--host H] [--port P] record <session file> [seconds]
+//   t85ctl [--host H] [--port P] capture <log file>
+//   t85ctl [--host H] [--port P] blackbox <csv file>
+//   t85ctl [--host H] [--port P] schedule <dump file>
+//   t85ctl [--host H] [--port P] shell
+//
+// send    sends commands in order and prints each ack with its round trip
+// bench   sends one command count times, waiting for each ack, and prints the
+//         command-to-ack latency histogram with p50/p99/p999
+// trace   like bench, but sends the command with an id and splits each round
+//         trip into the car's stages using the timestamps in the ack:
+//         queue (receipt to dispatch), actuate (dispatch to first motor
+//         update), car (receipt to ack) and network (round trip minus car)
+// route   drives a route of go steps (s100 t90 a80,45 w500 ...) twice, first
+//         stop-and-go with one "go" per step, each sent once the car reports
+//         [MOV]idle, then queued as a single "go", and prints both times
+// mission uploads a mission script line by line, runs it and prints its
+//         [MSN] status until it is done, Ctrl-C stops it on the car
+// map     polls the car's maze map with "map <revision>", so each poll only
+//         carries the rows changed since the last, and redraws it until Ctrl-C:
+//         # occupied, o visited, . free, blank unknown, @ the car
+// record  writes every telemetry message to a session file, one per line:
+//         <wall clock us>\t<T text | S hex stats frame>\t<data>
+// capture stops the car's control log ("rec on" starts it) and saves it with
+//         "rec dump" for t85_replay
+// blackbox saves the car's flash black box ("bb arm" starts it) with
+//         "bb dump" as CSV, one line per control period
+// schedule stops the car's schedule trace ("trc on" starts it) and saves it
+//         with "trc dump" for t85_trace
+// shell   sends lines read from stdin and prints telemetry as it arrives
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "blackbox.h"
+#include "trace.h"
+#include "t85client.h"
+
+namespace {
+
+volatile sig_atomic_t stop_requested = 0;
+
+void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+int usage()
+{
+    fprintf(stderr,
+            "usage: t85ctl [--host H] [--port P] send <command>...\n"
+            "       t85ctl [--host H] [--port P] bench <command> [count]\n"
+            "       t85ctl [--host H] [--port P] trace <command> [count]\n"
+            "       t85ctl [--host H] [--port P] route <step>...\n"
+            "       t85ctl [--host H] [--port P] mission <script file>\n"
+            "       t85ctl [--host H] [--port P] map [interval ms]\n"
+            "       t85ctl [--host H] [--port P] record <session file> [seconds]\n"
+            "       t85ctl [--host H] [--port P] capture <log file>\n"
+            "       t85ctl [--host H] [--port P] blackbox <csv file>\n"
+            "       t85ctl [--host H] [--port P] schedule <dump file>\n"
+            "       t85ctl [--host H] [--port P] shell\n"
+            "host defaults to $T85_HOST or 127.0.0.1, port to 4242\n");
+    return 2;
+}
+
+std::string hex(const std::string &data)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(data.size() * 2);
+    for (unsigned char c : data) {
+        out += digits[c >> 4];
+        out += digits[c & 15];
+    }
+    return out;
+}
+
+void print_telemetry(const t85::Telemetry &t)
+{
+    if (t.binary)
+        printf("<stats frame, %zu bytes>\n", t.data.size());
+    else
+        printf("%s\n", t.data.c_str());
+    fflush(stdout);
+}
+
+int cmd_send(t85::Client &client, const std::vector<std::string> &commands)
+{
+    client.on_telemetry(print_telemetry);
+    for (const std::string &c : commands) {
+        std::string ack;
+        int64_t rtt = client.command(c, 2000, &ack);
+        if (rtt < 0) {
+            fprintf(stderr, "%s: no ack\n", c.c_str());
+            return 1;
+        }
+        printf("%s -> %s (%lld us)\n", c.c_str(), ack.c_str(), (long long)rtt);
+    }
+    return 0;
+}
+
+int cmd_bench(t85::Client &client, const std::string &command, int count)
+{
+    t85::Histogram hist;
+    int lost = 0;
+    for (int i = 0; i < count && !stop_requested; i++) {
+        int64_t rtt = client.command(command, 2000);
+        if (rtt < 0) {
+            if (!client.connected()) {
+                fprintf(stderr, "connection lost after %d commands\n", i);
+                break;
+            }
+            lost++;
+            continue;
+        }
+        hist.add(rtt);
+    }
+    printf("%s", hist.report(command).c_str());
+    if (lost)
+        printf("%d commands got no ack within 2 s\n", lost);
+    return hist.count() ? 0 : 1;
+}
+
+int cmd_trace(t85::Client &client, const std::string &command, int count)
+{
+    t85::Histogram rtt, queue, actuate, car, network;
+    int lost = 0, untraced = 0;
+    for (int i = 0; i < count && !stop_requested; i++) {
+        uint32_t id = i + 1;
+        std::string ack;
+        int64_t us = client.command("#" + std::to_string(id) + " " + command, 2000, &ack);
+        if (us < 0) {
+            if (!client.connected()) {
+                fprintf(stderr, "connection lost after %d commands\n", i);
+                break;
+            }
+            lost++;
+            continue;
+        }
+        t85::AckTrace t;
+        if (!t85::parse_ack(ack, t) || t.id != id) {
+            untraced++;
+            continue;
+        }
+        // commands that never reach move_task are acked on receipt
+        uint32_t end = t.act_us ? t.act_us : t.dsp_us ? t.dsp_us : t.rx_us;
+        uint32_t on_car = end - t.rx_us;
+        rtt.add(us);
+        car.add(on_car);
+        network.add((uint64_t)us > on_car ? us - on_car : 0);
+        if (t.dsp_us)
+            queue.add(uint32_t(t.dsp_us - t.rx_us));
+        if (t.dsp_us && t.act_us)
+            actuate.add(uint32_t(t.act_us - t.dsp_us));
+    }
+    printf("%s", rtt.report("round trip").c_str());
+    printf("%s", network.report("network").c_str());
+    printf("%s", car.report("car").c_str());
+    if (queue.count())
+        printf("%s", queue.report("queue").c_str());
+    if (actuate.count())
+        printf("%s", actuate.report("actuate").c_str());
+    if (lost)
+        printf("%d commands got no ack within 2 s\n", lost);
+    if (untraced)
+        printf("%d acks carried no matching id, is the firmware older than tracing?\n", untraced);
+    return rtt.count() ? 0 : 1;
+}
+
+// Sends each command once the car went idle after the previous one, returns
+// the time until the car is idle after the last, or -1
+int64_t drive_until_idle(t85::Client &client, const std::vector<std::string> &commands, bool &idle)
+{
+    auto start = t85::Clock::now();
+    for (const std::string &c : commands) {
+        idle = false;
+        if (client.command(c) < 0)
+            return -1;
+        auto deadline = t85::Clock::now() + std::chrono::seconds(60);
+        while (!idle && !stop_requested) {
+            if (!client.poll(100) || t85::Clock::now() > deadline)
+                return -1;
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(t85::Clock::now() - start).count();
+}
+
+int cmd_route(t85::Client &client, const std::vector<std::string> &steps)
+{
+    bool idle = false;
+    client.on_telemetry([&](const t85::Telemetry &t) {
+        if (!t.binary && t.data == "[MOV]idle")
+            idle = true;
+    });
+    if (client.command("sub motion") < 0)
+        return 1;
+    std::vector<std::string> one_by_one;
+    std::string route = "go";
+    for (const std::string &step : steps) {
+        one_by_one.push_back("go " + step);
+        route += " " + step;
+    }
+    int64_t stop_and_go = drive_until_idle(client, one_by_one, idle);
+    int64_t queued = stop_and_go < 0 ? -1 : drive_until_idle(client, {route}, idle);
+    if (stop_and_go < 0 || queued < 0) {
+        fprintf(stderr, "route did not finish, is the firmware older than go?\n");
+        return 1;
+    }
+    printf("stop-and-go %8.3f s\n", stop_and_go / 1e6);
+    printf("queued      %8.3f s  %+.1f%%\n", queued / 1e6, 100.0 * (queued - stop_and_go) / stop_and_go);
+    return 0;
+}
+
+int cmd_mission(t85::Client &client, const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        perror(path.c_str());
+        return 1;
+    }
+    bool done = false, failed = false;
+    client.on_telemetry([&](const t85::Telemetry &t) {
+        if (t.binary || t.data.compare(0, 5, "[MSN]") != 0)
+            return;
+        printf("%s\n", t.data.c_str());
+        fflush(stdout);
+        if (t.data.compare(0, 10, "[MSN]error") == 0 || t.data == "[MSN]busy")
+            failed = done = true;
+        else if (t.data.compare(0, 9, "[MSN]done") == 0 || t.data == "[MSN]stopped")
+            done = true;
+    });
+    if (client.command("sub mission") < 0 || client.command("mission begin") < 0)
+        return 1;
+    std::string line;
+    while (std::getline(in, line) && !failed) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.size() + 2 > 64) {
+            fprintf(stderr, "line too long for a command: %s\n", line.c_str());
+            return 1;
+        }
+        if (client.command("m " + line) < 0)
+            return 1;
+    }
+    if (failed || client.command("mission run") < 0)
+        return 1;
+    while (!done && client.connected()) {
+        if (stop_requested) {
+            client.command("mission stop");
+            stop_requested = 0;
+        }
+        client.poll(100);
+    }
+    return failed ? 1 : 0;
+}
+
+int cmd_map(t85::Client &client, int interval_ms)
+{
+    unsigned revision = 0, width = 0, height = 0, cell_cm = 1;
+    double x_cm = 0, y_cm = 0;
+    std::vector<unsigned> known(16), occupied(16), visited(16);
+    size_t rows = 0, bytes = 0;
+    client.on_telemetry([&](const t85::Telemetry &t) {
+        if (t.binary || t.data.compare(0, 5, "[MAP]") != 0)
+            return;
+        bytes += t.data.size() + 1;
+        unsigned y, k, o, v;
+        if (sscanf(t.data.c_str(), "[MAP]rev:%u\tsince:%*u\tsize:%ux%u\tcell:%u\tat:%lf,%lf", &revision, &width,
+                   &height, &cell_cm, &x_cm, &y_cm) == 6) {
+            return;
+        } else if (sscanf(t.data.c_str(), "[MAP]row %u %x %x %x", &y, &k, &o, &v) == 4 && y < 16) {
+            known[y] = k;
+            occupied[y] = o;
+            visited[y] = v;
+            rows++;
+        } else {
+            printf("%s\n", t.data.c_str());
+        }
+    });
+    while (!stop_requested && client.connected()) {
+        rows = bytes = 0;
+        if (client.command("map " + std::to_string(revision)) < 0)
+            return 1;
+        if (rows > 0) {
+            int car_x = cell_cm ? (int)(x_cm / cell_cm) : -1, car_y = cell_cm ? (int)(y_cm / cell_cm) : -1;
+            printf("\033[H\033[2J");
+            // north up, row 0 at the bottom
+            for (int y = (int)height - 1; y >= 0; y--) {
+                for (unsigned x = 0; x < width; x++) {
+                    unsigned bit = 1u << x;
+                    char c = (int)x == car_x && y == car_y ? '@'
+                             : occupied[y] & bit          ? '#'
+                             : visited[y] & bit           ? 'o'
+                             : known[y] & bit             ? '.'
+                                                          : ' ';
+                    printf("%c ", c);
+                }
+                printf("|\n");
+            }
+            printf("rev %u  %ux%u cells of %u cm  car at %.0f,%.0f cm  %zu rows in %zu bytes\n", revision, width, height,
+                   cell_cm, x_cm, y_cm, rows, bytes);
+            fflush(stdout);
+        }
+        auto end = t85::Clock::now() + std::chrono::milliseconds(interval_ms);
+        while (!stop_requested && client.connected() && t85::Clock::now() < end)
+            client.poll(50);
+    }
+    return 0;
+}
+
+// fetch a log the car replies as "<tag><offset> <hex>" lines to "<command> <offset>"
+bool download(t85::Client &client, const std::string &command, const std::string &tag, std::string &log)
+{
+    const std::string next_format = tag + "next %u", end_format = tag + "end %u", line_format = tag + "%u %n";
+    unsigned next = 0, total = 0;
+    bool ended = false, bad = false;
+    client.on_telemetry([&](const t85::Telemetry &t) {
+        if (t.binary || t.data.compare(0, tag.size(), tag) != 0)
+            return;
+        unsigned offset;
+        int pos = 0;
+        if (sscanf(t.data.c_str(), next_format.c_str(), &next) == 1)
+            return;
+        if (sscanf(t.data.c_str(), end_format.c_str(), &total) == 1) {
+            ended = true;
+            return;
+        }
+        if (sscanf(t.data.c_str(), line_format.c_str(), &offset, &pos) != 1 || offset != log.size()) {
+            bad = true;
+            return;
+        }
+        for (size_t i = pos; i + 1 < t.data.size(); i += 2)
+            log += (char)strtoul(t.data.substr(i, 2).c_str(), nullptr, 16);
+    });
+    while (!ended && !bad && !stop_requested) {
+        if (client.command(command + " " + std::to_string(next)) < 0)
+            return false;
+        if (!ended && next != log.size())
+            bad = true;
+    }
+    if (bad || log.size() != total) {
+        fprintf(stderr, "log dump out of order at byte %zu\n", log.size());
+        return false;
+    }
+    return true;
+}
+
+int cmd_capture(t85::Client &client, const std::string &path)
+{
+    std::string log;
+    if (!download(client, "rec dump", "[REC]", log))
+        return 1;
+    std::ofstream out(path, std::ios::binary);
+    if (!out.write(log.data(), log.size())) {
+        perror(path.c_str());
+        return 1;
+    }
+    printf("%zu bytes written to %s\n", log.size(), path.c_str());
+    return 0;
+}
+
+int cmd_blackbox(t85::Client &client, const std::string &path)
+{
+    std::string log;
+    if (!download(client, "bb dump", "[BB]", log))
+        return 1;
+    blackbox_header_t header{};
+    if (log.size() >= BLACKBOX_HEADER_SIZE)
+        memcpy(&header, log.data(), sizeof(header));
+    if (header.magic != BLACKBOX_MAGIC || header.version != BLACKBOX_VERSION ||
+        header.sample_size != sizeof(blackbox_sample_t)) {
+        fprintf(stderr, "no black box of version %d on the car, \"bb arm\" records one\n", BLACKBOX_VERSION);
+        return 1;
+    }
+    FILE *csv = fopen(path.c_str(), "w");
+    if (!csv) {
+        perror(path.c_str());
+        return 1;
+    }
+    fprintf(csv, "time_ms,dt_us,mode,drive,left_speed,right_speed,left_code,right_code,bearing,target_bearing,error,"
+                 "obstacle_cm,line_offset,left_ir,right_ir,line_valid,client,events\n");
+    size_t count = 0;
+    uint32_t first_us = 0;
+    for (size_t at = BLACKBOX_HEADER_SIZE; at + sizeof(blackbox_sample_t) <= log.size(); at += sizeof(blackbox_sample_t)) {
+        blackbox_sample_t s;
+        memcpy(&s, log.data() + at, sizeof(s));
+        if (count++ == 0)
+            first_us = s.time_us;
+        fprintf(csv, "%.3f,%u,%c,%u,%u,%u,%d,%d,%d,%d,%.1f,", (uint32_t)(s.time_us - first_us) / 1e3, s.dt_us,
+                s.mode ? s.mode : '-', s.drive, s.left_speed, s.right_speed, s.left_code, s.right_code, s.bearing,
+                s.target_bearing, s.error / 10.0);
+        if (s.obstacle_cm == BLACKBOX_OBSTACLE_NONE)
+            fprintf(csv, ",");
+        else
+            fprintf(csv, "%u,", s.obstacle_cm);
+        fprintf(csv, "%.4f,%d,%d,%d,%d,%#x\n", s.line_offset / 32767.0, !!(s.flags & BLACKBOX_FLAG_LEFT_IR),
+                !!(s.flags & BLACKBOX_FLAG_RIGHT_IR), !!(s.flags & BLACKBOX_FLAG_LINE_VALID),
+                !!(s.flags & BLACKBOX_FLAG_CLIENT), s.events);
+    }
+    fclose(csv);
+    printf("%zu samples written to %s\n", count, path.c_str());
+    return 0;
+}
+
+int cmd_schedule(t85::Client &client, const std::string &path)
+{
+    std::string log;
+    if (!download(client, "trc dump", "[TRC]", log))
+        return 1;
+    if (log.empty()) {
+        fprintf(stderr, "no schedule trace on the car, \"trc on\" records one\n");
+        return 1;
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!out.write(log.data(), log.size())) {
+        perror(path.c_str());
+        return 1;
+    }
+    trace_dump_header_t header{};
+    memcpy(&header, log.data(), std::min(log.size(), sizeof(header)));
+    printf("%u records, %u lost, written to %s\n", header.record_count, header.lost, path.c_str());
+    return 0;
+}
+
+int cmd_record(t85::Client &client, const std::string &path, int seconds, const std::string &peer)
+{
+    std::ofstream out(path, std::ios::app);
+    if (!out) {
+        perror(path.c_str());
+        return 1;
+    }
+    out << "# t85 session " << peer << " start_us " << t85::wall_time_us() << '\n';
+    size_t messages = 0;
+    client.on_telemetry([&](const t85::Telemetry &t) {
+        out << t.wall_us << '\t' << (t.binary ? "S\t" + hex(t.data) : "T\t" + t.data) << '\n';
+        messages++;
+    });
+    auto end = t85::Clock::now() + std::chrono::seconds(seconds);
+    while (!stop_requested && client.connected() && (seconds <= 0 || t85::Clock::now() < end))
+        client.poll(200);
+    printf("recorded %zu messages to %s\n", messages, path.c_str());
+    return 0;
+}
+
+int cmd_shell(t85::Client &client)
+{
+    client.on_telemetry(print_telemetry);
+    client.on_ack([](const std::string &ack, int64_t rtt) {
+        printf("%s (%lld us)\n", ack.c_str(), (long long)rtt);
+        fflush(stdout);
+    });
+    std::string line;
+    while (!stop_requested && client.connected()) {
+        pollfd pfd{STDIN_FILENO, POLLIN, 0};
+        if (::poll(&pfd, 1, 0) > 0) {
+            if (!std::getline(std::cin, line))
+                break;
+            if (!line.empty())
+                client.send(line);
+        }
+        client.poll(50);
+    }
+    // give the last commands a moment to be acknowledged
+    for (int i = 0; i < 20 && client.pending(); i++)
+        client.poll(50);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *env_host = getenv("T85_HOST");
+    std::string host = env_host ? env_host : "127.0.0.1";
+    uint16_t port = 4242;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--host") && i + 1 < argc)
+            host = argv[++i];
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else
+            return usage();
+    }
+    if (i >= argc)
+        return usage();
+    std::string verb = argv[i++];
+    std::vector<std::string> args(argv + i, argv + argc);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    t85::Client client;
+    if (!client.connect(host, port)) {
+        fprintf(stderr, "cannot connect to %s:%u\n", host.c_str(), port);
+        return 1;
+    }
+    if (verb == "send" && !args.empty())
+        return cmd_send(client, args);
+    if (verb == "bench" && !args.empty())
+        return cmd_bench(client, args[0], args.size() > 1 ? atoi(args[1].c_str()) : 1000);
+    if (verb == "trace" && !args.empty())
+        return cmd_trace(client, args[0], args.size() > 1 ? atoi(args[1].c_str()) : 1000);
+    if (verb == "route" && !args.empty())
+        return cmd_route(client, args);
+    if (verb == "mission" && !args.empty())
+        return cmd_mission(client, args[0]);
+    if (verb == "map")
+        return cmd_map(client, args.empty() ? 500 : atoi(args[0].c_str()));
+    if (verb == "record" && !args.empty())
+        return cmd_record(client, args[0], args.size() > 1 ? atoi(args[1].c_str()) : 0, host + ":" + std::to_string(port));
+    if (verb == "capture" && !args.empty())
+        return cmd_capture(client, args[0]);
+    if (verb == "blackbox" && !args.empty())
+        return cmd_blackbox(client, args[0]);
+    if (verb == "schedule" && !args.empty())
+        return cmd_schedule(client, args[0]);
+    if (verb == "shell")
+        return cmd_shell(client);
+    return usage();
+}
@@ -0,0 +1,104 @@
+// A wheel model and the motion engine driving it, shared by the host tests
+#pragma once
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include "motion.h"
+}
+
+inline constexpr float STEP_S = 0.01f;      // CONTROL_LOOP_HZ 100
+inline constexpr uint16_t MAX_SPEED = 6250; // DEFAULT_SPEED
+inline constexpr double CODES_PER_S = 200;  // wheel speed at full PWM
+inline constexpr double DEG_PER_CODE = 0.9; // heading change per code of wheel speed difference
+inline constexpr int MAX_STEPS = 3000;      // 30 s, far longer than any route here takes
+
+// Wheels that follow their PWM level with some lag, encoders that count up
+// in both directions and a compass that follows the wheel speed difference,
+// as in t85_fakecar, with an obstacle the tests can place ahead
+struct Wheels {
+    double left = 0, right = 0;
+    double v_left = 0, v_right = 0;
+    double bearing = 0;
+    float obstacle_cm = 1000;
+
+    motion_input_t input() const
+    {
+        return {STEP_S, (int64_t)left, (int64_t)right, (int)bearing, obstacle_cm, false, false, false, 0};
+    }
+
+    void drive(const motion_output_t &out)
+    {
+        double l = out.left_speed * CODES_PER_S / MAX_SPEED;
+        double r = out.right_speed * CODES_PER_S / MAX_SPEED;
+        switch (out.drive) {
+        case MOTION_DRIVE_FORWARD: break;
+        case MOTION_DRIVE_BACKWARD: l = -l; r = -r; break;
+        case MOTION_DRIVE_CW: r = -r; break;
+        case MOTION_DRIVE_CCW: l = -l; break;
+        default: l = r = 0; break;
+        }
+        v_left += (l - v_left) * 0.2;
+        v_right += (r - v_right) * 0.2;
+        left += std::fabs(v_left) * STEP_S;
+        right += std::fabs(v_right) * STEP_S;
+        bearing = std::fmod(bearing + (v_left - v_right) * STEP_S * DEG_PER_CODE + 360, 360);
+    }
+};
+
+inline constexpr motion_gains_t GAINS = {0.1f, 0, 0, 0.15f, 0.075f, 0.6f, 0.3f}; // t85_fakecar's
+
+// The motion engine driving the wheels
+struct Car {
+    motion_engine_t engine;
+    Wheels wheels;
+    motion_output_t out{};
+    uint8_t events = 0;
+
+    Car()
+    {
+        motion_init(&engine, MAX_SPEED, STEP_S, 0.5f / STEP_S);
+        engine.gains = GAINS;
+    }
+
+    void push(uint8_t type, int32_t value, int32_t arg = 0)
+    {
+        motion_primitive_t p{};
+        p.type = type;
+        p.value = value;
+        p.arg = arg;
+        motion_push(&engine, &p);
+    }
+
+    void step()
+    {
+        motion_input_t in = wheels.input();
+        events = motion_step(&engine, &in, &out);
+        wheels.drive(out);
+    }
+
+    // signed codes along the route, as the engine counts them
+    float position() const
+    {
+        return (engine.pos_left + engine.pos_right) / 2;
+    }
+
+    // steps until the queue runs empty, -1 if it never does; done collects the DONE ids in
+    // order, first_stop the id running when the wheels were first stopped after moving
+    int run(std::vector<uint16_t> *done = nullptr, uint16_t *first_stop = nullptr)
+    {
+        bool moved = false;
+        for (int n = 1; n <= MAX_STEPS; n++) {
+            step();
+            if (done && (events & MOTION_EVENT_DONE))
+                done->push_back(engine.done_id);
+            if (out.drive != MOTION_DRIVE_STOP)
+                moved = true;
+            else if (first_stop && moved && !*first_stop)
+                *first_stop = engine.current.id;
+            if (events & MOTION_EVENT_IDLE)
+                return n;
+        }
+        return -1;
+    }
+};
@@ -0,0 +1,31 @@
+// A minimal test runner for the host tests: TEST(suite, name) defines a case,
+// CHECK(cond) fails it and returns. "t85_test <suite>" runs one suite, ctest
+// runs each suite as its own test, see host/CMakeLists.txt.
+#pragma once
+#include <cstdio>
+
+namespace t85test {
+
+struct Case {
+    const char *suite;
+    const char *name;
+    void (*run)();
+};
+
+bool add(const Case &c);
+void fail(const char *file, int line, const char *cond);
+
+} // namespace t85test
+
+#define TEST(suite, name)                                                                        \
+    static void test_##suite##_##name();                                                         \
+    [[maybe_unused]] static bool registered_##suite##_##name = t85test::add({#suite, #name, test_##suite##_##name}); \
+    static void test_##suite##_##name()
+
+#define CHECK(cond)                                        \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            t85test::fail(__FILE__, __LINE__, #cond);      \
+            return;                                        \
+        }                                                  \
+    } while (0)
@@ -0,0 +1,200 @@
+#include "fake_lwip.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <list>
+
+extern "C" {
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+#include "pico/cyw43_arch.h"
+}
+
+struct tcp_pcb {
+    bool listening = false;
+    bool open = true;
+    void *arg = nullptr;
+    tcp_accept_fn accept = nullptr;
+    tcp_recv_fn recv = nullptr;
+    tcp_err_fn err = nullptr;
+    uint16_t sndbuf = 8 * 1460; // TCP_SND_BUF in lwipopts.h
+    std::string written;
+};
+
+namespace {
+
+std::list<tcp_pcb> pcbs; // stable addresses
+tcp_pcb *listener = nullptr;
+netif loopback{};
+
+} // namespace
+
+struct netif *netif_list = &loopback;
+
+namespace fake_lwip {
+
+tcp_pcb *connect()
+{
+    if (!listener || !listener->accept)
+        return nullptr;
+    tcp_pcb *pcb = &pcbs.emplace_back();
+    if (listener->accept(listener->arg, pcb, ERR_OK) != ERR_OK)
+        return nullptr;
+    return pcb;
+}
+
+void send(tcp_pcb *pcb, const std::string &data)
+{
+    pbuf *p = pbuf_alloc(PBUF_TRANSPORT, data.size(), PBUF_RAM);
+    std::memcpy(p->payload, data.data(), data.size());
+    pcb->recv(pcb->arg, pcb, p, ERR_OK);
+}
+
+void disconnect(tcp_pcb *pcb)
+{
+    pcb->recv(pcb->arg, pcb, nullptr, ERR_OK);
+}
+
+void fail(tcp_pcb *pcb)
+{
+    pcb->open = false;
+    if (pcb->err)
+        pcb->err(pcb->arg, ERR_RST);
+}
+
+std::string received(tcp_pcb *pcb)
+{
+    std::string data;
+    data.swap(pcb->written);
+    return data;
+}
+
+void set_sndbuf(tcp_pcb *pcb, uint16_t bytes)
+{
+    pcb->sndbuf = bytes;
+}
+
+void reset()
+{
+    pcbs.clear();
+    listener = nullptr;
+}
+
+} // namespace fake_lwip
+
+extern "C" {
+
+void cyw43_arch_lwip_begin(void)
+{
+}
+
+void cyw43_arch_lwip_end(void)
+{
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *)
+{
+    static char text[] = "127.0.0.1";
+    return text;
+}
+
+struct pbuf *pbuf_alloc(pbuf_layer, uint16_t length, pbuf_type)
+{
+    pbuf *p = static_cast<pbuf *>(std::malloc(sizeof(pbuf) + length));
+    *p = pbuf{nullptr, p + 1, length, length};
+    return p;
+}
+
+uint8_t pbuf_free(struct pbuf *p)
+{
+    std::free(p);
+    return 1;
+}
+
+uint16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, uint16_t len, uint16_t offset)
+{
+    if (offset >= p->len)
+        return 0;
+    uint16_t n = std::min<uint16_t>(len, p->len - offset);
+    std::memcpy(dataptr, static_cast<const uint8_t *>(p->payload) + offset, n);
+    return n;
+}
+
+struct tcp_pcb *tcp_new_ip_type(uint8_t)
+{
+    return &pcbs.emplace_back();
+}
+
+err_t tcp_bind(struct tcp_pcb *, const ip_addr_t *, uint16_t)
+{
+    return ERR_OK;
+}
+
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, uint8_t)
+{
+    pcb->listening = true;
+    listener = pcb;
+    return pcb;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg)
+{
+    pcb->arg = arg;
+}
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+    pcb->accept = accept;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+    pcb->recv = recv;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
+{
+    pcb->err = err;
+}
+
+void tcp_recved(struct tcp_pcb *, uint16_t)
+{
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, uint16_t len, uint8_t)
+{
+    if (!pcb->open)
+        return ERR_CONN;
+    if (len > pcb->sndbuf)
+        return ERR_MEM;
+    pcb->written.append(static_cast<const char *>(dataptr), len);
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *)
+{
+    return ERR_OK;
+}
+
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+    pcb->open = false;
+    return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb)
+{
+    pcb->open = false;
+}
+
+uint16_t tcp_sndbuf(const struct tcp_pcb *pcb)
+{
+    return pcb->sndbuf;
+}
+
+uint16_t tcp_sndqueuelen(const struct tcp_pcb *)
+{
+    return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,22 @@
+// In-memory lwIP for the server tests: the API of sim/include/lwip with pcbs
+// that keep what the firmware writes, and calls for the test to play the
+// remote end of a connection.
+#pragma once
+#include <cstdint>
+#include <string>
+
+extern "C" {
+#include "lwip/tcp.h"
+}
+
+namespace fake_lwip {
+
+tcp_pcb *connect();                            // a client connects to the listening pcb, nullptr if refused
+void send(tcp_pcb *pcb, const std::string &data); // the client sends data, the recv callback runs
+void disconnect(tcp_pcb *pcb);                  // the client closes, the recv callback gets no pbuf
+void fail(tcp_pcb *pcb);                        // the connection is reset, the err callback runs
+std::string received(tcp_pcb *pcb);             // what was written to the client since the last call
+void set_sndbuf(tcp_pcb *pcb, uint16_t bytes);  // room left in the send buffer, a slow client has little
+void reset();                                   // drop every pcb
+
+} // namespace fake_lwip
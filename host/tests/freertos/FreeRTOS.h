@@ -0,0 +1,21 @@
+#ifndef TEST_FREERTOS_H
+#define TEST_FREERTOS_H
+// Just enough of the FreeRTOS types for the host tests to compile firmware
+// modules, the functions they call are defined by each test, see sdk.cpp
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define configTICK_RATE_HZ 1000
+#define configMINIMAL_STACK_SIZE 256
+#define configSTACK_DEPTH_TYPE uint32_t
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#endif
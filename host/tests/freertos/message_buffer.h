@@ -0,0 +1,21 @@
+#ifndef TEST_MESSAGE_BUFFER_H
+#define TEST_MESSAGE_BUFFER_H
+// Message buffers that never block, a receive with nothing queued returns 0
+#include <stddef.h>
+#include "FreeRTOS.h"
+
+typedef struct test_message_buffer *MessageBufferHandle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MessageBufferHandle_t xMessageBufferCreate(size_t size);
+size_t xMessageBufferSend(MessageBufferHandle_t buffer, const void *data, size_t len, TickType_t wait);
+size_t xMessageBufferReceive(MessageBufferHandle_t buffer, void *data, size_t size, TickType_t wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
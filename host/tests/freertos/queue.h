@@ -0,0 +1,19 @@
+#ifndef TEST_QUEUE_H
+#define TEST_QUEUE_H
+// Queue handles and their trace numbers, the test that uses them defines them
+#include "FreeRTOS.h"
+
+typedef struct QueueDefinition *QueueHandle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+UBaseType_t uxQueueGetQueueNumber(QueueHandle_t queue);
+void vQueueSetQueueNumber(QueueHandle_t queue, UBaseType_t number);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef TEST_STREAM_BUFFER_H
+#define TEST_STREAM_BUFFER_H
+// Stream buffer handles and their trace numbers, the test that uses them defines them
+#include "FreeRTOS.h"
+
+typedef struct StreamBufferDef_t *StreamBufferHandle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+UBaseType_t uxStreamBufferGetStreamBufferNumber(StreamBufferHandle_t buffer);
+void vStreamBufferSetStreamBufferNumber(StreamBufferHandle_t buffer, UBaseType_t number);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
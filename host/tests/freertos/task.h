@@ -0,0 +1,43 @@
+#ifndef TEST_TASK_H
+#define TEST_TASK_H
+#include "FreeRTOS.h"
+
+#define tskIDLE_PRIORITY 0
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+
+typedef enum
+{
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+typedef struct xTASK_STATUS
+{
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    UBaseType_t xTaskNumber;
+} TaskStatus_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+UBaseType_t uxTaskGetTaskNumber(TaskHandle_t task);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, uint32_t *total_run_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+// The GPIO, I2C, PWM and ADC calls of the sensor and motor drivers, with the
+// SDK shims of sim/include, for the host bench. Pins keep the level last put,
+// the compass answers every register read with the same bytes, and sleep_us
+// moves sdk.cpp's clock on instead of waiting.
+#include <cstdint>
+
+#include "sdk.h"
+
+extern "C" {
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/pwm.h"
+}
+
+struct i2c_inst {
+    uint8_t reg; // register pointer, set by a one byte write
+};
+
+namespace {
+
+i2c_inst i2c0_inst;
+uint32_t levels;
+
+// a magnetometer and accelerometer sample far from any axis, so heading() does all its work
+uint8_t register_value(uint8_t reg)
+{
+    return (uint8_t)(0x35 + reg * 29);
+}
+
+} // namespace
+
+extern "C" {
+
+i2c_inst_t *const sim_i2c0 = &i2c0_inst;
+pwm_hw_t sim_pwm_hw;
+adc_hw_t sim_adc_hw;
+
+bool stdio_init_all(void)
+{
+    return true;
+}
+
+void sleep_us(uint64_t us)
+{
+    sdk::advance_us(us);
+}
+
+uint i2c_init(i2c_inst_t *, uint baudrate)
+{
+    return baudrate;
+}
+
+void i2c_set_slave_mode(i2c_inst_t *, bool, uint8_t)
+{
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t, const uint8_t *src, size_t len, bool)
+{
+    if (len >= 1)
+        i2c->reg = src[0];
+    return (int)len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t, uint8_t *dst, size_t len, bool)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] = register_value(i2c->reg++);
+    return (int)len;
+}
+
+void gpio_init(uint gpio)
+{
+    levels &= ~(1u << gpio);
+}
+
+void gpio_set_dir(uint, bool)
+{
+}
+
+void gpio_set_function(uint, enum gpio_function)
+{
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    if (value)
+        levels |= 1u << gpio;
+    else
+        levels &= ~(1u << gpio);
+}
+
+bool gpio_get(uint gpio)
+{
+    return (levels >> gpio) & 1;
+}
+
+uint32_t gpio_get_all(void)
+{
+    return levels;
+}
+
+void gpio_set_mask(uint32_t mask)
+{
+    levels |= mask;
+}
+
+void gpio_clr_mask(uint32_t mask)
+{
+    levels &= ~mask;
+}
+
+void adc_init(void)
+{
+}
+
+} // extern "C"
@@ -0,0 +1,56 @@
+// Runs the host tests, all of them or one suite:
+//   t85_test [suite]
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+
+namespace t85test {
+
+namespace {
+
+std::vector<Case> &cases()
+{
+    static std::vector<Case> all;
+    return all;
+}
+
+bool failed = false;
+
+} // namespace
+
+bool add(const Case &c)
+{
+    cases().push_back(c);
+    return true;
+}
+
+void fail(const char *file, int line, const char *cond)
+{
+    std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, cond);
+    failed = true;
+}
+
+} // namespace t85test
+
+int main(int argc, char **argv)
+{
+    const char *suite = argc > 1 ? argv[1] : nullptr;
+    int run = 0, failures = 0;
+    for (const t85test::Case &c : t85test::cases()) {
+        if (suite && std::strcmp(suite, c.suite) != 0)
+            continue;
+        t85test::failed = false;
+        c.run();
+        run++;
+        if (t85test::failed)
+            failures++;
+        std::printf("%s %s.%s\n", t85test::failed ? "FAIL" : "ok  ", c.suite, c.name);
+    }
+    if (run == 0) {
+        std::fprintf(stderr, "no tests in suite %s\n", suite ? suite : "(all)");
+        return 2;
+    }
+    std::printf("%d of %d failed\n", failures, run);
+    return failures ? 1 : 0;
+}
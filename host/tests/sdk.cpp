@@ -0,0 +1,235 @@
+// The SDK and FreeRTOS functions that the firmware modules under test call,
+// with the SDK shims of sim/include. Masking "interrupts" takes a recursive
+// mutex, so spin locks keep out the other test threads, and time is a clock
+// the tests set. A task started with sdk::start_task runs on a thread and
+// sleeps in ulTaskNotifyTake until it is notified.
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sdk.h"
+
+extern "C" {
+#include "FreeRTOS.h"
+#include "task.h"
+#include "message_buffer.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+}
+
+namespace {
+
+std::atomic<uint64_t> now_us{0};
+std::atomic<uint32_t> notified{0};
+std::recursive_mutex interrupts;
+spin_lock_t locks[32];
+std::atomic<int> next_lock{0};
+
+// never destroyed, started tasks still wait on them at exit
+std::mutex &tasks_mutex = *new std::mutex;
+std::condition_variable &tasks_changed = *new std::condition_variable;
+std::vector<tskTaskControlBlock *> tasks;
+thread_local tskTaskControlBlock *current = nullptr;
+bool tasks_held = false;
+
+} // namespace
+
+struct tskTaskControlBlock {
+    uint32_t notified = 0;
+    bool waiting = false;
+};
+
+struct test_message_buffer {
+    size_t size;
+    size_t used = 0;
+    std::deque<std::vector<uint8_t>> messages;
+};
+
+namespace sdk {
+
+void set_time_us(uint64_t us)
+{
+    now_us = us;
+}
+
+void advance_us(uint64_t us)
+{
+    now_us += us;
+}
+
+uint32_t notifications()
+{
+    return notified;
+}
+
+void start_task(void (*task)(void *), void *params)
+{
+    tskTaskControlBlock *tcb = new tskTaskControlBlock;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        tasks.push_back(tcb);
+    }
+    std::thread([=] {
+        current = tcb;
+        task(params);
+    }).detach();
+}
+
+void wait_blocked()
+{
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    tasks_changed.wait(lock, [] {
+        for (tskTaskControlBlock *tcb : tasks)
+            if (!tcb->waiting || (tcb->notified && !tasks_held))
+                return false;
+        return true;
+    });
+}
+
+void hold_tasks(bool held)
+{
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks_held = held;
+    tasks_changed.notify_all();
+}
+
+} // namespace sdk
+
+extern "C" {
+
+uint64_t time_us_64(void)
+{
+    return now_us;
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    interrupts.lock();
+    return 0;
+}
+
+void restore_interrupts(uint32_t)
+{
+    interrupts.unlock();
+}
+
+spin_lock_t *spin_lock_init(uint lock_num)
+{
+    return &locks[lock_num % 32];
+}
+
+int spin_lock_claim_unused(bool)
+{
+    return next_lock++ % 32;
+}
+
+void panic(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    std::vfprintf(stderr, fmt, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+    std::abort();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+// the timeout is not simulated, the caller waits for a notification
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t)
+{
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    current->waiting = true;
+    tasks_changed.notify_all();
+    tasks_changed.wait(lock, [] { return current->notified != 0 && !tasks_held; });
+    current->waiting = false;
+    uint32_t value = current->notified;
+    current->notified = clear ? 0 : value - 1;
+    return value;
+}
+
+// handles from start_task wake their task, the others are only counted
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    notified++;
+    if (task) {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        task->notified++;
+        tasks_changed.notify_all();
+    }
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *)
+{
+    xTaskNotifyGive(task);
+}
+
+// the notification value is the count ulTaskNotifyTake returns, bits are or'ed into it
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *)
+{
+    notified++;
+    if (task) {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        if (action == eSetBits)
+            task->notified |= value;
+        else if (action == eIncrement)
+            task->notified++;
+        else if (action == eSetValueWithoutOverwrite && task->notified)
+            return pdFALSE;
+        else if (action != eNoAction)
+            task->notified = value;
+        tasks_changed.notify_all();
+    }
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t)
+{
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return now_us / 1000;
+}
+
+// each message also takes its length, as in FreeRTOS
+MessageBufferHandle_t xMessageBufferCreate(size_t size)
+{
+    test_message_buffer *buffer = new test_message_buffer;
+    buffer->size = size;
+    return buffer;
+}
+
+size_t xMessageBufferSend(MessageBufferHandle_t buffer, const void *data, size_t len, TickType_t)
+{
+    if (buffer->used + len + sizeof(size_t) > buffer->size)
+        return 0;
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    buffer->messages.emplace_back(bytes, bytes + len);
+    buffer->used += len + sizeof(size_t);
+    return len;
+}
+
+size_t xMessageBufferReceive(MessageBufferHandle_t buffer, void *data, size_t size, TickType_t)
+{
+    if (buffer->messages.empty() || buffer->messages.front().size() > size)
+        return 0;
+    std::vector<uint8_t> message = std::move(buffer->messages.front());
+    buffer->messages.pop_front();
+    buffer->used -= message.size() + sizeof(size_t);
+    std::memcpy(data, message.data(), message.size());
+    return message.size();
+}
+
+} // extern "C"
@@ -0,0 +1,18 @@
+// Controls for the SDK and FreeRTOS stand-ins in sdk.cpp
+#pragma once
+#include <cstdint>
+
+namespace sdk {
+
+void set_time_us(uint64_t us);  // what time_us_64 returns from now on
+void advance_us(uint64_t us);
+uint32_t notifications();       // task notifications given so far
+
+// runs a task's loop on a thread of its own, it blocks in ulTaskNotifyTake
+void start_task(void (*task)(void *), void *params);
+// until every started task waits in ulTaskNotifyTake with no notification pending, or held
+void wait_blocked();
+// started tasks are not woken while held, as behind a higher priority task
+void hold_tasks(bool held);
+
+} // namespace sdk
@@ -0,0 +1,231 @@
+// The black box: blackbox_task on a thread of its own against a flash that
+// counts what it is asked to do. While recording, each wake programs at most
+// one page, and each flash_safe_execute does one page program or one sector
+// erase, so move_task is held up by one of them at most. "bb arm" erases the
+// whole region, a stop flushes the partial page, blackbox_init finds the end
+// of the samples again, and a full region stops the recording.
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+#include "sdk.h"
+
+extern "C" {
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "blackbox.h"
+}
+
+namespace {
+
+constexpr uint32_t REGION = PICO_FLASH_SIZE_BYTES - BLACKBOX_FLASH_SIZE;
+constexpr uint32_t CAPACITY = (BLACKBOX_FLASH_SIZE - BLACKBOX_HEADER_SIZE) / sizeof(blackbox_sample_t);
+constexpr uint32_t PAGE_US = 500; // a page program and a sector erase, as the W25Q16 takes them
+constexpr uint32_t SECTOR_US = 45000;
+
+struct Flash {
+    bool locked = false;     // in flash_safe_execute
+    uint32_t ops = 0;        // programs and erases in the current flash_safe_execute
+    uint32_t max_ops = 0;    // most in one of them
+    uint32_t unlocked = 0;   // outside of one
+    uint32_t erases = 0;
+    uint32_t programs = 0;
+} flash;
+
+uint32_t samples_added = 0;
+
+blackbox_sample_t sample(uint32_t n)
+{
+    blackbox_sample_t s{};
+    s.time_us = 1000000 + n * 10000;
+    s.left_code = (int32_t)n * 3;
+    s.right_code = -(int32_t)n;
+    s.dt_us = 10000;
+    s.mode = 'f';
+    return s;
+}
+
+// one move_task period
+void add(uint32_t count = 1)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        blackbox_sample_t s = sample(samples_added++);
+        blackbox_add(&s);
+    }
+}
+
+uint32_t samples_in_flash()
+{
+    uint32_t size = blackbox_size();
+    return size < BLACKBOX_HEADER_SIZE ? 0 : (size - BLACKBOX_HEADER_SIZE) / sizeof(blackbox_sample_t);
+}
+
+// the samples in flash are the ones added, from the first of the recording
+bool in_order(uint32_t first)
+{
+    std::vector<uint8_t> log(blackbox_size());
+    if (blackbox_read(0, log.data(), log.size()) != log.size())
+        return false;
+    for (uint32_t i = 0; i < samples_in_flash(); i++) {
+        blackbox_sample_t expected = sample(first + i);
+        if (std::memcmp(log.data() + BLACKBOX_HEADER_SIZE + i * sizeof(expected), &expected, sizeof(expected)) != 0)
+            return false;
+    }
+    return true;
+}
+
+// a log that an earlier run left in the region
+void write_log(uint32_t samples)
+{
+    std::memset(sim_flash + REGION, 0xff, BLACKBOX_FLASH_SIZE);
+    blackbox_header_t header = {BLACKBOX_MAGIC, BLACKBOX_VERSION, sizeof(blackbox_sample_t), 0};
+    std::memcpy(sim_flash + REGION, &header, sizeof(header));
+    for (uint32_t i = 0; i < samples; i++) {
+        blackbox_sample_t s = sample(i);
+        std::memcpy(sim_flash + REGION + BLACKBOX_HEADER_SIZE + i * sizeof(s), &s, sizeof(s));
+    }
+}
+
+} // namespace
+
+// hardware/flash.h and pico/flash.h, as sim/hal.c has them, counting the calls
+extern "C" {
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    flash.locked = true;
+    flash.ops = 0;
+    func(param);
+    if (flash.ops > flash.max_ops)
+        flash.max_ops = flash.ops;
+    flash.locked = false;
+    restore_interrupts(irq);
+    return PICO_OK;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+        panic("flash_range_erase(%u, %zu) is not whole sectors of flash", flash_offs, count);
+    std::memset(sim_flash + flash_offs, 0xff, count);
+    flash.unlocked += !flash.locked;
+    flash.ops += count / FLASH_SECTOR_SIZE;
+    flash.erases += count / FLASH_SECTOR_SIZE;
+    sdk::advance_us(count / FLASH_SECTOR_SIZE * SECTOR_US);
+}
+
+// programming only clears bits, as on the chip
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+        panic("flash_range_program(%u, %zu) is not whole pages of flash", flash_offs, count);
+    for (size_t i = 0; i < count; i++)
+        sim_flash[flash_offs + i] &= data[i];
+    flash.unlocked += !flash.locked;
+    flash.ops += count / FLASH_PAGE_SIZE;
+    flash.programs += count / FLASH_PAGE_SIZE;
+    sdk::advance_us(count / FLASH_PAGE_SIZE * PAGE_US);
+}
+
+} // extern "C"
+
+// before blackbox_task runs, as at boot
+TEST(blackbox, init_finds_the_end)
+{
+    std::memset(sim_flash, 0xff, sizeof(sim_flash));
+    blackbox_init();
+    CHECK(blackbox_size() == 0); // no header, no log
+    for (uint32_t samples : {0u, 1u, 7u, 8u, 9u, 1000u, CAPACITY - 1, CAPACITY}) {
+        write_log(samples);
+        blackbox_init();
+        CHECK(samples_in_flash() == samples);
+        CHECK(in_order(0));
+    }
+}
+
+TEST(blackbox, arm_erases_the_region)
+{
+    sdk::set_time_us(1000000);
+    sdk::start_task(blackbox_task, nullptr);
+    sdk::wait_blocked();
+    std::memset(sim_flash + REGION, 0, BLACKBOX_FLASH_SIZE);
+    CHECK(blackbox_arm());
+    sdk::wait_blocked();
+    CHECK(flash.erases == BLACKBOX_FLASH_SIZE / FLASH_SECTOR_SIZE);
+    CHECK(flash.programs == 1); // the header
+    CHECK(flash.max_ops == 1);  // a sector at a time
+    CHECK(flash.unlocked == 0);
+    CHECK(blackbox_size() == BLACKBOX_HEADER_SIZE);
+    blackbox_header_t header;
+    std::memcpy(&header, sim_flash + REGION, sizeof(header));
+    CHECK(header.magic == BLACKBOX_MAGIC && header.sample_size == sizeof(blackbox_sample_t));
+    for (uint32_t i = BLACKBOX_HEADER_SIZE; i < BLACKBOX_FLASH_SIZE; i++)
+        CHECK(sim_flash[REGION + i] == 0xff);
+}
+
+TEST(blackbox, one_page_per_period)
+{
+    samples_added = 0;
+    // move_task adds a sample and blackbox_task runs before the next period
+    for (int n = 0; n < 1000; n++) {
+        uint32_t programs = flash.programs;
+        sdk::advance_us(10000);
+        add();
+        sdk::wait_blocked();
+        CHECK(flash.programs - programs == (n % 8 == 7 ? 1 : 0)); // whole pages only
+    }
+    CHECK(samples_in_flash() == 1000);
+    CHECK(in_order(0));
+
+    // a burst of periods before the task gets to run still costs one page
+    uint32_t programs = flash.programs;
+    sdk::hold_tasks(true);
+    add(40);
+    sdk::hold_tasks(false);
+    sdk::wait_blocked();
+    CHECK(flash.programs - programs == 1);
+    CHECK(samples_in_flash() == 1008);
+    CHECK(flash.max_ops == 1);
+    CHECK(flash.unlocked == 0);
+}
+
+TEST(blackbox, stop_flushes_the_rest)
+{
+    add(5); // with the burst's, more than a page is left in RAM
+    sdk::wait_blocked();
+    blackbox_stop();
+    sdk::wait_blocked();
+    CHECK(samples_in_flash() == 1045);
+    CHECK(in_order(0));
+    CHECK(flash.max_ops == 1);
+    add();
+    sdk::wait_blocked();
+    CHECK(samples_in_flash() == 1045); // stopped
+    // after a reset the partial page's erased slots end the log
+    blackbox_init();
+    CHECK(samples_in_flash() == 1045);
+}
+
+TEST(blackbox, fills_the_region_and_stops)
+{
+    CHECK(blackbox_arm());
+    sdk::wait_blocked();
+    CHECK(samples_in_flash() == 0);
+    uint32_t first = samples_added;
+    while (samples_added - first < CAPACITY + 100) {
+        add(8);
+        sdk::wait_blocked();
+    }
+    CHECK(samples_in_flash() == CAPACITY);
+    CHECK(in_order(first));
+    CHECK(flash.max_ops == 1);
+    CHECK(flash.unlocked == 0);
+    uint32_t programs = flash.programs;
+    add(8);
+    sdk::wait_blocked();
+    CHECK(flash.programs == programs); // until the next arm
+}
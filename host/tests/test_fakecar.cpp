@@ -0,0 +1,149 @@
+// The client library against t85_fakecar on a loopback port: acks in order,
+// traced acks, subscriptions, motion telemetry, and a read taken as one
+// command with its line ending on, as the car's server does.
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "t85client.h"
+
+namespace {
+
+// a free loopback port, the fake car binds it right after
+uint16_t free_port()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(fd, (sockaddr *)&addr, len);
+    getsockname(fd, (sockaddr *)&addr, &len);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// t85_fakecar in a child process for the length of a test, with a client
+// connected to it that keeps every telemetry line
+struct FakeCar {
+    pid_t pid = -1;
+    t85::Client client;
+    std::vector<std::string> lines;
+
+    FakeCar()
+    {
+        std::string port = std::to_string(free_port());
+        pid = fork();
+        if (pid == 0) {
+            execl(T85_FAKECAR, T85_FAKECAR, port.c_str(), (char *)nullptr);
+            _exit(127);
+        }
+        for (int i = 0; i < 100 && !client.connect("127.0.0.1", std::stoi(port), 100); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        client.on_telemetry([this](const t85::Telemetry &t) { lines.push_back(t.data); });
+    }
+
+    ~FakeCar()
+    {
+        client.close();
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+
+    bool seen(const std::string &prefix) const
+    {
+        for (const std::string &line : lines)
+            if (line.compare(0, prefix.size(), prefix) == 0)
+                return true;
+        return false;
+    }
+
+    // poll until a telemetry line starting with prefix has arrived, up to timeout_ms
+    bool wait_for(const std::string &prefix, int timeout_ms = 3000)
+    {
+        auto deadline = t85::Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!seen(prefix) && t85::Clock::now() < deadline && client.poll(20))
+            ;
+        return seen(prefix);
+    }
+};
+
+} // namespace
+
+TEST(fakecar, acks_in_order)
+{
+    FakeCar car;
+    CHECK(car.client.connected());
+    std::string ack;
+    for (const char *cmd : {"unsub all", "setp1.50", "stats", "fwd10", "stop"}) {
+        CHECK(car.client.command(cmd, 2000, &ack) >= 0);
+        CHECK(ack == "ack");
+    }
+    CHECK(car.client.pending() == 0);
+}
+
+TEST(fakecar, traced_acks)
+{
+    FakeCar car;
+    CHECK(car.client.command("unsub all") >= 0);
+    std::string ack;
+    t85::AckTrace trace;
+    CHECK(car.client.command("#41 fwd20", 2000, &ack) >= 0);
+    CHECK(t85::parse_ack(ack, trace));
+    CHECK(trace.id == 41 && trace.rx_us != 0 && trace.dsp_us != 0 && trace.act_us != 0);
+    // not a motion command, so no dispatch or actuation
+    CHECK(car.client.command("#42 sub motion", 2000, &ack) >= 0);
+    CHECK(t85::parse_ack(ack, trace));
+    CHECK(trace.id == 42 && trace.rx_us != 0 && trace.dsp_us == 0 && trace.act_us == 0);
+}
+
+TEST(fakecar, subscriptions_and_motion_telemetry)
+{
+    FakeCar car;
+    CHECK(car.client.command("unsub all") >= 0);
+    CHECK(car.client.command("fwd20") >= 0);
+    CHECK(!car.wait_for("[MOV]", 300));
+    CHECK(car.client.command("sub motion") >= 0);
+    CHECK(car.client.command("go s20 t90 x") >= 0);
+    CHECK(car.wait_for("[MOV]start"));
+    CHECK(car.wait_for("[MOV]idle"));
+}
+
+TEST(fakecar, one_read_is_one_command)
+{
+    FakeCar car;
+    CHECK(car.client.command("unsub all") >= 0);
+    int acks = 0;
+    car.client.on_ack([&](const std::string &, int64_t) { acks++; });
+    // two commands in one write get one ack, the second is part of the first's text
+    CHECK(car.client.send("sub motion\nsub heading"));
+    for (int i = 0; i < 10; i++)
+        car.client.poll(20);
+    CHECK(acks == 1);
+    // a line ending is kept and ends the last topic name like a space
+    CHECK(car.client.command("sub motion\r\n") >= 0);
+    CHECK(car.client.command("fwd20") >= 0);
+    CHECK(car.wait_for("[MOV]start"));
+}
+
+TEST(fakecar, go_with_line_ending)
+{
+    FakeCar car;
+    CHECK(car.client.command("unsub all") >= 0);
+    CHECK(car.client.command("sub motion") >= 0);
+    // the last step is followed by the line ending, "x" must still be queued
+    CHECK(car.client.command("go s20 w50 x\r\n") >= 0);
+    CHECK(car.wait_for("[MOV]idle"));
+    CHECK(car.seen("[MOV]start id:3"));
+    car.lines.clear();
+    // a negative arc is rejected and ends the route there
+    CHECK(car.client.command("go a-20,30 s20\n") >= 0);
+    CHECK(!car.wait_for("[MOV]start", 300));
+}
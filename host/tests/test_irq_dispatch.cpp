@@ -0,0 +1,200 @@
+// The GPIO IRQ dispatcher against a bank of fake pins: the raw handler serves
+// the pins with pending edges in priority order, equal priorities in the order
+// they were added, acknowledges each pin's edges before calling its handler,
+// and counts each run in irq_time with its duration and the time it waited
+// behind the handlers before it.
+#include <vector>
+
+#include "check.h"
+#include "sdk.h"
+
+extern "C" {
+#include "hardware/gpio.h"
+#include "irq_dispatch.h"
+#include "irq_time.h"
+}
+
+namespace {
+
+constexpr uint32_t EDGES = GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL;
+
+// a table like taskmanager.c's, added out of order
+struct Pin {
+    uint gpio;
+    irq_source_t source;
+    uint8_t priority;
+    uint32_t run_us; // how long its handler takes
+} const PINS[] = {
+    {26, IRQ_SOURCE_BARCODE, 3, 40},
+    {15, IRQ_SOURCE_ECHO, 2, 3},
+    {8, IRQ_SOURCE_IR_LEFT, 1, 5},
+    {2, IRQ_SOURCE_LEFT_ENCODER, 0, 2},
+    {9, IRQ_SOURCE_IR_RIGHT, 1, 5},
+    {3, IRQ_SOURCE_RIGHT_ENCODER, 0, 2},
+};
+const uint SERVED_ORDER[] = {2, 3, 8, 9, 15, 26};
+
+uint32_t pending[NUM_BANK0_GPIOS];
+uint32_t enabled[NUM_BANK0_GPIOS];
+uint32_t raw_mask = 0;
+irq_handler_t raw_handler = nullptr;
+
+struct Call {
+    uint gpio;
+    uint32_t events;
+    uint32_t pending; // the pin's edges left when it ran
+};
+std::vector<Call> calls;
+uint raise_during = NUM_BANK0_GPIOS; // a pin that gets an edge while a handler runs
+
+const Pin &pin(uint gpio)
+{
+    for (const Pin &p : PINS)
+        if (p.gpio == gpio)
+            return p;
+    return PINS[0];
+}
+
+void handler(uint gpio, uint32_t events)
+{
+    calls.push_back({gpio, events, pending[gpio]});
+    if (raise_during < NUM_BANK0_GPIOS)
+        pending[raise_during] |= GPIO_IRQ_EDGE_RISE;
+    sdk::advance_us(pin(gpio).run_us);
+}
+
+void start()
+{
+    static bool started = false;
+    if (started)
+        return;
+    for (const Pin &p : PINS)
+        irq_dispatch_add(p.gpio, EDGES, p.source, p.priority, handler);
+    irq_dispatch_start();
+    started = true;
+}
+
+// one IO_IRQ_BANK0 interrupt
+void interrupt()
+{
+    calls.clear();
+    raw_handler();
+}
+
+void clear_irq_time()
+{
+    for (irq_time_t volatile &t : irq_time) {
+        t.count = 0;
+        t.total_us = 0;
+        t.max_us = 0;
+        t.max_latency_us = 0;
+    }
+}
+
+} // namespace
+
+// hardware/gpio.h, as sim/hal.c has them
+extern "C" {
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool on)
+{
+    enabled[gpio] = on ? enabled[gpio] | event_mask : enabled[gpio] & ~event_mask;
+}
+
+void gpio_add_raw_irq_handler_masked(uint32_t gpio_mask, irq_handler_t handler)
+{
+    raw_handler = handler;
+    raw_mask |= gpio_mask;
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio)
+{
+    return pending[gpio];
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events)
+{
+    pending[gpio] &= ~events;
+}
+
+} // extern "C"
+
+TEST(irq_dispatch, start_enables_the_pins)
+{
+    start();
+    CHECK(raw_handler != nullptr);
+    uint32_t mask = 0;
+    for (const Pin &p : PINS) {
+        mask |= 1u << p.gpio;
+        CHECK(enabled[p.gpio] == EDGES);
+    }
+    CHECK(raw_mask == mask);
+}
+
+TEST(irq_dispatch, served_in_priority_order)
+{
+    start();
+    clear_irq_time();
+    for (const Pin &p : PINS)
+        pending[p.gpio] = p.gpio == 26 ? uint32_t{GPIO_IRQ_EDGE_FALL} : EDGES;
+    interrupt();
+    CHECK(calls.size() == 6);
+    for (size_t i = 0; i < calls.size(); i++) {
+        CHECK(calls[i].gpio == SERVED_ORDER[i]);
+        CHECK(calls[i].events == (calls[i].gpio == 26 ? uint32_t{GPIO_IRQ_EDGE_FALL} : EDGES));
+        CHECK(calls[i].pending == 0); // acknowledged before the handler
+    }
+    for (const Pin &p : PINS)
+        CHECK(irq_time[p.source].count == 1);
+}
+
+TEST(irq_dispatch, only_pending_pins)
+{
+    start();
+    clear_irq_time();
+    pending[15] = GPIO_IRQ_EDGE_RISE;
+    pending[3] = GPIO_IRQ_EDGE_FALL;
+    interrupt();
+    CHECK(calls.size() == 2);
+    CHECK(calls[0].gpio == 3 && calls[0].events == GPIO_IRQ_EDGE_FALL);
+    CHECK(calls[1].gpio == 15 && calls[1].events == GPIO_IRQ_EDGE_RISE);
+    CHECK(irq_time[IRQ_SOURCE_RIGHT_ENCODER].count == 1 && irq_time[IRQ_SOURCE_ECHO].count == 1);
+    CHECK(irq_time[IRQ_SOURCE_LEFT_ENCODER].count == 0 && irq_time[IRQ_SOURCE_BARCODE].count == 0);
+    interrupt(); // nothing pending
+    CHECK(calls.empty());
+}
+
+TEST(irq_dispatch, latency_is_the_wait_behind_earlier_handlers)
+{
+    start();
+    clear_irq_time();
+    for (const Pin &p : PINS)
+        pending[p.gpio] = GPIO_IRQ_EDGE_RISE;
+    interrupt();
+    uint32_t waited_us = 0;
+    for (uint gpio : SERVED_ORDER) {
+        const Pin &p = pin(gpio);
+        CHECK(irq_time[p.source].max_us == p.run_us);
+        CHECK(irq_time[p.source].total_us == p.run_us);
+        CHECK(irq_time[p.source].max_latency_us == waited_us);
+        waited_us += p.run_us;
+    }
+    // the barcode handler waited for all the others, 17 us
+    CHECK(irq_time[IRQ_SOURCE_BARCODE].max_latency_us == 17);
+}
+
+// the pass does not go back, a pin with a new edge is left for the next interrupt
+TEST(irq_dispatch, edges_during_a_pass_stay_pending)
+{
+    start();
+    pending[2] = GPIO_IRQ_EDGE_RISE;
+    pending[26] = GPIO_IRQ_EDGE_RISE;
+    raise_during = 2; // the encoder again, while the handlers run
+    interrupt();
+    raise_during = NUM_BANK0_GPIOS;
+    CHECK(calls.size() == 2);
+    CHECK(pending[2] == GPIO_IRQ_EDGE_RISE && pending[26] == 0);
+    interrupt();
+    CHECK(calls.size() == 1 && calls[0].gpio == 2);
+    CHECK(pending[2] == 0);
+}
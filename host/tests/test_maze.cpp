@@ -0,0 +1,240 @@
+// The maze map and planner: BFS paths on open, walled and closed grids and
+// when exploring, the primitives a path turns into, what a range reading
+// marks along its beam, and the rows a client is sent since a revision.
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "check.h"
+
+extern "C" {
+#include "maze.h"
+}
+
+namespace {
+
+constexpr uint16_t CELL_CM = 20;
+
+// the cell a plan ends in, walked from the car's cell; false if it leaves the grid or crosses an occupied cell
+bool walk(const maze_t &maze, const maze_plan_t &plan, uint8_t *x, uint8_t *y)
+{
+    static const int step_x[4] = {0, 1, 0, -1};
+    static const int step_y[4] = {1, 0, -1, 0};
+    if (!maze_cell(&maze, x, y))
+        return false;
+    int cx = *x, cy = *y;
+    for (uint16_t i = 0; i < plan.length; i++) {
+        cx += step_x[plan.path[i]];
+        cy += step_y[plan.path[i]];
+        if (cx < 0 || cy < 0 || cx >= maze.width || cy >= maze.height || maze_is_set(maze.occupied, cx, cy))
+            return false;
+    }
+    *x = cx;
+    *y = cy;
+    return true;
+}
+
+void wall(maze_t &maze, uint8_t y, uint16_t columns)
+{
+    maze.known[y] |= columns;
+    maze.occupied[y] |= columns;
+}
+
+int rows_in(const char *text)
+{
+    int rows = 0;
+    for (const char *p = text; (p = std::strstr(p, "[MAP]row ")); p++)
+        rows++;
+    return rows;
+}
+
+} // namespace
+
+TEST(maze, plan_open_grid)
+{
+    maze_t maze = {};
+    maze_plan_t plan;
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    CHECK(maze_plan(&maze, 3, 3, &plan));
+    CHECK(plan.length == 6);
+    uint8_t x, y;
+    CHECK(walk(maze, plan, &x, &y) && x == 3 && y == 3);
+
+    // already there
+    CHECK(maze_plan(&maze, 0, 0, &plan));
+    CHECK(plan.length == 0);
+}
+
+TEST(maze, plan_around_a_wall)
+{
+    maze_t maze = {};
+    maze_plan_t plan;
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    wall(maze, 1, 0x7); // x 0..2, the gap is at x 3
+    CHECK(maze_plan(&maze, 0, 2, &plan));
+    CHECK(plan.length == 8); // 3 east, 2 north, 3 west
+    uint8_t x, y;
+    CHECK(walk(maze, plan, &x, &y) && x == 0 && y == 2);
+}
+
+TEST(maze, plan_unreachable)
+{
+    maze_t maze = {};
+    maze_plan_t plan;
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    wall(maze, 1, 0xf);
+    CHECK(!maze_plan(&maze, 0, 3, &plan));
+    CHECK(plan.length == 0);
+    CHECK(plan.expanded == 4); // the row the car is in
+
+    // exploring with nothing unknown left on its side
+    for (int y = 0; y < 4; y++)
+        maze.known[y] = 0xf;
+    CHECK(!maze_plan(&maze, MAZE_NO_GOAL, 0, &plan));
+
+    // off the grid
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    maze.x_cm = -1;
+    CHECK(!maze_plan(&maze, 1, 1, &plan));
+}
+
+TEST(maze, explore_finds_the_nearest_unknown)
+{
+    maze_t maze = {};
+    maze_plan_t plan;
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    for (int y = 0; y < 4; y++)
+        maze.known[y] = 0xf;
+    maze.known[3] &= ~(1u << 3); // the far corner
+    maze.known[0] &= ~(1u << 2); // and two cells east
+    CHECK(maze_plan(&maze, MAZE_NO_GOAL, 0, &plan));
+    uint8_t x, y;
+    CHECK(walk(maze, plan, &x, &y) && x == 2 && y == 0);
+}
+
+TEST(maze, primitives_turn_signs)
+{
+    maze_t maze = {};
+    maze_plan_t plan;
+    motion_primitive_t out[8];
+    const float codes_per_cm = 2;
+    maze_reset(&maze, 4, 4, CELL_CM, 1, 1, 0);
+    plan.length = 4;
+    const uint8_t path[] = {MAZE_EAST, MAZE_EAST, MAZE_SOUTH, MAZE_NORTH};
+    std::memcpy(plan.path, path, sizeof(path));
+
+    // facing north: right, two cells, right, a cell, about, a cell
+    CHECK(maze_primitives(&maze, &plan, 0, codes_per_cm, out, 8) == 6);
+    CHECK(out[0].type == MOTION_TURN && out[0].value == 90);
+    CHECK(out[1].type == MOTION_STRAIGHT && out[1].value == 2 * CELL_CM * codes_per_cm);
+    CHECK(out[2].type == MOTION_TURN && out[2].value == 90);
+    CHECK(out[3].type == MOTION_STRAIGHT && out[3].value == CELL_CM * codes_per_cm);
+    CHECK(out[4].type == MOTION_TURN && out[4].value == 180);
+    CHECK(out[5].type == MOTION_STRAIGHT);
+
+    // facing west, the first turn is about; north of the grid is the compass' 100 degrees
+    maze_reset(&maze, 4, 4, CELL_CM, 1, 1, 100);
+    CHECK(maze_primitives(&maze, &plan, 100 + 270, codes_per_cm, out, 8) == 6);
+    CHECK(out[0].type == MOTION_TURN && out[0].value == 180);
+    // facing east within 45 degrees needs no turn
+    CHECK(maze_primitives(&maze, &plan, 100 + 120, codes_per_cm, out, 8) == 5);
+    CHECK(out[0].type == MOTION_STRAIGHT);
+    // a path towards the west from facing north is a left turn
+    plan.path[0] = plan.path[1] = MAZE_WEST;
+    CHECK(maze_primitives(&maze, &plan, 100, codes_per_cm, out, 8) >= 1);
+    CHECK(out[0].type == MOTION_TURN && out[0].value == -90);
+
+    // max leaves out a step that does not fit with its turn
+    CHECK(maze_primitives(&maze, &plan, 100, codes_per_cm, out, 3) == 2);
+}
+
+TEST(maze, primitives_first_run_offset)
+{
+    maze_t maze = {};
+    maze_plan_t plan;
+    motion_primitive_t out[4];
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    maze_odometry(&maze, 5, 0); // 5 cm north of the centre of cell 0,0
+    plan.length = 3;
+    const uint8_t path[] = {MAZE_NORTH, MAZE_NORTH, MAZE_EAST};
+    std::memcpy(plan.path, path, sizeof(path));
+    CHECK(maze_primitives(&maze, &plan, 0, 1, out, 4) == 3);
+    CHECK(out[0].type == MOTION_STRAIGHT && out[0].value == 2 * CELL_CM - 5);
+    // later runs go centre to centre, the offset across them does not count
+    CHECK(out[2].type == MOTION_STRAIGHT && out[2].value == CELL_CM);
+
+    // an offset across the first run does not shorten it
+    plan.path[0] = plan.path[1] = MAZE_EAST;
+    plan.length = 2;
+    CHECK(maze_primitives(&maze, &plan, 90, 1, out, 4) == 1);
+    CHECK(out[0].value == 2 * CELL_CM);
+}
+
+TEST(maze, range_clears_the_beam)
+{
+    maze_t maze = {};
+    maze_reset(&maze, 8, 8, CELL_CM, 0, 0, 0);
+    // from 10 cm up the first column an echo at 70 cm is in cell 0,4
+    maze_range(&maze, 70, 200, 0);
+    for (uint8_t y = 0; y < 4; y++)
+        CHECK(maze_is_set(maze.known, 0, y) && !maze_is_set(maze.occupied, 0, y));
+    CHECK(maze_is_set(maze.known, 0, 4) && maze_is_set(maze.occupied, 0, 4));
+    CHECK(!maze_is_set(maze.known, 0, 5));
+    CHECK(maze.known[0] == 1 && maze.known[5] == 0); // nothing beside the beam
+
+    // nothing within range clears the whole beam, the earlier echo was noise
+    maze_range(&maze, 200, 200, 0);
+    for (uint8_t y = 0; y < 8; y++)
+        CHECK(maze_is_set(maze.known, 0, y) && !maze_is_set(maze.occupied, 0, y));
+
+    // east along the bottom row
+    maze_range(&maze, 30, 200, 90);
+    CHECK(maze_is_set(maze.known, 1, 0) && !maze_is_set(maze.occupied, 1, 0));
+    CHECK(maze_is_set(maze.occupied, 2, 0));
+
+    // driving into an occupied cell clears it
+    maze_odometry(&maze, 40, 90);
+    uint8_t x, y;
+    CHECK(maze_cell(&maze, &x, &y) && x == 2 && y == 0);
+    CHECK(!maze_is_set(maze.occupied, 2, 0) && maze_is_set(maze.visited, 2, 0));
+}
+
+TEST(maze, format_rows_since_a_revision)
+{
+    maze_t maze = {};
+    char text[512];
+    uint16_t before = maze.revision;
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+
+    // after a reset every row is new to a client that had the map before it
+    maze_format_rows(&maze, before, text, sizeof(text));
+    CHECK(rows_in(text) == 4);
+    uint16_t rev = maze.revision;
+    maze_format_rows(&maze, rev, text, sizeof(text));
+    CHECK(rows_in(text) == 0);
+    char header[64];
+    std::snprintf(header, sizeof(header), "[MAP]rev:%u\tsince:%u\tsize:4x4\tcell:20\tat:10,10\n", rev, rev);
+    CHECK(std::string(text) == header);
+
+    // an echo two cells north changes rows 1 and 2 only
+    maze_range(&maze, 45, 200, 0);
+    CHECK(maze.revision > rev);
+    maze_format_rows(&maze, rev, text, sizeof(text));
+    CHECK(rows_in(text) == 2);
+    CHECK(std::strstr(text, "[MAP]row 1 0001 0000 0000\n"));
+    CHECK(std::strstr(text, "[MAP]row 2 0001 0001 0000\n"));
+
+    // the same reading again changes nothing
+    rev = maze.revision;
+    maze_range(&maze, 45, 200, 0);
+    CHECK(maze.revision == rev);
+
+    // a reset keeps revisions going up, so a client's since stays meaningful
+    maze_reset(&maze, 4, 4, CELL_CM, 0, 0, 0);
+    CHECK((int16_t)(maze.revision - rev) > 0);
+    maze_format_rows(&maze, rev, text, sizeof(text));
+    CHECK(rows_in(text) == 4);
+
+    // a small buffer is cut, never overrun
+    CHECK(maze_format_rows(&maze, rev, text, 40) == 39);
+}
@@ -0,0 +1,178 @@
+// The mission interpreter: compile errors, control flow, the per-tick bound and
+// scripts that run their moves to the end on the wheel model.
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "car.h"
+#include "check.h"
+
+extern "C" {
+#include "mission.h"
+}
+
+namespace {
+
+// compiles the lines into program, returns the error or nullptr
+const char *compile(const std::vector<const char *> &lines, mission_program_t *program, uint16_t *line = nullptr)
+{
+    static mission_compiler_t compiler;
+    mission_compile_begin(&compiler);
+    for (const char *l : lines)
+        if (!mission_compile_line(&compiler, l))
+            break;
+    mission_compile_end(&compiler);
+    *program = compiler.program;
+    if (line)
+        *line = compiler.line;
+    return compiler.error;
+}
+
+struct Run {
+    Car car;
+    mission_t mission;
+    mission_sensors_t sensors{1000, false, false, ""};
+    std::vector<std::string> said;
+
+    bool load(const std::vector<const char *> &lines)
+    {
+        mission_program_t program;
+        if (compile(lines, &program))
+            return false;
+        mission_load(&mission, &program);
+        return true;
+    }
+
+    // one control period as move_task runs it, true once the script is done
+    bool tick()
+    {
+        uint8_t events = mission_step(&mission, &car.engine, &sensors);
+        if (events & MISSION_EVENT_SAY)
+            said.push_back(mission.say_text);
+        car.step();
+        return events & MISSION_EVENT_DONE;
+    }
+
+    // ticks until the script is done, -1 if it never is
+    int run(int limit = MAX_STEPS)
+    {
+        for (int n = 1; n <= limit; n++)
+            if (tick())
+                return n;
+        return -1;
+    }
+};
+
+} // namespace
+
+TEST(mission, compile_errors)
+{
+    mission_program_t program;
+    uint16_t line;
+    CHECK(compile({"fwd 10", "else"}, &program, &line) != nullptr);
+    CHECK(line == 2);
+    CHECK(std::strcmp(compile({"repeat 2", "fwd 10"}, &program), "missing end") == 0);
+    CHECK(std::strcmp(compile({"end"}, &program), "end without block") == 0);
+    CHECK(std::strcmp(compile({"jump 3"}, &program), "unknown statement") == 0);
+    CHECK(std::strcmp(compile({"fwd x"}, &program), "number expected") == 0);
+    CHECK(std::strcmp(compile({"fwd 40000"}, &program), "number out of range") == 0);
+    CHECK(std::strcmp(compile({"arc -80 45"}, &program), "arc distance must not be negative") == 0);
+    CHECK(std::strcmp(compile({"if obstacle = 3", "end"}, &program), "obstacle needs < or >") == 0);
+    CHECK(std::strcmp(compile({"repeat 9", "repeat 9", "repeat 9", "repeat 9", "repeat 9", "repeat 9", "repeat 9",
+                               "repeat 9", "repeat 9"},
+                              &program),
+                      "blocks nested too deep") == 0);
+    std::vector<const char *> long_script(MISSION_CODE_SIZE / 7 + 1, "fwd 10");
+    CHECK(std::strcmp(compile(long_script, &program), "program too long") == 0);
+    CHECK(compile({"# comment", "", "fwd 10", "sync"}, &program) == nullptr);
+}
+
+TEST(mission, moves_run_to_the_end)
+{
+    Run run;
+    CHECK(run.load({"fwd 60", "back 30", "back 30", "fwd 20", "sync", "say done"}));
+    CHECK(run.run() > 0);
+    CHECK((run.said == std::vector<std::string>{"done"}));
+    CHECK(!run.car.engine.active);
+    CHECK(std::fabs(run.car.position() - 20) <= 3);
+}
+
+TEST(mission, sync_waits_for_the_moves)
+{
+    Run run;
+    CHECK(run.load({"fwd 50", "sync", "say there"}));
+    for (int n = 0; n < 20; n++)
+        run.tick();
+    CHECK(run.said.empty());
+    CHECK(run.car.engine.active);
+    CHECK(run.run() > 0);
+    CHECK((run.said == std::vector<std::string>{"there"}));
+}
+
+TEST(mission, conditions_and_blocks)
+{
+    Run run;
+    CHECK(run.load({"repeat 3", "if obstacle < 20", "say near", "else", "say far", "end", "end",
+                    "while not barcode A1", "wait 10", "end", "say read"}));
+    run.sensors.obstacle_cm = 10;
+    run.tick();
+    run.sensors.obstacle_cm = 50;
+    run.tick();
+    run.tick();
+    CHECK((run.said == std::vector<std::string>{"near", "far", "far"}));
+    for (int n = 0; n < 50; n++)
+        CHECK(!run.tick());
+    CHECK(run.said.size() == 3);
+    run.sensors.barcode = "A1";
+    CHECK(run.run(100) > 0);
+    CHECK(run.said.back() == "read");
+}
+
+TEST(mission, until_line)
+{
+    Run run;
+    CHECK(run.load({"until line right", "say line"}));
+    run.sensors.left_ir_black = true;
+    for (int n = 0; n < 10; n++)
+        CHECK(!run.tick());
+    run.sensors.right_ir_black = true;
+    CHECK(run.run(2) > 0);
+    CHECK((run.said == std::vector<std::string>{"line"}));
+}
+
+TEST(mission, tick_is_bounded)
+{
+    Run run;
+    CHECK(run.load({"loop", "end"}));
+    // an empty loop spins for MISSION_STEPS_PER_TICK instructions a tick and stays running
+    CHECK(run.run(100) < 0);
+    CHECK(run.mission.running);
+    CHECK(run.mission.ticks == 100);
+    mission_stop(&run.mission);
+    CHECK(!run.tick());
+    CHECK(run.mission.ticks == 100);
+}
+
+TEST(mission, full_queue_retries)
+{
+    Run run;
+    CHECK(run.load({"repeat 30", "fwd 5", "end", "sync", "say done"}));
+    run.tick();
+    CHECK(motion_queued(&run.car.engine) <= MOTION_QUEUE_SIZE);
+    CHECK(run.run() > 0);
+    CHECK(std::fabs(run.car.position() - 150) <= 3);
+}
+
+TEST(mission, stop_flushes)
+{
+    Run run;
+    CHECK(run.load({"fwd 500", "fwd 500", "until obstacle < 30", "stop", "sync", "say stopped"}));
+    for (int n = 0; n < 100; n++)
+        run.tick();
+    CHECK(run.car.engine.active);
+    run.sensors.obstacle_cm = 20; // above the engine's own obstacle stop
+    CHECK(run.run() > 0);
+    CHECK((run.said == std::vector<std::string>{"stopped"}));
+    CHECK(motion_queued(&run.car.engine) == 0);
+    CHECK(run.car.position() > 50 && run.car.position() < 500);
+}
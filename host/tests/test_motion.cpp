@@ -0,0 +1,197 @@
+// The motion engine against a wheel model: primitives settle, blend and stop
+// on a flush, queued chains in either direction run to their end, turns and
+// waits settle between moves while arcs blend, and an obstacle ends a route.
+#include <cmath>
+#include <vector>
+
+#include "car.h"
+#include "check.h"
+
+namespace {
+
+bool on_target(const Car &car, float target)
+{
+    return std::fabs(car.position() - target) <= 3;
+}
+
+bool on_bearing(const Car &car, float target)
+{
+    return std::fabs(motion_bearing_error(car.wheels.bearing, target)) <= 5;
+}
+
+} // namespace
+
+TEST(motion, straight_settles)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 100);
+    std::vector<uint16_t> done;
+    CHECK(car.run(&done) > 0);
+    CHECK(done.size() == 1);
+    CHECK(on_target(car, 100));
+    CHECK(!car.engine.active);
+}
+
+TEST(motion, reverse_settles)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, -50);
+    CHECK(car.run() > 0);
+    CHECK(on_target(car, -50));
+}
+
+TEST(motion, forward_chain_blends)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 50);
+    car.push(MOTION_STRAIGHT, 50);
+    car.push(MOTION_STRAIGHT, 50);
+    std::vector<uint16_t> done;
+    uint16_t first_stop = 0;
+    CHECK(car.run(&done, &first_stop) > 0);
+    CHECK((done == std::vector<uint16_t>{1, 2, 3}));
+    CHECK(first_stop == 3); // handed over at speed
+    CHECK(on_target(car, 150));
+}
+
+TEST(motion, reverse_chain_blends)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, -50);
+    car.push(MOTION_STRAIGHT, -50);
+    std::vector<uint16_t> done;
+    uint16_t first_stop = 0;
+    CHECK(car.run(&done, &first_stop) > 0);
+    CHECK((done == std::vector<uint16_t>{1, 2}));
+    CHECK(first_stop == 2);
+    CHECK(on_target(car, -100));
+}
+
+TEST(motion, forward_then_reverse)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 80);
+    car.push(MOTION_STRAIGHT, -50);
+    CHECK(car.run() > 0);
+    CHECK(on_target(car, 30));
+}
+
+TEST(motion, reverse_then_forward)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, -50);
+    car.push(MOTION_STRAIGHT, -30);
+    car.push(MOTION_STRAIGHT, 120);
+    std::vector<uint16_t> done;
+    CHECK(car.run(&done) > 0);
+    CHECK(done.size() == 3);
+    CHECK(on_target(car, 40));
+}
+
+TEST(motion, flush_stops)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 500);
+    car.push(MOTION_STRAIGHT, 500);
+    for (int n = 0; n < 100; n++)
+        car.step();
+    CHECK(car.out.drive == MOTION_DRIVE_FORWARD);
+    motion_flush(&car.engine);
+    car.step();
+    CHECK(car.out.drive == MOTION_DRIVE_STOP);
+    CHECK(car.events & MOTION_EVENT_IDLE);
+    CHECK(motion_queued(&car.engine) == 0);
+    CHECK(!car.engine.active);
+}
+
+TEST(motion, turn_settles)
+{
+    Car car;
+    car.push(MOTION_TURN, 90);
+    car.push(MOTION_TURN, -45);
+    std::vector<uint16_t> done;
+    CHECK(car.run(&done) > 0);
+    CHECK((done == std::vector<uint16_t>{1, 2}));
+    CHECK(on_bearing(car, 45));
+    CHECK(on_target(car, 0)); // rotating in place is no travel
+}
+
+TEST(motion, turn_between_straights_stops)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 50);
+    car.push(MOTION_TURN, 90);
+    car.push(MOTION_STRAIGHT, 50);
+    std::vector<uint16_t> done;
+    uint16_t first_stop = 0;
+    CHECK(car.run(&done, &first_stop) > 0);
+    CHECK((done == std::vector<uint16_t>{1, 2, 3}));
+    CHECK(first_stop == 1); // the straight settles before the turn
+    CHECK(on_bearing(car, 90));
+    CHECK(on_target(car, 100));
+}
+
+TEST(motion, arc_blends_with_straights)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 50);
+    car.push(MOTION_ARC, 150, 30);
+    car.push(MOTION_STRAIGHT, 50);
+    std::vector<uint16_t> done;
+    uint16_t first_stop = 0;
+    CHECK(car.run(&done, &first_stop) > 0);
+    CHECK((done == std::vector<uint16_t>{1, 2, 3}));
+    CHECK(first_stop == 3); // handed over at speed, in and out of the arc
+    CHECK(car.engine.target_bearing == 30);
+    CHECK(on_bearing(car, 30));
+    CHECK(on_target(car, 250));
+}
+
+TEST(motion, wait_holds_between_straights)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 50);
+    car.push(MOTION_WAIT, 500);
+    car.push(MOTION_STRAIGHT, 50);
+    std::vector<uint16_t> done;
+    uint16_t first_stop = 0;
+    int waited = 0;
+    bool moved_while_waiting = false;
+    for (int n = 0; n < MAX_STEPS && !(car.events & MOTION_EVENT_IDLE); n++) {
+        car.step();
+        if (car.events & MOTION_EVENT_DONE)
+            done.push_back(car.engine.done_id);
+        if (car.engine.active && car.engine.current.type == MOTION_WAIT) {
+            waited++;
+            moved_while_waiting = moved_while_waiting || car.out.drive != MOTION_DRIVE_STOP;
+        }
+        if (car.out.drive == MOTION_DRIVE_STOP && done.empty() && car.position() > 0 && !first_stop)
+            first_stop = car.engine.current.id;
+    }
+    CHECK((done == std::vector<uint16_t>{1, 2, 3}));
+    CHECK(first_stop == 1);
+    CHECK(waited >= 49 && waited <= 51);
+    CHECK(!moved_while_waiting);
+    CHECK(on_target(car, 100));
+}
+
+TEST(motion, obstacle_ends_the_route)
+{
+    Car car;
+    car.push(MOTION_STRAIGHT, 500);
+    car.push(MOTION_TURN, 90);
+    for (int n = 0; n < 50; n++)
+        car.step();
+    CHECK(car.out.drive == MOTION_DRIVE_FORWARD);
+    car.wheels.obstacle_cm = car.engine.obstacle_cm - 1;
+    car.step();
+    CHECK(car.events & MOTION_EVENT_OBSTACLE);
+    CHECK(car.out.drive == MOTION_DRIVE_STOP);
+    CHECK(!car.engine.active && motion_queued(&car.engine) == 0);
+
+    // reversing away from it is still allowed
+    car.push(MOTION_STRAIGHT, -30);
+    float from = car.position();
+    CHECK(car.run() > 0);
+    CHECK(on_target(car, from - 30));
+}
@@ -0,0 +1,231 @@
+// The control recorder: a run of the control code with routes, a mission,
+// barcodes, echoes on the map and a gain change, long enough for the ring to
+// drop its oldest records, replays bit-exactly from the dump as t85_replay
+// does it, from the first keyframe or from every one; other gains diverge.
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "car.h"
+#include "check.h"
+
+extern "C" {
+#include "control.h"
+#include "recorder.h"
+}
+
+// control.h hooks, nothing to fence or time here
+extern "C" void control_map_write_begin(void) {}
+extern "C" void control_map_write_end(void) {}
+extern "C" uint32_t control_time_us(void) { return 0; }
+
+namespace {
+
+constexpr int RUN_STEPS = 4000; // 40 s, the 32 kB ring holds the last 9 or so
+constexpr int FIRST_COMMAND = 3400; // the moves, the gain change and a mission fall in the ring
+constexpr uint32_t PERIOD_US = 10000;
+constexpr motion_gains_t RETUNED = {0.12f, 0.01f, 0, 0.2f, 0.05f, 0.5f, 0.2f};
+
+struct Recording {
+    std::vector<uint8_t> dump;
+    std::map<uint32_t, control_output_t> outputs; // by period time
+    control_t final;
+    uint32_t dropped;
+};
+
+bool compile(const char *script, mission_program_t *program)
+{
+    static mission_compiler_t compiler;
+    mission_compile_begin(&compiler);
+    std::istringstream lines(script);
+    for (std::string line; std::getline(lines, line);)
+        if (!mission_compile_line(&compiler, line.c_str()))
+            return false;
+    if (!mission_compile_end(&compiler))
+        return false;
+    *program = compiler.program;
+    return true;
+}
+
+void move(control_t *control, recorder_t *recorder, bool flush, bool append, uint8_t type, int32_t value)
+{
+    motion_primitive_t primitive{};
+    primitive.type = type;
+    primitive.value = value;
+    control_move(control, flush, append, &primitive);
+    recorder_move(recorder, flush, append, &primitive);
+}
+
+// move_task's period loop against the wheel model, with the recorder on
+const Recording &record()
+{
+    static Recording rec;
+    if (!rec.dump.empty())
+        return rec;
+    static control_t control;
+    static recorder_t recorder;
+    static mission_program_t program;
+    control_init(&control, MAX_SPEED, STEP_S, 0.5f / STEP_S, 2);
+    recorder_clear(&recorder);
+    Wheels wheels;
+    motion_gains_t gains = GAINS;
+    control_input_t in{};
+    for (int n = 0; n < RUN_STEPS; n++) {
+        uint32_t time_us = 1000000 + n * PERIOD_US;
+        recorder_begin(&recorder, &control, time_us);
+        if (n == 10) {
+            map_cmd_t reset = {MAP_RESET, {6, 6, 20, 0, 0}};
+            control_map(&control, &reset);
+            recorder_map(&recorder, &reset);
+        }
+        if (n == 20 || n == 3600) {
+            if (!compile("fwd 80\nback 40\nuntil barcode A1\nrepeat 3\nfwd 20\nend\nback 30\nsay done", &program))
+                return rec;
+            control_mission(&control, &program, in.barcode_count);
+            recorder_mission(&recorder, &program, in.barcode_count);
+        }
+        if (n == 900 || n == 3750) {
+            in.barcode_count++;
+            std::strcpy(in.barcode, "A1");
+        }
+        if (n == FIRST_COMMAND) {
+            move(&control, &recorder, false, false, MOTION_STRAIGHT, 100);
+            move(&control, &recorder, false, true, MOTION_STRAIGHT, 100);
+        }
+        if (n == FIRST_COMMAND + 50)
+            move(&control, &recorder, true, false, MOTION_STRAIGHT, -50);
+        if (n == FIRST_COMMAND + 20)
+            gains = RETUNED;
+
+        control.engine.gains = gains;
+        in.motion = wheels.input();
+        in.motion.left_ir_black = n % 97 < 3;
+        in.motion.line_valid = n % 300 < 150;
+        in.motion.line_offset = (n % 41 - 20) / 25.0f;
+        if (n % 6 == 0) {
+            in.echo_valid = true;
+            in.echo_cm = 40 + n % 70;
+            in.echo_us = time_us - 2000;
+        }
+        control_output_t out;
+        control_step(&control, &in, &out);
+        recorder_step(&recorder, time_us, &control.engine.gains, &in, &out);
+        wheels.drive(out.motion);
+        rec.outputs[time_us] = out;
+    }
+    rec.final = control;
+    rec.dropped = recorder.dropped;
+    rec.dump.resize(recorder_size(&recorder));
+    rec.dump.resize(recorder_read(&recorder, 0, rec.dump.data(), rec.dump.size()));
+    return rec;
+}
+
+bool same(const control_output_t &a, const control_output_t &b)
+{
+    return a.motion.drive == b.motion.drive && a.motion.left_speed == b.motion.left_speed &&
+           a.motion.right_speed == b.motion.right_speed && a.motion_events == b.motion_events &&
+           a.mission_events == b.mission_events && a.map_events == b.map_events;
+}
+
+struct Replay {
+    unsigned steps = 0, diverged = 0, keyframes = 0, mismatched = 0;
+    bool complete = false;
+    control_t control;
+};
+
+// t85_replay's loop; mismatched counts periods whose recorded output is not the run's
+Replay replay(const Recording &rec, bool resync, const motion_gains_t *override)
+{
+    static recorder_reader_t reader;
+    static recorder_entry_t entry;
+    Replay result;
+    bool started = false;
+    motion_gains_t gains{};
+    if (!recorder_reader_init(&reader, rec.dump.data(), rec.dump.size()))
+        return result;
+    while (recorder_next(&reader, &entry)) {
+        switch (entry.type) {
+        case RECORD_KEYFRAME:
+            result.keyframes++;
+            if (!started || resync)
+                result.control = entry.control;
+            gains = entry.gains;
+            started = true;
+            break;
+        case RECORD_GAINS:
+            gains = entry.gains;
+            break;
+        case RECORD_MOVE:
+            control_move(&result.control, entry.move.flush, entry.move.append, &entry.move.primitive);
+            break;
+        case RECORD_MISSION:
+            control_mission(&result.control, &entry.program, entry.barcode_count);
+            break;
+        case RECORD_MAP:
+            control_map(&result.control, &entry.map);
+            break;
+        case RECORD_STEP: {
+            control_output_t out;
+            result.control.engine.gains = override ? *override : gains;
+            control_step(&result.control, &entry.input, &out);
+            auto run = rec.outputs.find(entry.time_us);
+            if (run == rec.outputs.end() || !same(run->second, entry.output))
+                result.mismatched++;
+            if (!same(out, entry.output))
+                result.diverged++;
+            result.steps++;
+            break;
+        }
+        }
+    }
+    result.complete = reader.pos == reader.size;
+    return result;
+}
+
+} // namespace
+
+TEST(recorder, ring_wraps)
+{
+    const Recording &rec = record();
+    CHECK(rec.dropped > 0);
+    CHECK(rec.dump.size() > RECORDER_SIZE - 1024);
+    CHECK(rec.dump.size() <= RECORDER_HEADER_SIZE + RECORDER_SIZE);
+}
+
+TEST(recorder, replay_is_bit_exact)
+{
+    const Recording &rec = record();
+    Replay result = replay(rec, false, nullptr);
+    CHECK(result.complete);
+    CHECK(result.keyframes >= 5);
+    CHECK(result.steps > RUN_STEPS - FIRST_COMMAND && result.steps < RUN_STEPS / 2);
+    CHECK(result.mismatched == 0); // the log holds what the car computed
+    CHECK(result.diverged == 0);
+    // and the replay ends where the run did
+    CHECK(result.control.engine.pos_left == rec.final.engine.pos_left);
+    CHECK(result.control.engine.pos_right == rec.final.engine.pos_right);
+    CHECK(result.control.engine.done_id == rec.final.engine.done_id);
+    CHECK(result.control.mission.pc == rec.final.mission.pc);
+    CHECK(result.control.mapped_echo == rec.final.mapped_echo);
+    CHECK(result.control.maze.revision == rec.final.maze.revision && result.control.maze.revision > 0);
+    CHECK(std::memcmp(result.control.maze.known, rec.final.maze.known, sizeof(rec.final.maze.known)) == 0);
+    CHECK(std::memcmp(result.control.maze.occupied, rec.final.maze.occupied, sizeof(rec.final.maze.occupied)) == 0);
+}
+
+TEST(recorder, replay_from_every_keyframe)
+{
+    Replay result = replay(record(), true, nullptr);
+    CHECK(result.complete);
+    CHECK(result.diverged == 0);
+}
+
+TEST(recorder, other_gains_diverge)
+{
+    motion_gains_t gains = RETUNED;
+    gains.dist_p *= 2;
+    Replay result = replay(record(), false, &gains);
+    CHECK(result.complete);
+    CHECK(result.diverged > 0);
+}
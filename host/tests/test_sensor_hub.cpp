@@ -0,0 +1,108 @@
+// The sensor hub's sequence lock: a writer thread publishing snapshots whose
+// fields all carry the same number against reader threads that check every
+// copy they get is one whole publish, in order. A writer preempted in the
+// middle of a publish is enough for a reader to catch it, so the run finds a
+// broken lock on one core too.
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+extern "C" {
+#include "sensor_hub.h"
+}
+
+namespace {
+
+constexpr uint32_t STRESS_PUBLISHES = 200000;
+constexpr int READERS = 2;
+
+void publish(uint32_t n)
+{
+    sensor_hub_begin();
+    for (int id = 0; id < SENSOR_COUNT; id++)
+        sensor_hub_set((sensor_id_t)id, (float)n, n % 2 == 0, n);
+    sensor_hub_end();
+}
+
+// every reading from the same publish
+bool whole(const sensor_snapshot_t &s)
+{
+    for (const sensor_reading_t &r : s.readings)
+        if (r.timestamp_us != s.readings[0].timestamp_us || r.value != (float)r.timestamp_us || r.valid != (r.timestamp_us % 2 == 0))
+            return false;
+    return true;
+}
+
+} // namespace
+
+TEST(sensor_hub, read_sees_the_last_publish)
+{
+    sensor_snapshot_t before, after;
+    CHECK(sensor_hub_read(&before));
+    publish(42);
+    CHECK(sensor_hub_read(&after));
+    CHECK(after.version == before.version + 1);
+    CHECK(whole(after) && after.readings[SENSOR_HEADING].timestamp_us == 42);
+}
+
+TEST(sensor_hub, fresh)
+{
+    sensor_reading_t reading = {90, 1000, true};
+    CHECK(sensor_hub_fresh(&reading, 1000, 500));
+    CHECK(sensor_hub_fresh(&reading, 1500, 500));
+    CHECK(!sensor_hub_fresh(&reading, 1501, 500));
+    reading.valid = false;
+    CHECK(!sensor_hub_fresh(&reading, 1000, 500));
+    // time_us_32 wraps after 71 minutes, the age does not
+    reading = {90, 0xffffff00u, true};
+    CHECK(sensor_hub_fresh(&reading, 0x100, 0x200));
+    CHECK(!sensor_hub_fresh(&reading, 0x101, 0x200));
+}
+
+TEST(sensor_hub, writer_readers_stress)
+{
+    publish(2); // an even number, so the first copy passes whole()
+    std::atomic<bool> writing{true};
+    std::thread writer([&writing] {
+        for (uint32_t n = 3; n < STRESS_PUBLISHES; n++)
+            publish(n);
+        writing = false;
+    });
+
+    std::atomic<int> torn{0}, backwards{0};
+    std::atomic<uint32_t> copies{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; r++) {
+        readers.emplace_back([&] {
+            uint32_t last_version = 0, last_n = 0;
+            sensor_snapshot_t s;
+            for (;;) {
+                bool done = !writing; // read before the last copy, nothing is published after it
+                if (sensor_hub_read(&s)) {
+                    copies++;
+                    if (!whole(s))
+                        torn++;
+                    if (s.version < last_version || s.readings[0].timestamp_us < last_n)
+                        backwards++;
+                    last_version = s.version;
+                    last_n = s.readings[0].timestamp_us;
+                }
+                if (done)
+                    break;
+                std::this_thread::yield();
+            }
+        });
+    }
+    writer.join();
+    for (std::thread &t : readers)
+        t.join();
+
+    CHECK(torn == 0);
+    CHECK(backwards == 0);
+    CHECK(copies >= READERS);
+    sensor_snapshot_t s;
+    CHECK(sensor_hub_read(&s));
+    CHECK(s.readings[SENSOR_LINE_OFFSET].timestamp_us == STRESS_PUBLISHES - 1);
+}
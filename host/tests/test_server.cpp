@@ -0,0 +1,171 @@
+// The TCP server of wifi.c on an in-memory lwIP: several clients with their
+// own topics, fan-out of broadcasts, a slow client missing messages instead
+// of holding up the rest, and replies that must not reach a client that took
+// over the slot of the one that sent the command.
+#include <string>
+
+#include "check.h"
+#include "fake_lwip.h"
+
+extern "C" {
+#include "wifi.h"
+}
+
+namespace {
+
+// a server with no clients and an empty command buffer, as network_task starts it
+void start()
+{
+    fake_lwip::reset();
+    if (!wifiCmdBuffer)
+        wifiCmdBuffer = xMessageBufferCreate(4 * sizeof(queued_cmd_t));
+    start_server(nullptr);
+}
+
+// what network_task does with the commands the recv callback queued
+void run_commands()
+{
+    queued_cmd_t cmd;
+    size_t len;
+    while ((len = xMessageBufferReceive(wifiCmdBuffer, &cmd, sizeof(cmd) - 1, 0)) > 0)
+        tcp_server_run_queued(&cmd, len);
+}
+
+tcp_pcb *connect_with(const char *subscription)
+{
+    tcp_pcb *pcb = fake_lwip::connect();
+    if (!pcb)
+        return nullptr;
+    fake_lwip::send(pcb, "unsub all");
+    run_commands();
+    fake_lwip::send(pcb, subscription);
+    run_commands();
+    return fake_lwip::received(pcb) == "ack\nack\n" ? pcb : nullptr;
+}
+
+void broadcast(uint8_t topic, const std::string &text)
+{
+    tcp_server_broadcast(myServer, topic, text.data(), text.size());
+}
+
+} // namespace
+
+// the application's commands, taskmanager.c on the car
+extern "C" void tcp_server_command(TCP_CLIENT_T *client, char *cmd, size_t, cmd_trace_t *trace)
+{
+    if (std::string(cmd) == "ping")
+        tcp_server_reply(client, trace->generation, "pong\n");
+    tcp_server_ack(client, trace);
+}
+
+TEST(server, fan_out_by_topic)
+{
+    start();
+    tcp_pcb *motion = connect_with("sub motion");
+    tcp_pcb *heading = connect_with("sub heading calibration");
+    tcp_pcb *all = fake_lwip::connect();
+    CHECK(motion && heading && all);
+
+    broadcast(TOPIC_MOTION, "[P]a\n");
+    broadcast(TOPIC_HEADING, "[TUN]b\n");
+    broadcast(TOPIC_CALIBRATION, "[CAL]c\n");
+    broadcast(TOPIC_STATS, "stats");
+    CHECK(fake_lwip::received(motion) == "[P]a\n");
+    CHECK(fake_lwip::received(heading) == "[TUN]b\n[CAL]c\n");
+    CHECK(fake_lwip::received(all) == "[P]a\n[TUN]b\n[CAL]c\n"); // stats only when asked for
+
+    fake_lwip::send(heading, "unsub calibration");
+    run_commands();
+    CHECK(fake_lwip::received(heading) == "ack\n");
+    broadcast(TOPIC_CALIBRATION, "[CAL]d\n");
+    CHECK(fake_lwip::received(heading).empty());
+    CHECK(fake_lwip::received(all) == "[CAL]d\n");
+}
+
+TEST(server, slow_client_misses_messages)
+{
+    start();
+    tcp_pcb *fast = connect_with("sub motion");
+    tcp_pcb *slow = connect_with("sub motion");
+    CHECK(fast && slow);
+
+    fake_lwip::set_sndbuf(slow, 4);
+    broadcast(TOPIC_MOTION, "[P]one\n");
+    broadcast(TOPIC_MOTION, "[P]two\n");
+    CHECK(fake_lwip::received(fast) == "[P]one\n[P]two\n");
+    CHECK(fake_lwip::received(slow).empty());
+    CHECK(myServer->clients[0].dropped == 0);
+    CHECK(myServer->clients[1].dropped == 2);
+
+    // whole messages only, the client catches up with the next one that fits
+    fake_lwip::set_sndbuf(slow, 1000);
+    broadcast(TOPIC_MOTION, "[P]three\n");
+    CHECK(fake_lwip::received(fast) == "[P]three\n");
+    CHECK(fake_lwip::received(slow) == "[P]three\n");
+}
+
+TEST(server, client_limit_and_reconnect)
+{
+    start();
+    tcp_pcb *clients[MAX_CLIENTS];
+    for (tcp_pcb *&pcb : clients)
+        CHECK((pcb = connect_with("sub barcode")) != nullptr);
+    CHECK(fake_lwip::connect() == nullptr);
+
+    fake_lwip::disconnect(clients[1]);
+    fake_lwip::fail(clients[2]);
+    tcp_pcb *next = fake_lwip::connect();
+    CHECK(next != nullptr);
+    CHECK(myServer->clients[1].pcb == next);
+    CHECK(myServer->clients[1].topics == TOPIC_ALL); // a new client starts with everything
+    CHECK(fake_lwip::connect() != nullptr);
+    broadcast(TOPIC_MOTION, "[P]x\n");
+    CHECK(fake_lwip::received(clients[0]).empty());
+    CHECK(fake_lwip::received(next) == "[P]x\n");
+}
+
+TEST(server, reply_to_the_sender_only)
+{
+    start();
+    tcp_pcb *first = fake_lwip::connect();
+    CHECK(first);
+    fake_lwip::send(first, "ping");
+    run_commands();
+    CHECK(fake_lwip::received(first) == "pong\nack\n");
+
+    // the sender leaves and another client takes its slot before network_task gets to the command
+    fake_lwip::send(first, "#7 ping");
+    fake_lwip::send(first, "unsub all");
+    fake_lwip::disconnect(first);
+    tcp_pcb *second = fake_lwip::connect();
+    CHECK(second && myServer->clients[0].pcb == second);
+    run_commands();
+    CHECK(fake_lwip::received(second).empty());
+    CHECK(myServer->clients[0].topics == TOPIC_ALL);
+
+    // a deferred reply queued for the first client is dropped the same way
+    uint32_t old = myServer->clients[0].generation - 1;
+    CHECK(tcp_server_reply(&myServer->clients[0], old, "ack\n") == ERR_CONN);
+    CHECK(tcp_server_reply(&myServer->clients[0], myServer->clients[0].generation, "ack\n") == ERR_OK);
+    CHECK(fake_lwip::received(second) == "ack\n");
+}
+
+TEST(server, generation_does_not_repeat_after_many_clients)
+{
+    start();
+    tcp_pcb *first = fake_lwip::connect();
+    CHECK(first);
+    uint32_t old = myServer->clients[0].generation;
+    fake_lwip::disconnect(first);
+
+    // as many clients as an 8-bit count has values take the slot in turn
+    tcp_pcb *last = nullptr;
+    for (int i = 0; i < 256; i++) {
+        if (last)
+            fake_lwip::disconnect(last);
+        last = fake_lwip::connect();
+        CHECK(last && myServer->clients[0].pcb == last);
+    }
+    CHECK(tcp_server_reply(&myServer->clients[0], old, "ack\n") == ERR_CONN);
+    CHECK(fake_lwip::received(last).empty());
+}
@@ -0,0 +1,182 @@
+// The lock-free telemetry queue: order and drops within a lane, the slots
+// kept for replies, round robin between lanes, and a stress run with a thread per producer lane against a
+// consumer thread, every message checked for order and torn contents. The
+// stress run only overlaps a copy with its publication on a host with at
+// least as many cores as threads, on one core it checks the counters.
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "sdk.h"
+
+extern "C" {
+#include "telemetry_queue.h"
+}
+
+namespace {
+
+constexpr uint32_t STRESS_MESSAGES = 200000; // per producer
+
+// "<lane> <seq> " and a filler that depends on both, so a torn copy shows
+void format(char *text, size_t size, uint32_t lane, uint32_t seq)
+{
+    int len = std::snprintf(text, size, "%u %u ", lane, seq);
+    int fill = seq % (sizeof(telemetry_msg_t::data) - 1 - len);
+    for (int i = 0; i < fill; i++)
+        text[len + i] = 'a' + (lane + seq + i) % 26;
+    text[len + fill] = '\0';
+}
+
+bool check_message(const telemetry_msg_t &msg, uint32_t *lane, uint32_t *seq)
+{
+    char expected[sizeof(msg.data)];
+    if (std::sscanf(msg.data, "%u %u", lane, seq) != 2 || *lane >= TELEMETRY_PRODUCER_COUNT)
+        return false;
+    format(expected, sizeof(expected), *lane, *seq);
+    return msg.len == std::strlen(expected) && std::memcmp(msg.data, expected, msg.len) == 0 && msg.topic == *lane + 1;
+}
+
+void drain()
+{
+    telemetry_msg_t msg;
+    while (telemetry_consume(&msg))
+        ;
+}
+
+} // namespace
+
+TEST(telemetry_queue, lane_order_and_drops)
+{
+    drain();
+    uint32_t dropped = telemetry_dropped(TELEMETRY_PRODUCER_MOVE);
+    char text[32];
+    const uint32_t published = TELEMETRY_LANE_SLOTS - TELEMETRY_REPLY_SLOTS;
+    for (uint32_t seq = 0; seq < published + 3; seq++) {
+        std::snprintf(text, sizeof(text), "m%u", seq);
+        CHECK(telemetry_publish(TELEMETRY_PRODUCER_MOVE, 1, text) == (seq < published));
+    }
+    CHECK(telemetry_depth(TELEMETRY_PRODUCER_MOVE) == published);
+    CHECK(telemetry_dropped(TELEMETRY_PRODUCER_MOVE) - dropped == 3);
+    telemetry_msg_t msg;
+    for (uint32_t seq = 0; seq < published; seq++) {
+        std::snprintf(text, sizeof(text), "m%u", seq);
+        CHECK(telemetry_consume(&msg));
+        CHECK(msg.len == std::strlen(text) && std::memcmp(msg.data, text, msg.len) == 0);
+        CHECK(msg.client == TELEMETRY_BROADCAST);
+    }
+    CHECK(!telemetry_consume(&msg));
+    CHECK(telemetry_depth(TELEMETRY_PRODUCER_MOVE) == 0);
+}
+
+TEST(telemetry_queue, reply_survives_publish_flood)
+{
+    drain();
+    uint32_t dropped = telemetry_dropped(TELEMETRY_PRODUCER_MOVE);
+    for (int i = 0; i < 2 * TELEMETRY_LANE_SLOTS; i++)
+        telemetry_publish(TELEMETRY_PRODUCER_MOVE, 1, "[P]flood");
+    for (uint32_t i = 0; i < TELEMETRY_REPLY_SLOTS; i++)
+        CHECK(telemetry_reply(TELEMETRY_PRODUCER_MOVE, 2, 5, "ack"));
+    CHECK(!telemetry_reply(TELEMETRY_PRODUCER_MOVE, 2, 5, "ack"));
+    CHECK(telemetry_dropped(TELEMETRY_PRODUCER_MOVE) - dropped == 2 * TELEMETRY_LANE_SLOTS - (TELEMETRY_LANE_SLOTS - TELEMETRY_REPLY_SLOTS) + 1);
+
+    // the replies come out behind the publishes that were queued first
+    telemetry_msg_t msg;
+    for (uint32_t i = 0; i < TELEMETRY_LANE_SLOTS - TELEMETRY_REPLY_SLOTS; i++) {
+        CHECK(telemetry_consume(&msg));
+        CHECK(msg.client == TELEMETRY_BROADCAST);
+    }
+    for (uint32_t i = 0; i < TELEMETRY_REPLY_SLOTS; i++) {
+        CHECK(telemetry_consume(&msg));
+        CHECK(msg.client == 2 && msg.generation == 5 && msg.len == 3 && std::memcmp(msg.data, "ack", 3) == 0);
+    }
+    CHECK(!telemetry_consume(&msg));
+}
+
+TEST(telemetry_queue, long_message_truncated)
+{
+    drain();
+    char text[2 * TELEMETRY_MSG_SIZE];
+    std::memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    CHECK(telemetry_reply(TELEMETRY_PRODUCER_CALIBRATE, 3, 7, text));
+    telemetry_msg_t msg;
+    CHECK(telemetry_consume(&msg));
+    CHECK(msg.len == sizeof(msg.data) - 1);
+    CHECK(msg.client == 3 && msg.generation == 7);
+}
+
+TEST(telemetry_queue, lanes_round_robin)
+{
+    drain();
+    for (int i = 0; i < 3; i++) {
+        CHECK(telemetry_publish(TELEMETRY_PRODUCER_MOVE, 1, "move"));
+        CHECK(telemetry_publish(TELEMETRY_PRODUCER_CALIBRATE, 2, "calibrate"));
+    }
+    // a busy lane cannot starve the other one
+    telemetry_msg_t msg;
+    uint8_t last = 0;
+    for (int i = 0; i < 6; i++) {
+        CHECK(telemetry_consume(&msg));
+        CHECK(msg.topic != last);
+        last = msg.topic;
+    }
+    CHECK(!telemetry_consume(&msg));
+}
+
+TEST(telemetry_queue, producers_stress)
+{
+    drain();
+    uint32_t dropped_before[TELEMETRY_PRODUCER_COUNT];
+    for (uint32_t lane = 0; lane < TELEMETRY_PRODUCER_COUNT; lane++)
+        dropped_before[lane] = telemetry_dropped((telemetry_producer_t)lane);
+
+    std::atomic<int> running{TELEMETRY_PRODUCER_COUNT};
+    uint32_t retries[TELEMETRY_PRODUCER_COUNT] = {};
+    std::vector<std::thread> producers;
+    for (uint32_t lane = 0; lane < TELEMETRY_PRODUCER_COUNT; lane++) {
+        producers.emplace_back([lane, &running, &retries] {
+            char text[sizeof(telemetry_msg_t::data)];
+            for (uint32_t seq = 0; seq < STRESS_MESSAGES; seq++) {
+                format(text, sizeof(text), lane, seq);
+                // a full lane drops, retry so every message gets through once
+                while (!telemetry_publish((telemetry_producer_t)lane, lane + 1, text)) {
+                    retries[lane]++;
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        });
+    }
+
+    uint32_t next[TELEMETRY_PRODUCER_COUNT] = {};
+    bool intact = true, ordered = true;
+    telemetry_msg_t msg;
+    for (;;) {
+        bool done = running == 0; // read before the last drain, nothing is published after it
+        while (telemetry_consume(&msg)) {
+            uint32_t lane, seq;
+            if (!check_message(msg, &lane, &seq)) {
+                intact = false;
+                continue;
+            }
+            ordered = ordered && seq == next[lane];
+            next[lane] = seq + 1;
+        }
+        if (done)
+            break;
+        std::this_thread::yield();
+    }
+    for (std::thread &t : producers)
+        t.join();
+
+    CHECK(intact);
+    CHECK(ordered);
+    for (uint32_t lane = 0; lane < TELEMETRY_PRODUCER_COUNT; lane++) {
+        CHECK(next[lane] == STRESS_MESSAGES);
+        CHECK(telemetry_dropped((telemetry_producer_t)lane) - dropped_before[lane] == retries[lane]);
+        CHECK(telemetry_depth((telemetry_producer_t)lane) == 0);
+    }
+}
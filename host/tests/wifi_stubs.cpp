@@ -0,0 +1,48 @@
+// What wifi.c calls outside the server, for the server tests
+#include <cstdio>
+
+extern "C" {
+#include "pico/cyw43_arch.h"
+#include "stats.h"
+#include "udp_telemetry.h"
+
+void stats_watch_buffer(const char *, void *, size_t)
+{
+}
+
+void stats_fill(stats_report_t *)
+{
+}
+
+int stats_format(const stats_report_t *, char *text, size_t size)
+{
+    return std::snprintf(text, size, "[STATS]\n");
+}
+
+void udp_telemetry_init(void)
+{
+}
+
+bool async_context_freertos_init(async_context_freertos_t *, async_context_freertos_config_t *)
+{
+    return false;
+}
+
+void cyw43_arch_set_async_context(async_context_t *)
+{
+}
+
+int cyw43_arch_init(void)
+{
+    return -1;
+}
+
+void cyw43_arch_enable_sta_mode(void)
+{
+}
+
+int cyw43_arch_wifi_connect_timeout_ms(const char *, const char *, uint32_t, uint32_t)
+{
+    return -1;
+}
+}
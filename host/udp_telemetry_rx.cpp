@@ -0,0 +1,159 @@
+// Receive the car's UDP telemetry stream and report loss, reordering and latency.
+//
+//   udp_telemetry_rx [port] [seconds]
+//
+// Latency is one-way and relative: the car and the laptop clocks are not
+// synchronised, so every sample's (receive time - robot timestamp) is measured
+// against the smallest one seen, which is the best-case path through the link.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "udp_telemetry.h"
+
+namespace {
+
+uint64_t now_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct StreamStats {
+    bool started = false;
+    uint32_t first_seq = 0;
+    uint32_t highest_seq = 0;
+    uint64_t received = 0;
+    uint64_t reordered = 0; // arrived after a higher sequence number
+    uint64_t duplicates = 0;
+    uint64_t malformed = 0;
+    int64_t min_offset = INT64_MAX;
+    std::vector<int64_t> offsets; // receive time - robot time, this interval only
+    std::vector<int64_t> all_offsets;
+    std::vector<uint64_t> seen; // bitmap of recent sequence numbers for duplicate detection
+
+    void add(const udp_sample_t &s, uint64_t recv_us)
+    {
+        if (!started) {
+            started = true;
+            first_seq = highest_seq = s.seq;
+            seen.assign(1 << 14, 0);
+        }
+        uint64_t &word = seen[(s.seq >> 6) & (seen.size() - 1)];
+        uint64_t bit = 1ull << (s.seq & 63);
+        if (s.seq + seen.size() * 64 > highest_seq && (word & bit)) {
+            duplicates++;
+            return;
+        }
+        if (s.seq > highest_seq) {
+            // clear bitmap words the window has moved past
+            for (uint32_t q = (highest_seq >> 6) + 1; q <= (s.seq >> 6) && q <= (highest_seq >> 6) + seen.size(); q++)
+                seen[q & (seen.size() - 1)] = 0;
+            highest_seq = s.seq;
+        } else if (s.seq < highest_seq) {
+            reordered++;
+        }
+        word |= bit;
+        received++;
+        int64_t offset = (int64_t)recv_us - (int64_t)s.timestamp_us;
+        min_offset = std::min(min_offset, offset);
+        offsets.push_back(offset);
+        all_offsets.push_back(offset);
+    }
+
+    uint64_t expected() const { return started ? (uint64_t)(highest_seq - first_seq) + 1 : 0; }
+    uint64_t lost() const { return expected() > received ? expected() - received : 0; }
+};
+
+int64_t percentile(std::vector<int64_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+void report(StreamStats &st, uint64_t interval_received, double seconds, bool final_report)
+{
+    const std::vector<int64_t> &offsets = final_report ? st.all_offsets : st.offsets;
+    std::vector<int64_t> lat;
+    lat.reserve(offsets.size());
+    for (int64_t o : offsets)
+        lat.push_back(o - st.min_offset);
+    double loss = st.expected() ? 100.0 * st.lost() / st.expected() : 0.0;
+    printf("%s rate=%.0f/s recv=%llu lost=%llu (%.2f%%) reordered=%llu dup=%llu bad=%llu"
+           " lat_us p50=%lld p99=%lld max=%lld\n",
+           final_report ? "total" : "     ",
+           seconds > 0 ? interval_received / seconds : 0.0,
+           (unsigned long long)st.received, (unsigned long long)st.lost(), loss,
+           (unsigned long long)st.reordered, (unsigned long long)st.duplicates,
+           (unsigned long long)st.malformed,
+           (long long)percentile(lat, 0.50), (long long)percentile(lat, 0.99),
+           lat.empty() ? 0LL : (long long)*std::max_element(lat.begin(), lat.end()));
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int port = argc > 1 ? atoi(argv[1]) : UDP_TELEMETRY_PORT;
+    int seconds = argc > 2 ? atoi(argv[2]) : 0; // 0 runs until interrupted
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    int rcvbuf = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    printf("listening for telemetry on udp port %d\n", port);
+
+    StreamStats st;
+    uint64_t start = now_us();
+    uint64_t last_report = start;
+    uint64_t last_received = 0;
+    for (;;) {
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) > 0) {
+            udp_sample_t s;
+            ssize_t n = recv(fd, &s, sizeof(s), 0);
+            uint64_t t = now_us();
+            if (n != (ssize_t)sizeof(s) || s.magic != UDP_TELEMETRY_MAGIC || s.version != UDP_TELEMETRY_VERSION)
+                st.malformed++;
+            else
+                st.add(s, t);
+        }
+        uint64_t t = now_us();
+        if (t - last_report >= 1000000) {
+            report(st, st.received - last_received, (t - last_report) / 1e6, false);
+            st.offsets.clear();
+            last_report = t;
+            last_received = st.received;
+        }
+        if (seconds > 0 && t - start >= (uint64_t)seconds * 1000000)
+            break;
+    }
+    report(st, st.received, (now_us() - start) / 1e6, true);
+    close(fd);
+    return 0;
+}
@@ -1,5 +1,12 @@
 #include "irline.h"
-#include "wifi.h"
+#include "isr_event.h"
+#include "hardware/sync.h"
+#include "irq_time.h"
+#include "dlog.h"
+
+// last whole barcode, written by barcode_handler, read with barcode_last()
+static volatile char last_barcode[ISR_EVENT_DATA_SIZE];
+static volatile uint32_t last_barcode_seq = 0; // odd while the ISR writes
 
 static const unsigned char bit_reverse_table256[] =
     {
@@ -84,8 +91,8 @@ char read_char(char bars, char spaces)
     default:
         break;
     }
-    printf("[barcode] bars is %d, spaces is %d\n", bars, spaces);
-    printf("[barcode] bar_num is %d, space_num is %d\n", bar_num, space_num);
+    DLOG_DEBUG(DLOG_BARCODE_BARS, bars, spaces); // runs in the GPIO IRQ
+    DLOG_DEBUG(DLOG_BARCODE_NUMS, bar_num, space_num);
     if (bar_num == 0 || space_num == 1)
         return '%';
     return CODE39ENCODE[bar_num + space_num];
@@ -98,8 +105,6 @@ char read_char_reversed(char bars, char spaces)
 // Define slow speed as 10cm/s
 #define SLOW_SPEED 10
 
-char randomtext[100] = "";
-char placeholdertext[100] = "\n";
 void barcode_handler(uint32_t events)
 {
     static volatile int counter = 0;
@@ -141,6 +146,8 @@ void barcode_handler(uint32_t events)
         }
         if (++counter == 9)
         {
+            BaseType_t woken = pdFALSE;
+            isr_event_t event = {.type = ISR_EVENT_BARCODE_CHAR};
             if (datacount == 0)
             {
                 if (read_char(info[BAR], info[SPACE]) == '*')
@@ -154,8 +161,7 @@ void barcode_handler(uint32_t events)
                 }
                 else
                 {
-                    sprintf(randomtext, "[barcode] barcode does not start with '*'\n");
-                    xMessageBufferSendFromISR(wifiMsgBufferFromISR, &randomtext, sizeof(randomtext), NULL);
+                    event.type = ISR_EVENT_BARCODE_BAD_START;
                 }
             }
             else
@@ -164,89 +170,120 @@ void barcode_handler(uint32_t events)
                     data[datacount] = read_char_reversed(info[BAR], info[SPACE]);
                 else
                     data[datacount] = read_char(info[BAR], info[SPACE]);
-                if (data[datacount++] == '*')
-                {
-                    datacount = 0;
-                    xMessageBufferSendFromISR(wifiMsgBufferFromISR, &data, sizeof(data), NULL);
-                    memset(&data, 0, sizeof(data));
-                    reversed = false;
-                }
+                event.ch = data[datacount];
+                if (data[datacount++] == '*' || datacount == sizeof(data))
+                    event.type = ISR_EVENT_BARCODE_DONE;
+            }
+            memcpy(event.data, data, sizeof(event.data));
+            isr_event_post_from_isr(&event, &woken); // formatted and sent by server_forward_task_from_ISR
+            if (event.type == ISR_EVENT_BARCODE_DONE)
+            {
+                last_barcode_seq++;
+                __dmb();
+                for (int i = 0; i < ISR_EVENT_DATA_SIZE; i++)
+                    last_barcode[i] = data[i];
+                __dmb();
+                last_barcode_seq++;
+                datacount = 0;
+                memset(&data, 0, sizeof(data));
+                reversed = false;
             }
-            xMessageBufferSendFromISR(wifiMsgBufferFromISR, &data, sizeof(data), NULL);
-            xMessageBufferSendFromISR(wifiMsgBufferFromISR, &placeholdertext, sizeof(1), NULL);
             counter = 0;
             info[BAR] = 0;
             info[SPACE] = 0;
+            portYIELD_FROM_ISR(woken);
         }
     }
 }
 
-// check if the interrupt from the barcode detection is a barcode
-bool is_barcode(absolute_time_t start, absolute_time_t end)
+// Copy the text of the last barcode read, without the '*' delimiters, into out.
+// Returns how many barcodes were read so far, retries if the ISR writes a new
+// one meanwhile so it is safe from a task on either core.
+uint32_t barcode_last(char *out, size_t size)
 {
-    uint64_t time_elapse = absolute_time_diff_us(start, end) / 1000;
-    if (time_elapse < 400)
+    uint32_t seq;
+    do
     {
-        return true;
-    }
-    return false;
+        seq = last_barcode_seq;
+        __dmb();
+        size_t n = 0;
+        for (int i = 1; i < ISR_EVENT_DATA_SIZE && last_barcode[i] && last_barcode[i] != '*' && n + 1 < size; i++)
+            out[n++] = last_barcode[i];
+        out[n] = '\0';
+        __dmb();
+    } while ((seq & 1) || seq != last_barcode_seq);
+    return seq / 2;
 }
 
-static volatile bool left = false;
-static volatile bool right = false;
+// line edge reflex, armed by move_task, acted on by ir_edge_handler
+static volatile bool reflex_armed = false;
+static volatile uint32_t reflex_armed_us;
+static volatile uint32_t reflex_hold_us;
+static ir_reflex_speeds_t reflex_speeds;
+static TaskHandle_t reflex_task = NULL;
+
+// Let the IR edges steer at the given speeds until disarmed or hold_us passes,
+// call from the control task on the core that takes the GPIO IRQ
+void ir_reflex_arm(const ir_reflex_speeds_t *speeds, uint32_t hold_us)
+{
+    uint32_t save = save_and_disable_interrupts();
+    reflex_speeds = *speeds;
+    reflex_hold_us = hold_us;
+    reflex_armed_us = time_us_32();
+    reflex_task = xTaskGetCurrentTaskHandle();
+    reflex_armed = true;
+    restore_interrupts(save);
+}
 
-// handler for wall detection
-void wall_detect_handler(uint16_t gpio, uint32_t events)
+void ir_reflex_disarm(void)
 {
-    if (gpio == 26)
+    reflex_armed = false;
+}
+
+// IR_LEFT_PIN or IR_RIGHT_PIN changed, a sensor reads high over the black line
+void ir_edge_handler(uint gpio, uint32_t events)
+{
+    uint32_t start_us = time_us_32();
+    if (!reflex_armed)
+        return;
+    bool left_black = gpio_get(IR_LEFT_PIN);
+    bool right_black = gpio_get(IR_RIGHT_PIN);
+    bool into_black = gpio == IR_LEFT_PIN ? left_black : right_black;
+
+    bool stale = start_us - reflex_armed_us > reflex_hold_us;
+    if (stale)
     {
-        static volatile absolute_time_t leftHit = {};
-        if (events == GPIO_IRQ_EDGE_RISE)
-        {
-            left = true;
-            leftHit = get_absolute_time();
-        }
-        else
-        {
-            if (!right)
-            {
-                left_tilt();
-                return;
-            }
-            left = false;
-            absolute_time_t left_now_time = get_absolute_time();
-            if (!is_barcode(leftHit, left_now_time))
-            {
-                stop();
-                return;
-            }
-            stop();
-        }
+        // move_task stopped refreshing the speeds, do not steer on old ones
+        if (!into_black)
+            return;
+        stop();
+        reflex_armed = false;
     }
     else
     {
-        static volatile absolute_time_t rightHit = {};
-        if (events == GPIO_IRQ_EDGE_RISE)
-        {
-            right = true;
-            rightHit = get_absolute_time();
-        }
-        else
-        {
-            if (!left)
-            {
-                right_tilt();
-                return;
-            }
-            right = false;
-            absolute_time_t right_now_time = get_absolute_time();
-            if (!is_barcode(rightHit, right_now_time))
-            {
-                stop();
-                return;
-            }
-            stop();
-        }
+        // the same correction motion_step makes on its next step, never faster than move_task drives
+        set_wheel_speeds(right_black ? reflex_speeds.left_tilted : reflex_speeds.left,
+                         left_black ? reflex_speeds.right_tilted : reflex_speeds.right);
+    }
+    uint32_t write_us = time_us_32() - start_us;
+    // the PWM level is double buffered, the wheels see it at the next counter wrap
+    uint32_t pwm_us = stale ? write_us : write_us + pwm_update_delay_us();
+
+    ir_reflex_time.count++;
+    ir_reflex_time.stops += stale;
+    ir_reflex_time.total_us += write_us;
+    ir_reflex_time.total_pwm_us += pwm_us;
+    if (write_us > ir_reflex_time.max_us)
+        ir_reflex_time.max_us = write_us;
+    if (pwm_us > ir_reflex_time.max_pwm_us)
+        ir_reflex_time.max_pwm_us = pwm_us;
+
+    if (into_black && reflex_task)
+    {
+        // the control task takes the edge into its next step, sense_task may not have seen it yet
+        BaseType_t woken = pdFALSE;
+        xTaskNotifyFromISR(reflex_task, gpio == IR_LEFT_PIN ? IR_REFLEX_LEFT_BLACK : IR_REFLEX_RIGHT_BLACK, eSetBits, &woken);
+        portYIELD_FROM_ISR(woken);
     }
 }
 
@@ -8,8 +8,12 @@
 #include "motor.h"
 #include "FreeRTOS.h"  // Include the FreeRTOS library for real-time operating system functionality.
 #include "message_buffer.h"
+#include "task.h"
 
 #define ADC_PIN 15
+// IR line sensors, high over the black line
+#define IR_LEFT_PIN 26
+#define IR_RIGHT_PIN 27
 
 #define WIDE 1
 #define NARROW 0
@@ -23,8 +27,28 @@ const static char SPACE_BIT_VALUE[] = {8, 4, 2, 1};
 const static char BAR_BIT_VALUE[] = {16, 8, 4, 2, 1};
 
 extern MessageBufferHandle_t barcodeMsgBuffer;
+char read_char(char bars, char spaces); // Code 39 character of a bar and a space pattern, wide bits set
 void barcode_handler(uint32_t events);
+uint32_t barcode_last(char *out, size_t size);
 void init_adc();
-void wall_detect_handler(uint16_t gpio, uint32_t events);
+
+// Line edge reflex: while armed, an IR edge changes the wheel speeds from the
+// GPIO IRQ instead of waiting up to two control periods for sense_task to poll
+// the sensors and move_task to act. An edge into black also notifies the
+// arming task with IR_REFLEX_*_BLACK bits. If the arming is older than its
+// hold time, an edge into black stops the car instead. The latency is kept in
+// ir_reflex_time, see irq_time.h.
+#define IR_REFLEX_LEFT_BLACK 0x01
+#define IR_REFLEX_RIGHT_BLACK 0x02
+
+typedef struct ir_reflex_speeds_t_
+{
+    uint16_t left, right;               // PWM levels with both sensors on white
+    uint16_t left_tilted, right_tilted; // left wheel while the right sensor is black, right wheel while the left is
+} ir_reflex_speeds_t;
+
+void ir_reflex_arm(const ir_reflex_speeds_t *speeds, uint32_t hold_us);
+void ir_reflex_disarm(void);
+void ir_edge_handler(uint gpio, uint32_t events);
 
 #endif
\ No newline at end of file
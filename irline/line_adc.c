@@ -0,0 +1,180 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/gpio.h"
+#include "irline.h"
+#include "line_adc.h"
+
+typedef enum
+{
+    LINE_DIGITAL,
+    LINE_ANALOG,
+    LINE_CALIBRATING,
+} line_mode_t;
+
+static volatile uint8_t command = LINE_CMD_NONE; // line_cmd_t, taken by line_adc_sample
+static volatile uint8_t mode = LINE_DIGITAL;     // only changed by sense_task
+static volatile bool calibrated = false;
+static line_cal_t cal;
+static uint16_t cal_min[2], cal_max[2];
+static line_sample_t last; // for line_adc_format, a status line may mix two bursts
+static uint32_t overruns = 0;
+
+static const char *const mode_names[] = {
+    [LINE_DIGITAL] = "digital",
+    [LINE_ANALOG] = "analog",
+    [LINE_CALIBRATING] = "cal",
+};
+
+void line_adc_command(line_cmd_t cmd)
+{
+    command = cmd;
+}
+
+bool line_adc_calibrated(void)
+{
+    return calibrated;
+}
+
+// hand both pins to the ADC, their digital inputs and edge IRQs go quiet
+static void analog_pins(void)
+{
+    adc_gpio_init(IR_LEFT_PIN);
+    adc_gpio_init(IR_RIGHT_PIN);
+    adc_set_round_robin((1u << LINE_ADC_LEFT) | (1u << LINE_ADC_RIGHT));
+    adc_fifo_setup(true, false, 0, false, false);
+}
+
+static void digital_pins(void)
+{
+    adc_set_round_robin(0);
+    adc_fifo_setup(false, false, 0, false, false);
+    gpio_set_input_enabled(IR_LEFT_PIN, true);
+    gpio_set_input_enabled(IR_RIGHT_PIN, true);
+    gpio_set_function(IR_LEFT_PIN, GPIO_FUNC_SIO);
+    gpio_set_function(IR_RIGHT_PIN, GPIO_FUNC_SIO);
+}
+
+static void apply_command(line_cmd_t cmd)
+{
+    switch (cmd)
+    {
+    case LINE_CMD_DIGITAL:
+        if (mode != LINE_DIGITAL)
+            digital_pins();
+        mode = LINE_DIGITAL;
+        break;
+    case LINE_CMD_ANALOG:
+        if (!calibrated)
+            break;
+        if (mode == LINE_DIGITAL)
+            analog_pins();
+        mode = LINE_ANALOG;
+        break;
+    case LINE_CMD_CAL_BEGIN:
+        if (mode == LINE_DIGITAL)
+            analog_pins();
+        for (int i = 0; i < 2; i++)
+        {
+            cal_min[i] = UINT16_MAX;
+            cal_max[i] = 0;
+        }
+        mode = LINE_CALIBRATING;
+        break;
+    case LINE_CMD_CAL_END:
+        if (mode != LINE_CALIBRATING)
+            break;
+        // the sensors read higher over black, like their digital output
+        if (cal_max[0] >= cal_min[0] + LINE_ADC_MIN_CONTRAST && cal_max[1] >= cal_min[1] + LINE_ADC_MIN_CONTRAST)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                cal.white[i] = cal_min[i];
+                cal.black[i] = cal_max[i];
+            }
+            calibrated = true;
+            mode = LINE_ANALOG;
+        }
+        else
+        {
+            digital_pins();
+            mode = LINE_DIGITAL;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// one round-robin burst, the FIFO holds four results so it is read as it fills
+static bool burst(uint16_t raw[2])
+{
+    uint32_t sum[2] = {0, 0};
+    adc_select_input(LINE_ADC_LEFT); // the round robin starts from the selected input
+    adc_fifo_drain();
+    hw_set_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS); // write one to clear the sticky overflow
+    adc_run(true);
+    for (int i = 0; i < 2 * LINE_ADC_SAMPLES; i++)
+        sum[i & 1] += adc_fifo_get_blocking();
+    adc_run(false);
+    adc_fifo_drain(); // the conversion in flight when it stopped
+    if (adc_hw->fcs & ADC_FCS_OVER_BITS)
+    {
+        // an interrupt held us long enough to drop results, the channels may be out of step
+        overruns++;
+        return false;
+    }
+    raw[0] = sum[0] / LINE_ADC_SAMPLES;
+    raw[1] = sum[1] / LINE_ADC_SAMPLES;
+    return true;
+}
+
+bool line_adc_sample(line_sample_t *sample)
+{
+    line_cmd_t cmd = command;
+    if (cmd != LINE_CMD_NONE)
+    {
+        command = LINE_CMD_NONE;
+        apply_command(cmd);
+    }
+    if (mode == LINE_DIGITAL)
+        return false;
+
+    if (!burst(sample->raw))
+        return false;
+    if (mode == LINE_CALIBRATING)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            cal_min[i] = MIN(cal_min[i], sample->raw[i]);
+            cal_max[i] = MAX(cal_max[i], sample->raw[i]);
+        }
+        last = *sample;
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        float level = (float)(sample->raw[i] - cal.white[i]) / (cal.black[i] - cal.white[i]);
+        sample->level[i] = level < 0 ? 0 : level > 1 ? 1 : level;
+    }
+    sample->offset = sample->level[LINE_ADC_LEFT] - sample->level[LINE_ADC_RIGHT];
+    sample->left_black = sample->level[LINE_ADC_LEFT] > 0.5f;
+    sample->right_black = sample->level[LINE_ADC_RIGHT] > 0.5f;
+    last = *sample;
+    return true;
+}
+
+int line_adc_format(char *text, size_t size)
+{
+    int len = snprintf(text, size, "[LINE]mode:%s\traw:%u,%u\toffset:%.2f\toverruns:%" PRIu32,
+                       mode_names[mode], last.raw[0], last.raw[1], last.offset, overruns);
+    if (mode == LINE_CALIBRATING && len < size)
+        len += snprintf(text + len, size - len, "\tseen:%u-%u,%u-%u", cal_min[0], cal_max[0], cal_min[1], cal_max[1]);
+    else if (calibrated && len < size)
+        len += snprintf(text + len, size - len, "\tcal:%u-%u,%u-%u", cal.white[0], cal.black[0], cal.white[1], cal.black[1]);
+    if (len < size)
+        len += snprintf(text + len, size - len, "\n");
+    return len < size ? len : (int)size - 1;
+}
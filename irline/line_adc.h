@@ -0,0 +1,57 @@
+#ifndef LINE_ADC_H
+#define LINE_ADC_H
+// Analog line position from the IR sensors on ADC0 and ADC1.
+//
+// The IR sensors sit on GPIO 26 and 27, the RP2040's ADC0 and ADC1. In digital
+// mode they are plain GPIO inputs with edge IRQs for the line reflex. In analog
+// mode sense_task calls line_adc_sample, which runs a short round-robin burst
+// over both channels through the ADC FIFO, scales each average between the
+// calibrated white and black levels and returns a continuous line offset for
+// the PD line follower in motion_step. The analog pins have no digital input,
+// so the edge IRQs and the reflex are off in this mode.
+//
+// Calibrate on each new surface: "line cal", sweep both sensors across the line
+// and the floor around it, then "line cal end". Analog mode needs a calibration.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LINE_ADC_LEFT 0  // ADC input of IR_LEFT_PIN
+#define LINE_ADC_RIGHT 1 // ADC input of IR_RIGHT_PIN
+#define LINE_ADC_SAMPLES 8      // conversions per channel in a burst, 2 us each
+#define LINE_ADC_MIN_CONTRAST 200 // counts between white and black for a usable calibration
+
+typedef enum
+{
+    LINE_CMD_NONE,
+    LINE_CMD_DIGITAL,   // back to gpio_get and the edge reflex
+    LINE_CMD_ANALOG,    // follow the analog offset, ignored without a calibration
+    LINE_CMD_CAL_BEGIN, // sample and track the lowest and highest levels
+    LINE_CMD_CAL_END,   // keep them as white and black, analog mode if the contrast is enough
+} line_cmd_t;
+
+typedef struct line_cal_t_
+{
+    uint16_t white[2]; // raw 12-bit levels, per channel
+    uint16_t black[2];
+} line_cal_t;
+
+// Line position from one burst
+typedef struct line_sample_t_
+{
+    uint16_t raw[2];
+    float level[2];    // 0 on white, 1 on black
+    float offset;      // level[left] - level[right], positive towards the left sensor
+    bool left_black;   // level above one half
+    bool right_black;
+} line_sample_t;
+
+// any task, sense_task applies it before its next sample
+void line_adc_command(line_cmd_t command);
+bool line_adc_calibrated(void);
+// sense_task only, false in digital mode or while calibrating
+bool line_adc_sample(line_sample_t *sample);
+// status text for the line command, read from any task
+int line_adc_format(char *text, size_t size);
+
+#endif
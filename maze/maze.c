@@ -0,0 +1,212 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "maze.h"
+
+#define PI_F 3.14159265f
+
+static const int8_t step_x[4] = {0, 1, 0, -1}; // by maze_dir_t
+static const int8_t step_y[4] = {1, 0, -1, 0};
+
+bool maze_is_set(const uint16_t *rows, uint8_t x, uint8_t y)
+{
+    return (rows[y] >> x) & 1;
+}
+
+static void set_cell(maze_t *maze, uint16_t *rows, uint8_t x, uint8_t y, bool on)
+{
+    uint16_t row = on ? rows[y] | (1u << x) : rows[y] & ~(1u << x);
+    if (row == rows[y])
+        return;
+    rows[y] = row;
+    maze->row_revision[y] = ++maze->revision;
+}
+
+static bool cell_at(const maze_t *maze, float x_cm, float y_cm, uint8_t *x, uint8_t *y)
+{
+    if (x_cm < 0 || y_cm < 0)
+        return false;
+    int cx = x_cm / maze->cell_cm;
+    int cy = y_cm / maze->cell_cm;
+    if (cx >= maze->width || cy >= maze->height)
+        return false;
+    *x = cx;
+    *y = cy;
+    return true;
+}
+
+void maze_reset(maze_t *maze, uint8_t width, uint8_t height, uint16_t cell_cm, uint8_t x, uint8_t y, int bearing)
+{
+    uint16_t revision = maze->revision + 1; // clients keep their since across a reset
+    memset(maze, 0, sizeof(*maze));
+    maze->width = width > MAZE_MAX_SIZE ? MAZE_MAX_SIZE : width ? width : 1;
+    maze->height = height > MAZE_MAX_SIZE ? MAZE_MAX_SIZE : height ? height : 1;
+    maze->cell_cm = cell_cm ? cell_cm : 1;
+    maze->bearing0 = bearing;
+    maze->revision = revision;
+    for (int i = 0; i < MAZE_MAX_SIZE; i++)
+        maze->row_revision[i] = revision;
+    x = x < maze->width ? x : maze->width - 1;
+    y = y < maze->height ? y : maze->height - 1;
+    maze->x_cm = (x + 0.5f) * maze->cell_cm;
+    maze->y_cm = (y + 0.5f) * maze->cell_cm;
+    set_cell(maze, maze->known, x, y, true);
+    set_cell(maze, maze->visited, x, y, true);
+}
+
+bool maze_cell(const maze_t *maze, uint8_t *x, uint8_t *y)
+{
+    return cell_at(maze, maze->x_cm, maze->y_cm, x, y);
+}
+
+// distance along the route since the last call, negative when reversing
+void maze_odometry(maze_t *maze, float distance_cm, float bearing)
+{
+    if (distance_cm == 0)
+        return;
+    float angle = (bearing - maze->bearing0) * PI_F / 180;
+    maze->x_cm += distance_cm * sinf(angle);
+    maze->y_cm += distance_cm * cosf(angle);
+    uint8_t x, y;
+    if (cell_at(maze, maze->x_cm, maze->y_cm, &x, &y))
+    {
+        // the car fits in the cell, whatever echoed from it before was noise
+        set_cell(maze, maze->known, x, y, true);
+        set_cell(maze, maze->occupied, x, y, false);
+        set_cell(maze, maze->visited, x, y, true);
+    }
+}
+
+// an echo at range_cm straight ahead, ranges of max_cm or more only clear the beam
+void maze_range(maze_t *maze, float range_cm, float max_cm, float bearing)
+{
+    float angle = (bearing - maze->bearing0) * PI_F / 180;
+    float dx = sinf(angle), dy = cosf(angle);
+    bool echo = range_cm < max_cm;
+    float reach = echo ? range_cm : max_cm;
+    uint8_t end_x = 0xff, end_y = 0xff;
+    if (echo && cell_at(maze, maze->x_cm + range_cm * dx, maze->y_cm + range_cm * dy, &end_x, &end_y))
+    {
+        set_cell(maze, maze->known, end_x, end_y, true);
+        set_cell(maze, maze->occupied, end_x, end_y, true);
+    }
+    // quarter-cell steps visit every cell the beam crosses except for corner clips
+    float step = maze->cell_cm / 4.0f;
+    for (float t = 0; t < reach; t += step)
+    {
+        uint8_t x, y;
+        if (!cell_at(maze, maze->x_cm + t * dx, maze->y_cm + t * dy, &x, &y))
+            break;
+        if (x == end_x && y == end_y)
+            break;
+        set_cell(maze, maze->known, x, y, true);
+        set_cell(maze, maze->occupied, x, y, false);
+    }
+}
+
+bool maze_plan(const maze_t *maze, uint8_t goal_x, uint8_t goal_y, maze_plan_t *plan)
+{
+    uint8_t x, y;
+    plan->length = 0;
+    plan->expanded = 0;
+    if (!maze_cell(maze, &x, &y))
+        return false;
+    memset(plan->reached, 0, sizeof(plan->reached));
+    uint16_t head = 0, tail = 0;
+    plan->queue[tail++] = y * MAZE_MAX_SIZE + x;
+    plan->reached[y] |= 1u << x;
+
+    int goal = -1;
+    while (head < tail)
+    {
+        uint8_t cell = plan->queue[head++];
+        x = cell % MAZE_MAX_SIZE;
+        y = cell / MAZE_MAX_SIZE;
+        plan->expanded++;
+        bool is_goal = goal_x == MAZE_NO_GOAL ? !maze_is_set(maze->known, x, y) : x == goal_x && y == goal_y;
+        if (is_goal)
+        {
+            goal = cell;
+            break;
+        }
+        for (uint8_t dir = 0; dir < 4; dir++)
+        {
+            int nx = x + step_x[dir], ny = y + step_y[dir];
+            if (nx < 0 || ny < 0 || nx >= maze->width || ny >= maze->height)
+                continue;
+            if (maze_is_set(plan->reached, nx, ny) || maze_is_set(maze->occupied, nx, ny))
+                continue;
+            plan->reached[ny] |= 1u << nx;
+            plan->from[ny * MAZE_MAX_SIZE + nx] = dir;
+            plan->queue[tail++] = ny * MAZE_MAX_SIZE + nx;
+        }
+    }
+    if (goal < 0)
+        return false;
+
+    // walk back to the start, then put the steps in driving order
+    uint8_t start = plan->queue[0];
+    for (int cell = goal; cell != start;)
+    {
+        uint8_t dir = plan->from[cell];
+        plan->path[plan->length++] = dir;
+        cell -= step_y[dir] * MAZE_MAX_SIZE + step_x[dir];
+    }
+    for (uint16_t i = 0; i < plan->length / 2; i++)
+    {
+        uint8_t swap = plan->path[i];
+        plan->path[i] = plan->path[plan->length - 1 - i];
+        plan->path[plan->length - 1 - i] = swap;
+    }
+    return true;
+}
+
+uint8_t maze_primitives(const maze_t *maze, const maze_plan_t *plan, int target_bearing, float codes_per_cm,
+                        motion_primitive_t *out, uint8_t max)
+{
+    int relative = ((target_bearing - maze->bearing0) % 360 + 360) % 360;
+    uint8_t heading = ((relative + 45) / 90) % 4;
+    uint8_t n = 0;
+    for (uint16_t i = 0; i < plan->length;)
+    {
+        uint8_t dir = plan->path[i];
+        uint16_t run = 0;
+        while (i < plan->length && plan->path[i] == dir)
+        {
+            run++;
+            i++;
+        }
+        if (n + (dir != heading) + 1 > max)
+            break;
+        if (dir != heading)
+        {
+            static const int16_t turns[4] = {0, 90, 180, -90};
+            out[n++] = (motion_primitive_t){.type = MOTION_TURN, .value = turns[(dir - heading + 4) % 4]};
+            heading = dir;
+        }
+        float distance = run * maze->cell_cm;
+        if (i == run)
+        {
+            // the first run starts from where the car is in its cell, not the centre
+            float centre_x = (floorf(maze->x_cm / maze->cell_cm) + 0.5f) * maze->cell_cm;
+            float centre_y = (floorf(maze->y_cm / maze->cell_cm) + 0.5f) * maze->cell_cm;
+            distance -= (maze->x_cm - centre_x) * step_x[dir] + (maze->y_cm - centre_y) * step_y[dir];
+        }
+        out[n++] = (motion_primitive_t){.type = MOTION_STRAIGHT, .value = lroundf(distance * codes_per_cm)};
+    }
+    return n;
+}
+
+int maze_format_rows(const maze_t *maze, uint16_t since, char *text, size_t size)
+{
+    int len = snprintf(text, size, "[MAP]rev:%u\tsince:%u\tsize:%ux%u\tcell:%u\tat:%.0f,%.0f\n", maze->revision, since,
+                       maze->width, maze->height, maze->cell_cm, maze->x_cm, maze->y_cm);
+    for (uint8_t y = 0; y < maze->height && len < (int)size; y++)
+    {
+        if ((int16_t)(maze->row_revision[y] - since) <= 0)
+            continue;
+        // known, occupied and visited, bit x is column x
+        len += snprintf(text + len, size - len, "[MAP]row %u %04x %04x %04x\n", y, maze->known[y], maze->occupied[y], maze->visited[y]);
+    }
+    return len < (int)size ? len : (int)size - 1;
+}
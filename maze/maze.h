@@ -0,0 +1,78 @@
+#ifndef MAZE_H
+#define MAZE_H
+// Occupancy grid of the maze and a shortest-path planner over it.
+//
+// The grid is at most MAZE_MAX_SIZE cells a side, one bit per cell in each of
+// three row bitsets: known (seen by the ultrasonic or driven through),
+// occupied (an echo came from it) and visited. move_task feeds it odometry
+// with maze_odometry and forward ranges with maze_range, which marks the
+// cells along the beam free and the cell at the echo occupied.
+//
+// maze_plan runs a breadth-first search from the car's cell over the cells
+// not known to be occupied, to a goal cell or to the nearest unknown cell when
+// exploring, and maze_primitives turns the path into turns and straights for
+// the motion engine. Every cell costs the same, so BFS finds the same paths as
+// A* would, and 256 cells are too few for a heuristic to pay for its queue.
+//
+// Rows carry the revision they last changed at, so a client can fetch only
+// the rows changed since the revision it already has, see maze_format_rows.
+// Fixed size, about 180 bytes for the map and 800 for maze_plan_t, nothing is
+// allocated. Pure logic with no Pico includes, so it builds on the host too.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "motion.h"
+
+#define MAZE_MAX_SIZE 16 // cells a side, one row fits a uint16_t
+#define MAZE_CELLS (MAZE_MAX_SIZE * MAZE_MAX_SIZE)
+#define MAZE_NO_GOAL 0xff // maze_plan goal: the nearest unknown cell
+
+typedef enum
+{
+    MAZE_NORTH, // +y, the heading the map was reset at
+    MAZE_EAST,  // +x
+    MAZE_SOUTH,
+    MAZE_WEST,
+} maze_dir_t;
+
+typedef struct maze_t_
+{
+    uint8_t width, height;
+    uint16_t cell_cm;
+    int bearing0; // compass bearing of north in the grid
+    float x_cm, y_cm; // pose from odometry, from the south-west corner
+    uint16_t revision; // bumped by every change
+    uint16_t known[MAZE_MAX_SIZE]; // bit x of row y
+    uint16_t occupied[MAZE_MAX_SIZE];
+    uint16_t visited[MAZE_MAX_SIZE];
+    uint16_t row_revision[MAZE_MAX_SIZE]; // revision the row last changed at
+} maze_t;
+
+// Planner scratch and result, cells are y * MAZE_MAX_SIZE + x
+typedef struct maze_plan_t_
+{
+    uint16_t reached[MAZE_MAX_SIZE]; // bitset of cells the search got to
+    uint8_t queue[MAZE_CELLS];
+    uint8_t from[MAZE_CELLS]; // maze_dir_t the search entered each cell with
+    uint8_t path[MAZE_CELLS]; // directions from the start to the goal
+    uint16_t length;          // steps in path, 0 if the car is on the goal
+    uint16_t expanded;        // cells taken off the queue, for benchmarks
+} maze_plan_t;
+
+// width and height up to MAZE_MAX_SIZE, the car starts in cell (x, y) facing north at bearing
+void maze_reset(maze_t *maze, uint8_t width, uint8_t height, uint16_t cell_cm, uint8_t x, uint8_t y, int bearing);
+void maze_odometry(maze_t *maze, float distance_cm, float bearing);
+void maze_range(maze_t *maze, float range_cm, float max_cm, float bearing);
+bool maze_cell(const maze_t *maze, uint8_t *x, uint8_t *y); // the car's cell, false off the grid
+bool maze_is_set(const uint16_t *rows, uint8_t x, uint8_t y);
+
+// goal_x MAZE_NO_GOAL explores, false if no goal can be reached
+bool maze_plan(const maze_t *maze, uint8_t goal_x, uint8_t goal_y, maze_plan_t *plan);
+// the plan as primitives from target_bearing, at most max of them, returns how many
+uint8_t maze_primitives(const maze_t *maze, const maze_plan_t *plan, int target_bearing, float codes_per_cm,
+                        motion_primitive_t *out, uint8_t max);
+
+// header line, then one line per row changed after since, returns the length
+int maze_format_rows(const maze_t *maze, uint16_t since, char *text, size_t size);
+
+#endif
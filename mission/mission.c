@@ -0,0 +1,463 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mission.h"
+
+// Bytecode, operands follow the opcode, 16 bit values are little endian
+enum
+{
+    OP_END,         //
+    OP_MOVE,        // type, flags, value16, arg16
+    OP_SYNC,        //
+    OP_UNTIL,       // cond
+    OP_JUMP_IF_NOT, // cond, target16
+    OP_JUMP,        // target16
+    OP_REPEAT,      // count16
+    OP_LOOP,        // target16, back to the start of a repeat
+    OP_SAY,         // len, text
+};
+
+// Conditions, COND_NOT may be or-ed into the kind
+enum
+{
+    COND_OBSTACLE_BELOW, // cm16
+    COND_OBSTACLE_ABOVE, // cm16
+    COND_BARCODE,        // len, text
+    COND_LINE,           // mask: 1 left, 2 right
+    COND_MOVING,         //
+};
+#define COND_NOT 0x80
+
+enum
+{
+    BLOCK_IF,
+    BLOCK_ELSE,
+    BLOCK_WHILE,
+    BLOCK_REPEAT,
+    BLOCK_LOOP,
+};
+
+typedef struct
+{
+    const char *name;
+    uint8_t type;
+    uint8_t flags;
+    int8_t sign;
+    uint8_t args;
+} move_statement_t;
+
+static const move_statement_t move_statements[] = {
+    {"fwd", MOTION_STRAIGHT, 0, 1, 1},
+    {"back", MOTION_STRAIGHT, 0, -1, 1},
+    {"bar", MOTION_STRAIGHT, MOTION_FLAG_NO_LINE, 1, 1},
+    {"turn", MOTION_TURN, 0, 1, 1},
+    {"arc", MOTION_ARC, 0, 1, 2},
+    {"wait", MOTION_WAIT, 0, 1, 1},
+    {"stop", MOTION_STOP, 0, 1, 0},
+};
+
+// copy the next space separated word of p into out, returns what follows it
+static const char *next_word(const char *p, char *out, size_t size)
+{
+    size_t n = 0;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+    {
+        if (n + 1 < size)
+            out[n++] = *p;
+        p++;
+    }
+    out[n] = '\0';
+    return p;
+}
+
+static bool at_end(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+    return *p == '\0';
+}
+
+static bool fail(mission_compiler_t *compiler, const char *error)
+{
+    if (!compiler->error)
+        compiler->error = error;
+    return false;
+}
+
+static bool emit(mission_compiler_t *compiler, uint8_t byte)
+{
+    mission_program_t *program = &compiler->program;
+    if (program->len >= MISSION_CODE_SIZE - 1) // room for the final OP_END
+        return fail(compiler, "program too long");
+    program->code[program->len++] = byte;
+    return true;
+}
+
+static bool emit16(mission_compiler_t *compiler, int32_t value)
+{
+    if (value < INT16_MIN || value > INT16_MAX)
+        return fail(compiler, "number out of range");
+    return emit(compiler, value & 0xff) && emit(compiler, (value >> 8) & 0xff);
+}
+
+static bool emit_text(mission_compiler_t *compiler, const char *text)
+{
+    size_t len = strlen(text);
+    if (len > MISSION_TEXT_SIZE)
+        return fail(compiler, "text too long");
+    if (!emit(compiler, len))
+        return false;
+    for (size_t i = 0; i < len; i++)
+        if (!emit(compiler, text[i]))
+            return false;
+    return true;
+}
+
+static void patch16(mission_compiler_t *compiler, uint16_t at, uint16_t value)
+{
+    compiler->program.code[at] = value & 0xff;
+    compiler->program.code[at + 1] = value >> 8;
+}
+
+static const char *parse_number(mission_compiler_t *compiler, const char *p, int32_t *value)
+{
+    char word[12];
+    char *end;
+    p = next_word(p, word, sizeof(word));
+    *value = strtol(word, &end, 10);
+    if (word[0] == '\0' || *end != '\0')
+    {
+        fail(compiler, "number expected");
+        return NULL;
+    }
+    return p;
+}
+
+// <cond> up to the end of the line
+static bool compile_condition(mission_compiler_t *compiler, const char *p)
+{
+    char word[MISSION_TEXT_SIZE + 2];
+    int32_t value;
+    uint8_t negate = 0;
+
+    p = next_word(p, word, sizeof(word));
+    if (strcmp(word, "not") == 0)
+    {
+        negate = COND_NOT;
+        p = next_word(p, word, sizeof(word));
+    }
+    if (strcmp(word, "obstacle") == 0)
+    {
+        p = next_word(p, word, sizeof(word));
+        if (strcmp(word, "<") == 0)
+            emit(compiler, COND_OBSTACLE_BELOW | negate);
+        else if (strcmp(word, ">") == 0)
+            emit(compiler, COND_OBSTACLE_ABOVE | negate);
+        else
+            return fail(compiler, "obstacle needs < or >");
+        if (!(p = parse_number(compiler, p, &value)))
+            return false;
+        emit16(compiler, value);
+    }
+    else if (strcmp(word, "barcode") == 0)
+    {
+        p = next_word(p, word, sizeof(word));
+        if (word[0] == '\0')
+            return fail(compiler, "barcode needs text");
+        emit(compiler, COND_BARCODE | negate);
+        emit_text(compiler, word);
+    }
+    else if (strcmp(word, "line") == 0)
+    {
+        p = next_word(p, word, sizeof(word));
+        uint8_t mask = strcmp(word, "left") == 0 ? 1 : strcmp(word, "right") == 0 ? 2
+                                                   : strcmp(word, "any") == 0     ? 3
+                                                                                  : 0;
+        if (!mask)
+            return fail(compiler, "line needs left, right or any");
+        emit(compiler, COND_LINE | negate);
+        emit(compiler, mask);
+    }
+    else if (strcmp(word, "moving") == 0)
+        emit(compiler, COND_MOVING | negate);
+    else
+        return fail(compiler, "unknown condition");
+    if (!at_end(p))
+        return fail(compiler, "unexpected text after condition");
+    return !compiler->error;
+}
+
+static bool push_block(mission_compiler_t *compiler, uint8_t kind, uint16_t start, uint16_t patch)
+{
+    if (compiler->depth >= MISSION_MAX_DEPTH)
+        return fail(compiler, "blocks nested too deep");
+    compiler->blocks[compiler->depth].kind = kind;
+    compiler->blocks[compiler->depth].start = start;
+    compiler->blocks[compiler->depth].patch = patch;
+    compiler->depth++;
+    return true;
+}
+
+void mission_compile_begin(mission_compiler_t *compiler)
+{
+    memset(compiler, 0, sizeof(*compiler));
+}
+
+// Compile one line of a script, false on the first error, see compiler->error
+bool mission_compile_line(mission_compiler_t *compiler, const char *line)
+{
+    char word[MISSION_TEXT_SIZE + 2];
+    int32_t value;
+    const char *p;
+
+    if (compiler->error)
+        return false;
+    compiler->line++;
+    p = next_word(line, word, sizeof(word));
+    if (word[0] == '\0' || word[0] == '#')
+        return true; // blank line or comment
+
+    for (size_t i = 0; i < sizeof(move_statements) / sizeof(move_statements[0]); i++)
+    {
+        const move_statement_t *statement = &move_statements[i];
+        if (strcmp(word, statement->name) != 0)
+            continue;
+        int32_t args[2] = {0, 0};
+        for (uint8_t a = 0; a < statement->args; a++)
+            if (!(p = parse_number(compiler, p, &args[a])))
+                return false;
+        if (!at_end(p))
+            return fail(compiler, "unexpected text after move");
+        if (statement->type == MOTION_ARC && args[0] < 0)
+            return fail(compiler, "arc distance must not be negative");
+        emit(compiler, OP_MOVE);
+        emit(compiler, statement->type);
+        emit(compiler, statement->flags);
+        emit16(compiler, statement->sign * args[0]);
+        emit16(compiler, args[1]);
+        return !compiler->error;
+    }
+
+    if (strcmp(word, "sync") == 0)
+    {
+        if (!at_end(p))
+            return fail(compiler, "unexpected text after sync");
+        return emit(compiler, OP_SYNC);
+    }
+    if (strcmp(word, "until") == 0)
+        return emit(compiler, OP_UNTIL) && compile_condition(compiler, p);
+    if (strcmp(word, "if") == 0 || strcmp(word, "while") == 0)
+    {
+        uint16_t start = compiler->program.len;
+        if (!emit(compiler, OP_JUMP_IF_NOT) || !compile_condition(compiler, p))
+            return false;
+        uint16_t patch = compiler->program.len;
+        return emit16(compiler, 0) && push_block(compiler, word[0] == 'i' ? BLOCK_IF : BLOCK_WHILE, start, patch);
+    }
+    if (strcmp(word, "else") == 0)
+    {
+        if (compiler->depth == 0 || compiler->blocks[compiler->depth - 1].kind != BLOCK_IF)
+            return fail(compiler, "else without if");
+        if (!emit(compiler, OP_JUMP))
+            return false;
+        uint16_t patch = compiler->program.len;
+        if (!emit16(compiler, 0))
+            return false;
+        // the condition failing jumps past the jump to the end
+        patch16(compiler, compiler->blocks[compiler->depth - 1].patch, compiler->program.len);
+        compiler->blocks[compiler->depth - 1].kind = BLOCK_ELSE;
+        compiler->blocks[compiler->depth - 1].patch = patch;
+        return true;
+    }
+    if (strcmp(word, "repeat") == 0)
+    {
+        if (!(p = parse_number(compiler, p, &value)))
+            return false;
+        if (value <= 0)
+            return fail(compiler, "repeat count must be positive");
+        if (!at_end(p))
+            return fail(compiler, "unexpected text after repeat");
+        if (!emit(compiler, OP_REPEAT) || !emit16(compiler, value))
+            return false;
+        return push_block(compiler, BLOCK_REPEAT, compiler->program.len, 0);
+    }
+    if (strcmp(word, "loop") == 0)
+        return push_block(compiler, BLOCK_LOOP, compiler->program.len, 0);
+    if (strcmp(word, "end") == 0)
+    {
+        if (compiler->depth == 0)
+            return fail(compiler, "end without block");
+        compiler->depth--;
+        uint8_t kind = compiler->blocks[compiler->depth].kind;
+        uint16_t start = compiler->blocks[compiler->depth].start;
+        uint16_t patch = compiler->blocks[compiler->depth].patch;
+        if (kind == BLOCK_WHILE || kind == BLOCK_LOOP)
+        {
+            if (!emit(compiler, OP_JUMP) || !emit16(compiler, start))
+                return false;
+        }
+        else if (kind == BLOCK_REPEAT)
+        {
+            if (!emit(compiler, OP_LOOP) || !emit16(compiler, start))
+                return false;
+        }
+        if (kind != BLOCK_REPEAT && kind != BLOCK_LOOP)
+            patch16(compiler, patch, compiler->program.len);
+        return true;
+    }
+    if (strcmp(word, "say") == 0)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        char text[MISSION_TEXT_SIZE + 2];
+        size_t len = strcspn(p, "\r\n");
+        if (len >= sizeof(text))
+            return fail(compiler, "text too long");
+        memcpy(text, p, len);
+        text[len] = '\0';
+        return emit(compiler, OP_SAY) && emit_text(compiler, text);
+    }
+    return fail(compiler, "unknown statement");
+}
+
+// Check the script is complete and terminate it
+bool mission_compile_end(mission_compiler_t *compiler)
+{
+    if (!compiler->error && compiler->depth)
+        fail(compiler, "missing end");
+    if (compiler->error)
+        return false;
+    compiler->program.code[compiler->program.len++] = OP_END; // emit() kept room for it
+    return true;
+}
+
+void mission_load(mission_t *mission, const mission_program_t *program)
+{
+    memset(mission, 0, sizeof(*mission));
+    mission->program = *program;
+    mission->running = program->len > 0;
+}
+
+void mission_stop(mission_t *mission)
+{
+    mission->running = false;
+}
+
+static uint16_t read16(const uint8_t *code)
+{
+    return code[0] | code[1] << 8;
+}
+
+static bool moving(const motion_engine_t *engine)
+{
+    return engine->active || motion_queued(engine) > 0;
+}
+
+// evaluate the condition at code, sets *next to what follows it
+static bool condition(const uint8_t *code, const uint8_t **next, const motion_engine_t *engine, const mission_sensors_t *sensors)
+{
+    bool negate = code[0] & COND_NOT;
+    bool result = false;
+    switch (*code++ & ~COND_NOT)
+    {
+    case COND_OBSTACLE_BELOW:
+        result = sensors->obstacle_cm < (int16_t)read16(code);
+        code += 2;
+        break;
+    case COND_OBSTACLE_ABOVE:
+        result = sensors->obstacle_cm > (int16_t)read16(code);
+        code += 2;
+        break;
+    case COND_BARCODE:
+        result = strlen(sensors->barcode) == code[0] && memcmp(sensors->barcode, code + 1, code[0]) == 0;
+        code += 1 + code[0];
+        break;
+    case COND_LINE:
+        result = ((code[0] & 1) && sensors->left_ir_black) || ((code[0] & 2) && sensors->right_ir_black);
+        code++;
+        break;
+    case COND_MOVING:
+        result = moving(engine);
+        break;
+    }
+    *next = code;
+    return negate ? !result : result;
+}
+
+// Run the script for one control period: at most MISSION_STEPS_PER_TICK
+// instructions, stopping early at the first one that has to wait. Moves are
+// pushed to the engine, call before motion_step so they start this period.
+uint8_t mission_step(mission_t *mission, motion_engine_t *engine, const mission_sensors_t *sensors)
+{
+    if (!mission->running)
+        return 0;
+    mission->ticks++;
+    for (int steps = 0; steps < MISSION_STEPS_PER_TICK; steps++)
+    {
+        const uint8_t *code = mission->program.code;
+        const uint8_t *op = code + mission->pc;
+        const uint8_t *next;
+        if (mission->pc >= mission->program.len || op[0] == OP_END)
+        {
+            mission->running = false;
+            return MISSION_EVENT_DONE;
+        }
+        switch (op[0])
+        {
+        case OP_MOVE:
+        {
+            motion_primitive_t primitive = {.type = op[1], .flags = op[2], .value = (int16_t)read16(op + 3), .arg = (int16_t)read16(op + 5)};
+            if (primitive.type == MOTION_STOP)
+                motion_flush(engine);
+            if (!motion_push(engine, &primitive))
+                return 0; // queue full, try again next period
+            mission->pc += 7;
+            break;
+        }
+        case OP_SYNC:
+            if (moving(engine))
+                return 0;
+            mission->pc++;
+            break;
+        case OP_UNTIL:
+            if (!condition(op + 1, &next, engine, sensors))
+                return 0;
+            mission->pc = next - code;
+            break;
+        case OP_JUMP_IF_NOT:
+            mission->pc = condition(op + 1, &next, engine, sensors) ? next + 2 - code : read16(next);
+            break;
+        case OP_JUMP:
+            mission->pc = read16(op + 1);
+            break;
+        case OP_REPEAT:
+            if (mission->depth >= MISSION_MAX_DEPTH)
+            {
+                mission->running = false;
+                return MISSION_EVENT_DONE;
+            }
+            mission->counters[mission->depth++] = read16(op + 1);
+            mission->pc += 3;
+            break;
+        case OP_LOOP:
+            if (mission->depth && --mission->counters[mission->depth - 1] > 0)
+                mission->pc = read16(op + 1);
+            else
+            {
+                mission->depth--;
+                mission->pc += 3;
+            }
+            break;
+        case OP_SAY:
+            memcpy(mission->say_text, op + 2, op[1]);
+            mission->say_text[op[1]] = '\0';
+            mission->pc += 2 + op[1];
+            return MISSION_EVENT_SAY; // one line per period, the lanes are small
+        default:
+            mission->running = false; // not compiled by us
+            return MISSION_EVENT_DONE;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef MISSION_H
+#define MISSION_H
+// Mission scripts: a line-based language compiled to bytecode on upload and
+// run by move_task alongside the motion engine.
+//
+//   fwd 100 | back 50 | bar 200 | turn 90 | arc 80 45 | wait 500 | stop
+//       queue a motion primitive, the script carries on without waiting so
+//       consecutive moves blend, see motion.h; arcs only drive forward
+//   sync                wait until the queued moves are done
+//   until <cond>        wait until the condition holds
+//   if <cond> / else / end
+//   while <cond> / end
+//   repeat <n> / end
+//   loop / end          forever, until "mission stop"
+//   say <text>          report text to the client
+//
+// Conditions, each may be prefixed with "not":
+//   obstacle < <cm>, obstacle > <cm>, barcode <text>, line left|right|any, moving
+//
+// A tick runs at most MISSION_STEPS_PER_TICK instructions and stops at the
+// first one that has to wait, so a script can never hold up the control loop.
+// Programs are at most MISSION_CODE_SIZE bytes with MISSION_MAX_DEPTH nested
+// blocks, nothing is allocated. Pure logic with no Pico includes.
+#include <stdbool.h>
+#include <stdint.h>
+#include "motion.h"
+
+#define MISSION_CODE_SIZE 256
+#define MISSION_MAX_DEPTH 8
+#define MISSION_STEPS_PER_TICK 16
+#define MISSION_TEXT_SIZE 24 // longest say text or barcode
+
+typedef struct mission_program_t_
+{
+    uint16_t len;
+    uint8_t code[MISSION_CODE_SIZE];
+} mission_program_t;
+
+// Compiles one line at a time, so a script can be uploaded line by line
+typedef struct mission_compiler_t_
+{
+    mission_program_t program;
+    uint16_t line;
+    uint8_t depth;
+    struct
+    {
+        uint8_t kind;
+        uint16_t start; // first instruction of a loop
+        uint16_t patch; // jump operand to fill in at the end of the block
+    } blocks[MISSION_MAX_DEPTH];
+    const char *error; // first error, compiling stops there
+} mission_compiler_t;
+
+// Sensor state the conditions look at
+typedef struct mission_sensors_t_
+{
+    float obstacle_cm;
+    bool left_ir_black;
+    bool right_ir_black;
+    const char *barcode; // payload of the last barcode read, "" if none
+} mission_sensors_t;
+
+// mission_step() events
+#define MISSION_EVENT_SAY 0x01  // say text is in say_text
+#define MISSION_EVENT_DONE 0x02 // the script ran to its end
+
+typedef struct mission_t_
+{
+    mission_program_t program;
+    bool running;
+    uint16_t pc;
+    uint8_t depth;
+    uint16_t counters[MISSION_MAX_DEPTH]; // repeat counts left
+    char say_text[MISSION_TEXT_SIZE + 1];
+    uint32_t ticks; // ticks since the script started
+} mission_t;
+
+void mission_compile_begin(mission_compiler_t *compiler);
+bool mission_compile_line(mission_compiler_t *compiler, const char *line);
+bool mission_compile_end(mission_compiler_t *compiler);
+
+void mission_load(mission_t *mission, const mission_program_t *program);
+void mission_stop(mission_t *mission);
+uint8_t mission_step(mission_t *mission, motion_engine_t *engine, const mission_sensors_t *sensors);
+
+#endif
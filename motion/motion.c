@@ -0,0 +1,428 @@
+#include <math.h>
+#include <string.h>
+#include "motion.h"
+
+#define DIST_DEADBAND 2     // codes, a straight or arc this close to its end is on target
+#define BEARING_DEADBAND 3  // degrees, a turn this close to its target is on target
+#define REVERSE_HOLD 0.1f   // seconds stopped before driving the other way, for the wheels to stop
+#define LINE_MIN_SHARE 0.2f // slowest the inner wheel gets while following the analog line
+#define QUEUE_MASK (MOTION_QUEUE_SIZE - 1)
+
+static int wrap_bearing(int bearing)
+{
+    bearing %= 360;
+    return bearing < 0 ? bearing + 360 : bearing;
+}
+
+// shortest signed turn from current to target, clockwise positive
+float motion_bearing_error(float current, float target)
+{
+    float error = fmodf(target - current, 360);
+    if (error > 180)
+        return error - 360;
+    if (error < -180)
+        return error + 360;
+    return error;
+}
+
+void motion_init(motion_engine_t *engine, uint16_t max_speed, float gain_dt, uint16_t settle_steps)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->max_speed = max_speed;
+    engine->gain_dt = gain_dt;
+    engine->settle_steps = settle_steps;
+    engine->obstacle_cm = 15;
+    engine->next_id = 1;
+    engine->idle = true;
+}
+
+// Append a primitive, fills in its id, false if the queue is full
+bool motion_push(motion_engine_t *engine, motion_primitive_t *primitive)
+{
+    if ((uint8_t)(engine->head - engine->tail) >= MOTION_QUEUE_SIZE)
+        return false;
+    primitive->id = engine->next_id++;
+    engine->queue[engine->head & QUEUE_MASK] = *primitive;
+    engine->head++;
+    return true;
+}
+
+// Drop everything queued and the primitive in progress
+void motion_flush(motion_engine_t *engine)
+{
+    engine->tail = engine->head;
+    engine->active = false;
+    engine->blended = false;
+}
+
+uint8_t motion_queued(const motion_engine_t *engine)
+{
+    return engine->head - engine->tail;
+}
+
+static const motion_primitive_t *peek(const motion_engine_t *engine, uint8_t n)
+{
+    if (n >= motion_queued(engine))
+        return NULL;
+    return &engine->queue[(engine->tail + n) & QUEUE_MASK];
+}
+
+static int direction(const motion_primitive_t *p)
+{
+    if (p->type == MOTION_ARC)
+        return 1;
+    if (p->type == MOTION_STRAIGHT)
+        return p->value < 0 ? -1 : 1;
+    return 0;
+}
+
+// next can take over from p without settling
+static bool blendable(const motion_primitive_t *p, const motion_primitive_t *next)
+{
+    return next && direction(p) != 0 && direction(p) == direction(next);
+}
+
+static float route_position(const motion_engine_t *engine)
+{
+    return (engine->pos_left + engine->pos_right) / 2;
+}
+
+static void start(motion_engine_t *engine, const motion_input_t *in)
+{
+    engine->current = *peek(engine, 0);
+    engine->tail++;
+    engine->active = true;
+    engine->elapsed = 0;
+    engine->settled = 0;
+    engine->integral = 0;
+    engine->line_tracking = false;
+    engine->start_left = engine->pos_left;
+    engine->start_right = engine->pos_right;
+
+    motion_primitive_t *p = &engine->current;
+    switch (p->type)
+    {
+    case MOTION_STRAIGHT:
+    case MOTION_ARC:
+        // a blended start continues from where the previous move was meant to end, so errors do not add up
+        engine->origin = engine->blended ? engine->planned : route_position(engine);
+        engine->target = engine->origin + p->value;
+        engine->planned = engine->target;
+        engine->arc_bearing = engine->target_bearing;
+        engine->last_error = fabsf(engine->target - route_position(engine));
+        break;
+    case MOTION_TURN:
+        engine->target_bearing = wrap_bearing(engine->target_bearing + p->value);
+        engine->last_error = motion_bearing_error(in->bearing, engine->target_bearing);
+        break;
+    case MOTION_STOP:
+        engine->tail = engine->head;
+        engine->target_bearing = in->bearing;
+        break;
+    }
+    engine->blended = false;
+}
+
+static void finish(motion_engine_t *engine, bool blend)
+{
+    if (engine->current.type == MOTION_ARC)
+        engine->target_bearing = wrap_bearing(engine->arc_bearing + engine->current.arg);
+    engine->done_id = engine->current.id;
+    engine->active = false;
+    engine->blended = blend;
+}
+
+// distance to the end of the current move and every move blended after it, in the direction of travel
+static float chain_error(const motion_engine_t *engine, float error)
+{
+    const motion_primitive_t *p = &engine->current;
+    for (uint8_t n = 0; blendable(p, peek(engine, n)); n++)
+    {
+        p = peek(engine, n);
+        error += p->value * direction(p);
+    }
+    return error;
+}
+
+// analog line following: PD on the line offset, it replaces both the wheel balance and the black flags
+static void follow_line(motion_engine_t *engine, const motion_input_t *in, motion_output_t *out, uint16_t speed)
+{
+    float derivative = engine->line_tracking ? (in->line_offset - engine->last_line_offset) * engine->gain_dt / in->dt : 0;
+    engine->last_line_offset = in->line_offset;
+    engine->line_tracking = true;
+    float steer = engine->gains.line_p * in->line_offset + engine->gains.line_d * derivative;
+    float inner = 1 - fminf(fabsf(steer), 1 - LINE_MIN_SHARE);
+    out->left_speed = speed;
+    out->right_speed = speed;
+    // the same sides as the digital correction, a line under the left sensor slows the right wheel
+    if (steer > 0)
+        out->right_speed = speed * inner;
+    else
+        out->left_speed = speed * inner;
+}
+
+// straights and arcs: PD on the distance left, steering to keep the wheels level, follow the line or the arc
+static void step_distance(motion_engine_t *engine, const motion_input_t *in, motion_output_t *out, uint8_t *events)
+{
+    const motion_primitive_t *p = &engine->current;
+    int dir = direction(p);
+    float error = (engine->target - route_position(engine)) * dir; // positive while short of the end
+    bool blend = blendable(p, peek(engine, 0));
+
+    if (dir > 0 && in->obstacle_cm < engine->obstacle_cm)
+    {
+        motion_flush(engine);
+        engine->target_bearing = in->bearing;
+        *events |= MOTION_EVENT_OBSTACLE;
+        return;
+    }
+    if (blend && error < DIST_DEADBAND)
+    {
+        finish(engine, true);
+        *events |= MOTION_EVENT_DONE;
+        return;
+    }
+
+    float distance = fabsf(error);
+    float derivative = (distance - engine->last_error) * engine->gain_dt / in->dt;
+    engine->last_error = distance;
+    engine->error = error;
+    float control;
+    if (distance < DIST_DEADBAND)
+    {
+        control = 0;
+        if (++engine->settled >= engine->settle_steps)
+        {
+            finish(engine, false);
+            *events |= MOTION_EVENT_DONE;
+            return;
+        }
+    }
+    else
+    {
+        control = engine->gains.dist_p * chain_error(engine, distance);
+        engine->settled = 0;
+    }
+    control += engine->gains.dist_d * derivative;
+    if (control > 1)
+        control = 1;
+    if (control < 0)
+        control = 0;
+    engine->control = control;
+
+    // past the end, drive the other way
+    uint8_t drive = (error < 0) == (dir > 0) ? MOTION_DRIVE_BACKWARD : MOTION_DRIVE_FORWARD;
+    uint16_t speed = control * engine->max_speed;
+    out->drive = control > 0 ? drive : MOTION_DRIVE_STOP;
+    out->left_speed = speed;
+    out->right_speed = speed;
+
+    float left = fabsf(engine->pos_left - engine->start_left);
+    float right = fabsf(engine->pos_right - engine->start_right);
+    if (p->type == MOTION_ARC)
+    {
+        // the heading follows the arc in proportion to the distance covered
+        float done = p->value ? (route_position(engine) - engine->origin) / p->value : 1;
+        done = done < 0 ? 0 : done > 1 ? 1 : done;
+        float steer = engine->gains.turn_p * motion_bearing_error(in->bearing, engine->arc_bearing + p->arg * done);
+        float inner = 1 - fminf(fabsf(steer), 1);
+        if (steer > 0)
+            out->right_speed = speed * inner;
+        else
+            out->left_speed = speed * inner;
+        return;
+    }
+    if (drive == MOTION_DRIVE_FORWARD && !(p->flags & MOTION_FLAG_NO_LINE) && in->line_valid)
+    {
+        follow_line(engine, in, out, speed);
+        return;
+    }
+    engine->line_tracking = false;
+    if (left < right)
+        out->right_speed = speed * MOTION_RIGHT_TILT;
+    if (left > right)
+        out->left_speed = speed * MOTION_LEFT_TILT;
+    if (drive == MOTION_DRIVE_FORWARD && !(p->flags & MOTION_FLAG_NO_LINE))
+    {
+        if (in->left_ir_black)
+            out->right_speed = speed * MOTION_RIGHT_TILT;
+        if (in->right_ir_black)
+            out->left_speed = speed * MOTION_LEFT_TILT;
+    }
+}
+
+// turns: PID on the bearing error, rotating in place
+static void step_turn(motion_engine_t *engine, const motion_input_t *in, motion_output_t *out, uint8_t *events)
+{
+    float error = motion_bearing_error(in->bearing, engine->target_bearing);
+    engine->integral += error * in->dt / engine->gain_dt;
+    float derivative = (error - engine->last_error) * engine->gain_dt / in->dt;
+    engine->last_error = error;
+    engine->error = error;
+
+    float control;
+    if (fabsf(error) > BEARING_DEADBAND)
+    {
+        control = engine->gains.turn_p * error;
+        engine->settled = 0;
+    }
+    else
+    {
+        // nothing waiting, hold the heading for the full settle time
+        uint16_t settle = motion_queued(engine) ? engine->settle_steps / 5 : engine->settle_steps;
+        if (++engine->settled >= settle)
+        {
+            finish(engine, false);
+            *events |= MOTION_EVENT_DONE;
+            return;
+        }
+        control = 0;
+    }
+    control += engine->gains.turn_i * engine->integral + engine->gains.turn_d * derivative;
+    out->drive = control > 0 ? MOTION_DRIVE_CW : MOTION_DRIVE_CCW;
+    control = fminf(fabsf(control), 1);
+    engine->control = control;
+    out->left_speed = out->right_speed = control * engine->max_speed;
+}
+
+static void update_odometry(motion_engine_t *engine, const motion_input_t *in)
+{
+    int64_t left = in->left_code - engine->last_left;
+    int64_t right = in->right_code - engine->last_right;
+    engine->last_left = in->left_code;
+    engine->last_right = in->right_code;
+    if (!engine->have_codes || left < 0 || right < 0)
+    {
+        engine->have_codes = true; // first step, or the encoders were reset
+        return;
+    }
+    switch (engine->last_motion)
+    {
+    case MOTION_DRIVE_FORWARD:
+        engine->pos_left += left;
+        engine->pos_right += right;
+        break;
+    case MOTION_DRIVE_BACKWARD:
+        engine->pos_left -= left;
+        engine->pos_right -= right;
+        break;
+    }
+}
+
+// Run the current primitive for one control period, returns MOTION_EVENT_* bits
+uint8_t motion_step(motion_engine_t *engine, const motion_input_t *in, motion_output_t *out)
+{
+    uint8_t events = 0;
+    update_odometry(engine, in);
+
+    out->drive = MOTION_DRIVE_STOP;
+    out->left_speed = out->right_speed = 0;
+    // a primitive that ends or is blended hands over within the same step, bounded by the queue
+    for (int n = 0; n <= MOTION_QUEUE_SIZE; n++)
+    {
+        if (!engine->active)
+        {
+            if (!motion_queued(engine))
+            {
+                if (!engine->idle)
+                    events |= MOTION_EVENT_IDLE;
+                engine->idle = true;
+                engine->blended = false;
+                break;
+            }
+            if (engine->idle)
+                engine->target_bearing = in->bearing; // a new route turns relative to where the car points now
+            engine->idle = false;
+            start(engine, in);
+            events |= MOTION_EVENT_STARTED;
+        }
+        switch (engine->current.type)
+        {
+        case MOTION_STRAIGHT:
+        case MOTION_ARC:
+            step_distance(engine, in, out, &events);
+            break;
+        case MOTION_TURN:
+            step_turn(engine, in, out, &events);
+            break;
+        case MOTION_WAIT:
+            engine->elapsed += in->dt;
+            if (engine->elapsed * 1000 >= engine->current.value)
+            {
+                finish(engine, false);
+                events |= MOTION_EVENT_DONE;
+            }
+            break;
+        case MOTION_STOP:
+            finish(engine, false);
+            events |= MOTION_EVENT_DONE;
+            break;
+        }
+        if (engine->active || out->drive != MOTION_DRIVE_STOP)
+            break;
+    }
+
+    // let the wheels stop before reversing
+    bool moving = engine->last_drive == MOTION_DRIVE_FORWARD || engine->last_drive == MOTION_DRIVE_BACKWARD;
+    bool reverse = (out->drive == MOTION_DRIVE_FORWARD || out->drive == MOTION_DRIVE_BACKWARD) && out->drive != engine->last_drive;
+    if (moving && reverse)
+        engine->hold = REVERSE_HOLD;
+    if (engine->hold > 0)
+    {
+        engine->hold -= in->dt;
+        out->drive = MOTION_DRIVE_STOP;
+        out->left_speed = out->right_speed = 0;
+    }
+    engine->last_drive = out->drive;
+    if (out->drive == MOTION_DRIVE_FORWARD || out->drive == MOTION_DRIVE_BACKWARD)
+        engine->last_motion = out->drive;
+    else if (out->drive != MOTION_DRIVE_STOP)
+        engine->last_motion = MOTION_DRIVE_STOP; // codes counted while rotating are not travel
+    return events;
+}
+
+// Progress through the current primitive in permille
+uint16_t motion_progress(const motion_engine_t *engine)
+{
+    const motion_primitive_t *p = &engine->current;
+    float done = 0;
+    if (!engine->active)
+        return 0;
+    switch (p->type)
+    {
+    case MOTION_STRAIGHT:
+    case MOTION_ARC:
+        done = p->value ? (route_position(engine) - engine->origin) / p->value : 1;
+        break;
+    case MOTION_TURN:
+        done = p->value ? 1 - fabsf(engine->error) / fabsf((float)p->value) : 1;
+        break;
+    case MOTION_WAIT:
+        done = p->value ? engine->elapsed * 1000 / p->value : 1;
+        break;
+    }
+    done = done < 0 ? 0 : done > 1 ? 1 : done;
+    return done * 1000;
+}
+
+// move_task mode character for telemetry: p idle, f forward, r reverse, b barcode run, t turn, a arc, w wait
+char motion_mode(const motion_engine_t *engine)
+{
+    const motion_primitive_t *p = &engine->current;
+    if (!engine->active)
+        return 'p';
+    switch (p->type)
+    {
+    case MOTION_STRAIGHT:
+        if (p->value < 0)
+            return 'r';
+        return p->flags & MOTION_FLAG_NO_LINE ? 'b' : 'f';
+    case MOTION_TURN:
+        return 't';
+    case MOTION_ARC:
+        return 'a';
+    case MOTION_WAIT:
+        return 'w';
+    }
+    return 'p';
+}
@@ -0,0 +1,137 @@
+#ifndef MOTION_H
+#define MOTION_H
+// Queued motion primitives for move_task.
+//
+// Commands append primitives to a queue, move_task calls motion_step() once a
+// control period with fresh sensor readings and applies the returned drive and
+// wheel speeds. When a primitive ends while moving and the next one can be
+// blended with it (straights in the same direction, arcs), the car carries on
+// at speed instead of settling first. Turns rotate in place, so they still
+// stop, but settle for a shorter time when more primitives are queued.
+//
+// Pure logic with no Pico includes, so it builds on the host too.
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MOTION_QUEUE_SIZE 16 // must be a power of two
+
+typedef enum
+{
+    MOTION_STRAIGHT, // value: encoder codes, negative drives backwards
+    MOTION_TURN,     // value: degrees clockwise, rotates in place
+    MOTION_ARC,      // value: encoder codes forward, not negative, arg: degrees clockwise over that distance
+    MOTION_WAIT,     // value: milliseconds stopped
+    MOTION_STOP,     // drop the rest of the queue and hold the current heading
+} motion_type_t;
+
+#define MOTION_FLAG_NO_LINE 0x01 // straight: ignore the IR line sensors, for barcode runs
+#define MOTION_LEFT_TILT 0.5f    // left wheel share when steering left, see left_tilt()
+#define MOTION_RIGHT_TILT 0.8f   // right wheel share when steering right, see right_tilt()
+
+typedef struct motion_primitive_t_
+{
+    uint8_t type;  // motion_type_t
+    uint8_t flags; // MOTION_FLAG_*
+    uint16_t id;   // set by motion_push, reported with progress
+    int32_t value;
+    int32_t arg;
+} motion_primitive_t;
+
+typedef enum
+{
+    MOTION_DRIVE_STOP,
+    MOTION_DRIVE_FORWARD,
+    MOTION_DRIVE_BACKWARD,
+    MOTION_DRIVE_CW,
+    MOTION_DRIVE_CCW,
+} motion_drive_t;
+
+// Sensor readings for one step
+typedef struct motion_input_t_
+{
+    float dt;          // seconds since the previous step
+    int64_t left_code; // wheel encoder codes, they count up in both directions
+    int64_t right_code;
+    int bearing;       // degrees, clockwise
+    float obstacle_cm; // ultrasonic distance ahead
+    bool left_ir_black;
+    bool right_ir_black;
+    bool line_valid;   // line_offset is measured, forward straights follow it instead of the black flags
+    float line_offset; // analog line position, -1..1, positive towards the left sensor
+} motion_input_t;
+
+// What to do with the motors until the next step
+typedef struct motion_output_t_
+{
+    uint8_t drive;        // motion_drive_t
+    uint16_t left_speed;  // PWM level
+    uint16_t right_speed; // PWM level
+} motion_output_t;
+
+typedef struct motion_gains_t_
+{
+    float turn_p, turn_i, turn_d;
+    float dist_p, dist_d;
+    float line_p, line_d; // analog line following, steer per unit of line offset
+} motion_gains_t;
+
+// motion_step() events
+#define MOTION_EVENT_STARTED 0x01  // a primitive started, see current.id
+#define MOTION_EVENT_DONE 0x02     // a primitive finished, see done_id
+#define MOTION_EVENT_IDLE 0x04     // the queue ran empty
+#define MOTION_EVENT_OBSTACLE 0x08 // the route was dropped for an obstacle ahead
+
+typedef struct motion_engine_t_
+{
+    // configuration, the gains may be changed between steps
+    motion_gains_t gains;
+    uint16_t max_speed;    // PWM level at full control
+    float gain_dt;         // step the gains were tuned at, D and I terms are scaled by dt against it
+    uint16_t settle_steps; // steps on target that end a primitive
+    float obstacle_cm;     // forward moves stop closer than this
+
+    motion_primitive_t queue[MOTION_QUEUE_SIZE];
+    uint8_t head, tail;
+    uint16_t next_id;
+
+    bool idle; // nothing ran since the queue last emptied
+    bool active;
+    motion_primitive_t current;
+    uint16_t done_id;
+
+    // odometry, signed codes along the route, integrated with the drive direction
+    int64_t last_left, last_right;
+    bool have_codes;
+    float pos_left, pos_right;
+    uint8_t last_drive;
+    uint8_t last_motion; // last straight drive, codes counted after stopping are the wheels coasting
+
+    // state of the current primitive
+    float origin;   // route position the current straight or arc started from
+    float target;   // route position it ends at
+    float planned;  // where the last straight or arc was meant to end, for blending
+    bool blended;   // the previous primitive handed over without settling
+    float start_left, start_right;
+    int target_bearing;
+    int arc_bearing;
+    float elapsed;
+    float hold;     // seconds left stopped before reversing
+    uint16_t settled;
+    float last_error;
+    float integral;
+    float error;    // last distance or bearing error, for telemetry
+    float control;
+    float last_line_offset;
+    bool line_tracking; // last_line_offset is from the previous step
+} motion_engine_t;
+
+void motion_init(motion_engine_t *engine, uint16_t max_speed, float gain_dt, uint16_t settle_steps);
+bool motion_push(motion_engine_t *engine, motion_primitive_t *primitive);
+void motion_flush(motion_engine_t *engine);
+uint8_t motion_queued(const motion_engine_t *engine);
+uint8_t motion_step(motion_engine_t *engine, const motion_input_t *in, motion_output_t *out);
+uint16_t motion_progress(const motion_engine_t *engine);
+char motion_mode(const motion_engine_t *engine);
+float motion_bearing_error(float current, float target);
+
+#endif
@@ -12,6 +12,8 @@
 #include "hardware/pwm.h"
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
 #include "motor.h"
 #include "magnometer.h"
 
@@ -36,9 +38,14 @@
 #define RW_RV 0x40000 //bit 18
 #define RW_FW 0x80000 //bit 19
 
+// PWM counter divider, with the default wrap one period is about 5 ms
+#define PWM_CLKDIV 100
+
 
 volatile long long  g_left_wheel_code = 0;
 volatile long long  g_right_wheel_code = 0;
+// guards the codes against the encoder IRQ and writers on the other core
+static spin_lock_t *wheel_lock;
 volatile unsigned int speed = 0;
 
 
@@ -47,6 +54,7 @@ uint slice_num_2;
 
 //Initialise the respective gpio pins
 void init_engine() {
+    wheel_lock = spin_lock_init(spin_lock_claim_unused(true));
 
     gpio_init(IN1_PIN);
     gpio_init(IN2_PIN);
@@ -67,8 +75,8 @@ void init_motor(uint16_t default_speed) {
     slice_num_1 = pwm_gpio_to_slice_num(ENA_PIN);
     slice_num_2 = pwm_gpio_to_slice_num(ENB_PIN);
 
-    pwm_set_clkdiv(slice_num_1, 100);
-    pwm_set_clkdiv(slice_num_2, 100);
+    pwm_set_clkdiv(slice_num_1, PWM_CLKDIV);
+    pwm_set_clkdiv(slice_num_2, PWM_CLKDIV);
 
     pwm_set_wrap(slice_num_1, default_speed);
     pwm_set_wrap(slice_num_2, default_speed);
@@ -126,6 +134,26 @@ void set_speed(uint16_t current_speed){
     return;
 }
 
+// Set each wheel on its own, for steering without the fixed tilt ratios
+void set_wheel_speeds(uint16_t left_speed, uint16_t right_speed){
+    speed = left_speed > right_speed ? left_speed : right_speed;
+    pwm_set_chan_level(slice_num_2, PWM_CHAN_B, left_speed);
+    pwm_set_chan_level(slice_num_1, PWM_CHAN_A, right_speed);
+}
+
+uint16_t get_speed(){
+    return speed;
+}
+
+// Time until a level set now reaches the pins, the slices latch it at their next wrap
+uint32_t pwm_update_delay_us(){
+    uint32_t top = pwm_hw->slice[slice_num_1].top;
+    uint32_t left = pwm_get_counter(slice_num_2);
+    uint32_t right = pwm_get_counter(slice_num_1);
+    uint32_t counts = top - (left < right ? left : right);
+    return (uint64_t)counts * PWM_CLKDIV * 1000000 / clock_get_hz(clk_sys);
+}
+
 //Turn left 
 void left_tilt() {
     //Slow right motor
@@ -139,14 +167,32 @@ void right_tilt() {
 }
 
 void left_wheel_encoder_handler(uint32_t events){
+    uint32_t save = spin_lock_blocking(wheel_lock);
     ++g_left_wheel_code;
+    spin_unlock(wheel_lock, save);
 }
 
 void right_wheel_encoder_handler(uint32_t events){
+    uint32_t save = spin_lock_blocking(wheel_lock);
     ++g_right_wheel_code;
+    spin_unlock(wheel_lock, save);
 }
 
 void reset_wheel_encoder(){
-    g_left_wheel_code = 0;
-    g_right_wheel_code = 0;
+    set_wheel_codes(0, 0);
+}
+
+void set_wheel_codes(long long left, long long right){
+    uint32_t save = spin_lock_blocking(wheel_lock);
+    g_left_wheel_code = left;
+    g_right_wheel_code = right;
+    spin_unlock(wheel_lock, save);
+}
+
+// Consistent pair of codes, needed off the encoder IRQ's core
+void get_wheel_codes(long long *left, long long *right){
+    uint32_t save = spin_lock_blocking(wheel_lock);
+    *left = g_left_wheel_code;
+    *right = g_right_wheel_code;
+    spin_unlock(wheel_lock, save);
 }
@@ -9,6 +9,9 @@ void stop();
 void left_tilt();
 void right_tilt();
 void set_speed(uint16_t current_speed);
+void set_wheel_speeds(uint16_t left_speed, uint16_t right_speed);
+uint16_t get_speed();
+uint32_t pwm_update_delay_us();
 // void move_forward_with_distance(int wheel_encoder_pin, int IN1_PIN, int IN2_PIN, int IN3_PIN, int IN4_PIN, double distance);
 
 #define right_wheel_encoder_pin 3
@@ -20,6 +23,8 @@ void right_wheel_encoder_handler();
 void rotate_clockwise();
 void rotate_counter_clockwise();
 void reset_wheel_encoder();
+void set_wheel_codes(long long left, long long right);
+void get_wheel_codes(long long *left, long long *right);
 #define DIST_5CM 10
 #define DIST_10CM 20
 #define DIST_20CM 40
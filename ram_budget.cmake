@@ -0,0 +1,130 @@
+# RAM budget per subsystem, from the GNU ld map file of the firmware.
+#
+#   cmake -DMAP=taskmanager.elf.map [-DOUT=ram_budget.txt] -P ram_budget.cmake
+#
+# Every input section placed in RAM (.data, .bss, RAM code and the reserved
+# stacks) is charged to the subsystem of the object it came from: our own
+# libraries by name, the FreeRTOS heap on its own line, the rest of the kernel,
+# lwIP, cyw43, the C library and the remaining Pico SDK.
+cmake_minimum_required(VERSION 3.15)
+
+if (NOT MAP OR NOT EXISTS "${MAP}")
+    message(WARNING "ram_budget: no map file ${MAP}")
+    return()
+endif ()
+set(RAM_SIZE 270336) # 264 KB, SRAM0-5
+
+file(STRINGS "${MAP}" lines)
+set(in_map FALSE)
+set(section "")
+set(subsystems "")
+foreach (line IN LISTS lines)
+    if (NOT in_map)
+        if (line MATCHES "^Linker script and memory map")
+            set(in_map TRUE)
+        endif ()
+        continue()
+    endif ()
+    # " .bss.name  0x20001234  0x40 object", long names put the rest on the next line
+    if (line MATCHES "^ (\\.[^ ]+|COMMON)$")
+        set(section "${CMAKE_MATCH_1}")
+        continue()
+    endif ()
+    if (line MATCHES "^ (\\.[^ ]+|COMMON) +0x([0-9a-f]+) +0x([0-9a-f]+) +(.+)$")
+        set(name "${CMAKE_MATCH_1}")
+        set(address "${CMAKE_MATCH_2}")
+        set(size_hex "${CMAKE_MATCH_3}")
+        set(object "${CMAKE_MATCH_4}")
+    elseif (section AND line MATCHES "^ +0x([0-9a-f]+) +0x([0-9a-f]+) +(.+)$")
+        set(name "${section}")
+        set(address "${CMAKE_MATCH_1}")
+        set(size_hex "${CMAKE_MATCH_2}")
+        set(object "${CMAKE_MATCH_3}")
+    else ()
+        set(section "")
+        continue()
+    endif ()
+    set(section "")
+    if (NOT name MATCHES "^(\\.data|\\.bss|COMMON|\\.time_critical|\\.uninitialized_data|\\.scratch_|\\.stack|\\.heap)")
+        continue()
+    endif ()
+    math(EXPR size "0x${size_hex}")
+    if (size EQUAL 0 OR address MATCHES "^0+$")
+        continue()
+    endif ()
+
+    if (object MATCHES "(^|/)lib(c|c_nano|g|gcc|m|nosys|stdc\\+\\+)\\.a\\(")
+        set(subsystem "libc")
+    elseif (object MATCHES "(^|/)lib([A-Za-z0-9_]+)\\.a\\(")
+        set(subsystem "${CMAKE_MATCH_2}")
+    elseif (object MATCHES "taskmanager\\.c\\.obj")
+        set(subsystem "taskmanager")
+    elseif (object MATCHES "heap_[0-9]\\.c")
+        set(subsystem "freertos_heap")
+    elseif (object MATCHES "FreeRTOS")
+        set(subsystem "freertos")
+    elseif (object MATCHES "lwip")
+        set(subsystem "lwip")
+    elseif (object MATCHES "cyw43")
+        set(subsystem "cyw43")
+    else ()
+        set(subsystem "pico_sdk")
+    endif ()
+    if (name MATCHES "^(\\.bss|COMMON|\\.uninitialized_data|\\.stack|\\.heap)")
+        set(kind bss)
+    else ()
+        set(kind data)
+    endif ()
+    if (NOT DEFINED ${subsystem}_data)
+        list(APPEND subsystems ${subsystem})
+        set(${subsystem}_data 0)
+        set(${subsystem}_bss 0)
+    endif ()
+    math(EXPR ${subsystem}_${kind} "${${subsystem}_${kind}} + ${size}")
+endforeach ()
+
+# largest first
+set(rows "")
+set(total 0)
+foreach (subsystem IN LISTS subsystems)
+    math(EXPR bytes "${${subsystem}_data} + ${${subsystem}_bss}")
+    math(EXPR total "${total} + ${bytes}")
+    math(EXPR key "1000000000 - ${bytes}")
+    list(APPEND rows "${key}|${subsystem}")
+endforeach ()
+list(SORT rows)
+
+set(report "RAM budget from ${MAP}\n")
+string(APPEND report "subsystem               data       bss     total\n")
+foreach (row IN LISTS rows)
+    string(REGEX REPLACE "^[0-9]+\\|" "" subsystem "${row}")
+    math(EXPR bytes "${${subsystem}_data} + ${${subsystem}_bss}")
+    foreach (field subsystem ${subsystem}_data ${subsystem}_bss bytes)
+        if (field STREQUAL "subsystem")
+            set(text "${subsystem}")
+            set(width 18)
+        else ()
+            set(text "${${field}}")
+            set(width 10)
+        endif ()
+        string(LENGTH "${text}" length)
+        math(EXPR pad "${width} - ${length}")
+        if (pad LESS 1)
+            set(pad 1)
+        endif ()
+        string(REPEAT " " ${pad} spaces)
+        if (field STREQUAL "subsystem")
+            string(APPEND report "${text}${spaces}")
+        else ()
+            string(APPEND report "${spaces}${text}")
+        endif ()
+    endforeach ()
+    string(APPEND report "\n")
+endforeach ()
+math(EXPR percent "${total} * 100 / ${RAM_SIZE}")
+string(APPEND report "total ${total} of ${RAM_SIZE} bytes (${percent}%)\n")
+
+message("${report}")
+if (OUT)
+    file(WRITE "${OUT}" "${report}")
+endif ()
@@ -0,0 +1,471 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include "recorder.h"
+
+// RECORD_STEP flags
+#define STEP_LEFT_IR 0x01
+#define STEP_RIGHT_IR 0x02
+#define STEP_LINE_VALID 0x04
+#define STEP_OBSTACLE 0x08    // obstacle_cm follows, INFINITY otherwise
+#define STEP_ECHO_VALID 0x10
+#define STEP_NEW_ECHO 0x20    // echo_us and echo_cm follow
+#define STEP_LINE_OFFSET 0x40 // line_offset follows, 0 otherwise
+
+#define MOVE_FLUSH 0x01
+#define MOVE_APPEND 0x02
+
+#define RECORD_MAX_SMALL 96 // every record but keyframes and missions
+
+// a record payload being built or read
+typedef struct cursor_t_
+{
+    uint8_t *out;
+    const uint8_t *in, *end;
+    uint16_t len;
+    bool ok;
+} cursor_t;
+
+// control_t as this build lays it out: its size and where the int64 fields land
+uint32_t recorder_layout(void)
+{
+    return (uint32_t)sizeof(control_t) << 16 ^ offsetof(control_t, maze) << 4 ^ offsetof(motion_engine_t, last_left);
+}
+
+static void put(cursor_t *c, const void *data, uint16_t n)
+{
+    memcpy(c->out + c->len, data, n);
+    c->len += n;
+}
+
+static void put_u8(cursor_t *c, uint8_t v)
+{
+    c->out[c->len++] = v;
+}
+
+static void put_u32(cursor_t *c, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        put_u8(c, v >> (8 * i));
+}
+
+static void put_f32(cursor_t *c, float v)
+{
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    put_u32(c, bits);
+}
+
+static void put_varint(cursor_t *c, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        put_u8(c, v | 0x80);
+        v >>= 7;
+    }
+    put_u8(c, v);
+}
+
+static void put_svarint(cursor_t *c, int64_t v)
+{
+    put_varint(c, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_base(cursor_t *c, const recorder_base_t *base)
+{
+    put_u32(c, base->time_us);
+    put_svarint(c, base->left_code);
+    put_svarint(c, base->right_code);
+    put_svarint(c, base->bearing);
+    put_u32(c, base->echo_us);
+    put_f32(c, base->echo_cm);
+    put_varint(c, base->barcode_count);
+    put(c, base->barcode, CONTROL_BARCODE_SIZE);
+}
+
+static uint8_t ring_at(const recorder_t *recorder, uint32_t index)
+{
+    return recorder->data[index & (RECORDER_SIZE - 1)];
+}
+
+static void ring_write(recorder_t *recorder, const uint8_t *data, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+        recorder->data[(recorder->tail + i) & (RECORDER_SIZE - 1)] = data[i];
+    recorder->tail += n;
+}
+
+// drop the oldest records until n bytes fit
+static void make_room(recorder_t *recorder, uint32_t n)
+{
+    while (RECORDER_SIZE - (recorder->tail - recorder->head) < n)
+    {
+        uint16_t len = ring_at(recorder, recorder->head + 1) | ring_at(recorder, recorder->head + 2) << 8;
+        recorder->head += RECORDER_RECORD_HEADER + len;
+        recorder->dropped++;
+    }
+}
+
+// a record of two parts, so keyframes need no second copy of control_t
+static void write_record(recorder_t *recorder, uint8_t type, const uint8_t *a, uint16_t a_len, const void *b, uint16_t b_len)
+{
+    uint16_t len = a_len + b_len;
+    uint8_t header[RECORDER_RECORD_HEADER] = {type, len & 0xff, len >> 8};
+    make_room(recorder, RECORDER_RECORD_HEADER + len);
+    ring_write(recorder, header, sizeof(header));
+    ring_write(recorder, a, a_len);
+    ring_write(recorder, b, b_len);
+    recorder->records++;
+}
+
+void recorder_clear(recorder_t *recorder)
+{
+    recorder->head = recorder->tail = 0;
+    recorder->records = recorder->dropped = 0;
+    recorder->steps = 0;
+    memset(&recorder->base, 0, sizeof(recorder->base));
+}
+
+void recorder_begin(recorder_t *recorder, const control_t *control, uint32_t time_us)
+{
+    if (recorder->steps != 0)
+        return;
+    uint8_t buf[RECORD_MAX_SMALL];
+    cursor_t c = {.out = buf};
+    if (recorder->records == 0)
+        recorder->base.time_us = time_us; // the first step codes its time against the start
+    recorder->base.gains = control->engine.gains;
+    put_u32(&c, recorder_layout());
+    put_base(&c, &recorder->base);
+    write_record(recorder, RECORD_KEYFRAME, buf, c.len, control, sizeof(*control));
+}
+
+void recorder_move(recorder_t *recorder, bool flush, bool append, const motion_primitive_t *primitive)
+{
+    uint8_t buf[RECORD_MAX_SMALL];
+    cursor_t c = {.out = buf};
+    put_u8(&c, (flush ? MOVE_FLUSH : 0) | (append ? MOVE_APPEND : 0));
+    if (append)
+    {
+        put_u8(&c, primitive->type);
+        put_u8(&c, primitive->flags);
+        put_svarint(&c, primitive->value);
+        put_svarint(&c, primitive->arg);
+    }
+    write_record(recorder, RECORD_MOVE, buf, c.len, NULL, 0);
+}
+
+void recorder_mission(recorder_t *recorder, const mission_program_t *program, uint32_t barcode_count)
+{
+    uint8_t buf[RECORD_MAX_SMALL];
+    cursor_t c = {.out = buf};
+    uint16_t len = program->len < MISSION_CODE_SIZE ? program->len : MISSION_CODE_SIZE;
+    put_varint(&c, barcode_count);
+    write_record(recorder, RECORD_MISSION, buf, c.len, program->code, len);
+}
+
+void recorder_map(recorder_t *recorder, const map_cmd_t *cmd)
+{
+    uint8_t buf[1 + sizeof(cmd->args)] = {cmd->op};
+    memcpy(buf + 1, cmd->args, sizeof(cmd->args));
+    write_record(recorder, RECORD_MAP, buf, sizeof(buf), NULL, 0);
+}
+
+void recorder_step(recorder_t *recorder, uint32_t time_us, const motion_gains_t *gains, const control_input_t *in,
+                   const control_output_t *out)
+{
+    recorder_base_t *base = &recorder->base;
+    uint8_t buf[RECORD_MAX_SMALL];
+    cursor_t c = {.out = buf};
+    if (memcmp(gains, &base->gains, sizeof(*gains)) != 0)
+    {
+        const float *g = &gains->turn_p;
+        for (int i = 0; i < 7; i++)
+            put_f32(&c, g[i]);
+        write_record(recorder, RECORD_GAINS, buf, c.len, NULL, 0);
+        base->gains = *gains;
+        c.len = 0;
+    }
+    if (in->barcode_count != base->barcode_count)
+    {
+        put_varint(&c, in->barcode_count);
+        put(&c, in->barcode, strnlen(in->barcode, CONTROL_BARCODE_SIZE - 1));
+        write_record(recorder, RECORD_BARCODE, buf, c.len, NULL, 0);
+        base->barcode_count = in->barcode_count;
+        memset(base->barcode, 0, sizeof(base->barcode));
+        memcpy(base->barcode, in->barcode, strnlen(in->barcode, CONTROL_BARCODE_SIZE - 1));
+        c.len = 0;
+    }
+
+    const motion_input_t *m = &in->motion;
+    bool new_echo = in->echo_valid && (in->echo_us != base->echo_us || in->echo_cm != base->echo_cm);
+    uint8_t flags = (m->left_ir_black ? STEP_LEFT_IR : 0) | (m->right_ir_black ? STEP_RIGHT_IR : 0) |
+                    (m->line_valid ? STEP_LINE_VALID : 0) | (isfinite(m->obstacle_cm) ? STEP_OBSTACLE : 0) |
+                    (in->echo_valid ? STEP_ECHO_VALID : 0) | (new_echo ? STEP_NEW_ECHO : 0) |
+                    (m->line_offset != 0 ? STEP_LINE_OFFSET : 0);
+    put_varint(&c, time_us - base->time_us);
+    put_f32(&c, m->dt);
+    put_svarint(&c, m->left_code - base->left_code);
+    put_svarint(&c, m->right_code - base->right_code);
+    put_svarint(&c, (int64_t)m->bearing - base->bearing);
+    put_u8(&c, flags);
+    if (flags & STEP_OBSTACLE)
+        put_f32(&c, m->obstacle_cm);
+    if (flags & STEP_LINE_OFFSET)
+        put_f32(&c, m->line_offset);
+    if (new_echo)
+    {
+        put_varint(&c, in->echo_us - base->echo_us);
+        put_f32(&c, in->echo_cm);
+        base->echo_us = in->echo_us;
+        base->echo_cm = in->echo_cm;
+    }
+    put_u8(&c, out->motion.drive);
+    put_varint(&c, out->motion.left_speed);
+    put_varint(&c, out->motion.right_speed);
+    put_u8(&c, out->motion_events);
+    put_u8(&c, out->mission_events);
+    put_u8(&c, out->map_events);
+    write_record(recorder, RECORD_STEP, buf, c.len, NULL, 0);
+
+    base->time_us = time_us;
+    base->left_code = m->left_code;
+    base->right_code = m->right_code;
+    base->bearing = m->bearing;
+    recorder->steps = (recorder->steps + 1) % RECORDER_KEYFRAME_STEPS;
+}
+
+uint32_t recorder_size(const recorder_t *recorder)
+{
+    return RECORDER_HEADER_SIZE + (recorder->tail - recorder->head);
+}
+
+uint32_t recorder_read(const recorder_t *recorder, uint32_t offset, uint8_t *out, uint32_t size)
+{
+    uint8_t header[RECORDER_HEADER_SIZE] = {0};
+    cursor_t c = {.out = header};
+    put_u32(&c, RECORDER_MAGIC);
+    put_u8(&c, RECORDER_VERSION);
+    uint32_t total = recorder_size(recorder), n = 0;
+    for (; n < size && offset + n < total; n++)
+    {
+        uint32_t at = offset + n;
+        out[n] = at < RECORDER_HEADER_SIZE ? header[at] : ring_at(recorder, recorder->head + at - RECORDER_HEADER_SIZE);
+    }
+    return n;
+}
+
+static uint8_t get_u8(cursor_t *c)
+{
+    if (c->in >= c->end)
+    {
+        c->ok = false;
+        return 0;
+    }
+    return *c->in++;
+}
+
+static void get(cursor_t *c, void *data, size_t n)
+{
+    if ((size_t)(c->end - c->in) < n)
+    {
+        c->ok = false;
+        memset(data, 0, n);
+        return;
+    }
+    memcpy(data, c->in, n);
+    c->in += n;
+}
+
+static uint32_t get_u32(cursor_t *c)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)get_u8(c) << (8 * i);
+    return v;
+}
+
+static float get_f32(cursor_t *c)
+{
+    uint32_t bits = get_u32(c);
+    float v;
+    memcpy(&v, &bits, 4);
+    return v;
+}
+
+static uint64_t get_varint(cursor_t *c)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64 && c->ok; shift += 7)
+    {
+        uint8_t b = get_u8(c);
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    c->ok = false;
+    return 0;
+}
+
+static int64_t get_svarint(cursor_t *c)
+{
+    uint64_t v = get_varint(c);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+bool recorder_reader_init(recorder_reader_t *reader, const uint8_t *data, size_t size)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->data = data;
+    reader->size = size;
+    cursor_t c = {.in = data, .end = data + size, .ok = true};
+    uint32_t magic = get_u32(&c);
+    uint8_t version = get_u8(&c);
+    reader->pos = RECORDER_HEADER_SIZE;
+    return c.ok && magic == RECORDER_MAGIC && version == RECORDER_VERSION && size >= RECORDER_HEADER_SIZE;
+}
+
+static bool decode_step(recorder_reader_t *reader, cursor_t *c, recorder_entry_t *entry)
+{
+    recorder_base_t *base = &reader->base;
+    control_input_t *in = &entry->input;
+    motion_input_t *m = &in->motion;
+    memset(in, 0, sizeof(*in));
+    base->time_us += get_varint(c);
+    m->dt = get_f32(c);
+    base->left_code += get_svarint(c);
+    base->right_code += get_svarint(c);
+    base->bearing += get_svarint(c);
+    uint8_t flags = get_u8(c);
+    m->left_code = base->left_code;
+    m->right_code = base->right_code;
+    m->bearing = base->bearing;
+    m->left_ir_black = flags & STEP_LEFT_IR;
+    m->right_ir_black = flags & STEP_RIGHT_IR;
+    m->line_valid = flags & STEP_LINE_VALID;
+    m->obstacle_cm = flags & STEP_OBSTACLE ? get_f32(c) : INFINITY;
+    m->line_offset = flags & STEP_LINE_OFFSET ? get_f32(c) : 0;
+    if (flags & STEP_NEW_ECHO)
+    {
+        base->echo_us += get_varint(c);
+        base->echo_cm = get_f32(c);
+    }
+    in->echo_valid = flags & STEP_ECHO_VALID;
+    in->echo_us = base->echo_us;
+    in->echo_cm = base->echo_cm;
+    in->barcode_count = base->barcode_count;
+    memcpy(in->barcode, base->barcode, sizeof(in->barcode));
+    entry->output.motion.drive = get_u8(c);
+    entry->output.motion.left_speed = get_varint(c);
+    entry->output.motion.right_speed = get_varint(c);
+    entry->output.motion_events = get_u8(c);
+    entry->output.mission_events = get_u8(c);
+    entry->output.map_events = get_u8(c);
+    entry->time_us = base->time_us;
+    return c->ok;
+}
+
+static bool decode_keyframe(recorder_reader_t *reader, cursor_t *c, recorder_entry_t *entry)
+{
+    recorder_base_t *base = &reader->base;
+    if (get_u32(c) != recorder_layout())
+        return false;
+    base->time_us = get_u32(c);
+    base->left_code = get_svarint(c);
+    base->right_code = get_svarint(c);
+    base->bearing = get_svarint(c);
+    base->echo_us = get_u32(c);
+    base->echo_cm = get_f32(c);
+    base->barcode_count = get_varint(c);
+    get(c, base->barcode, CONTROL_BARCODE_SIZE);
+    base->barcode[CONTROL_BARCODE_SIZE - 1] = '\0';
+    get(c, &entry->control, sizeof(entry->control));
+    base->gains = entry->gains = entry->control.engine.gains;
+    entry->time_us = base->time_us;
+    return c->ok;
+}
+
+static bool decode(recorder_reader_t *reader, cursor_t *c, recorder_entry_t *entry)
+{
+    recorder_base_t *base = &reader->base;
+    entry->time_us = base->time_us;
+    switch (entry->type)
+    {
+    case RECORD_KEYFRAME:
+        return decode_keyframe(reader, c, entry);
+    case RECORD_STEP:
+        return decode_step(reader, c, entry);
+    case RECORD_GAINS:
+    {
+        float *g = &entry->gains.turn_p;
+        for (int i = 0; i < 7; i++)
+            g[i] = get_f32(c);
+        base->gains = entry->gains;
+        return c->ok;
+    }
+    case RECORD_MOVE:
+    {
+        uint8_t flags = get_u8(c);
+        memset(&entry->move, 0, sizeof(entry->move));
+        entry->move.flush = flags & MOVE_FLUSH;
+        entry->move.append = flags & MOVE_APPEND;
+        if (entry->move.append)
+        {
+            entry->move.primitive.type = get_u8(c);
+            entry->move.primitive.flags = get_u8(c);
+            entry->move.primitive.value = get_svarint(c);
+            entry->move.primitive.arg = get_svarint(c);
+        }
+        return c->ok;
+    }
+    case RECORD_MISSION:
+        entry->barcode_count = get_varint(c);
+        memset(&entry->program, 0, sizeof(entry->program));
+        entry->program.len = c->end - c->in;
+        if (entry->program.len > MISSION_CODE_SIZE)
+            return false;
+        get(c, entry->program.code, entry->program.len);
+        return c->ok;
+    case RECORD_MAP:
+        entry->map.op = get_u8(c);
+        get(c, entry->map.args, sizeof(entry->map.args));
+        return c->ok;
+    case RECORD_BARCODE:
+    {
+        base->barcode_count = get_varint(c);
+        size_t n = c->end - c->in;
+        if (n >= CONTROL_BARCODE_SIZE)
+            return false;
+        memset(base->barcode, 0, sizeof(base->barcode));
+        get(c, base->barcode, n);
+        return c->ok;
+    }
+    default:
+        return false;
+    }
+}
+
+bool recorder_next(recorder_reader_t *reader, recorder_entry_t *entry)
+{
+    while (reader->pos + RECORDER_RECORD_HEADER <= reader->size)
+    {
+        const uint8_t *record = reader->data + reader->pos;
+        uint16_t len = record[1] | record[2] << 8;
+        if (reader->pos + RECORDER_RECORD_HEADER + len > reader->size)
+            return false;
+        reader->pos += RECORDER_RECORD_HEADER + len;
+        entry->type = record[0];
+        if (!reader->synced && entry->type != RECORD_KEYFRAME)
+        {
+            // the ring dropped the keyframe these were coded against
+            reader->skipped += RECORDER_RECORD_HEADER + len;
+            continue;
+        }
+        cursor_t c = {.in = record + RECORDER_RECORD_HEADER, .end = record + RECORDER_RECORD_HEADER + len, .ok = true};
+        if (!decode(reader, &c, entry))
+            return false;
+        reader->synced = true;
+        return true;
+    }
+    return false;
+}
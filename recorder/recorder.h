@@ -0,0 +1,121 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+// Record of everything move_task's control code consumed, for replaying it
+// on the host, see control/control.h and host/t85_replay.cpp.
+//
+// move_task calls recorder_begin at the top of each period, then logs the
+// commands it hands to the control code, then the period's inputs and the
+// actuator outputs with recorder_step. Records go into a RAM ring, the oldest
+// are dropped when it fills, so the ring always holds the last few seconds.
+//
+// Every record is a type byte and a 16-bit little-endian payload length.
+// Steps are delta coded against the previous step: zigzag varints for the
+// time, the wheel codes and the bearing, a flag byte for the IR and line
+// states, and raw floats only for the readings present, about 25 bytes a
+// period. Gains and barcodes are logged when they change. Every
+// RECORDER_KEYFRAME_STEPS periods a keyframe holds a copy of control_t and
+// the delta baselines, so replay can start at any keyframe left in the ring.
+//
+// A dump is RECORDER_HEADER_SIZE bytes of header, then the ring from its
+// oldest record. The keyframe layout word refuses a control_t built with a
+// different layout, replay on a host with the firmware's alignment of
+// int64_t, such as x86_64 for the RP2040 build.
+//
+// Pure logic with no Pico includes, so it builds on the host too.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "control.h"
+
+#ifndef RECORDER_SIZE
+#define RECORDER_SIZE 32768 // bytes of RAM, a power of two, about 9 s at 100 Hz
+#endif
+#if RECORDER_SIZE & (RECORDER_SIZE - 1)
+#error "RECORDER_SIZE must be a power of two"
+#endif
+#define RECORDER_KEYFRAME_STEPS 128 // a keyframe is about 900 bytes
+#define RECORDER_MAGIC 0x52353854u // "T85R" little-endian
+#define RECORDER_VERSION 1
+#define RECORDER_HEADER_SIZE 8 // magic, version, three zero bytes
+#define RECORDER_RECORD_HEADER 3
+
+typedef enum
+{
+    RECORD_KEYFRAME = 1, // layout, baselines, control_t
+    RECORD_STEP,         // inputs of a period and the outputs control_step returned
+    RECORD_GAINS,        // motion gains from this period on
+    RECORD_MOVE,         // control_move
+    RECORD_MISSION,      // control_mission
+    RECORD_MAP,          // control_map
+    RECORD_BARCODE,      // the last barcode changed
+} record_type_t;
+
+// Values steps are coded against
+typedef struct recorder_base_t_
+{
+    uint32_t time_us;
+    int64_t left_code, right_code;
+    int32_t bearing;
+    uint32_t echo_us;
+    float echo_cm;
+    uint32_t barcode_count;
+    char barcode[CONTROL_BARCODE_SIZE];
+    motion_gains_t gains;
+} recorder_base_t;
+
+typedef struct recorder_t_
+{
+    uint8_t data[RECORDER_SIZE];
+    uint32_t head, tail; // bytes dropped and written, index with & (RECORDER_SIZE - 1)
+    uint32_t records, dropped;
+    uint16_t steps; // since the last keyframe
+    recorder_base_t base;
+} recorder_t;
+
+// One decoded record
+typedef struct recorder_entry_t_
+{
+    uint8_t type; // record_type_t
+    uint32_t time_us;
+    control_input_t input;   // RECORD_STEP
+    control_output_t output; // RECORD_STEP
+    motion_gains_t gains;    // RECORD_GAINS and RECORD_KEYFRAME
+    struct
+    {
+        bool flush, append;
+        motion_primitive_t primitive;
+    } move;                    // RECORD_MOVE
+    mission_program_t program; // RECORD_MISSION
+    uint32_t barcode_count;    // RECORD_MISSION
+    map_cmd_t map;             // RECORD_MAP
+    control_t control;         // RECORD_KEYFRAME
+} recorder_entry_t;
+
+typedef struct recorder_reader_t_
+{
+    const uint8_t *data;
+    size_t size, pos;
+    bool synced; // a keyframe was read, steps can be decoded
+    uint32_t skipped; // bytes before the first keyframe
+    recorder_base_t base;
+} recorder_reader_t;
+
+uint32_t recorder_layout(void);
+
+// firmware side
+void recorder_clear(recorder_t *recorder);
+void recorder_begin(recorder_t *recorder, const control_t *control, uint32_t time_us); // a keyframe when one is due
+void recorder_move(recorder_t *recorder, bool flush, bool append, const motion_primitive_t *primitive);
+void recorder_mission(recorder_t *recorder, const mission_program_t *program, uint32_t barcode_count);
+void recorder_map(recorder_t *recorder, const map_cmd_t *cmd);
+void recorder_step(recorder_t *recorder, uint32_t time_us, const motion_gains_t *gains, const control_input_t *in,
+                   const control_output_t *out);
+uint32_t recorder_size(const recorder_t *recorder); // bytes of a dump, header included
+uint32_t recorder_read(const recorder_t *recorder, uint32_t offset, uint8_t *out, uint32_t size);
+
+// host side, on a whole dump
+bool recorder_reader_init(recorder_reader_t *reader, const uint8_t *data, size_t size);
+// false at the end or on a corrupt record, records before the first keyframe are skipped
+bool recorder_next(recorder_reader_t *reader, recorder_entry_t *entry);
+
+#endif
@@ -0,0 +1,56 @@
+#include "sensor_hub.h"
+#include "hardware/sync.h"
+
+#define READ_TRIES 16 // a reader that keeps losing to the writer gives up, see sensor_hub_read()
+
+static volatile uint32_t sequence = 0; // odd while sense_task writes
+static sensor_snapshot_t snapshot;
+
+// Start publishing, the values set until sensor_hub_end() appear together
+void sensor_hub_begin(void)
+{
+    sequence++;
+    __dmb();
+}
+
+void sensor_hub_set(sensor_id_t id, float value, bool valid, uint32_t timestamp_us)
+{
+    snapshot.readings[id].value = value;
+    snapshot.readings[id].valid = valid;
+    snapshot.readings[id].timestamp_us = timestamp_us;
+}
+
+void sensor_hub_end(void)
+{
+    snapshot.version++;
+    __dmb();
+    sequence++;
+}
+
+// Copy the latest snapshot, retrying while sense_task publishes. Writes take a
+// few microseconds, so this only fails if the reader preempted the writer on
+// its own core, then out is left as it was and the caller keeps its last view.
+bool sensor_hub_read(sensor_snapshot_t *out)
+{
+    for (int tries = 0; tries < READ_TRIES; tries++)
+    {
+        uint32_t start = sequence;
+        if (start & 1)
+            continue;
+        __dmb();
+        sensor_snapshot_t copy = snapshot;
+        __dmb();
+        if (sequence == start)
+        {
+            *out = copy;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A reading that is valid and at most max_age_us old
+bool sensor_hub_fresh(const sensor_reading_t *reading, uint32_t now_us, uint32_t max_age_us)
+{
+    return reading->valid && now_us - reading->timestamp_us <= max_age_us;
+}
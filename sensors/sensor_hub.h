@@ -0,0 +1,42 @@
+#ifndef SENSOR_HUB_H
+#define SENSOR_HUB_H
+// Latest reading of every sensor in one snapshot behind a sequence lock.
+//
+// sense_task samples each sensor at its own rate and publishes what it read in
+// one short write section, sensor_hub_begin/sensor_hub_set/sensor_hub_end.
+// Readers on either core copy the whole snapshot with sensor_hub_read, so a
+// control step sees one coherent view and can tell how old each field is.
+// There is one writer, sense_task, never publish from an ISR.
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    SENSOR_HEADING,    // degrees clockwise
+    SENSOR_ULTRASONIC, // cm to the nearest echo
+    SENSOR_IR_LEFT,    // 1 over black
+    SENSOR_IR_RIGHT,   // 1 over black
+    SENSOR_LINE_OFFSET, // analog line position, -1..1 towards the left sensor, valid in analog line mode
+    SENSOR_COUNT
+} sensor_id_t;
+
+typedef struct sensor_reading_t_
+{
+    float value;
+    uint32_t timestamp_us; // time_us_32() when it was measured
+    bool valid;            // false until the first sample, or when the last sample failed
+} sensor_reading_t;
+
+typedef struct sensor_snapshot_t_
+{
+    uint32_t version; // publishes so far
+    sensor_reading_t readings[SENSOR_COUNT];
+} sensor_snapshot_t;
+
+void sensor_hub_begin(void);
+void sensor_hub_set(sensor_id_t id, float value, bool valid, uint32_t timestamp_us);
+void sensor_hub_end(void);
+bool sensor_hub_read(sensor_snapshot_t *out);
+bool sensor_hub_fresh(const sensor_reading_t *reading, uint32_t now_us, uint32_t max_age_us);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * FreeRTOS configuration of the host simulation, see sim/CMakeLists.txt.
+ *
+ * The same application settings as the firmware's FreeRTOSConfig.h on the
+ * POSIX port: one core, task stacks in pthreads and a tick hook that drives
+ * the simulated world, see sim/hal.c.
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/* Scheduler Related */
+#define configUSE_PREEMPTION                    1
+#define configUSE_TICKLESS_IDLE                 0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     1
+/* The kernel counts milliseconds, port.c alone is built with SIM_PORT_TICK_HZ
+   so that its tick thread fires SIM_SPEEDUP times as often */
+#ifdef SIM_PORT_TICK_HZ
+#define configTICK_RATE_HZ                      ( ( TickType_t ) SIM_PORT_TICK_HZ )
+#else
+#define configTICK_RATE_HZ                      ( ( TickType_t ) 1000 )
+#endif
+#define configMAX_PRIORITIES                    32
+/* pthread stacks, at least PTHREAD_STACK_MIN and room for host printf */
+#define configMINIMAL_STACK_SIZE                ( configSTACK_DEPTH_TYPE ) 8192
+#define configUSE_16_BIT_TICKS                  0
+
+#define configIDLE_SHOULD_YIELD                 1
+
+/* Synchronization Related */
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             1
+#define configUSE_APPLICATION_TASK_TAG          0
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configQUEUE_REGISTRY_SIZE               8
+#define configUSE_QUEUE_SETS                    1
+#define configUSE_TIME_SLICING                  1
+#define configUSE_NEWLIB_REENTRANT              0
+#define configENABLE_BACKWARD_COMPATIBILITY     1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
+
+/* System */
+#define configSTACK_DEPTH_TYPE                  uint32_t
+#define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
+
+/* Memory allocation related definitions. */
+#if T85_STATIC_ALLOC
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configUSE_MALLOC_FAILED_HOOK            1
+#else
+#define configSUPPORT_STATIC_ALLOCATION         0
+#define configUSE_MALLOC_FAILED_HOOK            0
+#endif
+/* heap_4 like the car, stats.c reports its free space; the pthread stacks are not in it */
+#define configTOTAL_HEAP_SIZE                   (2*1024*1024)
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configAPPLICATION_ALLOCATED_HEAP        0
+
+/* Hook function related definitions. */
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_DAEMON_TASK_STARTUP_HOOK      0
+
+/* Run time and task stats gathering related definitions. */
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        time_us_64()
+#ifndef __ASSEMBLER__
+extern uint64_t time_us_64(void);
+#endif
+#define configUSE_TRACE_FACILITY                1
+#define configUSE_STATS_FORMATTING_FUNCTIONS    0
+
+/* Co-routine related definitions. */
+#define configUSE_CO_ROUTINES                   0
+#define configMAX_CO_ROUTINE_PRIORITIES         1
+
+/* Software timer related definitions. */
+#define configUSE_TIMERS                        1
+/* below the simulated GPIO interrupt, the irq task in sim/hal.c */
+#define configTIMER_TASK_PRIORITY               ( configMAX_PRIORITIES - 2 )
+#define configTIMER_QUEUE_LENGTH                10
+#define configTIMER_TASK_STACK_DEPTH            configMINIMAL_STACK_SIZE
+
+#include <assert.h>
+#define configASSERT(x)                         assert(x)
+
+#define INCLUDE_vTaskPrioritySet                1
+#define INCLUDE_uxTaskPriorityGet               1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_vTaskDelayUntil                 1
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
+#define INCLUDE_eTaskGetState                   1
+#define INCLUDE_xTimerPendFunctionCall          1
+#define INCLUDE_xTaskAbortDelay                 1
+#define INCLUDE_xTaskGetHandle                  1
+#define INCLUDE_xTaskResumeFromISR              1
+#define INCLUDE_xQueueGetMutexHolder            1
+
+#endif /* FREERTOS_CONFIG_H */
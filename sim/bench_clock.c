@@ -0,0 +1,10 @@
+#include <time.h>
+#include "bench.h"
+
+// the host's wall clock, not the simulated time_us_64, which moves in ticks
+uint64_t bench_clock_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
@@ -0,0 +1,491 @@
+// Pico SDK hardware calls for the host simulation.
+//
+// Simulated time is the FreeRTOS tick count: the tick hook adds a millisecond
+// and steps the world to it, so time stands still between ticks and a task
+// sees the same time_us_64() until the next one. The POSIX port ticks
+// SIM_SPEEDUP times faster than the kernel thinks, which is what makes the
+// simulation run faster than real time.
+//
+// Pin edges from the world are "interrupts": the tick hook wakes the irq task,
+// the highest priority task, which runs the GPIO handler for each edge with
+// the scheduler suspended and the tick masked, and time_us_64() reading the
+// time of the edge. Masking "interrupts" masks the tick signal, so a task in
+// save_and_disable_interrupts() can be preempted by neither.
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/adc.h"
+#include "hardware/flash.h"
+#include "hardware/i2c.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "world.h"
+
+#ifndef SIM_SPEEDUP
+#define SIM_SPEEDUP 10
+#endif
+#define SIM_TRACE_US 100000 // ground truth rows, 10 Hz
+
+// the car's wiring, see taskmanager.c, motor.c and irline.h
+#define TRIG_PIN 13
+#define LEFT_SLICE_PIN 5 // ENB, channel B
+#define LEFT_FORWARD_PIN 6
+#define LEFT_REVERSE_PIN 7
+#define RIGHT_SLICE_PIN 20 // ENA, channel A
+#define RIGHT_FORWARD_PIN 19
+#define RIGHT_REVERSE_PIN 18
+static const uint8_t world_gpio[WORLD_PIN_COUNT] = {
+    [WORLD_PIN_LEFT_ENCODER] = 2,
+    [WORLD_PIN_RIGHT_ENCODER] = 3,
+    [WORLD_PIN_ECHO] = 12,
+    [WORLD_PIN_IR_LEFT] = 26,
+    [WORLD_PIN_IR_RIGHT] = 27,
+    [WORLD_PIN_BARCODE] = 15,
+};
+
+static world_t world;
+static volatile uint64_t tick_us = 0;
+static volatile uint64_t irq_us = 0; // time of the edge being dispatched, 0 outside the irq task
+static uint64_t stop_us = 0;         // T85_SIM_SECONDS, 0 to run until killed
+static FILE *trace = NULL;           // T85_SIM_TRACE
+static uint64_t next_trace_us = 0;
+static struct timespec started;
+static TaskHandle_t irq_task_handle = NULL;
+
+static volatile uint32_t out_levels = 0;
+static volatile uint32_t out_dir = 0;
+static volatile uint32_t in_levels = 0;
+static volatile uint32_t input_enabled = (1u << NUM_BANK0_GPIOS) - 1; // pads come up with their inputs on
+static uint8_t irq_events[NUM_BANK0_GPIOS];
+static uint8_t irq_pending[NUM_BANK0_GPIOS];
+static gpio_irq_callback_t irq_callback = NULL;
+static irq_handler_t raw_handler = NULL; // one raw handler, for the pins of raw_mask
+static uint32_t raw_mask = 0;
+
+pwm_hw_t sim_pwm_hw;
+adc_hw_t sim_adc_hw;
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+void panic(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "panic: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+uint64_t time_us_64(void)
+{
+    return irq_us ? irq_us : tick_us;
+}
+
+void sleep_us(uint64_t us)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    {
+        struct timespec wait = {0, (long)(us * 1000 / SIM_SPEEDUP)};
+        nanosleep(&wait, NULL);
+        return;
+    }
+    // busy, like the SDK's, until the ticks have moved time on
+    uint64_t until = time_us_64() + us;
+    while (time_us_64() < until)
+        sched_yield();
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    return sigismember(&old, SIGALRM);
+}
+
+void restore_interrupts(uint32_t status)
+{
+    if (status)
+        return; // they were off already
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_UNBLOCK, &all, NULL);
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, __unused uint32_t enter_exit_timeout_ms)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    func(param);
+    restore_interrupts(irq);
+    return PICO_OK;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+        panic("flash_range_erase(%u, %zu) is not whole sectors of flash", flash_offs, count);
+    memset(sim_flash + flash_offs, 0xff, count);
+}
+
+// programming only clears bits, as on the chip
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+        panic("flash_range_program(%u, %zu) is not whole pages of flash", flash_offs, count);
+    for (size_t i = 0; i < count; i++)
+        sim_flash[flash_offs + i] &= data[i];
+}
+
+spin_lock_t *spin_lock_init(uint lock_num)
+{
+    static spin_lock_t locks[32];
+    return &locks[lock_num % 32];
+}
+
+int spin_lock_claim_unused(bool required)
+{
+    static int next = 16; // the SDK hands out the upper half
+    if (next == 32 && required)
+        panic("no spin locks left");
+    return next < 32 ? next++ : -1;
+}
+
+void gpio_init(uint gpio)
+{
+    gpio_set_dir(gpio, GPIO_IN);
+    gpio_put(gpio, 0);
+    gpio_set_function(gpio, GPIO_FUNC_SIO);
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    if (out)
+        __atomic_or_fetch(&out_dir, 1u << gpio, __ATOMIC_SEQ_CST);
+    else
+        __atomic_and_fetch(&out_dir, ~(1u << gpio), __ATOMIC_SEQ_CST);
+}
+
+void gpio_set_input_enabled(uint gpio, bool enabled)
+{
+    if (enabled)
+        __atomic_or_fetch(&input_enabled, 1u << gpio, __ATOMIC_SEQ_CST);
+    else
+        __atomic_and_fetch(&input_enabled, ~(1u << gpio), __ATOMIC_SEQ_CST);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    gpio_set_input_enabled(gpio, true); // as the SDK does
+}
+
+void gpio_set_mask(uint32_t mask)
+{
+    __atomic_or_fetch(&out_levels, mask, __ATOMIC_SEQ_CST);
+}
+
+void gpio_clr_mask(uint32_t mask)
+{
+    __atomic_and_fetch(&out_levels, ~mask, __ATOMIC_SEQ_CST);
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    uint32_t mask = 1u << gpio;
+    uint32_t was = value ? __atomic_fetch_or(&out_levels, mask, __ATOMIC_SEQ_CST)
+                         : __atomic_fetch_and(&out_levels, ~mask, __ATOMIC_SEQ_CST);
+    if (gpio == TRIG_PIN && !value && (was & mask))
+    {
+        uint32_t irq = save_and_disable_interrupts();
+        world_ping(&world, time_us_64());
+        restore_interrupts(irq);
+    }
+}
+
+uint32_t gpio_get_all(void)
+{
+    return ((out_levels & out_dir) | (in_levels & ~out_dir)) & input_enabled;
+}
+
+bool gpio_get(uint gpio)
+{
+    return (gpio_get_all() >> gpio) & 1;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    irq_events[gpio] = enabled ? irq_events[gpio] | event_mask : irq_events[gpio] & ~event_mask;
+    restore_interrupts(irq);
+}
+
+void gpio_set_irq_callback(gpio_irq_callback_t callback)
+{
+    irq_callback = callback;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+    gpio_set_irq_callback(callback);
+}
+
+void gpio_add_raw_irq_handler_masked(uint32_t gpio_mask, irq_handler_t handler)
+{
+    if (raw_handler && raw_handler != handler)
+        panic("the simulation takes one raw GPIO handler");
+    raw_handler = handler;
+    raw_mask |= gpio_mask;
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio)
+{
+    return irq_pending[gpio];
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events)
+{
+    irq_pending[gpio] &= ~events;
+}
+
+// both wheels run from slice 2, direction from the H-bridge inputs
+static world_drive_t drive_from_pins(void)
+{
+    const pwm_slice_hw_t *slice = &pwm_hw->slice[pwm_gpio_to_slice_num(RIGHT_SLICE_PIN)];
+    uint32_t pins = out_levels & out_dir;
+    world_drive_t drive = {
+        .left_dir = (int8_t)((pins >> LEFT_FORWARD_PIN) & 1) - (int8_t)((pins >> LEFT_REVERSE_PIN) & 1),
+        .right_dir = (int8_t)((pins >> RIGHT_FORWARD_PIN) & 1) - (int8_t)((pins >> RIGHT_REVERSE_PIN) & 1),
+    };
+    if (slice->csr & 1)
+    {
+        drive.left_duty = fminf(1, (float)(slice->cc >> 16) / (slice->top + 1));
+        drive.right_duty = fminf(1, (float)(slice->cc & 0xffff) / (slice->top + 1));
+    }
+    return drive;
+}
+
+// from the tick interrupt, after the kernel has counted the tick
+void vApplicationTickHook(void)
+{
+    tick_us += 1000;
+    world_drive_t drive = drive_from_pins();
+    world_step(&world, &drive, tick_us);
+    if (irq_task_handle)
+        vTaskNotifyGiveFromISR(irq_task_handle, NULL);
+}
+
+static void dispatch(const world_edge_t *edge)
+{
+    uint gpio = world_gpio[edge->pin];
+    if (edge->level)
+        in_levels |= 1u << gpio;
+    else
+        in_levels &= ~(1u << gpio);
+    uint32_t events = edge->level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    if (!(irq_events[gpio] & events) || !(input_enabled & (1u << gpio)))
+        return;
+    irq_us = edge->time_us;
+    if (raw_handler && (raw_mask & (1u << gpio)))
+    {
+        irq_pending[gpio] |= events;
+        raw_handler();
+    }
+    else if (irq_callback)
+        irq_callback(gpio, events);
+    irq_us = 0;
+}
+
+static double wall_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+}
+
+static void write_trace(const world_t *at, const world_drive_t *drive)
+{
+    fprintf(trace, "%.1f,%.2f,%.2f,%.1f,%.1f,%.1f,%.2f,%.2f,%d,%d,%lu\n", at->time_us / 1e3, at->x_cm, at->y_cm,
+            at->bearing, at->v_left, at->v_right, drive->left_duty, drive->right_duty, drive->left_dir,
+            drive->right_dir, (unsigned long)at->collisions);
+}
+
+// the GPIO "interrupt", plus the ground truth trace and the end of the run, off the tick signal
+static void irq_task(__unused void *params)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskSuspendAll();
+        taskENTER_CRITICAL();
+        world_edge_t edge;
+        while (world_next_edge(&world, &edge))
+            dispatch(&edge);
+        world_t *now = NULL;
+        static world_t snapshot; // the tick hook moves the world, copy it while the tick is masked
+        if ((trace && world.time_us >= next_trace_us) || (stop_us && world.time_us >= stop_us))
+        {
+            snapshot = world;
+            now = &snapshot;
+        }
+        world_drive_t drive = drive_from_pins();
+        taskEXIT_CRITICAL();
+        xTaskResumeAll();
+
+        if (now && trace && now->time_us >= next_trace_us)
+        {
+            write_trace(now, &drive);
+            next_trace_us += SIM_TRACE_US;
+        }
+        if (now && stop_us && now->time_us >= stop_us)
+        {
+            double wall = wall_seconds();
+            printf("[SIM]time:%.1f s\twall:%.1f s\tspeedup:%.1f\tat:%.1f,%.1f\tbearing:%.1f\tcollisions:%lu\tedges_dropped:%lu\n",
+                   now->time_us / 1e6, wall, wall > 0 ? now->time_us / 1e6 / wall : 0, now->x_cm, now->y_cm,
+                   now->bearing, (unsigned long)now->collisions, (unsigned long)now->edges_dropped);
+            if (trace)
+                fclose(trace);
+            fflush(stdout);
+            exit(now->collisions ? 2 : 0);
+        }
+    }
+}
+
+// Load the world named by T85_SIM_WORLD (an empty floor without it) and read
+// the run's options, main() calls this first
+bool stdio_init_all(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    memset(sim_flash, 0xff, sizeof(sim_flash));
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    world_init(&world);
+    const char *path = getenv("T85_SIM_WORLD");
+    char error[128];
+    if (path && !world_load(&world, path, error, sizeof(error)))
+    {
+        fprintf(stderr, "%s\n", error);
+        exit(1);
+    }
+    const char *seconds = getenv("T85_SIM_SECONDS");
+    if (seconds)
+        stop_us = (uint64_t)(atof(seconds) * 1e6);
+    const char *trace_path = getenv("T85_SIM_TRACE");
+    if (trace_path)
+    {
+        trace = fopen(trace_path, "w");
+        if (!trace)
+        {
+            perror(trace_path);
+            exit(1);
+        }
+        fprintf(trace, "time_ms,x_cm,y_cm,bearing,v_left,v_right,left_duty,right_duty,left_dir,right_dir,collisions\n");
+    }
+    printf("[SIM]world:%s\twalls:%u\tmarks:%u\tat:%.1f,%.1f\tbearing:%.1f\tspeedup:%d\n", path ? path : "(empty)",
+           world.wall_count, world.mark_count, world.x_cm, world.y_cm, world.bearing, SIM_SPEEDUP);
+    xTaskCreate(irq_task, "SimIrq", configMINIMAL_STACK_SIZE, NULL, configMAX_PRIORITIES - 1, &irq_task_handle);
+    return true;
+}
+
+// i2c0 with the compass behind it, register pointers per device
+struct i2c_inst
+{
+    uint8_t reg[128];
+};
+static i2c_inst_t i2c0_inst;
+i2c_inst_t *const sim_i2c0 = &i2c0_inst;
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+    return baudrate;
+}
+
+void i2c_set_slave_mode(i2c_inst_t *i2c, bool slave, uint8_t addr)
+{
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop)
+{
+    if (world_i2c_read(&world, addr, 0) < 0)
+        return -2; // PICO_ERROR_GENERIC, no ack
+    if (len > 0)
+        i2c->reg[addr & 0x7f] = src[0]; // configuration writes are taken and ignored
+    return len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    int result = len;
+    for (size_t i = 0; i < len && result >= 0; i++)
+    {
+        int value = world_i2c_read(&world, addr, i2c->reg[addr & 0x7f]++);
+        if (value < 0)
+            result = -2;
+        dst[i] = value;
+    }
+    restore_interrupts(irq);
+    return result;
+}
+
+// ADC inputs 0 and 1 are the IR sensors on GPIO 26 and 27, a conversion is instant
+static uint adc_input = 0;
+static uint adc_round_robin = 0;
+
+void adc_init(void)
+{
+    adc_input = 0;
+    adc_round_robin = 0;
+}
+
+void adc_gpio_init(uint gpio)
+{
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+    gpio_set_input_enabled(gpio, false);
+}
+
+void adc_select_input(uint input)
+{
+    adc_input = input;
+}
+
+void adc_set_round_robin(uint input_mask)
+{
+    adc_round_robin = input_mask;
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift)
+{
+}
+
+void adc_run(bool run)
+{
+}
+
+void adc_fifo_drain(void)
+{
+}
+
+uint16_t adc_fifo_get_blocking(void)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    uint16_t value = adc_input == 0 ? world_adc(&world, WORLD_PIN_IR_LEFT) : adc_input == 1 ? world_adc(&world, WORLD_PIN_IR_RIGHT) : 0;
+    restore_interrupts(irq);
+    for (uint i = 1; adc_round_robin && i <= 5; i++)
+    {
+        if (adc_round_robin & (1u << ((adc_input + i) % 5)))
+        {
+            adc_input = (adc_input + i) % 5;
+            break;
+        }
+    }
+    return value;
+}
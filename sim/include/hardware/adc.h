@@ -0,0 +1,33 @@
+#ifndef SIM_HARDWARE_ADC_H
+#define SIM_HARDWARE_ADC_H
+#include "pico/platform.h"
+
+#define ADC_FCS_OVER_BITS 0x00000800u
+#define ADC_FCS_UNDER_BITS 0x00000400u
+
+typedef struct
+{
+    volatile uint32_t cs, result, fcs, fifo, div, intr, inte, intf, ints;
+} adc_hw_t;
+extern adc_hw_t sim_adc_hw;
+#define adc_hw (&sim_adc_hw)
+
+// the overflow flags are write one to clear, as on the chip
+static inline void hw_set_bits(volatile uint32_t *reg, uint32_t mask)
+{
+    if (reg == &adc_hw->fcs)
+        __atomic_and_fetch(reg, ~(mask & (ADC_FCS_OVER_BITS | ADC_FCS_UNDER_BITS)), __ATOMIC_SEQ_CST);
+    else
+        __atomic_or_fetch(reg, mask, __ATOMIC_SEQ_CST);
+}
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+void adc_set_round_robin(uint input_mask);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_run(bool run);
+void adc_fifo_drain(void);
+uint16_t adc_fifo_get_blocking(void);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SIM_HARDWARE_CLOCKS_H
+#define SIM_HARDWARE_CLOCKS_H
+#include "pico/platform.h"
+
+enum clock_index
+{
+    clk_ref = 4,
+    clk_sys = 5,
+};
+
+static inline uint32_t clock_get_hz(enum clock_index clock)
+{
+    return clock == clk_sys ? 125000000 : 12000000;
+}
+
+#endif
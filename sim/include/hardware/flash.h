@@ -0,0 +1,21 @@
+#ifndef SIM_HARDWARE_FLASH_H
+#define SIM_HARDWARE_FLASH_H
+// Flash is a RAM array that comes up erased, XIP_BASE maps it like the
+// chip's execute-in-place window. The simulated program is not in it.
+#include "pico/platform.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+#define PICO_NO_FLASH 1
+
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)sim_flash)
+
+// offsets from the start of flash, the same alignment checks as the SDK
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif
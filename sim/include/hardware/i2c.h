@@ -0,0 +1,15 @@
+#ifndef SIM_HARDWARE_I2C_H
+#define SIM_HARDWARE_I2C_H
+#include "pico/platform.h"
+
+typedef struct i2c_inst i2c_inst_t;
+extern i2c_inst_t *const sim_i2c0;
+#define i2c0 sim_i2c0
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+void i2c_set_slave_mode(i2c_inst_t *i2c, bool slave, uint8_t addr);
+// a one byte write sets the register pointer, two bytes write a register, reads go on from the pointer
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+#endif
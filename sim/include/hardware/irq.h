@@ -0,0 +1,22 @@
+#ifndef SIM_HARDWARE_IRQ_H
+#define SIM_HARDWARE_IRQ_H
+// The one interrupt the simulation has is the GPIO bank's, run by the irq
+// task in hal.c, so enables and priorities have nothing to set
+#include "pico/platform.h"
+
+#define IO_IRQ_BANK0 13
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+
+typedef void (*irq_handler_t)(void);
+
+static inline void irq_set_enabled(uint num, bool enabled)
+{
+    (void)num, (void)enabled;
+}
+
+static inline void irq_set_priority(uint num, uint8_t hardware_priority)
+{
+    (void)num, (void)hardware_priority;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SIM_HARDWARE_PWM_H
+#define SIM_HARDWARE_PWM_H
+#include "pico/platform.h"
+
+#define NUM_PWM_SLICES 8
+enum pwm_chan
+{
+    PWM_CHAN_A = 0,
+    PWM_CHAN_B = 1,
+};
+
+// register layout of the RP2040 slices, cc holds B in the top half
+typedef struct
+{
+    volatile uint32_t csr, div, ctr, cc, top;
+} pwm_slice_hw_t;
+typedef struct
+{
+    pwm_slice_hw_t slice[NUM_PWM_SLICES];
+} pwm_hw_t;
+extern pwm_hw_t sim_pwm_hw;
+#define pwm_hw (&sim_pwm_hw)
+
+static inline uint pwm_gpio_to_slice_num(uint gpio)
+{
+    return (gpio >> 1) & 7;
+}
+static inline void pwm_set_clkdiv(uint slice, float divider)
+{
+    pwm_hw->slice[slice].div = (uint32_t)(divider * 16);
+}
+static inline void pwm_set_wrap(uint slice, uint16_t wrap)
+{
+    pwm_hw->slice[slice].top = wrap;
+}
+static inline void pwm_set_chan_level(uint slice, uint chan, uint16_t level)
+{
+    uint32_t mask = chan ? 0xffff0000u : 0xffffu;
+    uint32_t cc = pwm_hw->slice[slice].cc;
+    while (!__atomic_compare_exchange_n(&pwm_hw->slice[slice].cc, &cc, (cc & ~mask) | ((uint32_t)level << (chan ? 16 : 0)),
+                                        false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        ;
+}
+static inline void pwm_set_enabled(uint slice, bool enabled)
+{
+    if (enabled)
+        __atomic_or_fetch(&pwm_hw->slice[slice].csr, 1u, __ATOMIC_SEQ_CST);
+    else
+        __atomic_and_fetch(&pwm_hw->slice[slice].csr, ~1u, __ATOMIC_SEQ_CST);
+}
+// the simulation does not model the counter, it reads as just wrapped
+static inline uint16_t pwm_get_counter(uint slice)
+{
+    (void)slice;
+    return 0;
+}
+
+#endif
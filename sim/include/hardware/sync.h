@@ -0,0 +1,31 @@
+#ifndef SIM_HARDWARE_SYNC_H
+#define SIM_HARDWARE_SYNC_H
+// "Interrupts" are the FreeRTOS tick signal, masking it keeps both the
+// scheduler and the simulated GPIO IRQs away, like masking PRIMASK does
+#include "pico/platform.h"
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __dmb(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+// one core, a spin lock is only its interrupt mask
+spin_lock_t *spin_lock_init(uint lock_num);
+int spin_lock_claim_unused(bool required);
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock)
+{
+    (void)lock;
+    return save_and_disable_interrupts();
+}
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved)
+{
+    (void)lock;
+    restore_interrupts(saved);
+}
+
+#endif
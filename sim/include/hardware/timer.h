@@ -0,0 +1,5 @@
+#ifndef SIM_HARDWARE_TIMER_H
+#define SIM_HARDWARE_TIMER_H
+#include "pico/time.h"
+
+#endif
@@ -0,0 +1,5 @@
+#ifndef SIM_LWIP_IP4_ADDR_H
+#define SIM_LWIP_IP4_ADDR_H
+#include "lwip/ip_addr.h"
+
+#endif
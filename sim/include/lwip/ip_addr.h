@@ -0,0 +1,24 @@
+#ifndef SIM_LWIP_IP_ADDR_H
+#define SIM_LWIP_IP_ADDR_H
+#include <stdint.h>
+
+#define IPADDR_TYPE_V4 0
+#define IPADDR_TYPE_ANY 46
+
+typedef struct ip4_addr
+{
+    uint32_t addr; // network order
+} ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;
+
+struct netif
+{
+    ip4_addr_t ip_addr;
+};
+extern struct netif *netif_list;
+#define netif_ip4_addr(netif) ((const ip4_addr_t *)&(netif)->ip_addr)
+
+int ipaddr_aton(const char *cp, ip_addr_t *addr);
+char *ip4addr_ntoa(const ip4_addr_t *addr);
+
+#endif
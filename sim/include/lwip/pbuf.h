@@ -0,0 +1,30 @@
+#ifndef SIM_LWIP_PBUF_H
+#define SIM_LWIP_PBUF_H
+#include <stdint.h>
+#include "lwip/err.h"
+
+typedef enum
+{
+    PBUF_TRANSPORT,
+    PBUF_IP,
+    PBUF_RAW,
+} pbuf_layer;
+typedef enum
+{
+    PBUF_RAM,
+    PBUF_POOL,
+} pbuf_type;
+
+// always one piece
+struct pbuf
+{
+    struct pbuf *next;
+    void *payload;
+    uint16_t tot_len, len;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t length, pbuf_type type);
+uint8_t pbuf_free(struct pbuf *p);
+uint16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, uint16_t len, uint16_t offset);
+
+#endif
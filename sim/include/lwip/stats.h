@@ -0,0 +1,21 @@
+#ifndef SIM_LWIP_STATS_H
+#define SIM_LWIP_STATS_H
+// filled by sim/net.c from its pcb table and pbuf count
+#include <stdint.h>
+#include "lwip/memp.h"
+
+struct stats_mem
+{
+    const char *name;
+    uint16_t err;
+    uint32_t avail, used, max, illegal;
+};
+
+struct stats_
+{
+    struct stats_mem mem;
+    struct stats_mem *memp[MEMP_MAX];
+};
+extern struct stats_ lwip_stats;
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SIM_LWIP_TCP_H
+#define SIM_LWIP_TCP_H
+#include <stdint.h>
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+#ifndef TCP_SND_QUEUELEN
+#define TCP_SND_QUEUELEN 32 // the host socket queues bytes, not segments, see tcp_sndqueuelen
+#endif
+
+struct tcp_pcb;
+typedef err_t (*tcp_accept_fn)(void *arg, struct tcp_pcb *newpcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+struct tcp_pcb *tcp_new_ip_type(uint8_t type);
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, uint16_t port);
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, uint8_t backlog);
+void tcp_arg(struct tcp_pcb *pcb, void *arg);
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept);
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err);
+void tcp_recved(struct tcp_pcb *pcb, uint16_t len);
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, uint16_t len, uint8_t apiflags);
+err_t tcp_output(struct tcp_pcb *pcb);
+err_t tcp_close(struct tcp_pcb *pcb);
+void tcp_abort(struct tcp_pcb *pcb);
+uint16_t tcp_sndbuf(const struct tcp_pcb *pcb);
+uint16_t tcp_sndqueuelen(const struct tcp_pcb *pcb);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef SIM_LWIP_UDP_H
+#define SIM_LWIP_UDP_H
+#include <stdint.h>
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+struct udp_pcb;
+struct udp_pcb *udp_new_ip_type(uint8_t type);
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip, uint16_t dst_port);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SIM_PICO_ASYNC_CONTEXT_FREERTOS_H
+#define SIM_PICO_ASYNC_CONTEXT_FREERTOS_H
+// The network stack's task, it polls the loopback sockets in sim/net.c
+#include "pico/platform.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifndef ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_PRIORITY
+#define ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_PRIORITY (tskIDLE_PRIORITY + 4)
+#endif
+#ifndef ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_STACK_SIZE
+#define ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_STACK_SIZE configMINIMAL_STACK_SIZE
+#endif
+
+typedef struct async_context
+{
+    TaskHandle_t task;
+} async_context_t;
+
+typedef struct async_context_freertos_config
+{
+    UBaseType_t task_priority;
+    configSTACK_DEPTH_TYPE task_stack_size;
+    UBaseType_t task_core_id;
+} async_context_freertos_config_t;
+
+typedef struct async_context_freertos
+{
+    async_context_t core;
+} async_context_freertos_t;
+
+static inline async_context_freertos_config_t async_context_freertos_default_config(void)
+{
+    return (async_context_freertos_config_t){
+        .task_priority = ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_PRIORITY,
+        .task_stack_size = ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_STACK_SIZE,
+        .task_core_id = (UBaseType_t)-1,
+    };
+}
+bool async_context_freertos_init(async_context_freertos_t *self, async_context_freertos_config_t *config);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SIM_PICO_CYW43_ARCH_H
+#define SIM_PICO_CYW43_ARCH_H
+// No radio, the "Wi-Fi" is the host's loopback interface, see sim/net.c
+#include "pico/platform.h"
+#include "pico/async_context_freertos.h"
+
+#define CYW43_AUTH_OPEN 0
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+
+void cyw43_arch_set_async_context(async_context_t *context);
+int cyw43_arch_init(void);
+void cyw43_arch_enable_sta_mode(void);
+int cyw43_arch_wifi_connect_timeout_ms(const char *ssid, const char *pw, uint32_t auth, uint32_t timeout);
+// lwIP's lock, a recursive mutex so the callbacks can send
+void cyw43_arch_lwip_begin(void);
+void cyw43_arch_lwip_end(void);
+
+#endif
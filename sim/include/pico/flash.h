@@ -0,0 +1,10 @@
+#ifndef SIM_PICO_FLASH_H
+#define SIM_PICO_FLASH_H
+#include "pico/platform.h"
+
+#define PICO_OK 0
+
+// runs func with the simulated interrupts masked, there is no other core to park
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SIM_PICO_PLATFORM_H
+#define SIM_PICO_PLATFORM_H
+// Host stand-in for the Pico SDK, only what the firmware uses, see sim/hal.c
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#endif
+
+void panic(const char *fmt, ...) __attribute__((noreturn));
+
+// one simulated core
+static inline uint get_core_num(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIM_PICO_STDLIB_H
+#define SIM_PICO_STDLIB_H
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+// loads the world and starts the simulation, see sim/hal.c
+bool stdio_init_all(void);
+
+#endif
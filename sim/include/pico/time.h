@@ -0,0 +1,35 @@
+#ifndef SIM_PICO_TIME_H
+#define SIM_PICO_TIME_H
+#include "pico/platform.h"
+
+// simulated microseconds since boot, they run SIM_SPEEDUP times faster than the host clock;
+// opaque like the SDK's debug builds, so the firmware cannot do arithmetic on it either
+typedef struct
+{
+    uint64_t _private_us_since_boot;
+} absolute_time_t;
+
+uint64_t time_us_64(void);
+static inline uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+static inline absolute_time_t get_absolute_time(void)
+{
+    return (absolute_time_t){time_us_64()};
+}
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+    return t._private_us_since_boot;
+}
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to._private_us_since_boot - from._private_us_since_boot);
+}
+void sleep_us(uint64_t us);
+static inline void sleep_ms(uint32_t ms)
+{
+    sleep_us(ms * 1000ull);
+}
+
+#endif
@@ -0,0 +1,393 @@
+// The parts of lwIP and cyw43_arch the firmware uses, over host sockets.
+//
+// There is no IP stack to simulate, the server listens on 127.0.0.1 and the
+// host tools connect to it like to the car. A pcb wraps a non-blocking socket;
+// the network stack task made by async_context_freertos_init polls them every
+// tick under the lwIP lock and runs the accept, recv and err callbacks, so the
+// callbacks see the same threading as with the tcpip thread on the car.
+// T85_SIM_PORT moves the server off TCP_PORT, to run several simulations.
+#define _GNU_SOURCE // accept4
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/stats.h"
+
+#define SIM_MAX_TCP_PCBS 8
+#define SIM_MAX_UDP_PCBS 2
+#define SIM_TCP_SND_BUF (8 * 1460) // TCP_SND_BUF in lwipopts.h
+#define SIM_PBUF_POOL_SIZE 24      // PBUF_POOL_SIZE in lwipopts.h, only for the stats
+#define SIM_RECV_SIZE 1460
+
+struct tcp_pcb
+{
+    bool used, listening, closed_by_peer;
+    int fd;
+    void *arg;
+    tcp_accept_fn accept;
+    tcp_recv_fn recv;
+    tcp_err_fn err;
+};
+
+struct udp_pcb
+{
+    bool used;
+    int fd;
+};
+
+static struct tcp_pcb tcp_pcbs[SIM_MAX_TCP_PCBS];
+static struct udp_pcb udp_pcbs[SIM_MAX_UDP_PCBS];
+static SemaphoreHandle_t lwip_lock = NULL;
+static struct netif loopback;
+struct netif *netif_list = &loopback;
+static struct stats_mem memp_stats[MEMP_MAX] = {
+    [MEMP_UDP_PCB] = {.name = "UDP_PCB", .avail = SIM_MAX_UDP_PCBS},
+    [MEMP_TCP_PCB] = {.name = "TCP_PCB", .avail = SIM_MAX_TCP_PCBS},
+    [MEMP_TCP_PCB_LISTEN] = {.name = "TCP_PCB_LISTEN"},
+    [MEMP_TCP_SEG] = {.name = "TCP_SEG"},
+    [MEMP_PBUF_POOL] = {.name = "PBUF_POOL", .avail = SIM_PBUF_POOL_SIZE},
+};
+struct stats_ lwip_stats = {
+    .mem = {.name = "HEAP"},
+    .memp = {&memp_stats[0], &memp_stats[1], &memp_stats[2], &memp_stats[3], &memp_stats[4]},
+};
+
+static void count(memp_t pool, int change)
+{
+    struct stats_mem *mem = &memp_stats[pool];
+    mem->used += change;
+    if (mem->used > mem->max)
+        mem->max = mem->used;
+}
+
+static bool would_block(void)
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; // the tick signal interrupts syscalls
+}
+
+void cyw43_arch_lwip_begin(void)
+{
+    if (lwip_lock)
+        xSemaphoreTakeRecursive(lwip_lock, portMAX_DELAY);
+}
+
+void cyw43_arch_lwip_end(void)
+{
+    if (lwip_lock)
+        xSemaphoreGiveRecursive(lwip_lock);
+}
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t length, pbuf_type type)
+{
+    struct pbuf *p = malloc(sizeof(struct pbuf) + length);
+    if (!p)
+    {
+        memp_stats[MEMP_PBUF_POOL].err++;
+        return NULL;
+    }
+    *p = (struct pbuf){.payload = p + 1, .tot_len = length, .len = length};
+    count(MEMP_PBUF_POOL, 1);
+    return p;
+}
+
+uint8_t pbuf_free(struct pbuf *p)
+{
+    if (!p)
+        return 0;
+    free(p);
+    count(MEMP_PBUF_POOL, -1);
+    return 1;
+}
+
+uint16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, uint16_t len, uint16_t offset)
+{
+    if (offset >= p->len)
+        return 0;
+    uint16_t n = MIN(len, p->len - offset);
+    memcpy(dataptr, (const uint8_t *)p->payload + offset, n);
+    return n;
+}
+
+static struct tcp_pcb *tcp_alloc(int fd)
+{
+    for (int i = 0; i < SIM_MAX_TCP_PCBS; i++)
+    {
+        if (!tcp_pcbs[i].used)
+        {
+            tcp_pcbs[i] = (struct tcp_pcb){.used = true, .fd = fd};
+            count(MEMP_TCP_PCB, 1);
+            return &tcp_pcbs[i];
+        }
+    }
+    memp_stats[MEMP_TCP_PCB].err++;
+    return NULL;
+}
+
+static void tcp_free(struct tcp_pcb *pcb)
+{
+    close(pcb->fd);
+    pcb->used = false;
+    count(MEMP_TCP_PCB, -1);
+}
+
+struct tcp_pcb *tcp_new_ip_type(uint8_t type)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return NULL;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct tcp_pcb *pcb = tcp_alloc(fd);
+    if (!pcb)
+        close(fd);
+    return pcb;
+}
+
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, uint16_t port)
+{
+    const char *moved = getenv("T85_SIM_PORT");
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(moved ? atoi(moved) : port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(pcb->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("bind");
+        return ERR_USE;
+    }
+    return ERR_OK;
+}
+
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, uint8_t backlog)
+{
+    if (listen(pcb->fd, backlog) < 0)
+        return NULL;
+    pcb->listening = true;
+    return pcb;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg)
+{
+    pcb->arg = arg;
+}
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+    pcb->accept = accept;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+    pcb->recv = recv;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
+{
+    pcb->err = err;
+}
+
+void tcp_recved(struct tcp_pcb *pcb, uint16_t len)
+{
+}
+
+static uint32_t tcp_queued(const struct tcp_pcb *pcb)
+{
+    int queued = 0;
+    ioctl(pcb->fd, SIOCOUTQ, &queued);
+    return queued > 0 ? queued : 0;
+}
+
+uint16_t tcp_sndbuf(const struct tcp_pcb *pcb)
+{
+    uint32_t queued = tcp_queued(pcb);
+    return queued < SIM_TCP_SND_BUF ? SIM_TCP_SND_BUF - queued : 0;
+}
+
+uint16_t tcp_sndqueuelen(const struct tcp_pcb *pcb)
+{
+    return tcp_queued(pcb) / 1460; // in full segments
+}
+
+// all or nothing like lwIP's, the send window above keeps it under the socket buffer
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, uint16_t len, uint8_t apiflags)
+{
+    if (len > tcp_sndbuf(pcb))
+        return ERR_MEM;
+    ssize_t sent = send(pcb->fd, dataptr, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0)
+        return would_block() ? ERR_MEM : ERR_CONN;
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb)
+{
+    return ERR_OK;
+}
+
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+    tcp_free(pcb);
+    return ERR_OK;
+}
+
+// reset the connection, the err callback hears of it as on lwIP
+void tcp_abort(struct tcp_pcb *pcb)
+{
+    struct linger reset = {1, 0};
+    setsockopt(pcb->fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    tcp_err_fn err = pcb->err;
+    void *arg = pcb->arg;
+    tcp_free(pcb);
+    if (err)
+        err(arg, ERR_ABRT);
+}
+
+struct udp_pcb *udp_new_ip_type(uint8_t type)
+{
+    for (int i = 0; i < SIM_MAX_UDP_PCBS; i++)
+    {
+        if (udp_pcbs[i].used)
+            continue;
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (fd < 0)
+            return NULL;
+        udp_pcbs[i] = (struct udp_pcb){.used = true, .fd = fd};
+        count(MEMP_UDP_PCB, 1);
+        return &udp_pcbs[i];
+    }
+    memp_stats[MEMP_UDP_PCB].err++;
+    return NULL;
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip, uint16_t dst_port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(dst_port),
+        .sin_addr.s_addr = dst_ip->addr,
+    };
+    if (sendto(pcb->fd, p->payload, p->len, MSG_DONTWAIT, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return would_block() ? ERR_MEM : ERR_RTE;
+    return ERR_OK;
+}
+
+int ipaddr_aton(const char *cp, ip_addr_t *addr)
+{
+    struct in_addr in;
+    if (!inet_aton(cp, &in))
+        return 0;
+    addr->addr = in.s_addr;
+    return 1;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr)
+{
+    struct in_addr in = {.s_addr = addr->addr};
+    return inet_ntoa(in);
+}
+
+static void poll_listener(struct tcp_pcb *pcb)
+{
+    int fd = accept4(pcb->fd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0)
+        return;
+    int size = SIM_TCP_SND_BUF;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    struct tcp_pcb *client = tcp_alloc(fd);
+    if (!client)
+    {
+        close(fd);
+        return;
+    }
+    err_t err = pcb->accept ? pcb->accept(pcb->arg, client, ERR_OK) : ERR_VAL;
+    if (err != ERR_OK && err != ERR_ABRT)
+        tcp_abort(client);
+}
+
+static void poll_client(struct tcp_pcb *pcb)
+{
+    if (!pcb->recv || pcb->closed_by_peer)
+        return; // the data waits in the socket like in an unread pbuf
+    static uint8_t data[SIM_RECV_SIZE];
+    ssize_t n = recv(pcb->fd, data, sizeof(data), MSG_DONTWAIT);
+    if (n > 0)
+    {
+        struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, n, PBUF_POOL);
+        if (!p)
+            return;
+        memcpy(p->payload, data, n);
+        pcb->recv(pcb->arg, pcb, p, ERR_OK);
+    }
+    else if (n == 0)
+    {
+        pcb->closed_by_peer = true;
+        pcb->recv(pcb->arg, pcb, NULL, ERR_OK); // the callback closes the pcb
+    }
+    else if (!would_block())
+    {
+        tcp_err_fn err = pcb->err;
+        void *arg = pcb->arg;
+        tcp_free(pcb);
+        if (err)
+            err(arg, ERR_RST);
+    }
+}
+
+// the tcpip thread
+static void network_stack_task(__unused void *params)
+{
+    while (true)
+    {
+        cyw43_arch_lwip_begin();
+        for (int i = 0; i < SIM_MAX_TCP_PCBS; i++)
+        {
+            if (tcp_pcbs[i].used && tcp_pcbs[i].listening)
+                poll_listener(&tcp_pcbs[i]);
+            else if (tcp_pcbs[i].used)
+                poll_client(&tcp_pcbs[i]);
+        }
+        cyw43_arch_lwip_end();
+        vTaskDelay(1);
+    }
+}
+
+bool async_context_freertos_init(async_context_freertos_t *self, async_context_freertos_config_t *config)
+{
+    lwip_lock = xSemaphoreCreateRecursiveMutex();
+    if (!lwip_lock)
+        return false;
+    loopback.ip_addr.addr = htonl(INADDR_LOOPBACK);
+    return xTaskCreate(network_stack_task, "NetworkStack", config->task_stack_size, NULL, config->task_priority,
+                       &self->core.task) == pdPASS;
+}
+
+void cyw43_arch_set_async_context(async_context_t *context)
+{
+}
+
+int cyw43_arch_init(void)
+{
+    return 0;
+}
+
+void cyw43_arch_enable_sta_mode(void)
+{
+}
+
+int cyw43_arch_wifi_connect_timeout_ms(const char *ssid, const char *pw, uint32_t auth, uint32_t timeout)
+{
+    return 0; // always in range
+}
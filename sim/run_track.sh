@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# The track test of sim/CMakeLists.txt: run t85_sim over a world for
+# T85_SIM_SECONDS simulated seconds, drive a short route through its server and
+# pass if the run ends with the [SIM] summary and no collision.
+# usage: run_track.sh <t85_sim> <world> <port>
+set -u
+sim=$1
+world=$2
+port=$3
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+T85_SIM_WORLD=$world T85_SIM_SECONDS=${T85_SIM_SECONDS:-20} T85_SIM_PORT=$port "$sim" >"$log" 2>&1 &
+pid=$!
+
+# the server listens once the network task has run, a few simulated ms in
+connected=0
+for _ in $(seq 50); do
+    if exec 3<>"/dev/tcp/127.0.0.1/$port"; then
+        connected=1
+        break
+    fi 2>/dev/null
+    sleep 0.1
+done
+if [ $connected = 1 ]; then
+    # 30 cm north over the barcode, a right turn, 20 cm east short of the obstacle (2 codes a cm)
+    printf 'go s60 t90 s40 x\n' >&3
+fi
+
+wait $pid
+status=$?
+exec 3>&-
+cat "$log"
+if [ $connected = 0 ]; then
+    echo "run_track: no server on port $port" >&2
+    exit 1
+fi
+if ! grep -q '^\[SIM\]time:' "$log"; then
+    echo "run_track: the run ended without its [SIM] summary" >&2
+    exit 1
+fi
+exit $status
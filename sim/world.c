@@ -0,0 +1,344 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "world.h"
+
+#define PI 3.14159265358979
+#define DEG (PI / 180)
+
+void world_init(world_t *world)
+{
+    memset(world, 0, sizeof(*world));
+}
+
+static bool add_wall(world_t *world, float x1, float y1, float x2, float y2)
+{
+    if (world->wall_count == WORLD_MAX_WALLS)
+        return false;
+    world->walls[world->wall_count++] = (world_wall_t){x1, y1, x2, y2};
+    return true;
+}
+
+// black rectangle from (x1, y1) to (x2, y2), width across
+static bool add_mark(world_t *world, float x1, float y1, float x2, float y2, float width)
+{
+    float length = hypotf(x2 - x1, y2 - y1);
+    if (world->mark_count == WORLD_MAX_MARKS || length == 0)
+        return false;
+    world->marks[world->mark_count++] = (world_mark_t){
+        (x1 + x2) / 2, (y1 + y2) / 2, (x2 - x1) / length, (y2 - y1) / length, length / 2, width / 2};
+    return true;
+}
+
+// the firmware's read_char in reverse: bar_num + space_num indexes this string
+static bool code39(char c, uint8_t *bars, uint8_t *spaces)
+{
+    static const char table[] = "~1234567890ABCDEFGHIJKLMNOPQRSTUVWXYZ-. *";
+    static const uint8_t bar_patterns[] = {0, 0x11, 0x09, 0x18, 0x05, 0x14, 0x0c, 0x03, 0x12, 0x0a, 0x06};
+    static const uint8_t space_patterns[] = {0x4, 0x2, 0x1, 0x8}; // space_num 0, 10, 20, 30
+    const char *at = c ? strchr(table + 1, c) : NULL;
+    if (!at)
+        return false;
+    int index = at - table;
+    int bar = (index - 1) % 10 + 1;
+    *bars = bar_patterns[bar];
+    *spaces = space_patterns[(index - bar) / 10];
+    return true;
+}
+
+bool world_add_barcode(world_t *world, float x, float y, float bearing, const char *text, float narrow_cm)
+{
+    static const float height = 10; // across the direction of travel
+    float dx = sin(bearing * DEG), dy = cos(bearing * DEG);
+    float at = 0;
+    for (size_t i = 0; i <= strlen(text) + 1; i++)
+    {
+        char c = i == 0 || i == strlen(text) + 1 ? '*' : text[i - 1];
+        uint8_t bars, spaces;
+        if (!code39(c, &bars, &spaces))
+            return false;
+        // b s b s b s b s b, most significant bit first, then a narrow gap
+        for (int e = 0; e < 9; e++)
+        {
+            bool wide = e % 2 == 0 ? (bars >> (4 - e / 2)) & 1 : (spaces >> (3 - e / 2)) & 1;
+            float width = wide ? 3 * narrow_cm : narrow_cm;
+            if (e % 2 == 0)
+            {
+                float cx = x + (at + width / 2) * dx, cy = y + (at + width / 2) * dy;
+                if (!add_mark(world, cx - dy * height / 2, cy + dx * height / 2, cx + dy * height / 2, cy - dx * height / 2, width))
+                    return false;
+            }
+            at += width;
+        }
+        at += narrow_cm;
+    }
+    return true;
+}
+
+bool world_load(world_t *world, const char *path, char *error, size_t size)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        snprintf(error, size, "cannot open %s", path);
+        return false;
+    }
+    char line[160];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        number++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char word[16], text[32];
+        float a, b, c, d, e = 0;
+        int n = sscanf(line, "%15s", word);
+        if (n != 1)
+            continue;
+        if (strcmp(word, "start") == 0 && sscanf(line, "%*s %f %f %f", &a, &b, &c) == 3)
+        {
+            world->x_cm = a;
+            world->y_cm = b;
+            world->bearing = fmod(fmod(c, 360) + 360, 360);
+        }
+        else if (strcmp(word, "wall") == 0 && sscanf(line, "%*s %f %f %f %f", &a, &b, &c, &d) == 4)
+            ok = add_wall(world, a, b, c, d);
+        else if (strcmp(word, "box") == 0 && sscanf(line, "%*s %f %f %f %f", &a, &b, &c, &d) == 4)
+            ok = add_wall(world, a, b, c, b) && add_wall(world, c, b, c, d) && add_wall(world, c, d, a, d) && add_wall(world, a, d, a, b);
+        else if (strcmp(word, "line") == 0 && (n = sscanf(line, "%*s %f %f %f %f %f", &a, &b, &c, &d, &e)) >= 4)
+            ok = add_mark(world, a, b, c, d, n == 5 ? e : 2);
+        else if (strcmp(word, "barcode") == 0 && (n = sscanf(line, "%*s %f %f %f %31s %f", &a, &b, &c, text, &e)) >= 4)
+            ok = world_add_barcode(world, a, b, c, text, n == 5 ? e : 1);
+        else
+            ok = false;
+        if (!ok)
+            snprintf(error, size, "%s:%d: bad line or too many walls and marks", path, number);
+    }
+    fclose(file);
+    return ok;
+}
+
+// a point in the car's frame, forward and right of the axle centre, on the floor
+static void car_point(const world_t *world, float forward, float right, double *x, double *y)
+{
+    double s = sin(world->bearing * DEG), c = cos(world->bearing * DEG);
+    *x = world->x_cm + forward * s + right * c;
+    *y = world->y_cm + forward * c - right * s;
+}
+
+static double wall_distance(const world_wall_t *wall, double x, double y)
+{
+    double dx = wall->x2 - wall->x1, dy = wall->y2 - wall->y1;
+    double length2 = dx * dx + dy * dy;
+    double t = length2 > 0 ? ((x - wall->x1) * dx + (y - wall->y1) * dy) / length2 : 0;
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    return hypot(x - wall->x1 - t * dx, y - wall->y1 - t * dy);
+}
+
+static double nearest_wall(const world_t *world, double x, double y)
+{
+    double nearest = INFINITY;
+    for (int i = 0; i < world->wall_count; i++)
+        nearest = fmin(nearest, wall_distance(&world->walls[i], x, y));
+    return nearest;
+}
+
+// distance along a ray to the first wall it meets
+static double cast(const world_t *world, double x, double y, double bearing)
+{
+    double rx = sin(bearing * DEG), ry = cos(bearing * DEG);
+    double nearest = INFINITY;
+    for (int i = 0; i < world->wall_count; i++)
+    {
+        const world_wall_t *w = &world->walls[i];
+        double sx = w->x2 - w->x1, sy = w->y2 - w->y1;
+        double denominator = rx * sy - ry * sx;
+        if (fabs(denominator) < 1e-9)
+            continue;
+        double t = ((w->x1 - x) * sy - (w->y1 - y) * sx) / denominator; // along the ray
+        double u = ((w->x1 - x) * ry - (w->y1 - y) * rx) / denominator; // along the wall
+        if (t >= 0 && u >= 0 && u <= 1)
+            nearest = fmin(nearest, t);
+    }
+    return nearest;
+}
+
+float world_range(const world_t *world)
+{
+    double x, y;
+    car_point(world, WORLD_SONAR_FORWARD_CM, 0, &x, &y);
+    double range = INFINITY;
+    for (int ray = -1; ray <= 1; ray++)
+        range = fmin(range, cast(world, x, y, world->bearing + ray * WORLD_SONAR_CONE_DEG));
+    return range;
+}
+
+// blurred coverage of one axis of a rectangle
+static double cover(double distance, double half)
+{
+    double c = (half - fabs(distance)) / WORLD_SPOT_CM + 0.5;
+    return c < 0 ? 0 : c > 1 ? 1 : c;
+}
+
+float world_floor(const world_t *world, world_pin_t sensor)
+{
+    double x, y;
+    if (sensor == WORLD_PIN_BARCODE)
+        car_point(world, WORLD_BARCODE_FORWARD_CM, 0, &x, &y);
+    else if (sensor == WORLD_PIN_IR_LEFT || sensor == WORLD_PIN_IR_RIGHT)
+        car_point(world, WORLD_IR_FORWARD_CM, sensor == WORLD_PIN_IR_LEFT ? WORLD_IR_LEFT_PIN_RIGHT_CM : -WORLD_IR_LEFT_PIN_RIGHT_CM, &x, &y);
+    else
+        return 0;
+    double black = 0;
+    for (int i = 0; i < world->mark_count; i++)
+    {
+        const world_mark_t *m = &world->marks[i];
+        double along = (x - m->x) * m->dx + (y - m->y) * m->dy;
+        double across = (x - m->x) * -m->dy + (y - m->y) * m->dx;
+        black = fmax(black, cover(along, m->half_length) * cover(across, m->half_width));
+    }
+    return black;
+}
+
+uint16_t world_adc(const world_t *world, world_pin_t sensor)
+{
+    return WORLD_ADC_WHITE + world_floor(world, sensor) * (WORLD_ADC_BLACK - WORLD_ADC_WHITE);
+}
+
+int world_i2c_read(const world_t *world, uint8_t address, uint8_t reg)
+{
+    int16_t value;
+    if (address == 0x19 && reg >= 0x28 && reg <= 0x2d)
+    {
+        // level floor, gravity on z, X Y Z little endian
+        value = reg >= 0x2c ? WORLD_ACC_1G : 0;
+        return reg & 1 ? (uint16_t)value >> 8 : value & 0xff;
+    }
+    if (address == 0x1e && reg >= 0x03 && reg <= 0x08)
+    {
+        // X Z Y big endian, heading() reads atan2(y, x) off the offsets
+        double h = world->bearing * DEG;
+        if (reg <= 0x04)
+            value = WORLD_MAG_OFFSET_X + lround(WORLD_MAG_FIELD * cos(h));
+        else if (reg <= 0x06)
+            value = WORLD_MAG_OFFSET_Z;
+        else
+            value = WORLD_MAG_OFFSET_Y + lround(WORLD_MAG_FIELD * sin(h));
+        return reg & 1 ? (uint16_t)value >> 8 : value & 0xff;
+    }
+    if (address == 0x19 || address == 0x1e)
+        return 0; // configuration registers
+    return -1;
+}
+
+static void push_edge(world_t *world, uint64_t time_us, world_pin_t pin, bool level)
+{
+    world->levels[pin] = level;
+    if (world->edge_count == WORLD_MAX_EDGES)
+    {
+        world->edges_dropped++;
+        return;
+    }
+    world->edges[(world->edge_head + world->edge_count++) % WORLD_MAX_EDGES] = (world_edge_t){time_us, pin, level};
+}
+
+bool world_next_edge(world_t *world, world_edge_t *edge)
+{
+    if (world->edge_count == 0)
+        return false;
+    *edge = world->edges[world->edge_head];
+    world->edge_head = (world->edge_head + 1) % WORLD_MAX_EDGES;
+    world->edge_count--;
+    return true;
+}
+
+void world_ping(world_t *world, uint64_t time_us)
+{
+    if (world->echo_rise_us || world->echo_fall_us)
+        return; // still listening for the last one
+    float range = world_range(world);
+    world->echo_rise_us = time_us + WORLD_ECHO_DELAY_US;
+    world->echo_fall_us = world->echo_rise_us + (range < WORLD_ECHO_MAX_CM ? (uint64_t)(range * 58) : WORLD_ECHO_TIMEOUT_US);
+}
+
+static double wheel(double v, float duty, int8_t dir, double dt)
+{
+    double share = (duty - WORLD_DEADBAND) / (1 - WORLD_DEADBAND);
+    share = share < 0 ? 0 : share > 1 ? 1 : share;
+    double target = dir * share * WORLD_WHEEL_MAX_CM_S;
+    return v + (target - v) * fmin(1, dt / WORLD_WHEEL_TAU_S);
+}
+
+static void move(world_t *world, const world_drive_t *drive, double dt)
+{
+    world->v_left = wheel(world->v_left, drive->left_duty, drive->left_dir, dt);
+    world->v_right = wheel(world->v_right, drive->right_duty, drive->right_dir, dt);
+    double v = (world->v_left + world->v_right) / 2;
+    double turn = (world->v_left - world->v_right) / WORLD_TRACK_CM / DEG * dt;
+    double mid = (world->bearing + turn / 2) * DEG;
+    double x = world->x_cm + v * sin(mid) * dt, y = world->y_cm + v * cos(mid) * dt;
+    world->bearing = fmod(world->bearing + turn + 360, 360);
+
+    // driving into a wall stalls the wheels, backing or turning away is free
+    double clearance = nearest_wall(world, x, y);
+    if (clearance < WORLD_RADIUS_CM && clearance < nearest_wall(world, world->x_cm, world->y_cm))
+    {
+        world->collisions += !world->blocked;
+        world->blocked = true;
+        world->v_left = world->v_right = 0;
+        return;
+    }
+    if (clearance > WORLD_RADIUS_CM + 1)
+        world->blocked = false; // a contact ends a cm off the wall
+    world->x_cm = x;
+    world->y_cm = y;
+    world->travel_left += fabs(world->v_left) * dt;
+    world->travel_right += fabs(world->v_right) * dt;
+}
+
+// one edge per slot boundary crossed
+static void encoder(world_t *world, world_pin_t pin, double travel, uint64_t time_us)
+{
+    bool level = (uint64_t)(travel / WORLD_SLOT_CM) & 1;
+    if (level != world->levels[pin])
+        push_edge(world, time_us, pin, level);
+}
+
+// IR comparators, with some hysteresis over the tape edge
+static void floor_sensor(world_t *world, world_pin_t pin, uint64_t time_us)
+{
+    float black = world_floor(world, pin);
+    if (!world->levels[pin] && black > 0.55f)
+        push_edge(world, time_us, pin, true);
+    else if (world->levels[pin] && black < 0.45f)
+        push_edge(world, time_us, pin, false);
+}
+
+void world_step(world_t *world, const world_drive_t *drive, uint64_t until_us)
+{
+    while (world->time_us < until_us)
+    {
+        uint64_t t = world->time_us + WORLD_STEP_US < until_us ? world->time_us + WORLD_STEP_US : until_us;
+        move(world, drive, (t - world->time_us) / 1e6);
+        world->time_us = t;
+
+        if (world->echo_rise_us && world->echo_rise_us <= t)
+        {
+            push_edge(world, world->echo_rise_us, WORLD_PIN_ECHO, true);
+            world->echo_rise_us = 0;
+        }
+        if (world->echo_fall_us && !world->echo_rise_us && world->echo_fall_us <= t)
+        {
+            push_edge(world, world->echo_fall_us, WORLD_PIN_ECHO, false);
+            world->echo_fall_us = 0;
+        }
+        // at 50 cm/s a wheel crosses a slot in 10 ms, so at most one edge per step
+        encoder(world, WORLD_PIN_LEFT_ENCODER, world->travel_left, t);
+        encoder(world, WORLD_PIN_RIGHT_ENCODER, world->travel_right, t);
+        floor_sensor(world, WORLD_PIN_IR_LEFT, t);
+        floor_sensor(world, WORLD_PIN_IR_RIGHT, t);
+        floor_sensor(world, WORLD_PIN_BARCODE, t);
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef WORLD_H
+#define WORLD_H
+// Differential-drive car on a floor with walls, tape lines and barcodes, for
+// the host simulation.
+//
+// The car is steered by the same signals the motor driver sees: a PWM duty and
+// a direction per wheel. Each wheel follows its duty with a first-order lag
+// above a deadband, and the body moves like a two-wheeled robot. The sensors
+// answer the way the real ones do: the wheel encoders toggle once per half
+// slot, the HC-SR04 raises its echo pin for 58 us per cm to the nearest wall
+// in its cone, the IR line and barcode sensors read high over black tape, and
+// the compass answers register reads with a field centred on the calibration
+// in magnometer.c.
+//
+// Positions are in cm, bearings in degrees clockwise from +y like the compass.
+// world_step advances the model in WORLD_STEP_US steps and queues the pin
+// edges it produces in time order, world_next_edge takes them. Pure C with no
+// randomness, the same drive gives the same edges.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORLD_STEP_US 100
+#define WORLD_MAX_WALLS 64
+#define WORLD_MAX_MARKS 512 // black rectangles: line segments and barcode bars
+#define WORLD_MAX_EDGES 64
+
+// the car
+#define WORLD_WHEEL_MAX_CM_S 50.0f // at full duty
+#define WORLD_WHEEL_TAU_S 0.08f    // motor lag
+#define WORLD_DEADBAND 0.15f       // duty below which a wheel does not turn
+#define WORLD_TRACK_CM 13.0f       // between the wheels
+#define WORLD_RADIUS_CM 9.0f       // for collisions
+#define WORLD_SLOT_CM (21.0f / 40) // encoder edge spacing, 20 holes on a 21 cm wheel
+// sensor mounts, forward of the axle and to the right of the centre line
+#define WORLD_IR_FORWARD_CM 8.0f
+#define WORLD_IR_LEFT_PIN_RIGHT_CM 2.5f // GPIO 26's sensor sits right of centre, the followers steer right when it reads black
+#define WORLD_BARCODE_FORWARD_CM 6.0f
+#define WORLD_SONAR_FORWARD_CM 9.0f
+#define WORLD_SONAR_CONE_DEG 7.5f      // half angle
+#define WORLD_ECHO_MAX_CM 400.0f       // no wall nearer gives the HC-SR04's timeout pulse
+#define WORLD_ECHO_DELAY_US 450        // trigger to echo, the burst
+#define WORLD_ECHO_TIMEOUT_US 38000
+#define WORLD_SPOT_CM 1.0f             // IR spot, tape edges blur over it
+#define WORLD_ADC_WHITE 250            // 12-bit readings
+#define WORLD_ADC_BLACK 3200
+// compass: field strength and offsets of the raw readings, see m_min and m_max in magnometer.c
+#define WORLD_MAG_FIELD 400
+#define WORLD_MAG_OFFSET_X 26
+#define WORLD_MAG_OFFSET_Y -173
+#define WORLD_MAG_OFFSET_Z -308
+#define WORLD_ACC_1G 16384
+
+typedef enum
+{
+    WORLD_PIN_LEFT_ENCODER,
+    WORLD_PIN_RIGHT_ENCODER,
+    WORLD_PIN_ECHO,
+    WORLD_PIN_IR_LEFT, // GPIO 26
+    WORLD_PIN_IR_RIGHT, // GPIO 27
+    WORLD_PIN_BARCODE,
+    WORLD_PIN_COUNT,
+} world_pin_t;
+
+// motor driver inputs, duty 0 to 1, direction -1, 0 or 1
+typedef struct world_drive_t_
+{
+    float left_duty, right_duty;
+    int8_t left_dir, right_dir;
+} world_drive_t;
+
+typedef struct world_edge_t_
+{
+    uint64_t time_us;
+    uint8_t pin; // world_pin_t
+    bool level;
+} world_edge_t;
+
+typedef struct world_wall_t_
+{
+    float x1, y1, x2, y2;
+} world_wall_t;
+
+// black rectangle, centre, unit vector along its length and half sizes
+typedef struct world_mark_t_
+{
+    float x, y, dx, dy;
+    float half_length, half_width;
+} world_mark_t;
+
+typedef struct world_t_
+{
+    world_wall_t walls[WORLD_MAX_WALLS];
+    world_mark_t marks[WORLD_MAX_MARKS];
+    uint16_t wall_count, mark_count;
+
+    uint64_t time_us;
+    double x_cm, y_cm, bearing;
+    double v_left, v_right;         // cm/s, negative in reverse
+    double travel_left, travel_right; // rolled in either direction, for the encoders
+    bool levels[WORLD_PIN_COUNT];
+    uint64_t echo_rise_us, echo_fall_us; // 0 when no echo is due
+    uint32_t collisions;
+    bool blocked; // against a wall now
+
+    world_edge_t edges[WORLD_MAX_EDGES];
+    uint8_t edge_head, edge_count;
+    uint32_t edges_dropped;
+} world_t;
+
+// empty floor, the car at the origin facing north
+void world_init(world_t *world);
+// add the walls, lines and barcodes of a world file, false with a message on a bad line:
+//   start x y bearing
+//   wall x1 y1 x2 y2
+//   box x1 y1 x2 y2                     four walls
+//   line x1 y1 x2 y2 [width]            black tape, 2 cm wide by default
+//   barcode x y bearing text [narrow]   Code 39 with its '*' delimiters, bars across bearing, 1 cm narrow
+bool world_load(world_t *world, const char *path, char *error, size_t size);
+bool world_add_barcode(world_t *world, float x, float y, float bearing, const char *text, float narrow_cm);
+
+void world_step(world_t *world, const world_drive_t *drive, uint64_t until_us);
+bool world_next_edge(world_t *world, world_edge_t *edge);
+// the trigger pin fell, the echo pin will answer unless an echo is still due
+void world_ping(world_t *world, uint64_t time_us);
+
+// distance from the sonar to the nearest wall in its cone, WORLD_ECHO_MAX_CM or more if none
+float world_range(const world_t *world);
+// 0 on white to 1 on black under an IR sensor, and its 12-bit ADC reading
+float world_floor(const world_t *world, world_pin_t sensor);
+uint16_t world_adc(const world_t *world, world_pin_t sensor);
+// register of the accelerometer (0x19) or magnetometer (0x1E), -1 for no device
+int world_i2c_read(const world_t *world, uint8_t address, uint8_t reg);
+
+#endif
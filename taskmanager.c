@@ -1,59 +1,192 @@
-// commands
+// modes reported by move_task
 // p for pause
 // f for forward
-// t for turn
-// s for transition to reverse
+// b for forward over a barcode
 // r for reverse
+// t for turn
+// a for arc
+// w for wait
 /*
  * taskmanager.c - documentations and commands for tcp use
  * enter the following commands in the terminal to control the car:
- * p for stop the car
- * f for move forward
- * t for turn
- * s for transition to reverse
- * r for reverse
+ * fwd100 - move forward for a certain distance
+ * turncw, turnccw - turn 90 degrees
+ * bar - move forward 200 without following the line, to read a barcode
+ * stop - drop the queued route and hold the heading
+ *
+ * Moves are queued and run back to back, straights and arcs in the same direction blend without stopping.
+ * go s100 t90 a80,45 w500 s-50 x - queue a route: s straight codes (negative reverses), b straight without line
+ *             following, t turn degrees clockwise, a arc codes,degrees clockwise, w wait ms, x stop
+ * Progress goes to the motion topic: [MOV]start, [MOV]done, [MOV]idle, [MOV]obstacle and a [MOV] line every second.
+ *
+ * Mission scripts, see mission/mission.h for the language:
+ * mission begin - start uploading a script
+ * m repeat 4 - one line of the script, errors are replied as "[MSN]error line <n>: <reason>"
+ * mission run - finish the upload and run it, replacing any running script
+ * mission stop - stop the script and the route it queued
+ * Status goes to the mission topic: [MSN]start, [MSN]say, [MSN]done, [MSN]stopped and a [MSN] line every second.
+ *
+ * Maze map, see maze/maze.h:
+ * map reset 16 16 20 0 0 - start a map of 16x16 cells of 20 cm with the car in cell 0,0, its heading is north
+ * map goto 5 3 - drive the shortest path to cell 5,3 through cells not known to be blocked, replanning on obstacles
+ * map explore - keep driving to the nearest unknown cell until there is none, map explore off or stop to end it
+ * map, map 41 - the map rows changed after revision 41, all rows without one
+ * map bench - time the planner on 16x16 test grids
+ * Planning goes to the motion topic: [MAP]plan, [MAP]arrived, [MAP]no path, [MAP]explored.
+ *
+ * Record and replay, see recorder/recorder.h and host/t85_replay.cpp:
+ * rec on - start logging every input move_task's control code consumes and its motor outputs, the last seconds are kept
+ * rec off - stop logging, rec alone reports the log size
+ * rec dump 0 - stop logging and reply the log from byte 0 as "[REC]<offset> <hex>" lines, then "[REC]next <offset>"
+ *              or "[REC]end <bytes>", t85ctl capture saves it to a file
+ *
+ * Black box in flash, see blackbox/blackbox.h:
+ * bb arm - erase the flash region, with the car parked, and record a sample of move_task's state every period
+ * bb stop - flush and stop, the log also stops when the region is full and is kept over a reset
+ * bb - state, samples, the sample rate into flash, the stall of a page program and move_task's worst period
+ * bb dump 0 - reply the log from byte 0 like rec dump, with "[BB]" lines, t85ctl blackbox saves it as CSV
+ *
+ * Schedule trace, in builds with the T85_TRACE CMake option, see telemetry/trace.h:
+ * trc on - trace task switches, blocking, wakeups and GPIO IRQs into a RAM ring, the last second or so is kept
+ * trc on hiccup - the same, stopping when move_task overruns its period
+ * trc off - stop, trc alone reports the state
+ * trc dump 0 - stop and reply the trace like rec dump, with "[TRC]" lines, t85ctl schedule saves it for t85_trace
  *
  * More tcp commands:
- * fwd100 - move forward for a certain distance
+ * sub motion heading - receive only the listed telemetry topics (motion, heading, calibration, barcode, mission, all)
+ * unsub barcode - stop receiving a topic, new clients start subscribed to all
+ * udp 192.168.1.10 4243 500 - stream control state over UDP to host, port, rate in Hz
+ * udp off - stop the UDP stream
+ * line - analog line sensing status, see irline/line_adc.h
+ * line cal - start calibrating the analog line sensing, sweep the sensors over the line and the floor
+ * line cal end - keep the calibration and follow the line by its analog offset
+ * line analog, line digital - switch line sensing, digital uses the IR comparators and the edge reflex
+ * set4 06, set5 03 - line follower P and D gains, tenths like the other set commands
+ * stats - heap, task stack, lwIP pool, buffer and dropped-message report
+ * stats on 1000 - send a binary stats report every 1000 ms to clients subscribed to stats, stats off to stop
+ * #7 fwd100 - any command can carry an id, its ack is then "ack #7 rx:<us> dsp:<us> act:<us>" with robot
+ *             timestamps of receipt, dispatch to move_task and first motor actuation (0 if not applicable)
+ *
+ * USB serial: the messages of the GPIO IRQs, the lwIP callbacks and these commands are logged with the
+ * telemetry/dlog.h ids and printed by LogTask when the car is idle, T85_LOG_LEVEL picks which are built in
  *
  * More notes: printed lc and lr should be 0 when the car is stationary, otherwise do a manual reset
  */
 #include "FreeRTOS.h"
 #include "pico/stdlib.h"
-#include "pico/mutex.h"
 #include "hardware/pwm.h"
 #include "hardware/gpio.h"
 #include <sys/time.h>
+#include <inttypes.h>
+#include <math.h>
 #include <hardware/adc.h>
+#include "hardware/sync.h"
 
 #include "irline.h"
+#include "line_adc.h"
 #include "motor.h"
 #include "ultrasonic.h"
 #include "magnometer.h"
 #include "wifi.h"
+#include "udp_telemetry.h"
+#include "telemetry_queue.h"
+#include "isr_event.h"
+#include "stats.h"
+#include "loop_timer.h"
+#include "irq_time.h"
+#include "irq_dispatch.h"
+#include "trace.h"
+#include "dlog.h"
+#include "motion.h"
+#include "mission.h"
+#include "maze.h"
+#include "control.h"
+#include "recorder.h"
+#include "blackbox.h"
+#include "static_alloc.h"
+#include "sensor_hub.h"
 
-// Ir Sensor Pins
-#define IR_LEFT_PIN 26
-#define IR_RIGHT_PIN 27
 #define DEFAULT_SPEED 62500 * 0.1
 #define ECHO_PIN 12
 #define TRI_PIN 13
-#define mbaTASK_MESSAGE_BUFFER_SIZE (60)
-// Buffer handle for type of movement, forward, backward, clockwise, counter clockwise, reverse
+// loop rates, set from CMake, at most configTICK_RATE_HZ
+#ifndef CONTROL_LOOP_HZ
+#define CONTROL_LOOP_HZ 100
+#endif
+#ifndef SENSE_LOOP_HZ
+#define SENSE_LOOP_HZ 100
+#endif
+#if CONTROL_LOOP_HZ > 1000 || SENSE_LOOP_HZ > 1000
+#error "loop rates above configTICK_RATE_HZ cannot be scheduled"
+#endif
+// sensor rates, each sensor is sampled on the sense_task releases that fall on its period
+#ifndef HEADING_HZ
+#define HEADING_HZ 50 // heading() is 12 single-register I2C reads at 100 kHz, about 5 ms
+#endif
+#ifndef ULTRASONIC_HZ
+#define ULTRASONIC_HZ 16 // the HC-SR04 wants about 60 ms between pings for old echoes to die out
+#endif
+#if HEADING_HZ > SENSE_LOOP_HZ || ULTRASONIC_HZ > SENSE_LOOP_HZ
+#error "sensor rates above SENSE_LOOP_HZ cannot be sampled"
+#endif
+#define ULTRASONIC_MAX_AGE_US (3 * 1000000 / ULTRASONIC_HZ) // older readings count as no reading
+#define HEADING_MAX_AGE_US (3 * 1000000 / HEADING_HZ)       // an older heading stops the car, see move_task
+#define LINE_MAX_AGE_US (3 * 1000000 / SENSE_LOOP_HZ)       // an older analog line offset falls back to the black flags
+// the gains were tuned with a 10 ms loop, derivative and integral terms are scaled to that step
+#define CONTROL_GAIN_DT 0.01f
+#define TELEMETRY_ITERATIONS CONTROL_LOOP_HZ    // one motion update a second
+#define STEADY_ITERATIONS (CONTROL_LOOP_HZ / 2) // half a second on target ends a move
+#define IR_REFLEX_HOLD_US (3 * 1000000 / CONTROL_LOOP_HZ) // the line reflex stops the car if move_task misses this many releases
+#ifndef CONTROL_TASK_CORE
+#define CONTROL_TASK_CORE 0 // Only used by SMP builds with core affinity, GPIO IRQs are enabled on this core too.
+#endif
+#if configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1 && CONTROL_TASK_CORE != RUN_FREERTOS_ON_CORE
+#error "main() enables the GPIO IRQs on the core that starts FreeRTOS, pin control there"
+#endif
+// a route change for move_task, trace has the id and timestamps of commands sent with an id
+typedef struct move_cmd_t_
+{
+    bool flush;  // drop the queued route first
+    bool append; // then queue primitive
+    motion_primitive_t primitive;
+    cmd_trace_t trace;
+} move_cmd_t;
+#define MOVE_CMD_BUFFER_SIZE (MOTION_QUEUE_SIZE * (sizeof(move_cmd_t) + sizeof(size_t)))
+// Buffer handle for route changes from the network task
 MessageBufferHandle_t h_move_mode_buffer;
-// Buffer handle for distance
-MessageBufferHandle_t h_dist_buffer;
-// Buffer handle for turning angle
-MessageBufferHandle_t h_turn_buffer;
+STATIC_MESSAGE_BUFFER(move_mode_buffer, MOVE_CMD_BUFFER_SIZE);
+// Buffer handle for compiled mission scripts from the network task, an empty program stops the mission
+#define MISSION_BUFFER_SIZE (sizeof(mission_program_t) + sizeof(size_t))
+MessageBufferHandle_t h_mission_buffer;
+STATIC_MESSAGE_BUFFER(mission_buffer, MISSION_BUFFER_SIZE);
+static mission_compiler_t mission_compiler; // only used by network_task
+// Map requests for move_task, see control.h
+#define MAP_BUFFER_SIZE (4 * (sizeof(map_cmd_t) + sizeof(size_t)))
+MessageBufferHandle_t h_map_buffer;
+STATIC_MESSAGE_BUFFER(map_buffer, MAP_BUFFER_SIZE);
+#define CODES_PER_CM (DIST_10CM / 10.0f)
+#if CONTROL_BARCODE_SIZE != ISR_EVENT_DATA_SIZE
+#error "control_input_t.barcode must hold what barcode_last returns"
+#endif
+// move_task's control state, its map is copied by network_task under the sequence count
+static control_t control;
+static volatile uint32_t maze_seq = 0; // odd while move_task writes
+// the record of move_task's inputs and outputs, dumped by network_task once recording stopped
+static recorder_t recorder;
+static volatile bool recording = false;
+static volatile bool recorder_restart = false; // clear the log at the next period
+static volatile uint32_t recorder_seq = 0;     // odd while move_task may be logging a period
 
-static volatile float tkp = 0.1, tki = 0, tkd = 0.05;
+static volatile float tkp = 0.1, tki = 0, tkd = 0;
 static volatile float fkp = 0.15, fki = 0, fkd = 0.075;
+static volatile float lkp = 0.6, lkd = 0.3; // analog line follower, a starting point to tune from
 
-int volatile current_bearing = 0;
-double ultrasonic_reading = 9999999;
-bool b_left_IR_black = false;
-bool b_right_IR_black = false;
-auto_init_mutex(wifiMutex);
+// move_task state for the telemetry tasks
+volatile char move_mode = 'p';
+volatile int move_target_bearing = 0;
+// release timing of the periodic tasks, reported by stats
+static loop_timer_t move_timer;
+static loop_timer_t sense_timer;
 
 // check if there is an interrupt
 inline bool is_interrupt()
@@ -65,527 +198,863 @@ inline bool is_interrupt()
     return num == 0;
 }
 
-err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
-{ // Receive data from the TCP connection.
-    if (!p)
-    {                                      // Check if the received packet buffer is invalid.
-        printf("Something went wrong!\n"); // Print an error message.
-        return ERR_BUF;
+void control_map_write_begin(void)
+{
+    maze_seq++;
+    __dmb();
+}
+
+void control_map_write_end(void)
+{
+    __dmb();
+    maze_seq++;
+}
+
+uint32_t control_time_us(void)
+{
+    return time_us_32();
+}
+
+// a consistent copy of the map, false if move_task kept writing
+static bool maze_copy(maze_t *out)
+{
+    for (int tries = 0; tries < 16; tries++)
+    {
+        uint32_t seq = maze_seq;
+        __dmb();
+        if (seq & 1)
+            continue;
+        memcpy(out, &control.maze, sizeof(control.maze));
+        __dmb();
+        if (seq == maze_seq)
+            return true;
+    }
+    return false;
+}
+
+// planner time on 16x16 grids: open floor to the far corner, exploring with only that corner unknown, a serpentine to its far end
+static int maze_bench(char *text, size_t size)
+{
+    static maze_t grid;
+    static maze_plan_t plan;
+    const char *names[] = {"open", "explore", "serpentine"};
+    int len = 0;
+    for (int k = 0; k < 3 && len < (int)size; k++)
+    {
+        maze_reset(&grid, MAZE_MAX_SIZE, MAZE_MAX_SIZE, 20, 0, 0, 0);
+        memset(grid.known, 0xff, sizeof(grid.known));
+        if (k == 1)
+            grid.known[MAZE_MAX_SIZE - 1] = 0x7fff; // the only unknown cell is the far corner
+        for (int y = 1; k == 2 && y < MAZE_MAX_SIZE - 1; y += 2)
+            grid.occupied[y] = (y / 2) % 2 ? 0xfffe : 0x7fff; // gaps at alternate ends
+        uint8_t goal_x = k == 1 ? MAZE_NO_GOAL : MAZE_MAX_SIZE - 1;
+        uint32_t min_us = UINT32_MAX, max_us = 0, total_us = 0;
+        bool found = false;
+        for (int run = 0; run < 10; run++)
+        {
+            uint32_t start_us = time_us_32();
+            found = maze_plan(&grid, goal_x, MAZE_MAX_SIZE - 1, &plan);
+            uint32_t us = time_us_32() - start_us;
+            min_us = MIN(min_us, us);
+            max_us = MAX(max_us, us);
+            total_us += us;
+        }
+        len += snprintf(text + len, size - len, "[MAP]bench %s\tfound:%d\tsteps:%u\tcells:%u\tus min:%" PRIu32 " avg:%" PRIu32 " max:%" PRIu32 "\n",
+                        names[k], found, plan.length, plan.expanded, min_us, total_us / 10, max_us);
+    }
+    return len < (int)size ? len : (int)size - 1;
+}
+
+// stop recording and wait out the period move_task may be logging, the log is then stable for dumping
+static void recorder_stop(void)
+{
+    recording = false;
+    __dmb();
+    while (recorder_seq & 1)
+        vTaskDelay(1);
+}
+
+static uint32_t recorder_chunk(uint32_t offset, uint8_t *out, uint32_t size)
+{
+    return recorder_read(&recorder, offset, out, size);
+}
+
+// up to 192 bytes of a log from offset as "<tag><offset> <hex>" lines, then where the next chunk starts or the end
+static int log_dump(const char *tag, uint32_t (*read)(uint32_t, uint8_t *, uint32_t), uint32_t total, uint32_t offset,
+                    char *text, size_t size)
+{
+    uint8_t chunk[64];
+    int len = 0;
+    for (int line = 0; line < 3; line++)
+    {
+        uint32_t n = read(offset, chunk, sizeof(chunk));
+        if (n == 0)
+            break;
+        len += snprintf(text + len, size - len, "%s%" PRIu32 " ", tag, offset);
+        for (uint32_t i = 0; i < n; i++)
+            len += snprintf(text + len, size - len, "%02x", chunk[i]);
+        len += snprintf(text + len, size - len, "\n");
+        offset += n;
+    }
+    if (offset < total)
+        len += snprintf(text + len, size - len, "%snext %" PRIu32 "\n", tag, offset);
+    else
+        len += snprintf(text + len, size - len, "%send %" PRIu32 "\n", tag, total);
+    return len < (int)size ? len : (int)size - 1;
+}
+
+// hand a route change to move_task, which acks traced commands once the motors act
+static bool dispatch_move(bool flush, const motion_primitive_t *primitive, const cmd_trace_t *trace)
+{
+    move_cmd_t move = {.flush = flush, .append = primitive != NULL, .trace = *trace};
+    if (primitive)
+        move.primitive = *primitive;
+    move.trace.dsp_us = time_us_32();
+    return xMessageBufferSend(h_move_mode_buffer, &move, sizeof(move), 0) != 0;
+}
+
+// one step of a go route: s<codes> b<codes> t<degrees> a<codes>,<degrees> w<ms> x, arcs only drive forward
+static bool parse_primitive(const char *token, motion_primitive_t *primitive)
+{
+    char *end;
+    switch (token[0])
+    {
+    case 's':
+        primitive->type = MOTION_STRAIGHT;
+        break;
+    case 'b':
+        primitive->type = MOTION_STRAIGHT;
+        primitive->flags = MOTION_FLAG_NO_LINE;
+        break;
+    case 't':
+        primitive->type = MOTION_TURN;
+        break;
+    case 'a':
+        primitive->type = MOTION_ARC;
+        break;
+    case 'w':
+        primitive->type = MOTION_WAIT;
+        break;
+    case 'x':
+        primitive->type = MOTION_STOP;
+        return token[1] == '\0';
+    default:
+        return false;
+    }
+    primitive->value = strtol(token + 1, &end, 10);
+    if (end == token + 1)
+        return false;
+    if (primitive->type == MOTION_ARC)
+    {
+        if (*end != ',')
+            return false;
+        primitive->arg = strtol(end + 1, &end, 10);
+        if (primitive->value < 0)
+            return false;
+    }
+    return *end == '\0';
+}
+
+// handle a command from a client, called from network_task
+// "#<id> <command>" is traced, its ack carries the id and robot timestamps
+void tcp_server_command(TCP_CLIENT_T *client, char *cmd, size_t len, cmd_trace_t *trace)
+{
+    bool deferred = false; // move_task sends the ack
+    DLOG_TEXT(DLOG_COMMAND, cmd, len); // Log the received data.
+    if (strncmp(cmd, "start", 5) == 0)
+    {
+        DLOG_INFO(DLOG_COMMAND_START);
+    }
+    if (strncmp(cmd, "turncw", 6) == 0)
+    {
+        DLOG_INFO(DLOG_COMMAND_TURN_CW);
+        motion_primitive_t turn = {.type = MOTION_TURN, .value = 90};
+        deferred = dispatch_move(false, &turn, trace) && trace->has_id;
+    }
+    if (strncmp(cmd, "turnccw", 7) == 0)
+    {
+        DLOG_INFO(DLOG_COMMAND_TURN_CCW);
+        motion_primitive_t turn = {.type = MOTION_TURN, .value = -90};
+        deferred = dispatch_move(false, &turn, trace) && trace->has_id;
+    }
+    if (strncmp(cmd, "stop", 4) == 0)
+    {
+        motion_primitive_t halt = {.type = MOTION_STOP};
+        deferred = dispatch_move(true, &halt, trace) && trace->has_id;
+    }
+    if (strncmp(cmd, "set", 3) == 0)
+    {
+        char value[5] = "";
+        strncpy(value, cmd + 4, 4); // 2d.p.
+        DLOG_TEXT(DLOG_COMMAND_SET, cmd + 3, strnlen(cmd + 3, 5));
+        switch (*(char *)(cmd + 3))
+        {
+        case 'p':
+            tkp = atof(value) / 10;
+            break;
+        case 'i':
+            tki = atof(value) / 10;
+            break;
+        case 'd':
+            tkd = atof(value) / 10;
+            break;
+        case '1':
+            fkp = atof(value) / 10;
+            break;
+        case '2':
+            fki = atof(value) / 10;
+            break;
+        case '3':
+            fkd = atof(value) / 10;
+            break;
+        case '4':
+            lkp = atof(value) / 10;
+            break;
+        case '5':
+            lkd = atof(value) / 10;
+            break;
+        }
+    }
+    if (strncmp(cmd, "fwd", 3) == 0)
+    {
+        motion_primitive_t straight = {.type = MOTION_STRAIGHT, .value = atoi(cmd + 3)};
+        deferred = dispatch_move(false, &straight, trace) && trace->has_id;
     }
-    if (strlen(p->payload) == 0)
-    {                 // Check if the received data is empty.
-        pbuf_free(p); // Free the packet buffer.
-        return ERR_OK;
+    if (strncmp(cmd, "bar", 3) == 0)
+    {
+        motion_primitive_t straight = {.type = MOTION_STRAIGHT, .flags = MOTION_FLAG_NO_LINE, .value = 200};
+        deferred = dispatch_move(false, &straight, trace) && trace->has_id;
     }
-    else if (p->tot_len > 0)
-    {                                                                    // Check if the total length of received data is greater than 0.
-        printf("Buffer value: %s, len is %d\n", p->payload, p->tot_len); // Print the received data.
-        if (strncmp(p->payload, "start", 5) == 0)
+    if (strncmp(cmd, "go ", 3) == 0)
+    {
+        // only the first step carries the trace, its ack follows the first actuation of the route;
+        // the command keeps the client's line ending, so it separates steps like a space
+        cmd_trace_t step_trace = *trace;
+        char *save;
+        for (char *token = strtok_r(cmd + 3, " \t\r\n", &save); token; token = strtok_r(NULL, " \t\r\n", &save))
         {
-            printf("starting\n");
+            motion_primitive_t primitive = {0};
+            if (!parse_primitive(token, &primitive))
+                break;
+            bool sent = dispatch_move(false, &primitive, &step_trace);
+            if (step_trace.has_id)
+                deferred = sent;
+            step_trace.has_id = false;
+            if (!sent)
+                break;
         }
-        if (strncmp(p->payload, "turncw", 6) == 0)
+    }
+    if (strncmp(cmd, "mission ", 8) == 0)
+    {
+        char reply[64] = "";
+        if (strncmp(cmd + 8, "begin", 5) == 0)
+            mission_compile_begin(&mission_compiler);
+        else if (strncmp(cmd + 8, "run", 3) == 0)
         {
-            printf("turn cw\n");
-            int new_bearing = 90;
-            xMessageBufferSend(h_move_mode_buffer, "t", sizeof(char), 0);
-            xMessageBufferSend(h_turn_buffer, &new_bearing, sizeof(new_bearing), 0);
+            if (!mission_compile_end(&mission_compiler))
+                snprintf(reply, sizeof(reply), "[MSN]error line %u: %s\n", mission_compiler.line, mission_compiler.error);
+            else if (!xMessageBufferSend(h_mission_buffer, &mission_compiler.program, sizeof(mission_compiler.program), 0))
+                snprintf(reply, sizeof(reply), "[MSN]busy\n");
+            mission_compile_begin(&mission_compiler); // the next upload starts afresh
         }
-        if (strncmp(p->payload, "turnccw", 7) == 0)
+        else if (strncmp(cmd + 8, "stop", 4) == 0)
         {
-            printf("turn ccw\n");
-            int new_bearing = -90;
-            xMessageBufferSend(h_move_mode_buffer, "t", sizeof(char), 0);
-            xMessageBufferSend(h_turn_buffer, &new_bearing, sizeof(new_bearing), 0);
+            static const mission_program_t none = {0};
+            if (!xMessageBufferSend(h_mission_buffer, &none, sizeof(none), 0))
+                snprintf(reply, sizeof(reply), "[MSN]busy\n");
         }
-        if (strncmp(p->payload, "stop", 4) == 0)
+        if (reply[0])
+            tcp_server_reply(client, trace->generation, reply);
+    }
+    if (strncmp(cmd, "m ", 2) == 0 && !mission_compile_line(&mission_compiler, cmd + 2))
+    {
+        char reply[64];
+        snprintf(reply, sizeof(reply), "[MSN]error line %u: %s\n", mission_compiler.line, mission_compiler.error);
+        tcp_server_reply(client, trace->generation, reply);
+    }
+    if (strncmp(cmd, "line", 4) == 0)
+    {
+        char reply[128];
+        if (strncmp(cmd, "line cal end", 12) == 0)
+            line_adc_command(LINE_CMD_CAL_END);
+        else if (strncmp(cmd, "line cal", 8) == 0)
+            line_adc_command(LINE_CMD_CAL_BEGIN);
+        else if (strncmp(cmd, "line digital", 12) == 0)
+            line_adc_command(LINE_CMD_DIGITAL);
+        else if (strncmp(cmd, "line analog", 11) == 0 && line_adc_calibrated())
+            line_adc_command(LINE_CMD_ANALOG);
+        else if (strncmp(cmd, "line analog", 11) == 0)
+            tcp_server_reply(client, trace->generation, "[LINE]not calibrated, run line cal first\n");
+        else
         {
-            int new_bearing = 0;
-            xMessageBufferSend(h_move_mode_buffer, "t", sizeof(char), 0);
-            xMessageBufferSend(h_turn_buffer, &new_bearing, sizeof(new_bearing), 0);
+            line_adc_format(reply, sizeof(reply));
+            tcp_server_reply(client, trace->generation, reply);
         }
-        if (strncmp(p->payload, "set", 3) == 0)
+    }
+    if (strncmp(cmd, "map", 3) == 0)
+    {
+        static maze_t snapshot;
+        static char text[512];
+        unsigned a[5] = {0}, since = 0;
+        map_cmd_t map = {0};
+        bool send = true;
+        if (sscanf(cmd, "map reset %u %u %u %u %u", &a[0], &a[1], &a[2], &a[3], &a[4]) >= 3)
+            map = (map_cmd_t){MAP_RESET, {a[0], a[1], MIN(a[2], 255), a[3], a[4]}};
+        else if (sscanf(cmd, "map goto %u %u", &a[0], &a[1]) == 2)
+            map = (map_cmd_t){MAP_GOTO, {a[0], a[1]}};
+        else if (strncmp(cmd, "map explore", 11) == 0)
+            map = (map_cmd_t){MAP_EXPLORE, {strncmp(cmd + 11, " off", 4) != 0}};
+        else
         {
-            char value[5] = "";
-            strncpy(value, p->payload + 4, 4); // 2d.p.
-            printf("value is %s\n", value);
-            printf("char is %c\n", *(char *)(p->payload + 3));
-            switch (*(char *)(p->payload + 3))
+            send = false;
+            if (strncmp(cmd, "map bench", 9) == 0)
+                maze_bench(text, sizeof(text));
+            else if (!maze_copy(&snapshot))
+                snprintf(text, sizeof(text), "[MAP]busy\n");
+            else
             {
-            case 'p':
-                tkp = atof(value) / 10;
-                break;
-            case 'i':
-                tki = atof(value) / 10;
-                break;
-            case 'd':
-                tkd = atof(value) / 10;
-                break;
-            case '1':
-                fkp = atof(value) / 10;
-                break;
-            case '2':
-                fki = atof(value) / 10;
-                break;
-            case '3':
-                fkd = atof(value) / 10;
-                break;
+                sscanf(cmd, "map %u", &since);
+                maze_format_rows(&snapshot, since, text, sizeof(text));
             }
+            tcp_server_reply(client, trace->generation, text);
+        }
+        if (send && !xMessageBufferSend(h_map_buffer, &map, sizeof(map), 0))
+            tcp_server_reply(client, trace->generation, "[MAP]busy\n");
+    }
+    if (strncmp(cmd, "rec", 3) == 0)
+    {
+        static char text[512];
+        unsigned offset = 0;
+        if (strncmp(cmd, "rec on", 6) == 0)
+        {
+            recorder_restart = true;
+            __dmb();
+            recording = true;
+        }
+        else if (strncmp(cmd, "rec off", 7) == 0)
+            recorder_stop();
+        else if (sscanf(cmd, "rec dump %u", &offset) == 1)
+        {
+            recorder_stop();
+            log_dump("[REC]", recorder_chunk, recorder_size(&recorder), offset, text, sizeof(text));
+            tcp_server_reply(client, trace->generation, text);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "[REC]%s bytes:%" PRIu32 " records:%" PRIu32 " dropped:%" PRIu32 "\n", recording ? "on" : "off",
+                     recorder_size(&recorder), recorder.records, recorder.dropped);
+            tcp_server_reply(client, trace->generation, text);
+        }
+    }
+    if (strncmp(cmd, "bb", 2) == 0)
+    {
+        static char text[512];
+        unsigned offset = 0;
+        if (strncmp(cmd, "bb arm", 6) == 0)
+        {
+            if (!blackbox_arm())
+                tcp_server_reply(client, trace->generation, "[BB]busy\n");
+        }
+        else if (strncmp(cmd, "bb stop", 7) == 0)
+            blackbox_stop();
+        else if (sscanf(cmd, "bb dump %u", &offset) == 1)
+        {
+            log_dump("[BB]", blackbox_read, blackbox_size(), offset, text, sizeof(text));
+            tcp_server_reply(client, trace->generation, text);
         }
-        if (strncmp(p->payload, "fwd", 3) == 0)
+        else
         {
-            char value[4] = "";
-            strncpy(value, p->payload + 3, 4);
-            int dist = atoi(value);
-            xMessageBufferSend(h_move_mode_buffer, "f", sizeof(char), 0);
-            xMessageBufferSend(h_dist_buffer, &dist, sizeof(dist), 0);
+            // what a page program costs move_task shows in its worst period
+            int len = blackbox_format(text, sizeof(text));
+            snprintf(text + len, sizeof(text) - len, "[BB]move us max jitter:%" PRIu32 " work:%" PRIu32 " overruns:%" PRIu32 "\n",
+                     move_timer.max_jitter_us, move_timer.max_work_us, move_timer.overruns);
+            tcp_server_reply(client, trace->generation, text);
         }
-        if (strncmp(p->payload, "bar", 3) == 0)
+    }
+    if (strncmp(cmd, "trc", 3) == 0)
+    {
+        static char text[512];
+        unsigned offset = 0;
+        if (strncmp(cmd, "trc on", 6) == 0)
         {
-            int dist = 200;
-            xMessageBufferSend(h_move_mode_buffer, "b", sizeof(char), 0);
-            xMessageBufferSend(h_dist_buffer, &dist, sizeof(dist), 0);
+            if (!trace_start(strncmp(cmd, "trc on hiccup", 13) == 0))
+            {
+                trace_format(text, sizeof(text));
+                tcp_server_reply(client, trace->generation, text);
+            }
         }
-        if (strncmp(p->payload, "reset", 5) == 0)
+        else if (strncmp(cmd, "trc off", 7) == 0)
+            trace_stop();
+        else if (sscanf(cmd, "trc dump %u", &offset) == 1)
         {
-            reset_wheel_encoder();
+            trace_stop();
+            log_dump("[TRC]", trace_read, trace_size(), offset, text, sizeof(text));
+            tcp_server_reply(client, trace->generation, text);
         }
-        while (!mutex_try_enter(&wifiMutex, 0))
+        else
         {
-            printf("waiting for mutex\n");
-            sleep_ms(5);
+            trace_format(text, sizeof(text));
+            tcp_server_reply(client, trace->generation, text);
         }
-        xMessageBufferSend(wifiMsgBuffer, "ack\n", 5, 0);
-        mutex_exit(&wifiMutex);
     }
-    pbuf_free(p); // Free the packet buffer.
-    return ERR_OK;
+    if (strncmp(cmd, "reset", 5) == 0)
+    {
+        reset_wheel_encoder();
+    }
+    if (strncmp(cmd, "udp", 3) == 0)
+    {
+        char host[16] = "";
+        unsigned port = UDP_TELEMETRY_PORT, rate = UDP_TELEMETRY_RATE_HZ;
+        if (strncmp(cmd, "udp off", 7) == 0)
+            udp_telemetry_stop();
+        else if (sscanf(cmd, "udp %15s %u %u", host, &port, &rate) >= 1)
+            udp_telemetry_start(host, port, rate);
+    }
+    if (!deferred)
+        tcp_server_ack(client, trace); // only the client that sent the command gets the ack
 }
 
 // task for receiving forward data from the server
+// sleeps until a producer publishes, then drains every telemetry lane
 void server_forward_task()
 {
+    telemetry_msg_t msg;
+    telemetry_set_consumer(xTaskGetCurrentTaskHandle());
     while (1)
     {
-        struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 256, PBUF_RAM);
-        xMessageBufferReceive(wifiMsgBuffer, (void *)p->payload, 256, portMAX_DELAY);
-        tcp_server_send_data(p, myServer);
-        pbuf_free(p);
-        taskYIELD();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (telemetry_consume(&msg))
+        {
+            if (msg.client == TELEMETRY_BROADCAST)
+            {
+                tcp_server_broadcast(myServer, msg.topic, msg.data, msg.len);
+            }
+            else if (myServer)
+            {
+                msg.data[msg.len] = '\0';
+                tcp_server_reply(&myServer->clients[msg.client], msg.generation, msg.data);
+            }
+        }
     }
 }
 
 // task for interrupt receiving forward data from the server
+// blocks until an ISR posts an event, formatting happens here instead of in the ISR
 void server_forward_task_from_ISR()
 {
+    isr_event_t event;
+    char text[64];
+    isr_event_set_consumer(xTaskGetCurrentTaskHandle());
     while (1)
     {
-        struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 256, PBUF_RAM);
-        while (xMessageBufferReceiveFromISR(wifiMsgBufferFromISR, (void *)p->payload, 256, NULL) == 0)
-            taskYIELD();
-        tcp_server_send_data(p, myServer);
-        pbuf_free(p);
-        taskYIELD();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (isr_event_take(&event))
+        {
+            int len = 0;
+            switch (event.type)
+            {
+            case ISR_EVENT_BARCODE_CHAR:
+                len = snprintf(text, sizeof(text), "[barcode] %c %.*s\n", event.ch, (int)sizeof(event.data), event.data);
+                break;
+            case ISR_EVENT_BARCODE_DONE:
+                len = snprintf(text, sizeof(text), "[barcode] read %.*s\n", (int)sizeof(event.data), event.data);
+                break;
+            case ISR_EVENT_BARCODE_BAD_START:
+                len = snprintf(text, sizeof(text), "[barcode] barcode does not start with '*'\n");
+                break;
+            }
+            tcp_server_broadcast(myServer, TOPIC_BARCODE, text, MIN(len, sizeof(text) - 1));
+            isr_event_latency_us = time_us_32() - event.timestamp_us;
+            if (isr_event_latency_us > isr_event_latency_max_us)
+                isr_event_latency_max_us = isr_event_latency_us;
+        }
     }
 }
 
-// first interrupt handler
-void mainIRQhandler(uint gpio, uint32_t events)
+// task for streaming control state over UDP at the configured rate
+// the period is rounded to whole ticks, so 500 Hz needs configTICK_RATE_HZ of 1000
+void udp_telemetry_task(__unused void *params)
 {
-    if (gpio == left_wheel_encoder_pin)
-    {
-        left_wheel_encoder_handler(events);
-        return;
-    }
-    if (gpio == right_wheel_encoder_pin)
-    {
-        right_wheel_encoder_handler(events);
-        return;
-    }
-    if (gpio == ADC_PIN)
-    {
-        barcode_handler(events);
-        return;
-    }
-    if (gpio == ECHO_PIN)
+    sensor_snapshot_t sensors = {0};
+    TickType_t last_wake = xTaskGetTickCount();
+    while (true)
     {
-        echocallback(events);
-        return;
+        uint16_t rate = udp_telemetry_rate();
+        if (rate == 0)
+        {
+            vTaskDelay(100);
+            last_wake = xTaskGetTickCount();
+            continue;
+        }
+        long long left_code, right_code;
+        get_wheel_codes(&left_code, &right_code); // runs on the network core in SMP builds
+        sensor_hub_read(&sensors);
+        udp_sample_t sample = {
+            .timestamp_us = time_us_64(),
+            .left_code = left_code,
+            .right_code = right_code,
+            .bearing = sensors.readings[SENSOR_HEADING].value,
+            .target_bearing = move_target_bearing,
+            .ultrasonic_cm = sensors.readings[SENSOR_ULTRASONIC].valid ? MIN(sensors.readings[SENSOR_ULTRASONIC].value, UINT16_MAX) : UINT16_MAX,
+            .speed = get_speed(),
+            .ir = (sensors.readings[SENSOR_IR_LEFT].value != 0) | ((sensors.readings[SENSOR_IR_RIGHT].value != 0) << 1),
+            .mode = move_mode,
+        };
+        udp_telemetry_send(&sample);
+        TickType_t period = configTICK_RATE_HZ / rate;
+        vTaskDelayUntil(&last_wake, period ? period : 1);
     }
 }
 
-// magnometer error for turning
-float getBearingError(float current, float target)
+// GPIO handlers in irq_dispatch's order within the bank interrupt, lower first, see irq_dispatch.h
+// encoder edges are timed for the speed, the IR reflex steers, the echo and the bars are widths
+#ifndef IRQ_PRIORITY_ENCODER
+#define IRQ_PRIORITY_ENCODER 0
+#endif
+#ifndef IRQ_PRIORITY_IR
+#define IRQ_PRIORITY_IR 1
+#endif
+#ifndef IRQ_PRIORITY_ECHO
+#define IRQ_PRIORITY_ECHO 2
+#endif
+#ifndef IRQ_PRIORITY_BARCODE
+#define IRQ_PRIORITY_BARCODE 3
+#endif
+
+static void left_encoder_irq(__unused uint gpio, uint32_t events)
+{
+    left_wheel_encoder_handler(events);
+}
+
+static void right_encoder_irq(__unused uint gpio, uint32_t events)
+{
+    right_wheel_encoder_handler(events);
+}
+
+static void barcode_irq(__unused uint gpio, uint32_t events)
+{
+    barcode_handler(events);
+}
+
+static void echo_irq(__unused uint gpio, uint32_t events)
 {
-    float error = target - current;
-    if (error > 180)
-        return error - 360;
-    if (error < -180)
-        return error + 360;
-    return error;
+    echocallback(events);
 }
 
-// task for sensing
+// task for sensing, released every 1 / SENSE_LOOP_HZ
+// samples each sensor at its own rate and publishes the readings to the sensor hub
 void sense_task(__unused void *param)
 {
+    uint32_t release = 0;
+    uint32_t pinged_echoes = 0; // echoes timed when the last ping went out
+    bool pinged = false;
     while (true)
     {
-        current_bearing = heading();
-        ultrasonic_reading = getcm(TRI_PIN, ECHO_PIN);
-        b_left_IR_black = gpio_get(IR_LEFT_PIN);
-        b_right_IR_black = gpio_get(IR_RIGHT_PIN);
+        loop_timer_begin(&sense_timer);
+        bool sample_heading = release % (SENSE_LOOP_HZ / HEADING_HZ) == 0;
+        bool sample_ultrasonic = release % (SENSE_LOOP_HZ / ULTRASONIC_HZ) == 0;
+        release++;
 
-        vTaskDelay(10);
+        // sample outside the write section, readers only wait for the copy
+        float bearing = 0, cm = 0;
+        uint32_t bearing_us = 0, echo_us = 0;
+        bool echoed = false;
+        if (sample_heading)
+        {
+            bearing = heading();
+            bearing_us = time_us_32();
+        }
+        if (sample_ultrasonic)
+        {
+            // the echo ISR timed the previous ping, if it came back
+            uint32_t echoes = ultrasonic_echo(&cm, &echo_us);
+            echoed = pinged && echoes != pinged_echoes;
+            pinged_echoes = echoes;
+            pinged = true;
+            sendpulse(TRI_PIN, ECHO_PIN);
+        }
+        // an analog burst when the pins are on the ADC, about 35 us, the comparators otherwise
+        line_sample_t line;
+        bool analog = line_adc_sample(&line);
+        bool left_black = analog ? line.left_black : gpio_get(IR_LEFT_PIN);
+        bool right_black = analog ? line.right_black : gpio_get(IR_RIGHT_PIN);
+        uint32_t ir_us = time_us_32();
+
+        sensor_hub_begin();
+        if (sample_heading)
+            sensor_hub_set(SENSOR_HEADING, bearing, true, bearing_us);
+        if (sample_ultrasonic && echoed)
+            sensor_hub_set(SENSOR_ULTRASONIC, cm, true, echo_us);
+        sensor_hub_set(SENSOR_IR_LEFT, left_black, true, ir_us);
+        sensor_hub_set(SENSOR_IR_RIGHT, right_black, true, ir_us);
+        sensor_hub_set(SENSOR_LINE_OFFSET, analog ? line.offset : 0, analog, ir_us);
+        sensor_hub_end();
+
+        loop_timer_wait(&sense_timer);
+    }
+}
+
+// apply a motion_step output to the motors
+static void drive(const motion_output_t *output)
+{
+    set_wheel_speeds(output->left_speed, output->right_speed);
+    switch (output->drive)
+    {
+    case MOTION_DRIVE_FORWARD:
+        forward();
+        break;
+    case MOTION_DRIVE_BACKWARD:
+        backwards();
+        break;
+    case MOTION_DRIVE_CW:
+        rotate_clockwise();
+        break;
+    case MOTION_DRIVE_CCW:
+        rotate_counter_clockwise();
+        break;
+    default:
+        stop();
+        break;
     }
 }
 
-// task for moving
+// ack a traced command once the motors were driven for it at act_us, false
+// if the lane had no room even in its reply slots (the lane counts the drop)
+static bool send_move_ack(const cmd_trace_t *trace, uint32_t act_us)
+{
+    char ack[64];
+    tcp_server_format_ack(ack, sizeof(ack), trace, act_us);
+    return telemetry_reply(TELEMETRY_PRODUCER_MOVE, trace->client, trace->generation, ack);
+}
+
+// add this period to the black box, a copy into RAM, blackbox_task writes the flash
+static void blackbox_log(const control_input_t *in, const control_output_t *out)
+{
+    const motion_engine_t *engine = &control.engine;
+    blackbox_sample_t sample = {
+        .time_us = move_timer.release_us,
+        .left_code = (int32_t)in->motion.left_code,
+        .right_code = (int32_t)in->motion.right_code,
+        .bearing = (int16_t)in->motion.bearing,
+        .target_bearing = (int16_t)engine->target_bearing,
+        .left_speed = out->motion.left_speed,
+        .right_speed = out->motion.right_speed,
+        .obstacle_cm = isinf(in->motion.obstacle_cm) ? BLACKBOX_OBSTACLE_NONE : (uint16_t)MIN(in->motion.obstacle_cm, 0xfffe),
+        .line_offset = in->motion.line_valid ? (int16_t)(in->motion.line_offset * 32767) : 0,
+        .error = (int16_t)MAX(MIN(engine->error * 10, INT16_MAX), INT16_MIN),
+        .dt_us = (uint16_t)MIN(in->motion.dt * 1e6f, UINT16_MAX),
+        .drive = out->motion.drive,
+        .mode = motion_mode(engine),
+        .flags = (in->motion.left_ir_black ? BLACKBOX_FLAG_LEFT_IR : 0) | (in->motion.right_ir_black ? BLACKBOX_FLAG_RIGHT_IR : 0) |
+                 (in->motion.line_valid ? BLACKBOX_FLAG_LINE_VALID : 0) | (tcp_server_connected() ? BLACKBOX_FLAG_CLIENT : 0),
+        .events = out->motion_events,
+    };
+    blackbox_add(&sample);
+}
+
+// task for moving, released every 1 / CONTROL_LOOP_HZ
+// runs the mission script, the queued route and the map, see control/control.h
 void move_task(__unused void *params)
 {
-    int volatile target_bearing = current_bearing;
-    int volatile read_bearing = 0;
-    int update = 100;
-    char steadycount = 50;
-    // reading will be that of previous one
-
-    int volatile read_dist = 0;
-    uint64_t volatile target_code = 0;
-    char mode = 'p';
-    // f for forward
-    // b for barcode
-    // t for turn
-    // s for transition to reverse
-    // r for reverse
-    // p for paused
-
-    int volatile dist_error = 0;
-    int volatile dist_last_error = 0;
-
-    int volatile bearing_error = 0;
-    int volatile bearing_last_error = 0;
-    float volatile intergral = 0;
-    float volatile derivative = 0;
-    float volatile control = 0;
+    static mission_program_t mission_program;
+    motion_engine_t *engine = &control.engine;
+    control_input_t input = {0};
+    control_output_t output;
+    move_cmd_t move_cmd;
+    cmd_trace_t ack_trace;
+    bool ack_pending = false; // a traced command is waiting for its first actuation or for room in the lane
+    uint32_t ack_act_us = 0;  // when it was actuated, 0 until then
+    int update = TELEMETRY_ITERATIONS;
+    char update_data[120];
+    long long left_code, right_code;
+    sensor_snapshot_t sensors = {0};
+    bool heading_ok = false; // the heading was fresh last period
+    map_cmd_t map_cmd;
+
+    uint32_t overruns = 0;
+
+    control_init(&control, DEFAULT_SPEED, CONTROL_GAIN_DT, STEADY_ITERATIONS, CODES_PER_CM);
     printf("task running\n");
 
     while (1)
     {
-        xMessageBufferReceive(h_move_mode_buffer, (void *)&mode, sizeof(mode), 0);
-        bearing_error = getBearingError(current_bearing, target_bearing);
-
-        if (mode == 'p')
+        input.motion.dt = loop_timer_begin(&move_timer); // measured, not the nominal period
+        if (move_timer.overruns != overruns)
         {
-            stop();
-            if (--update == 0)
-            {
-                update = 100;
-                char update_data[100] = "";
-                snprintf(update_data, 100, "[P]lc:%llu\tlr:%llu\ttc:%llu\tec:%d\tcb:%d\ttb:%d\teb:%d\n", g_left_wheel_code, g_right_wheel_code, target_code, dist_error, current_bearing, target_bearing, bearing_error);
-                while (!mutex_try_enter(&wifiMutex, 0))
-                {
-                    vTaskDelay(5);
-                    stop();
-                }
-                xMessageBufferSend(wifiMsgBuffer, update_data, 100, 0);
-                mutex_exit(&wifiMutex);
-            }
+            overruns = move_timer.overruns;
+            trace_hiccup(); // the late period is the last one in the trace
         }
-
-        if (mode == 'f')
+        // log this period unless network_task stopped the recorder, see recorder_stop
+        recorder_seq++;
+        __dmb();
+        bool record = recording;
+        if (record && recorder_restart)
         {
-            if (xMessageBufferReceive(h_dist_buffer, (void *)&read_dist, sizeof(read_dist), 0))
-            {
-                if (read_dist > 0)
-                {
-                    printf("distanceBuffer: %d\n", read_dist);
-                    reset_wheel_encoder();
-                    target_code = read_dist;
-                }
-                else if (read_dist == -1)
-                {
-                    target_code = 0;
-                }
-            }
-            // check for obsticles
-            if (ultrasonic_reading < 15)
-            {
-                target_code = 0;
-            }
-
-            dist_last_error = dist_error;
-            dist_error = target_code - g_left_wheel_code;
-            derivative = dist_error - dist_last_error;
-            // Code will increase going backwards too
-            if (dist_error < 2)
-            {
-                control = 0;
-                if (--steadycount == 0)
-                {
-                    if (dist_error < -2)
-                    {
-                        stop();
-                        printf("lc was %llu, rc was %llu, set tc to %d\n", g_left_wheel_code, g_right_wheel_code, target_code);
-                        mode = 's'; // transition state to reverse
-                        steadycount = 50;
-                    }
-                    else
-                    {
-                        mode = 'p';
-                        steadycount = 50;
-                    }
-                }
-            }
-            else
-            {
-                control = fkp * dist_error;
-                steadycount = 50;
-            }
-            control += fkd * derivative;
-            if (control > 1)
-                control = 1;
-            set_speed(control * DEFAULT_SPEED);
-            if (g_left_wheel_code < g_right_wheel_code)
-            {
-                right_tilt();
-            }
-            if (g_left_wheel_code > g_right_wheel_code)
-            {
-                for (int i = g_left_wheel_code - g_right_wheel_code; i > 0; i -= 1)
-                {
-                    left_tilt();
-                }
-            }
-            if (b_left_IR_black)
-            {
-                right_tilt();
-                right_tilt();
-            }
-            if (b_right_IR_black)
-            {
-                left_tilt();
-                left_tilt();
-            }
-            forward();
-
-            if (--update == 0)
-            {
-                update = 100;
-                char update_data[100] = "";
-                uint16_t speed = control * DEFAULT_SPEED;
-                snprintf(update_data, 100, "[FWD]lc:%llu\tlr:%llu\ttar:%llu\terr:%d\tctrl:%.2f\tp:%.3f\td:%.2f\tspeed:%d\n", g_left_wheel_code, g_right_wheel_code, target_code, dist_error, control, fkp, derivative, speed);
-                while (!mutex_try_enter(&wifiMutex, 0))
-                {
-                    vTaskDelay(5);
-                    stop();
-                }
-                xMessageBufferSend(wifiMsgBuffer, update_data, 100, 0);
-                mutex_exit(&wifiMutex);
-            }
+            recorder_clear(&recorder);
+            recorder_restart = false;
         }
-
-        if (mode == 'b')
+        if (record)
+            recorder_begin(&recorder, &control, move_timer.release_us);
+        while (xMessageBufferReceive(h_move_mode_buffer, (void *)&move_cmd, sizeof(move_cmd), 0))
         {
-            if (xMessageBufferReceive(h_dist_buffer, (void *)&read_dist, sizeof(read_dist), 0))
-            {
-                if (read_dist > 0)
-                {
-                    printf("distanceBuffer: %d\n", read_dist);
-                    reset_wheel_encoder();
-                    target_code = read_dist;
-                }
-            }
-            // check for obsticles
-            if (ultrasonic_reading < 15)
-            {
-                target_code = 0;
-            }
-
-            dist_last_error = dist_error;
-            dist_error = target_code - g_left_wheel_code;
-            derivative = dist_error - dist_last_error;
-            // Code will increase going backwards too
-            if (dist_error < 2)
+            if (!control_move(&control, move_cmd.flush, move_cmd.append, &move_cmd.primitive))
+                telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, "[MOV]queue full\n");
+            if (record)
+                recorder_move(&recorder, move_cmd.flush, move_cmd.append, &move_cmd.primitive);
+            if (move_cmd.trace.has_id)
             {
-                control = 0;
-                if (--steadycount == 0)
-                {
-                    if (dist_error < -2)
-                    {
-                        stop();
-                        printf("lc was %llu, rc was %llu, set tc to %d\n", g_left_wheel_code, g_right_wheel_code, target_code);
-                        mode = 's'; // transition state to reverse
-                        steadycount = 50;
-                    }
-                    else
-                    {
-                        mode = 'p';
-                        steadycount = 50;
-                    }
-                }
+                if (ack_pending)
+                    send_move_ack(&ack_trace, ack_act_us ? ack_act_us : time_us_32()); // two traced commands in one period, both act now
+                ack_trace = move_cmd.trace;
+                ack_pending = true;
+                ack_act_us = 0;
             }
+        }
+        if (xMessageBufferReceive(h_mission_buffer, (void *)&mission_program, sizeof(mission_program), 0))
+        {
+            uint32_t barcode_count = barcode_last(input.barcode, sizeof(input.barcode));
+            control_mission(&control, &mission_program, barcode_count);
+            if (record)
+                recorder_mission(&recorder, &mission_program, barcode_count);
+            if (control.mission.running)
+                snprintf(update_data, sizeof(update_data), "[MSN]start len:%u\n", control.mission.program.len);
             else
-            {
-                control = fkp * dist_error;
-                steadycount = 50;
-            }
-            control += fkd * derivative;
-            if (control > 1)
-                control = 1;
-            set_speed(control * DEFAULT_SPEED);
-            if (g_left_wheel_code < g_right_wheel_code)
-            {
-                right_tilt();
-            }
-            if (g_left_wheel_code > g_right_wheel_code)
-            {
-                for (int i = g_left_wheel_code - g_right_wheel_code; i > 0; i -= 1)
-                {
-                    left_tilt();
-                }
-            }
-            forward();
-
-            if (--update == 0)
-            {
-                update = 100;
-                char update_data[100] = "";
-                uint16_t speed = control * DEFAULT_SPEED;
-                snprintf(update_data, 100, "[BAR]lc:%llu\tlr:%llu\ttar:%llu\terr:%d\tctrl:%.2f\tp:%.3f\td:%.2f\tspeed:%d\n", g_left_wheel_code, g_right_wheel_code, target_code, dist_error, control, fkp, derivative, speed);
-                while (!mutex_try_enter(&wifiMutex, 0))
-                {
-                    vTaskDelay(5);
-                    stop();
-                }
-                xMessageBufferSend(wifiMsgBuffer, update_data, 100, 0);
-                mutex_exit(&wifiMutex);
-            }
+                snprintf(update_data, sizeof(update_data), "[MSN]stopped\n");
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MISSION, update_data);
         }
-
-        if (mode == 's')
+        while (xMessageBufferReceive(h_map_buffer, (void *)&map_cmd, sizeof(map_cmd), 0))
         {
-            vTaskDelay(100); // wheels to stop completely
-            target_code = g_left_wheel_code;
-            printf("lc was %llu, rc was %llu, set tc to %d\n", g_left_wheel_code, g_right_wheel_code, target_code);
-            long long right_offset = g_right_wheel_code - g_left_wheel_code;
-            reset_wheel_encoder();
-            g_right_wheel_code = right_offset;
-            mode = 'r';
+            control_map(&control, &map_cmd);
+            if (record)
+                recorder_map(&recorder, &map_cmd);
         }
 
-        if (mode == 'r')
+        engine->gains = (motion_gains_t){tkp, tki, tkd, fkp, fkd, lkp, lkd};
+        get_wheel_codes(&left_code, &right_code);
+        sensor_hub_read(&sensors); // one coherent view for this period, keeps the last one if it loses to sense_task
+        input.motion.left_code = left_code;
+        input.motion.right_code = right_code;
+        // turns and arcs steer by the compass and would never end on a heading that stopped
+        // updating: keep the last fresh one and stop whatever moves the car until it is back
+        bool heading_fresh = sensor_hub_fresh(&sensors.readings[SENSOR_HEADING], time_us_32(), HEADING_MAX_AGE_US);
+        if (heading_fresh)
+            input.motion.bearing = sensors.readings[SENSOR_HEADING].value;
+        else if (control.mission.running)
         {
-            dist_last_error = dist_error;
-            dist_error = target_code - g_left_wheel_code;
-            derivative = dist_error - dist_last_error;
-            // Code will increase going backwards too
-            if (dist_error < 2)
-            {
-                control = 0;
-                if (--steadycount == 0)
-                {
-                    mode = 'p';
-                    steadycount = 50;
-                }
-            }
-            else
-            {
-                control = fkp * dist_error;
-                steadycount = 50;
-            }
-            control += fkd * derivative;
-            if (control > 1)
-                control = 1;
-            set_speed(control * DEFAULT_SPEED);
-            if (g_left_wheel_code < g_right_wheel_code)
-            {
-                right_tilt();
-            }
-            if (g_left_wheel_code > g_right_wheel_code)
-            {
-                left_tilt();
-            }
-            backwards();
-
-            if (--update == 0)
-            {
-                update = 100;
-                char update_data[100] = "";
-                uint16_t speed = control * DEFAULT_SPEED;
-                snprintf(update_data, 100, "[RVE]lc:%llu\tlr:%llu\ttar:%llu\terr:%d\tctrl:%.2f\tp:%.3f\td:%.2f\tspeed:%d\n", g_left_wheel_code, g_right_wheel_code, target_code, dist_error, control, fkp, derivative, speed);
-                while (!mutex_try_enter(&wifiMutex, 0))
-                {
-                    vTaskDelay(5);
-                    stop();
-                }
-                xMessageBufferSend(wifiMsgBuffer, update_data, 100, 0);
-                mutex_exit(&wifiMutex);
-            }
+            static const mission_program_t none = {0};
+            uint32_t barcode_count = barcode_last(input.barcode, sizeof(input.barcode));
+            control_mission(&control, &none, barcode_count); // halts the route and map driving too
+            if (record)
+                recorder_mission(&recorder, &none, barcode_count);
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MISSION, "[MSN]stopped\n");
         }
+        else if (engine->active || motion_queued(engine))
+        {
+            motion_primitive_t halt = {.type = MOTION_STOP};
+            control_move(&control, true, true, &halt); // ends map driving too
+            if (record)
+                recorder_move(&recorder, true, true, &halt);
+        }
+        if (heading_fresh != heading_ok)
+        {
+            heading_ok = heading_fresh;
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, heading_ok ? "[MOV]heading ok\n" : "[MOV]heading stale\n");
+        }
+        // a missing or stale echo reads as nothing ahead, as before the first ping
+        if (sensor_hub_fresh(&sensors.readings[SENSOR_ULTRASONIC], time_us_32(), ULTRASONIC_MAX_AGE_US))
+            input.motion.obstacle_cm = sensors.readings[SENSOR_ULTRASONIC].value;
+        else
+            input.motion.obstacle_cm = INFINITY;
+        // edges the line reflex acted on since the last step count even if sense_task missed them
+        uint32_t ir_edges = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &ir_edges, 0);
+        input.motion.left_ir_black = sensors.readings[SENSOR_IR_LEFT].value != 0 || (ir_edges & IR_REFLEX_LEFT_BLACK);
+        input.motion.right_ir_black = sensors.readings[SENSOR_IR_RIGHT].value != 0 || (ir_edges & IR_REFLEX_RIGHT_BLACK);
+        input.motion.line_valid = sensor_hub_fresh(&sensors.readings[SENSOR_LINE_OFFSET], time_us_32(), LINE_MAX_AGE_US);
+        input.motion.line_offset = sensors.readings[SENSOR_LINE_OFFSET].value;
+        input.barcode_count = barcode_last(input.barcode, sizeof(input.barcode));
+        // the map takes each echo once, by its timestamp
+        const sensor_reading_t *echo = &sensors.readings[SENSOR_ULTRASONIC];
+        input.echo_valid = echo->valid;
+        input.echo_cm = echo->value;
+        input.echo_us = echo->timestamp_us;
 
-        if (mode == 't')
+        control_step(&control, &input, &output);
+        drive(&output.motion);
+        blackbox_log(&input, &output);
+        if (record)
+            recorder_step(&recorder, move_timer.release_us, &engine->gains, &input, &output);
+        __dmb();
+        recorder_seq++;
+        if (output.motion.drive == MOTION_DRIVE_FORWARD && motion_mode(engine) == 'f' && !input.motion.line_valid)
         {
-            if (xMessageBufferReceive(h_turn_buffer, (void *)&read_bearing, sizeof(read_bearing), 0))
-            {
-                printf("readbearing: %d\n", read_bearing);
-                if (read_bearing == 0)
-                    target_bearing = current_bearing;
-                target_bearing += read_bearing;
-                if (target_bearing > 360)
-                    target_bearing -= 360;
-                if (target_bearing < 0)
-                    target_bearing += 360;
-            }
-            bearing_last_error = bearing_error;
-            intergral += bearing_error;
-            derivative = bearing_error - bearing_last_error;
+            // let the IR edges steer until the next step, with the shares motion_step uses
+            uint16_t full = MAX(output.motion.left_speed, output.motion.right_speed);
+            ir_reflex_speeds_t reflex = {output.motion.left_speed, output.motion.right_speed, full * MOTION_LEFT_TILT, full * MOTION_RIGHT_TILT};
+            ir_reflex_arm(&reflex, IR_REFLEX_HOLD_US);
+        }
+        else
+            ir_reflex_disarm();
 
-            if (abs(bearing_error) > 3)
-            {
-                control = tkp * bearing_error;
-                steadycount = 50;
-            }
-            else
+        // drops the update if the lane is full, never waits
+        if (output.mission_events & MISSION_EVENT_SAY)
+        {
+            snprintf(update_data, sizeof(update_data), "[MSN]say %s\n", control.mission.say_text);
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MISSION, update_data);
+        }
+        if (output.mission_events & MISSION_EVENT_DONE)
+        {
+            snprintf(update_data, sizeof(update_data), "[MSN]done ticks:%" PRIu32 "\n", control.mission.ticks);
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MISSION, update_data);
+        }
+        if (output.map_events & CONTROL_MAP_PLANNED)
+        {
+            snprintf(update_data, sizeof(update_data), "[MAP]plan steps:%u\tmoves:%u\tcells:%u\tus:%" PRIu32 "\n", control.plan_length,
+                     control.plan_moves, control.plan_expanded, control.plan_us);
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, update_data);
+        }
+        if (output.map_events & CONTROL_MAP_ARRIVED)
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, "[MAP]arrived\n");
+        if (output.map_events & CONTROL_MAP_EXPLORED)
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, "[MAP]explored\n");
+        if (output.map_events & CONTROL_MAP_NO_PATH)
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, "[MAP]no path\n");
+        if (output.motion_events & MOTION_EVENT_OBSTACLE)
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, "[MOV]obstacle\n");
+        if (output.motion_events & MOTION_EVENT_DONE)
+        {
+            snprintf(update_data, sizeof(update_data), "[MOV]done id:%u\n", engine->done_id);
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, update_data);
+        }
+        if (output.motion_events & MOTION_EVENT_STARTED)
+        {
+            snprintf(update_data, sizeof(update_data), "[MOV]start id:%u\tmode:%c\tq:%u\n", engine->current.id, motion_mode(engine), motion_queued(engine));
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, update_data);
+        }
+        if (output.motion_events & MOTION_EVENT_IDLE)
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MOTION, "[MOV]idle\n");
+        if (--update == 0)
+        {
+            update = TELEMETRY_ITERATIONS;
+            control_format_update(&control, &input, update_data, sizeof(update_data));
+            telemetry_publish(TELEMETRY_PRODUCER_MOVE, motion_mode(engine) == 't' ? TOPIC_HEADING : TOPIC_MOTION, update_data);
+            if (control.mission.running)
             {
-                if (--steadycount == 0)
-                {
-                    mode = 'p';
-                    steadycount = 50;
-                }
-                control = 0;
+                snprintf(update_data, sizeof(update_data), "[MSN]pc:%u\tticks:%" PRIu32 "\n", control.mission.pc, control.mission.ticks);
+                telemetry_publish(TELEMETRY_PRODUCER_MOVE, TOPIC_MISSION, update_data);
             }
-            control += tki * intergral + tkd * derivative;
+        }
 
-            if (control > 0)
-            {
-                // set direction here
-                rotate_clockwise();
-            }
-            else
-            {
-                rotate_counter_clockwise();
-            }
-            if (control < 0)
-                control = -control;
-            if (control > 1)
-                control = 1;
-            set_speed(control * DEFAULT_SPEED);
-            if (--update == 0)
-            {
-                update = 100;
-                char update_data[100] = "";
-                uint16_t speed = control * DEFAULT_SPEED;
-                snprintf(update_data, 100, "[TUN]cur:%d\ttar:%d\terr:%d\tctrl:%f\tp:%.3f\tspeed:%d\n", current_bearing, target_bearing, bearing_error, control, tkp, speed);
-                while (!mutex_try_enter(&wifiMutex, 0))
-                {
-                    printf("waiting for mutex\n");
-                    vTaskDelay(5);
-                    stop();
-                }
-                xMessageBufferSend(wifiMsgBuffer, update_data, 100, 0);
-                mutex_exit(&wifiMutex);
-            }
+        if (ack_pending)
+        {
+            // the motors were driven for the new route in this iteration, a full lane gets another try next period
+            if (!ack_act_us)
+                ack_act_us = time_us_32();
+            ack_pending = !send_move_ack(&ack_trace, ack_act_us);
         }
-        vTaskDelay(10);
+        move_mode = motion_mode(engine);
+        move_target_bearing = engine->target_bearing;
+        loop_timer_wait(&move_timer);
     }
 }
 
@@ -614,36 +1083,71 @@ void calibrate_task()
             update = 200;
             char update_data[100] = "";
             snprintf(update_data, 100, "[CAL]min: x:%d\ty%d\tz%d[CAL]max: x:%d\ty:%d\tz:%d\n", m_min.x, m_min.y, m_min.z, m_max.x, m_max.y, m_max.z);
-            while (!mutex_try_enter(&wifiMutex, 0))
-            {
-                vTaskDelay(5);
-            }
-            xMessageBufferSend(wifiMsgBuffer, update_data, 100, 0);
-            mutex_exit(&wifiMutex);
+            telemetry_publish(TELEMETRY_PRODUCER_CALIBRATE, TOPIC_CALIBRATION, update_data); // drops the update if the lane is full, never waits
         }
         vTaskDelay(10);
     }
 }
 
+// pin a task to one core in SMP builds, tasks may run on either core otherwise
+static void pin_task(TaskHandle_t task, UBaseType_t core)
+{
+#if configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+    vTaskCoreAffinitySet(task, 1 << core);
+#endif
+}
+
+// task stacks in words, static in T85_STATIC_ALLOC builds
+STATIC_TASK(network, configMINIMAL_STACK_SIZE * 4);
+STATIC_TASK(move, configMINIMAL_STACK_SIZE * 4);
+STATIC_TASK(sense, configMINIMAL_STACK_SIZE);
+STATIC_TASK(forward, configMINIMAL_STACK_SIZE * 2);
+STATIC_TASK(forward_isr, configMINIMAL_STACK_SIZE * 2);
+STATIC_TASK(udp, configMINIMAL_STACK_SIZE * 2);
+STATIC_TASK(blackbox, configMINIMAL_STACK_SIZE);
+STATIC_TASK(dlog, configMINIMAL_STACK_SIZE * 2);
+
 void vLaunch(void)
 {
 
-    h_move_mode_buffer = xMessageBufferCreate(mbaTASK_MESSAGE_BUFFER_SIZE);
-    h_turn_buffer = xMessageBufferCreate(mbaTASK_MESSAGE_BUFFER_SIZE);
-    h_dist_buffer = xMessageBufferCreate(mbaTASK_MESSAGE_BUFFER_SIZE);
+    h_move_mode_buffer = static_message_buffer_create(move_mode_buffer);
+    stats_watch_buffer("move_mode", h_move_mode_buffer, MOVE_CMD_BUFFER_SIZE);
+    h_mission_buffer = static_message_buffer_create(mission_buffer);
+    stats_watch_buffer("mission", h_mission_buffer, MISSION_BUFFER_SIZE);
+    h_map_buffer = static_message_buffer_create(map_buffer);
+    stats_watch_buffer("map", h_map_buffer, MAP_BUFFER_SIZE);
+    loop_timer_init(&move_timer, "move", CONTROL_LOOP_HZ);
+    loop_timer_init(&sense_timer, "sense", SENSE_LOOP_HZ);
+    blackbox_init();
+    stats_watch_loop(&move_timer);
+    stats_watch_loop(&sense_timer);
 
     TaskHandle_t server_sampleRecv;    // Create a task handle for the server task.
     TaskHandle_t server_sampleRecvISR; // Create a task handle for the server task.
     TaskHandle_t movement_task;        // Create a task handle for the server task.
     TaskHandle_t sensor_task;          // Create a task handle for the server task.
-    wifiMsgBuffer = xMessageBufferCreate(256);
-    wifiMsgBufferFromISR = xMessageBufferCreate(256);
+    TaskHandle_t udp_task;             // Create a task handle for the UDP telemetry task.
+    TaskHandle_t net_task;             // Create a task handle for the network task.
+    TaskHandle_t blackbox_handle;      // Create a task handle for the black box writer.
+    TaskHandle_t log_task;             // Create a task handle for the deferred log printer.
 
     printf("creating tasks\n");
-    xTaskCreate(move_task, "TurningTask", configMINIMAL_STACK_SIZE * 4, NULL, 2, &movement_task);                                    // Create the server task.
-    xTaskCreate(sense_task, "SensorTask", configMINIMAL_STACK_SIZE, NULL, 3, &sensor_task);                                          // Create the server task.
-    xTaskCreate(server_forward_task, "ServerForwardTask", configMINIMAL_STACK_SIZE * 2, NULL, 1, &server_sampleRecv);                // Create the server task.
-    xTaskCreate(server_forward_task_from_ISR, "ServerForwardTaskISR", configMINIMAL_STACK_SIZE * 2, NULL, 1, &server_sampleRecvISR); // Create the server task.
+    static_task_create(network, network_task, "NetworkTask", NULL, NETWORK_TASK_PRIORITY, &net_task);                    // Create the network task, it brings up Wi-Fi.
+    static_task_create(move, move_task, "TurningTask", NULL, 2, &movement_task);                                         // Create the server task.
+    static_task_create(sense, sense_task, "SensorTask", NULL, 3, &sensor_task);                                          // Create the server task.
+    static_task_create(forward, server_forward_task, "ServerForwardTask", NULL, 1, &server_sampleRecv);                  // Create the server task.
+    static_task_create(forward_isr, server_forward_task_from_ISR, "ServerForwardTaskISR", NULL, 1, &server_sampleRecvISR); // Create the server task.
+    static_task_create(udp, udp_telemetry_task, "UdpTelemetryTask", NULL, 1, &udp_task);                                 // Create the UDP telemetry task.
+    static_task_create(blackbox, blackbox_task, "BlackBoxTask", NULL, 1, &blackbox_handle);                              // Create the black box writer.
+    static_task_create(dlog, dlog_task, "LogTask", NULL, tskIDLE_PRIORITY, &log_task);                                    // Create the deferred log printer.
+    pin_task(net_task, NETWORK_TASK_CORE);
+    pin_task(server_sampleRecv, NETWORK_TASK_CORE);
+    pin_task(server_sampleRecvISR, NETWORK_TASK_CORE);
+    pin_task(udp_task, NETWORK_TASK_CORE);
+    pin_task(log_task, NETWORK_TASK_CORE);
+    pin_task(movement_task, CONTROL_TASK_CORE);
+    pin_task(sensor_task, CONTROL_TASK_CORE);
+    pin_task(blackbox_handle, CONTROL_TASK_CORE); // below move_task on its core, a page program can only delay its next release
     printf("starting tasks\n");
     vTaskStartScheduler();
     printf("task scheduler failed to hold");
@@ -652,9 +1156,7 @@ void vLaunch(void)
 int main()
 {                     // Main function of the program.
     stdio_init_all(); // Initialize standard I/O.
-
-    initWifi();
-    start_server(NULL);
+    dlog_init();      // Before the IRQs that log.
 
     gpio_init(IR_LEFT_PIN);
     gpio_init(IR_RIGHT_PIN);
@@ -671,13 +1173,15 @@ int main()
     initalize_acc(); // Configure the accelerometer.
     initalize_mag(); // Configure the magnetometer.
 
-    gpio_set_irq_callback(&mainIRQhandler);
-    gpio_set_irq_enabled(left_wheel_encoder_pin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_enabled(right_wheel_encoder_pin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_enabled(ADC_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_enabled(ECHO_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_enabled(IR_LEFT_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_enabled(IR_RIGHT_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+    // the handler and enables are per core, these run before the scheduler on CONTROL_TASK_CORE
+    const uint32_t edges = GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL;
+    irq_dispatch_add(left_wheel_encoder_pin, edges, IRQ_SOURCE_LEFT_ENCODER, IRQ_PRIORITY_ENCODER, left_encoder_irq);
+    irq_dispatch_add(right_wheel_encoder_pin, edges, IRQ_SOURCE_RIGHT_ENCODER, IRQ_PRIORITY_ENCODER, right_encoder_irq);
+    irq_dispatch_add(IR_LEFT_PIN, edges, IRQ_SOURCE_IR_LEFT, IRQ_PRIORITY_IR, ir_edge_handler);
+    irq_dispatch_add(IR_RIGHT_PIN, edges, IRQ_SOURCE_IR_RIGHT, IRQ_PRIORITY_IR, ir_edge_handler);
+    irq_dispatch_add(ECHO_PIN, edges, IRQ_SOURCE_ECHO, IRQ_PRIORITY_ECHO, echo_irq);
+    irq_dispatch_add(ADC_PIN, edges, IRQ_SOURCE_BARCODE, IRQ_PRIORITY_BARCODE, barcode_irq);
+    irq_dispatch_start();
 
     vLaunch();
     return 0; // Return 0 to indicate successful program execution.
@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "dlog.h"
+
+static_assert((DLOG_SLOTS & (DLOG_SLOTS - 1)) == 0, "DLOG_SLOTS must be a power of two");
+static_assert(sizeof(dlog_record_t) == 28, "records are 28 bytes");
+
+static const char *const formats[DLOG_MESSAGE_COUNT] = {
+#define DLOG_MESSAGE(id, format) [id] = format,
+#include "dlog_messages.h"
+#undef DLOG_MESSAGE
+};
+
+static dlog_record_t ring[DLOG_SLOTS];
+static uint32_t head = 0;          // next slot to claim, under the lock
+static volatile uint32_t tail = 0; // next slot to print, dlog_task only
+static volatile uint32_t dropped = 0;
+static spin_lock_t *lock = NULL; // producers on both cores, tasks and ISRs
+
+void dlog_init(void)
+{
+    lock = spin_lock_init(spin_lock_claim_unused(true));
+}
+
+// claim the next slot, false when the ring is full
+static bool claim(uint32_t *n)
+{
+    uint32_t irq = spin_lock_blocking(lock);
+    *n = head;
+    bool room = *n - tail < DLOG_SLOTS;
+    if (room)
+        head = *n + 1;
+    else
+        dropped++;
+    spin_unlock(lock, irq);
+    return room;
+}
+
+// the slot is the caller's until seq is written, dlog_task waits for it in order
+static void commit(dlog_record_t *record, uint32_t n, uint8_t level, uint16_t id, uint8_t argc)
+{
+    record->time_us = time_us_32();
+    record->id = id;
+    record->level = level;
+    record->argc = argc;
+    __dmb();
+    record->seq = n + 1;
+}
+
+void dlog_write(uint8_t level, uint16_t id, uint8_t argc, const uint32_t *args)
+{
+    uint32_t n;
+    if (!claim(&n))
+        return;
+    dlog_record_t *record = &ring[n & (DLOG_SLOTS - 1)];
+    memcpy(record->args, args, sizeof(record->args));
+    commit(record, n, level, id, argc);
+}
+
+void dlog_write_text(uint8_t level, uint16_t id, const char *text, uint32_t len)
+{
+    uint32_t n;
+    if (!claim(&n))
+        return;
+    dlog_record_t *record = &ring[n & (DLOG_SLOTS - 1)];
+    if (len > DLOG_TEXT_SIZE)
+        len = DLOG_TEXT_SIZE;
+    memcpy(record->text, text, len);
+    commit(record, n, level, id, DLOG_ARGC_TEXT | len);
+}
+
+// copy out the oldest record, false when there is none or its writer is not done
+bool dlog_take(dlog_record_t *out)
+{
+    dlog_record_t *record = &ring[tail & (DLOG_SLOTS - 1)];
+    if (record->seq != tail + 1)
+        return false;
+    __dmb();
+    *out = *record;
+    record->seq = 0;
+    __dmb();
+    tail = tail + 1;
+    return true;
+}
+
+uint32_t dlog_dropped(void)
+{
+    return dropped;
+}
+
+// "<seconds> <level> <message>", a line
+int dlog_format(const dlog_record_t *record, char *text, size_t size)
+{
+    static const char levels[] = "DIWE";
+    const char *format = record->id < DLOG_MESSAGE_COUNT ? formats[record->id] : "unknown message";
+    int len = snprintf(text, size, "%5" PRIu32 ".%03" PRIu32 " %c ", record->time_us / 1000000, record->time_us / 1000 % 1000,
+                       levels[record->level & 3]);
+    if (len >= (int)size)
+        return (int)size - 1;
+    if (record->argc & DLOG_ARGC_TEXT)
+        len += snprintf(text + len, size - len, format, (int)(record->argc & ~DLOG_ARGC_TEXT), record->text);
+    else // arguments past the format's are ignored; uint32_t is unsigned long on the RP2040, the formats take ints
+        len += snprintf(text + len, size - len, format, (unsigned)record->args[0], (unsigned)record->args[1],
+                        (unsigned)record->args[2], (unsigned)record->args[3]);
+    if (len < (int)size - 1)
+    {
+        text[len++] = '\n';
+        text[len] = '\0';
+    }
+    return len < (int)size ? len : (int)size - 1;
+}
+
+// prints the log to stdio, at the lowest priority so only idle time pays for the formatting
+void dlog_task(__unused void *params)
+{
+    dlog_record_t record;
+    char text[128];
+    uint32_t reported = 0;
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(DLOG_POLL_MS));
+        while (dlog_take(&record))
+        {
+            dlog_format(&record, text, sizeof(text));
+            fputs(text, stdout);
+        }
+        uint32_t lost = dropped;
+        if (lost != reported)
+        {
+            printf("[LOG]dropped %" PRIu32 "\n", lost - reported);
+            reported = lost;
+        }
+    }
+}
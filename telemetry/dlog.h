@@ -0,0 +1,97 @@
+#ifndef DLOG_H
+#define DLOG_H
+// Deferred log: printf for GPIO IRQs, lwIP callbacks and the network task.
+//
+// printf formats and writes to USB CDC stdio on the spot, which takes tens of
+// microseconds and can wait for the USB stack, so an ISR or callback that
+// prints runs for an unpredictable time. A DLOG_* call instead records a
+// message id from dlog_messages.h, the time and up to four integer arguments
+// into a RAM ring, 28 bytes and a spin lock held for a few instructions.
+// dlog_task, at the lowest priority, formats and prints them later; a full
+// ring drops the message and counts it.
+//
+// Levels are filtered when compiling: a call below DLOG_LEVEL (the T85_LOG_LEVEL
+// CMake cache variable) expands to nothing and does not evaluate its
+// arguments. The default, info, leaves out the per-character barcode debug.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DLOG_LEVEL_DEBUG 0
+#define DLOG_LEVEL_INFO 1
+#define DLOG_LEVEL_WARN 2
+#define DLOG_LEVEL_ERROR 3
+#define DLOG_LEVEL_NONE 4
+
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+
+#define DLOG_SLOTS 64 // a power of two
+#define DLOG_ARGS 4
+#define DLOG_TEXT_SIZE (DLOG_ARGS * 4) // longer text is cut
+#define DLOG_POLL_MS 20 // how often dlog_task looks at the ring
+
+typedef enum
+{
+#define DLOG_MESSAGE(id, format) id,
+#include "dlog_messages.h"
+#undef DLOG_MESSAGE
+    DLOG_MESSAGE_COUNT,
+} dlog_id_t;
+
+typedef struct dlog_record_t_
+{
+    volatile uint32_t seq; // claim number + 1, written last, 0 while free
+    uint32_t time_us;
+    uint16_t id;   // dlog_id_t
+    uint8_t level;
+    uint8_t argc;  // DLOG_ARGC_TEXT and the length for DLOG_TEXT
+    union
+    {
+        uint32_t args[DLOG_ARGS];
+        char text[DLOG_TEXT_SIZE];
+    };
+} dlog_record_t;
+
+#define DLOG_ARGC_TEXT 0x80
+
+void dlog_init(void); // before the first DLOG_ call, IRQs included
+void dlog_write(uint8_t level, uint16_t id, uint8_t argc, const uint32_t *args);
+void dlog_write_text(uint8_t level, uint16_t id, const char *text, uint32_t len);
+bool dlog_take(dlog_record_t *out); // oldest first, for dlog_task
+void dlog_task(void *params);
+uint32_t dlog_dropped(void);
+int dlog_format(const dlog_record_t *record, char *text, size_t size);
+
+#define DLOG_COUNT_(...) DLOG_COUNT_N_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_COUNT_N_(_0, _1, _2, _3, _4, n, ...) n
+// the array starts with a dummy element so a call without arguments is {0}, not
+// the empty initialiser C11 does not allow
+#define DLOG_(level, id, ...) \
+    dlog_write(level, id, DLOG_COUNT_(__VA_ARGS__), (const uint32_t[1 + DLOG_ARGS]){0, ##__VA_ARGS__} + 1)
+
+#if DLOG_LEVEL <= DLOG_LEVEL_DEBUG
+#define DLOG_DEBUG(id, ...) DLOG_(DLOG_LEVEL_DEBUG, id, ##__VA_ARGS__)
+#else
+#define DLOG_DEBUG(id, ...) ((void)0)
+#endif
+#if DLOG_LEVEL <= DLOG_LEVEL_INFO
+#define DLOG_INFO(id, ...) DLOG_(DLOG_LEVEL_INFO, id, ##__VA_ARGS__)
+#define DLOG_TEXT(id, text, len) dlog_write_text(DLOG_LEVEL_INFO, id, text, len)
+#else
+#define DLOG_INFO(id, ...) ((void)0)
+#define DLOG_TEXT(id, text, len) ((void)0)
+#endif
+#if DLOG_LEVEL <= DLOG_LEVEL_WARN
+#define DLOG_WARN(id, ...) DLOG_(DLOG_LEVEL_WARN, id, ##__VA_ARGS__)
+#else
+#define DLOG_WARN(id, ...) ((void)0)
+#endif
+#if DLOG_LEVEL <= DLOG_LEVEL_ERROR
+#define DLOG_ERROR(id, ...) DLOG_(DLOG_LEVEL_ERROR, id, ##__VA_ARGS__)
+#else
+#define DLOG_ERROR(id, ...) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,24 @@
+// Messages of the deferred log, see dlog.h. No include guard, each user
+// defines DLOG_MESSAGE(id, format) and includes this list.
+//
+// Arguments are passed as 32-bit integers: use %d, %u, %x and %c. A message
+// logged with DLOG_TEXT has a single %.*s for its text instead.
+// Append new messages, the ids of the existing ones are in old dumps.
+
+// irline.c, from the GPIO IRQ
+DLOG_MESSAGE(DLOG_BARCODE_BARS, "[barcode] bars is %d, spaces is %d")
+DLOG_MESSAGE(DLOG_BARCODE_NUMS, "[barcode] bar_num is %d, space_num is %d")
+
+// wifi.c, from lwIP callbacks
+DLOG_MESSAGE(DLOG_CLIENT_CONNECTED, "Client connected")
+DLOG_MESSAGE(DLOG_CLIENT_DISCONNECTED, "Client disconnected")
+DLOG_MESSAGE(DLOG_CLIENT_ERROR, "Error code: %d")
+DLOG_MESSAGE(DLOG_ACCEPT_FAILED, "Failure in accept")
+DLOG_MESSAGE(DLOG_TOO_MANY_CLIENTS, "Too many clients, rejecting connection")
+
+// taskmanager.c, from network_task
+DLOG_MESSAGE(DLOG_COMMAND, "Buffer value: %.*s")
+DLOG_MESSAGE(DLOG_COMMAND_START, "starting")
+DLOG_MESSAGE(DLOG_COMMAND_TURN_CW, "turn cw")
+DLOG_MESSAGE(DLOG_COMMAND_TURN_CCW, "turn ccw")
+DLOG_MESSAGE(DLOG_COMMAND_SET, "set %.*s")
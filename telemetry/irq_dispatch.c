@@ -0,0 +1,53 @@
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "irq_dispatch.h"
+
+typedef struct irq_dispatch_entry_t_
+{
+    uint8_t gpio;
+    uint8_t source; // irq_source_t
+    uint8_t priority;
+    uint8_t events;
+    irq_dispatch_handler_t handler;
+} irq_dispatch_entry_t;
+
+static irq_dispatch_entry_t entries[IRQ_SOURCE_COUNT]; // by priority
+static uint8_t entry_count = 0;
+static uint32_t gpio_mask = 0;
+
+void irq_dispatch_add(uint gpio, uint32_t events, irq_source_t source, uint8_t priority, irq_dispatch_handler_t handler)
+{
+    if (entry_count >= IRQ_SOURCE_COUNT)
+        panic("more GPIO handlers than irq sources");
+    uint8_t i = entry_count++;
+    for (; i > 0 && entries[i - 1].priority > priority; i--)
+        entries[i] = entries[i - 1];
+    entries[i] = (irq_dispatch_entry_t){gpio, source, priority, events, handler};
+    gpio_mask |= 1u << gpio;
+}
+
+// the raw IO_IRQ_BANK0 handler
+static void dispatch(void)
+{
+    uint32_t entry_us = time_us_32();
+    for (uint8_t i = 0; i < entry_count; i++)
+    {
+        const irq_dispatch_entry_t *entry = &entries[i];
+        uint32_t events = gpio_get_irq_event_mask(entry->gpio);
+        if (events == 0)
+            continue;
+        gpio_acknowledge_irq(entry->gpio, events);
+        uint32_t start_us = time_us_32();
+        entry->handler(entry->gpio, events);
+        irq_time_add(entry->source, entry_us, start_us);
+    }
+}
+
+void irq_dispatch_start(void)
+{
+    gpio_add_raw_irq_handler_masked(gpio_mask, dispatch);
+    for (uint8_t i = 0; i < entry_count; i++)
+        gpio_set_irq_enabled(entries[i].gpio, entries[i].events, true);
+    irq_set_priority(IO_IRQ_BANK0, IRQ_DISPATCH_NVIC_PRIORITY);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
@@ -0,0 +1,37 @@
+#ifndef IRQ_DISPATCH_H
+#define IRQ_DISPATCH_H
+// GPIO interrupt dispatch: one handler per pin, served in priority order.
+//
+// All bank 0 pins share one interrupt per core, IO_IRQ_BANK0. The SDK's
+// gpio_set_irq_callback walks the pins in pin number order and the callback
+// then had to find the source with an if-chain. irq_dispatch_start instead
+// installs one raw handler that walks a table sorted by priority. For each
+// pin with pending edges it acknowledges them and calls the pin's handler, so
+// an encoder edge pending together with a barcode edge is served first.
+//
+// Priorities order the handlers within the one interrupt. The RP2040 cannot
+// preempt a GPIO handler with another one. IRQ_DISPATCH_NVIC_PRIORITY places
+// the bank among the other interrupts.
+//
+// Each handler run is counted in irq_time with its duration and its entry
+// latency. The latency runs from the dispatcher's entry to the handler's,
+// which is the time the edge waited behind higher priority handlers in the
+// same interrupt. An edge that arrived while an earlier interrupt was still
+// running also waited for that one, which cannot be seen without an edge
+// timestamp.
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "irq_time.h"
+
+#ifndef IRQ_DISPATCH_NVIC_PRIORITY
+#define IRQ_DISPATCH_NVIC_PRIORITY PICO_DEFAULT_IRQ_PRIORITY
+#endif
+
+typedef void (*irq_dispatch_handler_t)(uint gpio, uint32_t events);
+
+// register a pin's handler before irq_dispatch_start, lower priority values are served first
+void irq_dispatch_add(uint gpio, uint32_t events, irq_source_t source, uint8_t priority, irq_dispatch_handler_t handler);
+// install the dispatcher and enable the pins' events, on the core that is to take the interrupts
+void irq_dispatch_start(void);
+
+#endif
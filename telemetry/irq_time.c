@@ -0,0 +1,13 @@
+#include "irq_time.h"
+
+volatile irq_time_t irq_time[IRQ_SOURCE_COUNT];
+volatile ir_reflex_time_t ir_reflex_time;
+
+const char *const irq_source_names[IRQ_SOURCE_COUNT] = {
+    [IRQ_SOURCE_LEFT_ENCODER] = "enc_l",
+    [IRQ_SOURCE_RIGHT_ENCODER] = "enc_r",
+    [IRQ_SOURCE_BARCODE] = "barcode",
+    [IRQ_SOURCE_ECHO] = "echo",
+    [IRQ_SOURCE_IR_LEFT] = "ir_l",
+    [IRQ_SOURCE_IR_RIGHT] = "ir_r",
+};
@@ -0,0 +1,65 @@
+#ifndef IRQ_TIME_H
+#define IRQ_TIME_H
+// Cumulative time spent in the GPIO interrupt handlers, per source.
+//
+// irq_dispatch stamps each handler run with the 1 MHz timer. Handlers are a few
+// microseconds, so single readings are quantized, but the totals are not
+// biased because entry times fall at random within a microsecond. This time is
+// also charged to whichever task was interrupted in the FreeRTOS run-time stats.
+#include <stdint.h>
+#include "hardware/timer.h"
+#include "trace.h"
+
+typedef enum
+{
+    IRQ_SOURCE_LEFT_ENCODER,
+    IRQ_SOURCE_RIGHT_ENCODER,
+    IRQ_SOURCE_BARCODE,
+    IRQ_SOURCE_ECHO,
+    IRQ_SOURCE_IR_LEFT,
+    IRQ_SOURCE_IR_RIGHT,
+    IRQ_SOURCE_COUNT,
+} irq_source_t;
+
+typedef struct irq_time_t_
+{
+    uint32_t count;
+    uint32_t total_us;       // wraps after 71 minutes of handler time
+    uint32_t max_us;         // longest handler run
+    uint32_t max_latency_us; // longest wait from the dispatcher's entry to the handler's, see irq_dispatch.h
+} irq_time_t;
+
+// written only from the GPIO IRQ, read anywhere
+extern volatile irq_time_t irq_time[IRQ_SOURCE_COUNT];
+extern const char *const irq_source_names[IRQ_SOURCE_COUNT];
+
+// Edge to PWM latency of the IR line reflex in irline.c, from handler entry.
+// max_us and total_us run until the level register is written, the pwm ones
+// until the slices wrap and output it. Stops clear the direction pins, which
+// act at once.
+typedef struct ir_reflex_time_t_
+{
+    uint32_t count; // edges acted on
+    uint32_t stops;
+    uint32_t max_us;
+    uint32_t total_us;
+    uint32_t max_pwm_us;
+    uint32_t total_pwm_us;
+} ir_reflex_time_t;
+extern volatile ir_reflex_time_t ir_reflex_time;
+
+// call when a handler returns, with time_us_32() from the dispatcher's entry and from before the handler
+static inline void irq_time_add(irq_source_t source, uint32_t dispatch_us, uint32_t start_us)
+{
+    uint32_t duration_us = time_us_32() - start_us;
+    uint32_t latency_us = start_us - dispatch_us;
+    irq_time[source].count++;
+    irq_time[source].total_us += duration_us;
+    if (duration_us > irq_time[source].max_us)
+        irq_time[source].max_us = duration_us;
+    if (latency_us > irq_time[source].max_latency_us)
+        irq_time[source].max_latency_us = latency_us;
+    trace_irq(source, start_us, duration_us);
+}
+
+#endif
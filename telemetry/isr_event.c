@@ -0,0 +1,50 @@
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "isr_event.h"
+
+static isr_event_t events[ISR_EVENT_SLOTS];
+static volatile uint32_t head = 0; // written by the ISR only
+static volatile uint32_t tail = 0; // written by the consumer only
+static TaskHandle_t consumer_task = NULL;
+
+volatile uint32_t isr_event_dropped = 0;
+volatile uint32_t isr_event_latency_us = 0;
+volatile uint32_t isr_event_latency_max_us = 0;
+
+// Task woken by isr_event_post_from_isr
+void isr_event_set_consumer(TaskHandle_t consumer)
+{
+    consumer_task = consumer;
+}
+
+// Stamp and queue an event, then wake the consumer. Drops the event when the
+// ring is full, the caller passes woken on to portYIELD_FROM_ISR.
+bool isr_event_post_from_isr(isr_event_t *event, BaseType_t *woken)
+{
+    uint32_t h = head;
+    if (h - tail >= ISR_EVENT_SLOTS)
+    {
+        isr_event_dropped++;
+        return false;
+    }
+    event->timestamp_us = time_us_32();
+    events[h & (ISR_EVENT_SLOTS - 1)] = *event;
+    __dmb(); // the event must be written before the consumer can see it
+    head = h + 1;
+    if (consumer_task)
+        vTaskNotifyGiveFromISR(consumer_task, woken);
+    return true;
+}
+
+// Take the oldest event, false when there is none
+bool isr_event_take(isr_event_t *out)
+{
+    uint32_t t = tail;
+    if (head == t)
+        return false;
+    __dmb();
+    *out = events[t & (ISR_EVENT_SLOTS - 1)];
+    __dmb();
+    tail = t + 1;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef ISR_EVENT_H
+#define ISR_EVENT_H
+// Fixed-size events from the GPIO interrupt handlers to the network side.
+//
+// ISRs only fill in an event and post it, the forward task blocks on its task
+// notification and does the formatting and sending. All producers must run in
+// the GPIO IRQ (one interrupt context), which makes this a single-producer ring.
+#include <stdbool.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define ISR_EVENT_SLOTS 16 // must be a power of two
+#define ISR_EVENT_DATA_SIZE 10
+
+typedef enum
+{
+    ISR_EVENT_BARCODE_CHAR,      // a character was decoded, data holds the barcode so far
+    ISR_EVENT_BARCODE_DONE,      // the closing '*' was read, data holds the whole barcode
+    ISR_EVENT_BARCODE_BAD_START, // the first character was not '*'
+} isr_event_type_t;
+
+typedef struct isr_event_t_
+{
+    uint8_t type;          // isr_event_type_t
+    char ch;               // decoded character, if any
+    char data[ISR_EVENT_DATA_SIZE];
+    uint32_t timestamp_us; // when the ISR posted the event
+} isr_event_t;
+
+void isr_event_set_consumer(TaskHandle_t consumer);
+bool isr_event_post_from_isr(isr_event_t *event, BaseType_t *woken);
+bool isr_event_take(isr_event_t *out);
+
+extern volatile uint32_t isr_event_dropped;
+extern volatile uint32_t isr_event_latency_us;     // ISR to socket, last event
+extern volatile uint32_t isr_event_latency_max_us; // ISR to socket, worst event
+
+#endif
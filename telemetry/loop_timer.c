@@ -0,0 +1,57 @@
+#include <string.h>
+#include "hardware/timer.h"
+#include "loop_timer.h"
+
+static uint8_t bucket(uint32_t us)
+{
+    uint8_t k = 0;
+    for (us >>= 4; us && k < LOOP_TIMER_BUCKETS - 1; us >>= 1)
+        k++;
+    return k;
+}
+
+void loop_timer_init(loop_timer_t *timer, const char *name, uint32_t rate_hz)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->name = name;
+    timer->period_ticks = rate_hz ? configTICK_RATE_HZ / rate_hz : 1;
+    if (timer->period_ticks == 0)
+        timer->period_ticks = 1;
+    timer->period_us = timer->period_ticks * (1000000 / configTICK_RATE_HZ);
+    timer->last_wake = xTaskGetTickCount();
+    timer->release_us = time_us_32();
+}
+
+// Start an iteration, returns the seconds since the previous one started
+float loop_timer_begin(loop_timer_t *timer)
+{
+    uint32_t now = time_us_32();
+    uint32_t elapsed = now - timer->release_us;
+    timer->release_us = now;
+    if (timer->iterations++ == 0)
+    {
+        timer->last_wake = xTaskGetTickCount(); // init may have run before the scheduler started
+        return timer->period_us * 1e-6f;
+    }
+
+    uint32_t jitter = elapsed > timer->period_us ? elapsed - timer->period_us : timer->period_us - elapsed;
+    if (jitter > timer->max_jitter_us)
+        timer->max_jitter_us = jitter;
+    timer->jitter_hist[bucket(jitter)]++;
+    return elapsed * 1e-6f;
+}
+
+// End an iteration and sleep until the next release
+void loop_timer_wait(loop_timer_t *timer)
+{
+    uint32_t work = time_us_32() - timer->release_us;
+    if (work > timer->max_work_us)
+        timer->max_work_us = work;
+    if (work > timer->period_us)
+    {
+        timer->overruns++;
+        timer->overrun_hist[bucket(work - timer->period_us)]++;
+    }
+    if (xTaskDelayUntil(&timer->last_wake, timer->period_ticks) == pdFALSE)
+        timer->last_wake = xTaskGetTickCount(); // missed the release, do not run back-to-back iterations
+}
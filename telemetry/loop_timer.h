@@ -0,0 +1,36 @@
+#ifndef LOOP_TIMER_H
+#define LOOP_TIMER_H
+// Fixed-rate release for periodic tasks, with jitter and overrun histograms.
+//
+// loop_timer_begin() at the top of an iteration returns the measured dt since
+// the previous release, loop_timer_wait() at the bottom sleeps with
+// xTaskDelayUntil. An iteration that runs past its next release is counted as
+// an overrun and the schedule restarts from now instead of bursting to catch up.
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Histogram buckets in microseconds: <16, 16-31, 32-63, ... 512-1023, >=1024
+#define LOOP_TIMER_BUCKETS 8
+
+typedef struct loop_timer_t_
+{
+    const char *name;
+    TickType_t period_ticks;
+    uint32_t period_us;
+    TickType_t last_wake;
+    uint32_t release_us; // time_us_32() at the start of the current iteration
+    uint32_t iterations;
+    uint32_t overruns;   // iterations whose work took longer than the period
+    uint32_t max_jitter_us;
+    uint32_t max_work_us;
+    uint32_t jitter_hist[LOOP_TIMER_BUCKETS];  // |release interval - period|
+    uint32_t overrun_hist[LOOP_TIMER_BUCKETS]; // work time past the period
+} loop_timer_t;
+
+// rate_hz is rounded to whole ticks, so it can be at most configTICK_RATE_HZ
+void loop_timer_init(loop_timer_t *timer, const char *name, uint32_t rate_hz);
+float loop_timer_begin(loop_timer_t *timer);
+void loop_timer_wait(loop_timer_t *timer);
+
+#endif
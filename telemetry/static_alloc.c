@@ -0,0 +1,41 @@
+#include "static_alloc.h"
+
+#if T85_STATIC_ALLOC
+#include "pico/platform.h"
+
+// Kernel tasks, FreeRTOS asks for their storage when the scheduler starts
+void vApplicationGetIdleTaskMemory(StaticTask_t **tcb, StackType_t **stack, configSTACK_DEPTH_TYPE *stack_words)
+{
+    static StaticTask_t idle_tcb;
+    static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+    *tcb = &idle_tcb;
+    *stack = idle_stack;
+    *stack_words = configMINIMAL_STACK_SIZE;
+}
+
+#if configNUMBER_OF_CORES > 1
+void vApplicationGetPassiveIdleTaskMemory(StaticTask_t **tcb, StackType_t **stack, configSTACK_DEPTH_TYPE *stack_words, BaseType_t index)
+{
+    static StaticTask_t passive_idle_tcb[configNUMBER_OF_CORES - 1];
+    static StackType_t passive_idle_stack[configNUMBER_OF_CORES - 1][configMINIMAL_STACK_SIZE];
+    *tcb = &passive_idle_tcb[index];
+    *stack = passive_idle_stack[index];
+    *stack_words = configMINIMAL_STACK_SIZE;
+}
+#endif
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **tcb, StackType_t **stack, configSTACK_DEPTH_TYPE *stack_words)
+{
+    static StaticTask_t timer_tcb;
+    static StackType_t timer_stack[configTIMER_TASK_STACK_DEPTH];
+    *tcb = &timer_tcb;
+    *stack = timer_stack;
+    *stack_words = configTIMER_TASK_STACK_DEPTH;
+}
+
+// the heap only serves lwIP and cyw43 at startup in this build, running out is a sizing bug
+void vApplicationMallocFailedHook(void)
+{
+    panic("FreeRTOS heap exhausted, raise configTOTAL_HEAP_SIZE");
+}
+#endif
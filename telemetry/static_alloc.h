@@ -0,0 +1,34 @@
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+// Tasks and message buffers in static storage for T85_STATIC_ALLOC builds.
+//
+// STATIC_TASK and STATIC_MESSAGE_BUFFER declare the storage at file scope,
+// static_task_create and static_message_buffer_create make the object from it.
+// Other builds take them from the FreeRTOS heap as before, the declarations
+// then only hold the sizes. The build writes a per-subsystem RAM report to
+// ram_budget.txt, see ram_budget.cmake.
+#include "FreeRTOS.h"
+#include "task.h"
+#include "message_buffer.h"
+
+#if T85_STATIC_ALLOC
+#define STATIC_TASK(name, stack_words)            \
+    static StackType_t name##_stack[stack_words]; \
+    static StaticTask_t name##_tcb
+#define static_task_create(name, function, label, param, priority, handle) \
+    (*(handle) = xTaskCreateStatic(function, label, sizeof(name##_stack) / sizeof(StackType_t), param, priority, name##_stack, &name##_tcb))
+// FreeRTOS needs one byte more than the buffer holds
+#define STATIC_MESSAGE_BUFFER(name, size)      \
+    static uint8_t name##_storage[(size) + 1]; \
+    static StaticMessageBuffer_t name##_struct
+#define static_message_buffer_create(name) \
+    xMessageBufferCreateStatic(sizeof(name##_storage) - 1, name##_storage, &name##_struct)
+#else
+#define STATIC_TASK(name, stack_words) enum { name##_stack_words = (stack_words) }
+#define static_task_create(name, function, label, param, priority, handle) \
+    xTaskCreate(function, label, name##_stack_words, param, priority, handle)
+#define STATIC_MESSAGE_BUFFER(name, size) enum { name##_size = (size) }
+#define static_message_buffer_create(name) xMessageBufferCreate(name##_size)
+#endif
+
+#endif
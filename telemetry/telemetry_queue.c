@@ -0,0 +1,87 @@
+#include <string.h>
+#include "hardware/sync.h"
+#include "telemetry_queue.h"
+
+static telemetry_lane_t lanes[TELEMETRY_PRODUCER_COUNT];
+static TaskHandle_t consumer_task = NULL;
+
+// Task that gets notified when a message is published
+void telemetry_set_consumer(TaskHandle_t consumer)
+{
+    consumer_task = consumer;
+}
+
+// Copy msg into the producer's lane, false if it already holds limit messages
+static bool lane_push(telemetry_lane_t *lane, uint32_t limit, uint8_t topic, uint8_t client, uint32_t generation, const char *msg)
+{
+    uint32_t head = lane->head;
+    if (head - lane->tail >= limit)
+    {
+        lane->dropped++;
+        return false;
+    }
+    telemetry_msg_t *slot = &lane->slots[head & (TELEMETRY_LANE_SLOTS - 1)];
+    size_t len = strnlen(msg, sizeof(slot->data) - 1);
+    slot->topic = topic;
+    slot->client = client;
+    slot->generation = generation;
+    slot->len = len;
+    memcpy(slot->data, msg, len);
+    __dmb(); // the slot must be written before the consumer can see it
+    lane->head = head + 1;
+    lane->sent++;
+    return true;
+}
+
+// Queue a message from a task, never blocks
+bool telemetry_publish(telemetry_producer_t producer, uint8_t topic, const char *msg)
+{
+    if (!lane_push(&lanes[producer], TELEMETRY_LANE_SLOTS - TELEMETRY_REPLY_SLOTS, topic, TELEMETRY_BROADCAST, 0, msg))
+        return false;
+    if (consumer_task)
+        xTaskNotifyGive(consumer_task);
+    return true;
+}
+
+// Queue a message for one client only, such as a deferred ack, never blocks.
+// It may take the slots kept from publishes, so it only fails when the lane
+// is full with replies or the consumer is behind on them too.
+bool telemetry_reply(telemetry_producer_t producer, uint8_t client, uint32_t generation, const char *msg)
+{
+    if (!lane_push(&lanes[producer], TELEMETRY_LANE_SLOTS, 0, client, generation, msg))
+        return false;
+    if (consumer_task)
+        xTaskNotifyGive(consumer_task);
+    return true;
+}
+
+// Take the next message from any lane, lanes are visited round robin so a
+// busy producer cannot starve the others. Only one task may consume.
+bool telemetry_consume(telemetry_msg_t *out)
+{
+    static uint32_t next_lane = 0;
+    for (uint32_t i = 0; i < TELEMETRY_PRODUCER_COUNT; i++)
+    {
+        telemetry_lane_t *lane = &lanes[(next_lane + i) % TELEMETRY_PRODUCER_COUNT];
+        uint32_t tail = lane->tail;
+        if (lane->head == tail)
+            continue;
+        __dmb(); // read the slot only after seeing the head move
+        *out = lane->slots[tail & (TELEMETRY_LANE_SLOTS - 1)];
+        __dmb(); // finish the copy before the producer may reuse the slot
+        lane->tail = tail + 1;
+        next_lane = (next_lane + i + 1) % TELEMETRY_PRODUCER_COUNT;
+        return true;
+    }
+    return false;
+}
+
+uint32_t telemetry_dropped(telemetry_producer_t producer)
+{
+    return lanes[producer].dropped;
+}
+
+uint32_t telemetry_depth(telemetry_producer_t producer)
+{
+    return lanes[producer].head - lanes[producer].tail;
+}
@@ -0,0 +1,54 @@
+#ifndef TELEMETRY_QUEUE_H
+#define TELEMETRY_QUEUE_H
+// Lock-free multi-producer, single-consumer queue for telemetry messages.
+//
+// Every producer owns a lane, a single-producer ring that only it writes the
+// head of and only the consumer writes the tail of. The RP2040's M0+ cores have
+// no compare-and-swap, so this is how several tasks can enqueue without a
+// lock: a full lane drops the message and counts it, it never waits. Each lane
+// must be used from one task only; ISRs post through isr_event.h instead.
+// The last TELEMETRY_REPLY_SLOTS of a lane are for replies, so a producer
+// that floods its lane with publishes still has room for an ack.
+#include <stdbool.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define TELEMETRY_MSG_SIZE 128 // one formatted message, longer ones are truncated
+#define TELEMETRY_LANE_SLOTS 8 // messages a lane holds, must be a power of two
+#define TELEMETRY_REPLY_SLOTS 2 // of those, the ones publishes may not take
+#define TELEMETRY_BROADCAST 0xff // client value of messages sent by topic
+
+typedef enum
+{
+    TELEMETRY_PRODUCER_MOVE,      // move_task updates
+    TELEMETRY_PRODUCER_CALIBRATE, // calibrate_task updates
+    TELEMETRY_PRODUCER_COUNT
+} telemetry_producer_t;
+
+typedef struct telemetry_msg_t_
+{
+    uint32_t generation; // of the client slot, a reply to a client that has since gone is dropped
+    uint8_t topic;  // TOPIC_* from wifi.h
+    uint8_t client; // client slot for replies, TELEMETRY_BROADCAST otherwise
+    uint8_t len;
+    char data[TELEMETRY_MSG_SIZE - 7]; // always has room for a terminator
+} telemetry_msg_t;
+
+typedef struct telemetry_lane_t_
+{
+    volatile uint32_t head;    // next slot to write, producer only
+    volatile uint32_t tail;    // next slot to read, consumer only
+    volatile uint32_t sent;    // messages enqueued
+    volatile uint32_t dropped; // messages lost because the lane was full, replies included
+    telemetry_msg_t slots[TELEMETRY_LANE_SLOTS];
+} telemetry_lane_t;
+
+void telemetry_set_consumer(TaskHandle_t consumer);
+bool telemetry_publish(telemetry_producer_t producer, uint8_t topic, const char *msg);
+bool telemetry_reply(telemetry_producer_t producer, uint8_t client, uint32_t generation, const char *msg);
+bool telemetry_consume(telemetry_msg_t *out);
+uint32_t telemetry_dropped(telemetry_producer_t producer);
+uint32_t telemetry_depth(telemetry_producer_t producer);
+
+#endif
@@ -0,0 +1,211 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "stream_buffer.h"
+#include "trace.h"
+#include "irq_time.h"
+
+static_assert(sizeof(trace_record_t) == 8, "records are 8 bytes");
+static_assert(sizeof(trace_dump_header_t) == 16, "the dump header is 16 bytes");
+static_assert(sizeof(trace_name_t) == 16, "names are 16 bytes");
+static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "TRACE_RECORDS must be a power of two");
+
+#if T85_TRACE
+static trace_record_t ring[TRACE_RECORDS];
+#endif
+static uint32_t head = 0; // records written since trace_start, index with & (TRACE_RECORDS - 1)
+static volatile bool running = false;
+static volatile bool stop_on_hiccup = false;
+static spin_lock_t *lock = NULL; // producers on both cores, and ISRs
+
+// objects named by trace_name_object, then the tasks found when the dump is made
+static struct
+{
+    trace_dump_header_t header;
+    trace_name_t names[TRACE_MAX_NAMES];
+} dump;
+static uint16_t object_count = 0;
+static bool dump_ready = false;
+
+static uint16_t object_number(void *object, bool buffer)
+{
+    UBaseType_t number = buffer ? uxStreamBufferGetStreamBufferNumber((StreamBufferHandle_t)object)
+                                : uxQueueGetQueueNumber((QueueHandle_t)object);
+    if (number)
+        return number;
+    return TRACE_OBJECT_UNNAMED | (((uintptr_t)object >> 2) & 0x7fff);
+}
+
+static void add(uint8_t type, uint8_t task, uint16_t arg, uint32_t time_us)
+{
+#if T85_TRACE
+    uint32_t irq = spin_lock_blocking(lock);
+    trace_record_t *record = &ring[head++ & (TRACE_RECORDS - 1)];
+    spin_unlock(lock, irq);
+    // the slot is this core's now, a dump only reads once running is false
+    record->time_us = time_us;
+    record->type = type | (get_core_num() ? TRACE_CORE_BIT : 0);
+    record->task = task;
+    record->arg = arg;
+#endif
+}
+
+void trace_task(uint8_t type, void *task)
+{
+    if (!running)
+        return;
+    uint32_t now = time_us_32();
+    add(type, uxTaskGetTaskNumber(task ? (TaskHandle_t)task : xTaskGetCurrentTaskHandle()), 0, now);
+}
+
+void trace_object(uint8_t type, void *object, bool buffer)
+{
+    if (!running)
+        return;
+    uint32_t now = time_us_32();
+    add(type, uxTaskGetTaskNumber(xTaskGetCurrentTaskHandle()), object_number(object, buffer), now);
+}
+
+void trace_irq(uint8_t source, uint32_t start_us, uint32_t duration_us)
+{
+    if (!running)
+        return;
+    add(TRACE_IRQ, source, duration_us > UINT16_MAX ? UINT16_MAX : duration_us, start_us);
+}
+
+void trace_name_object(const char *name, void *handle, bool buffer)
+{
+    if (object_count >= TRACE_MAX_NAMES || handle == NULL)
+        return;
+    trace_name_t *entry = &dump.names[object_count++];
+    entry->kind = TRACE_NAME_OBJECT;
+    entry->id = object_count; // from 1, 0 is an object without a number
+    memcpy(entry->name, name, strnlen(name, TRACE_NAME_SIZE));
+    if (buffer)
+        vStreamBufferSetStreamBufferNumber((StreamBufferHandle_t)handle, entry->id);
+    else
+        vQueueSetQueueNumber((QueueHandle_t)handle, entry->id);
+}
+
+bool trace_start(bool hiccup)
+{
+#if T85_TRACE
+    if (lock == NULL)
+        lock = spin_lock_init(spin_lock_claim_unused(true));
+    running = false;
+    __dmb();
+    uint32_t irq = spin_lock_blocking(lock);
+    head = 0;
+    spin_unlock(lock, irq);
+    dump_ready = false;
+    stop_on_hiccup = hiccup;
+    __dmb();
+    running = true;
+    return true;
+#else
+    (void)hiccup;
+    return false;
+#endif
+}
+
+void trace_stop(void)
+{
+    running = false;
+    stop_on_hiccup = false;
+    __dmb();
+}
+
+void trace_hiccup(void)
+{
+    if (stop_on_hiccup)
+        trace_stop();
+}
+
+bool trace_running(void)
+{
+    return running;
+}
+
+// the header, the task and the IRQ source names, once per stopped trace
+static void prepare_dump(void)
+{
+    static TaskStatus_t tasks[TRACE_MAX_NAMES];
+    uint16_t count = object_count;
+    UBaseType_t task_count = uxTaskGetSystemState(tasks, TRACE_MAX_NAMES, NULL);
+    for (UBaseType_t i = 0; i < task_count && count < TRACE_MAX_NAMES; i++)
+    {
+        trace_name_t *entry = &dump.names[count++];
+        entry->kind = TRACE_NAME_TASK;
+        entry->reserved = 0;
+        entry->id = tasks[i].xTaskNumber;
+        memset(entry->name, 0, TRACE_NAME_SIZE);
+        memcpy(entry->name, tasks[i].pcTaskName, strnlen(tasks[i].pcTaskName, TRACE_NAME_SIZE));
+    }
+    for (int i = 0; i < IRQ_SOURCE_COUNT && count < TRACE_MAX_NAMES; i++)
+    {
+        trace_name_t *entry = &dump.names[count++];
+        entry->kind = TRACE_NAME_IRQ;
+        entry->reserved = 0;
+        entry->id = i;
+        memset(entry->name, 0, TRACE_NAME_SIZE);
+        memcpy(entry->name, irq_source_names[i], strnlen(irq_source_names[i], TRACE_NAME_SIZE));
+    }
+    dump.header.magic = TRACE_MAGIC;
+    dump.header.version = TRACE_VERSION;
+    dump.header.name_count = count;
+    dump.header.record_count = head < TRACE_RECORDS ? head : TRACE_RECORDS;
+    dump.header.lost = head - dump.header.record_count;
+    dump_ready = true;
+}
+
+uint32_t trace_size(void)
+{
+    if (running || head == 0)
+        return 0;
+    if (!dump_ready)
+        prepare_dump();
+    return sizeof(dump.header) + dump.header.name_count * sizeof(trace_name_t) + dump.header.record_count * sizeof(trace_record_t);
+}
+
+uint32_t trace_read(uint32_t offset, uint8_t *out, uint32_t size)
+{
+#if T85_TRACE
+    uint32_t total = trace_size();
+    uint32_t names_end = sizeof(dump.header) + dump.header.name_count * sizeof(trace_name_t);
+    uint32_t oldest = head - dump.header.record_count;
+    uint32_t n = 0;
+    for (; n < size && offset < total; n++, offset++)
+    {
+        if (offset < names_end)
+            out[n] = ((const uint8_t *)&dump)[offset];
+        else
+        {
+            uint32_t at = offset - names_end;
+            const trace_record_t *record = &ring[(oldest + at / sizeof(trace_record_t)) & (TRACE_RECORDS - 1)];
+            out[n] = ((const uint8_t *)record)[at % sizeof(trace_record_t)];
+        }
+    }
+    return n;
+#else
+    (void)offset, (void)out, (void)size;
+    return 0;
+#endif
+}
+
+int trace_format(char *text, size_t size)
+{
+#if T85_TRACE
+    uint32_t kept = head < TRACE_RECORDS ? head : TRACE_RECORDS;
+    int len = snprintf(text, size, "[TRC]%s%s\trecords:%" PRIu32 "/%u\tlost:%" PRIu32 "\n", running ? "on" : "off",
+                       stop_on_hiccup ? " hiccup" : "", kept, TRACE_RECORDS, head - kept);
+#else
+    int len = snprintf(text, size, "[TRC]not built, configure with -DT85_TRACE=ON\n");
+#endif
+    return len < (int)size ? len : (int)size - 1;
+}
@@ -0,0 +1,116 @@
+#ifndef TRACE_H
+#define TRACE_H
+// Schedule trace: what ran on each core and why it stopped, for finding what
+// held up a control period. Built with the T85_TRACE CMake option, which has
+// FreeRTOSConfig.h include this header to define the kernel's trace macros;
+// without it the macros stay empty and "trc on" answers that tracing is off.
+//
+// Records are 8 bytes in a RAM ring that overwrites its oldest:
+//   task switched in and out, a task made ready (the unblock), a task
+//   blocking on a queue or mutex, a message or stream buffer, a notification
+//   or a delay, and each GPIO IRQ handler run, from irq_time_add.
+// Queues and buffers are named by the number trace_name_object gave them,
+// stats_watch_buffer names the message buffers it watches. An object without
+// a number is 0x8000 and bits of its address.
+//
+// "trc on" starts tracing, "trc on hiccup" also stops it when move_task
+// overruns its period, so the ring ends with the period that was late.
+// The first dump after a stop snapshots the task and IRQ source names. "trc dump <offset>" replies the dump:
+// a trace_dump_header_t, name_count trace_name_t, then record_count records
+// oldest first. "t85ctl schedule" saves it and host/t85_trace.cpp converts
+// it to Chrome trace JSON for chrome://tracing or ui.perfetto.dev.
+//
+// This header is included by FreeRTOSConfig.h, so it uses only C types.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 2048 // a power of two, 16 KB, about a second of a busy schedule
+#endif
+#define TRACE_MAGIC 0x54353854u // "T85T" little-endian
+#define TRACE_VERSION 1
+#define TRACE_MAX_NAMES 32
+#define TRACE_NAME_SIZE 12
+#define TRACE_CORE_BIT 0x80 // of type, set for core 1
+#define TRACE_OBJECT_UNNAMED 0x8000
+
+typedef enum
+{
+    TRACE_SWITCH_IN = 1, // task: running from here
+    TRACE_SWITCH_OUT,    // task: stops running
+    TRACE_READY,         // task: unblocked or created
+    TRACE_BLOCK_QUEUE_RECEIVE, // task, arg object: queue, semaphore or mutex take
+    TRACE_BLOCK_QUEUE_SEND,
+    TRACE_BLOCK_BUFFER_RECEIVE, // message and stream buffers
+    TRACE_BLOCK_BUFFER_SEND,
+    TRACE_BLOCK_NOTIFY, // task: waiting for a notification
+    TRACE_BLOCK_DELAY,  // task: vTaskDelay or xTaskDelayUntil
+    TRACE_IRQ,          // task: irq_source_t, arg: handler time in us, time_us its entry
+} trace_type_t;
+
+typedef struct trace_record_t_
+{
+    uint32_t time_us; // time_us_32()
+    uint8_t type;     // trace_type_t, TRACE_CORE_BIT for core 1
+    uint8_t task;     // FreeRTOS task number, as in TaskStatus_t.xTaskNumber
+    uint16_t arg;
+} trace_record_t;
+
+typedef struct trace_dump_header_t_
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t name_count;
+    uint32_t record_count;
+    uint32_t lost; // records overwritten before the dump
+} trace_dump_header_t;
+
+typedef enum
+{
+    TRACE_NAME_TASK,
+    TRACE_NAME_OBJECT,
+    TRACE_NAME_IRQ, // id: irq_source_t
+} trace_name_kind_t;
+
+typedef struct trace_name_t_
+{
+    uint8_t kind; // trace_name_kind_t
+    uint8_t reserved;
+    uint16_t id; // task number or object number
+    char name[TRACE_NAME_SIZE]; // not terminated when full
+} trace_name_t;
+
+// number a queue or message buffer for the trace and remember its name
+void trace_name_object(const char *name, void *handle, bool buffer);
+bool trace_start(bool hiccup); // false in builds without T85_TRACE
+void trace_stop(void);
+void trace_hiccup(void); // move_task overran, stops the trace if "trc on hiccup" armed it
+bool trace_running(void);
+uint32_t trace_size(void); // bytes of a dump, 0 while running
+uint32_t trace_read(uint32_t offset, uint8_t *out, uint32_t size);
+int trace_format(char *text, size_t size);
+
+// recorders, called by the macros below and irq_time_add
+void trace_task(uint8_t type, void *task); // NULL for the running task
+void trace_object(uint8_t type, void *object, bool buffer);
+void trace_irq(uint8_t source, uint32_t start_us, uint32_t duration_us);
+
+#if T85_TRACE
+// task numbers are the kernel's TCB numbers, copied where uxTaskGetTaskNumber finds them
+#define traceTASK_CREATE(pxNewTCB) ((pxNewTCB)->uxTaskNumber = (pxNewTCB)->uxTCBNumber)
+#define traceTASK_SWITCHED_IN() trace_task(TRACE_SWITCH_IN, NULL)
+#define traceTASK_SWITCHED_OUT() trace_task(TRACE_SWITCH_OUT, NULL)
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB) trace_task(TRACE_READY, (pxTCB))
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue) trace_object(TRACE_BLOCK_QUEUE_RECEIVE, (pxQueue), false)
+#define traceBLOCKING_ON_QUEUE_PEEK(pxQueue) trace_object(TRACE_BLOCK_QUEUE_RECEIVE, (pxQueue), false)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue) trace_object(TRACE_BLOCK_QUEUE_SEND, (pxQueue), false)
+#define traceBLOCKING_ON_STREAM_BUFFER_RECEIVE(xStreamBuffer) trace_object(TRACE_BLOCK_BUFFER_RECEIVE, (xStreamBuffer), true)
+#define traceBLOCKING_ON_STREAM_BUFFER_SEND(xStreamBuffer) trace_object(TRACE_BLOCK_BUFFER_SEND, (xStreamBuffer), true)
+#define traceTASK_NOTIFY_TAKE_BLOCK(uxIndexToWait) trace_task(TRACE_BLOCK_NOTIFY, NULL)
+#define traceTASK_NOTIFY_WAIT_BLOCK(uxIndexToWait) trace_task(TRACE_BLOCK_NOTIFY, NULL)
+#define traceTASK_DELAY() trace_task(TRACE_BLOCK_DELAY, NULL)
+#define traceTASK_DELAY_UNTIL(xTimeToWake) trace_task(TRACE_BLOCK_DELAY, NULL)
+#endif
+
+#endif
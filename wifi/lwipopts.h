@@ -12,7 +12,7 @@
 // Common settings used in most of the pico_w examples
 // (see https://www.nongnu.org/lwip/2_1_x/group__lwip__opts.html for details)
 
-#define NO_SYS 1
+#define NO_SYS 0
 #define LWIP_SOCKET 0
 #if PICO_CYW43_ARCH_POLL
 #define MEM_LIBC_MALLOC             1
@@ -37,10 +37,11 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+#define MEM_STATS                   1 // heap and pool usage for the stats command
 #define SYS_STATS                   0
-#define MEMP_STATS                  0
+#define MEMP_STATS                  1
 #define LINK_STATS                  0
+#define LWIP_STATS                  1
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
 #define LWIP_DHCP                   1
@@ -55,7 +56,6 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
-#define LWIP_STATS                  1
 #define LWIP_STATS_DISPLAY          1
 #endif
 
@@ -91,6 +91,11 @@
 #endif /* __LWIPOPTS_H__ */
 
 #if !NO_SYS
+// lwIP runs in its own FreeRTOS task, below move_task and sense_task
+#ifndef NETWORK_STACK_PRIORITY
+#define NETWORK_STACK_PRIORITY 1
+#endif
+#define TCPIP_THREAD_PRIO NETWORK_STACK_PRIORITY
 #define TCPIP_THREAD_STACKSIZE 1024
 #define DEFAULT_THREAD_STACKSIZE 1024
 #define DEFAULT_RAW_RECVMBOX_SIZE 8
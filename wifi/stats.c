@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "wifi.h"
+#include "stats.h"
+#include "udp_telemetry.h"
+#include "telemetry_queue.h"
+#include "isr_event.h"
+#include "loop_timer.h"
+#include "irq_time.h"
+#include "trace.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+
+static_assert(TELEMETRY_PRODUCER_COUNT <= STATS_MAX_PRODUCERS, "grow STATS_MAX_PRODUCERS");
+static_assert(MAX_CLIENTS <= STATS_MAX_CLIENTS, "grow STATS_MAX_CLIENTS");
+static_assert(LOOP_TIMER_BUCKETS == STATS_LOOP_BUCKETS, "loop histogram layouts differ");
+static_assert(IRQ_SOURCE_COUNT <= STATS_MAX_IRQS, "grow STATS_MAX_IRQS");
+
+static struct
+{
+    const char *name;
+    MessageBufferHandle_t handle;
+    size_t size;
+} watched[STATS_MAX_BUFFERS];
+static uint8_t watched_count = 0;
+
+static const loop_timer_t *loops[STATS_MAX_LOOPS];
+static uint8_t loop_count = 0;
+
+static TaskStatus_t task_status[STATS_MAX_TASKS];
+
+// run-time counters at the previous report, CPU shares are taken over the interval since
+static struct
+{
+    TaskHandle_t handle;
+    configRUN_TIME_COUNTER_TYPE runtime;
+} cpu_last[STATS_MAX_TASKS];
+static UBaseType_t cpu_last_count = 0;
+static uint64_t cpu_last_us = 0;
+static uint32_t irq_last_count[IRQ_SOURCE_COUNT]; // IRQ rates are taken over the same interval
+
+static uint16_t cpu_share(const TaskStatus_t *status, uint64_t interval_us)
+{
+    configRUN_TIME_COUNTER_TYPE runtime = status->ulRunTimeCounter;
+    for (UBaseType_t i = 0; i < cpu_last_count; i++)
+    {
+        if (cpu_last[i].handle == status->xHandle)
+        {
+            runtime -= cpu_last[i].runtime;
+            break;
+        }
+    }
+    uint64_t permille = interval_us ? runtime * 1000 / interval_us : 0;
+    return permille > 1000 ? 1000 : permille;
+}
+
+// Include a message buffer's fill level in the report
+void stats_watch_buffer(const char *name, void *message_buffer, size_t size)
+{
+    if (watched_count < STATS_MAX_BUFFERS)
+    {
+        watched[watched_count].name = name;
+        watched[watched_count].handle = (MessageBufferHandle_t)message_buffer;
+        watched[watched_count].size = size;
+        watched_count++;
+    }
+    trace_name_object(name, message_buffer, true);
+}
+
+// Include a periodic task's timing in the report
+void stats_watch_loop(const loop_timer_t *timer)
+{
+    if (loop_count < STATS_MAX_LOOPS)
+        loops[loop_count++] = timer;
+}
+
+static void fill_pool(stats_pool_t *pool, const struct stats_mem *mem)
+{
+    pool->avail = mem->avail;
+    pool->used = mem->used;
+    pool->max = mem->max;
+    pool->err = mem->err;
+}
+
+// Take a snapshot of everything the report covers
+void stats_fill(stats_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+    report->magic = STATS_MAGIC;
+    report->version = STATS_VERSION;
+    report->length = sizeof(*report);
+    report->timestamp_us = time_us_64();
+    report->heap_free = xPortGetFreeHeapSize();
+    report->heap_min_free = xPortGetMinimumEverFreeHeapSize();
+
+    UBaseType_t count = uxTaskGetSystemState(task_status, STATS_MAX_TASKS, NULL);
+    uint64_t now_us = portGET_RUN_TIME_COUNTER_VALUE();
+    report->cpu_interval_us = now_us - cpu_last_us;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        stats_task_t *task = &report->tasks[i];
+        strncpy(task->name, task_status[i].pcTaskName, STATS_NAME_SIZE);
+        task->stack_free_min = task_status[i].usStackHighWaterMark;
+        task->priority = task_status[i].uxCurrentPriority;
+        task->state = task_status[i].eCurrentState;
+        task->cpu_permille = cpu_share(&task_status[i], now_us - cpu_last_us);
+    }
+    report->task_count = count;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        cpu_last[i].handle = task_status[i].xHandle;
+        cpu_last[i].runtime = task_status[i].ulRunTimeCounter;
+    }
+    cpu_last_count = count;
+    cpu_last_us = now_us;
+
+    for (int i = 0; i < IRQ_SOURCE_COUNT; i++)
+    {
+        uint32_t irq_count = irq_time[i].count;
+        report->irqs[i].count = irq_count;
+        report->irqs[i].total_us = irq_time[i].total_us;
+        report->irqs[i].rate_hz = report->cpu_interval_us ? (uint64_t)(irq_count - irq_last_count[i]) * 1000000 / report->cpu_interval_us : 0;
+        report->irqs[i].max_us = irq_time[i].max_us;
+        report->irqs[i].max_latency_us = irq_time[i].max_latency_us;
+        irq_last_count[i] = irq_count;
+    }
+    report->irq_count = IRQ_SOURCE_COUNT;
+    report->ir_reflex.count = ir_reflex_time.count;
+    report->ir_reflex.stops = ir_reflex_time.stops;
+    report->ir_reflex.max_us = ir_reflex_time.max_us;
+    report->ir_reflex.total_us = ir_reflex_time.total_us;
+    report->ir_reflex.max_pwm_us = ir_reflex_time.max_pwm_us;
+    report->ir_reflex.total_pwm_us = ir_reflex_time.total_pwm_us;
+
+    for (uint8_t i = 0; i < watched_count; i++)
+    {
+        stats_buffer_t *buffer = &report->buffers[i];
+        strncpy(buffer->name, watched[i].name, STATS_NAME_SIZE);
+        buffer->size = watched[i].size;
+        buffer->used = watched[i].size - xMessageBufferSpacesAvailable(watched[i].handle);
+    }
+    report->buffer_count = watched_count;
+
+    // written by the loop's own task, a report may mix two iterations
+    for (uint8_t i = 0; i < loop_count; i++)
+    {
+        stats_loop_t *loop = &report->loops[i];
+        strncpy(loop->name, loops[i]->name, STATS_NAME_SIZE);
+        loop->period_us = loops[i]->period_us;
+        loop->iterations = loops[i]->iterations;
+        loop->overruns = loops[i]->overruns;
+        loop->max_jitter_us = loops[i]->max_jitter_us;
+        loop->max_work_us = loops[i]->max_work_us;
+        memcpy(loop->jitter_hist, loops[i]->jitter_hist, sizeof(loop->jitter_hist));
+        memcpy(loop->overrun_hist, loops[i]->overrun_hist, sizeof(loop->overrun_hist));
+    }
+    report->loop_count = loop_count;
+
+    cyw43_arch_lwip_begin();
+    fill_pool(&report->lwip_heap, &lwip_stats.mem);
+    fill_pool(&report->pbuf_pool, lwip_stats.memp[MEMP_PBUF_POOL]);
+    fill_pool(&report->tcp_pcb, lwip_stats.memp[MEMP_TCP_PCB]);
+    fill_pool(&report->tcp_seg, lwip_stats.memp[MEMP_TCP_SEG]);
+    fill_pool(&report->udp_pcb, lwip_stats.memp[MEMP_UDP_PCB]);
+    for (int i = 0; i < MAX_CLIENTS && myServer; i++)
+        report->client_dropped[i] = myServer->clients[i].dropped;
+    cyw43_arch_lwip_end();
+
+    for (int i = 0; i < TELEMETRY_PRODUCER_COUNT; i++)
+        report->telemetry_dropped[i] = telemetry_dropped(i);
+    report->isr_event_dropped = isr_event_dropped;
+    report->cmd_dropped = wifi_cmd_dropped;
+    report->udp_failed = udp_telemetry_failed;
+}
+
+// Render a report as text lines for the stats command, returns the length
+int stats_format(const stats_report_t *report, char *text, size_t size)
+{
+    int len = snprintf(text, size, "[STATS]heap free:%" PRIu32 "\tmin:%" PRIu32 "\n", report->heap_free, report->heap_min_free);
+    for (int i = 0; i < report->task_count && len < size; i++)
+        len += snprintf(text + len, size - len, "[STATS]task %.*s\tprio:%u\tstack_free:%" PRIu32 "\tcpu:%u.%u%%\n",
+                        STATS_NAME_SIZE, report->tasks[i].name, report->tasks[i].priority, report->tasks[i].stack_free_min,
+                        report->tasks[i].cpu_permille / 10, report->tasks[i].cpu_permille % 10);
+    const struct
+    {
+        const char *name;
+        const stats_pool_t *pool;
+    } pools[] = {
+        {"mem", &report->lwip_heap},
+        {"pbuf", &report->pbuf_pool},
+        {"tcp_pcb", &report->tcp_pcb},
+        {"tcp_seg", &report->tcp_seg},
+        {"udp_pcb", &report->udp_pcb},
+    };
+    for (size_t i = 0; i < sizeof(pools) / sizeof(pools[0]) && len < size; i++)
+        len += snprintf(text + len, size - len, "[STATS]lwip %s\tused:%u\tmax:%u\tavail:%u\terr:%u\n",
+                        pools[i].name, pools[i].pool->used, pools[i].pool->max, pools[i].pool->avail, pools[i].pool->err);
+    for (int i = 0; i < report->buffer_count && len < size; i++)
+        len += snprintf(text + len, size - len, "[STATS]buffer %.*s\t%u/%u\n",
+                        STATS_NAME_SIZE, report->buffers[i].name, report->buffers[i].used, report->buffers[i].size);
+    for (int i = 0; i < report->loop_count && len < size; i++)
+    {
+        const stats_loop_t *loop = &report->loops[i];
+        len += snprintf(text + len, size - len, "[STATS]loop %.*s\tperiod:%" PRIu32 "\tn:%" PRIu32 "\toverrun:%" PRIu32 "\tjitter_max:%" PRIu32 "\twork_max:%" PRIu32 "\tjitter:",
+                        STATS_NAME_SIZE, loop->name, loop->period_us, loop->iterations, loop->overruns, loop->max_jitter_us, loop->max_work_us);
+        for (int k = 0; k < STATS_LOOP_BUCKETS && len < size; k++)
+            len += snprintf(text + len, size - len, k ? ",%" PRIu32 : "%" PRIu32, loop->jitter_hist[k]);
+        if (len < size)
+            len += snprintf(text + len, size - len, "\tover:");
+        for (int k = 0; k < STATS_LOOP_BUCKETS && len < size; k++)
+            len += snprintf(text + len, size - len, k ? ",%" PRIu32 : "%" PRIu32, loop->overrun_hist[k]);
+        if (len < size)
+            len += snprintf(text + len, size - len, "\n");
+    }
+    for (int i = 0; i < report->irq_count && i < IRQ_SOURCE_COUNT && len < size; i++)
+        len += snprintf(text + len, size - len, "[STATS]irq %s\tn:%" PRIu32 "\trate:%" PRIu32 "/s\ttotal:%" PRIu32 "us\tmax:%" PRIu32 "us\tlatency_max:%" PRIu32 "us\n",
+                        irq_source_names[i], report->irqs[i].count, report->irqs[i].rate_hz, report->irqs[i].total_us,
+                        report->irqs[i].max_us, report->irqs[i].max_latency_us);
+    const stats_reflex_t *reflex = &report->ir_reflex;
+    uint32_t reflex_n = reflex->count ? reflex->count : 1;
+    if (len < size)
+        len += snprintf(text + len, size - len, "[STATS]ir_reflex n:%" PRIu32 "\tstop:%" PRIu32 "\twrite:%" PRIu32 "/%" PRIu32 "us\tpwm:%" PRIu32 "/%" PRIu32 "us\n",
+                        reflex->count, reflex->stops, reflex->total_us / reflex_n, reflex->max_us,
+                        reflex->total_pwm_us / reflex_n, reflex->max_pwm_us);
+    if (len < size)
+        len += snprintf(text + len, size - len, "[STATS]dropped move:%" PRIu32 "\tcal:%" PRIu32 "\tisr:%" PRIu32 "\tcmd:%" PRIu32 "\tudp:%" PRIu32 "\tclients:%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+                        report->telemetry_dropped[TELEMETRY_PRODUCER_MOVE], report->telemetry_dropped[TELEMETRY_PRODUCER_CALIBRATE],
+                        report->isr_event_dropped, report->cmd_dropped, report->udp_failed,
+                        report->client_dropped[0], report->client_dropped[1], report->client_dropped[2], report->client_dropped[3]);
+    return len < size ? len : (int)size - 1;
+}
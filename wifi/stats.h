@@ -0,0 +1,117 @@
+#ifndef STATS_H
+#define STATS_H
+// Runtime resource report: FreeRTOS heap and task stacks, lwIP pools, buffer
+// fill levels, dropped-message counters, periodic loop timing, per-task CPU
+// use, time, rate and entry latency of each GPIO interrupt source and the IR
+// line reflex latency.
+//
+// "stats" replies with a text summary, "stats on <ms>" sends a binary
+// stats_report_t to clients subscribed to the stats topic every <ms>.
+// This header is shared with the host tools, keep it free of Pico includes.
+#include <stdint.h>
+#include <stddef.h>
+
+#define STATS_MAGIC 0x54383553 // "S58T" on the wire
+#define STATS_VERSION 5
+#define STATS_MAX_TASKS 16
+#define STATS_MAX_BUFFERS 8
+#define STATS_MAX_PRODUCERS 4
+#define STATS_MAX_CLIENTS 4
+#define STATS_MAX_LOOPS 4
+#define STATS_MAX_IRQS 8
+#define STATS_LOOP_BUCKETS 8 // <16, 16-31, ... 512-1023, >=1024 us
+#define STATS_NAME_SIZE 12
+
+typedef struct __attribute__((packed)) stats_task_t_
+{
+    char name[STATS_NAME_SIZE];
+    uint32_t stack_free_min; // stack high-water mark, in words never used
+    uint8_t priority;
+    uint8_t state;         // eTaskState
+    uint16_t cpu_permille; // share of one core since the previous report
+} stats_task_t;
+
+typedef struct __attribute__((packed)) stats_buffer_t_
+{
+    char name[STATS_NAME_SIZE];
+    uint16_t used; // bytes waiting
+    uint16_t size;
+} stats_buffer_t;
+
+typedef struct __attribute__((packed)) stats_pool_t_
+{
+    uint16_t avail;
+    uint16_t used;
+    uint16_t max; // most ever used at once
+    uint16_t err; // failed allocations
+} stats_pool_t;
+
+typedef struct __attribute__((packed)) stats_loop_t_
+{
+    char name[STATS_NAME_SIZE];
+    uint32_t period_us;
+    uint32_t iterations;
+    uint32_t overruns;
+    uint32_t max_jitter_us;
+    uint32_t max_work_us;
+    uint32_t jitter_hist[STATS_LOOP_BUCKETS];  // |release interval - period|
+    uint32_t overrun_hist[STATS_LOOP_BUCKETS]; // work time past the period
+} stats_loop_t;
+
+typedef struct __attribute__((packed)) stats_irq_t_
+{
+    uint32_t count;          // handler calls
+    uint32_t total_us;       // cumulative handler time
+    uint32_t rate_hz;        // handler calls a second since the previous report
+    uint32_t max_us;         // longest handler run
+    uint32_t max_latency_us; // longest wait behind other handlers of the same interrupt
+} stats_irq_t;
+
+typedef struct __attribute__((packed)) stats_reflex_t_
+{
+    uint32_t count; // IR edges acted on
+    uint32_t stops;
+    uint32_t max_us; // handler entry to the PWM level write
+    uint32_t total_us;
+    uint32_t max_pwm_us; // handler entry to the PWM output changing
+    uint32_t total_pwm_us;
+} stats_reflex_t;
+
+// One binary report, little endian
+typedef struct __attribute__((packed)) stats_report_t_
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length; // sizeof(stats_report_t)
+    uint64_t timestamp_us;
+    uint32_t heap_free;     // FreeRTOS heap free now
+    uint32_t heap_min_free; // FreeRTOS heap minimum ever free
+    stats_pool_t lwip_heap; // MEM_SIZE heap, in bytes
+    stats_pool_t pbuf_pool;
+    stats_pool_t tcp_pcb;
+    stats_pool_t tcp_seg;
+    stats_pool_t udp_pcb;
+    uint32_t telemetry_dropped[STATS_MAX_PRODUCERS]; // per telemetry lane
+    uint32_t client_dropped[STATS_MAX_CLIENTS];     // per TCP client slot
+    uint32_t isr_event_dropped;
+    uint32_t cmd_dropped;
+    uint32_t udp_failed;
+    uint8_t task_count;
+    uint8_t buffer_count;
+    stats_task_t tasks[STATS_MAX_TASKS];
+    stats_buffer_t buffers[STATS_MAX_BUFFERS];
+    uint8_t loop_count;
+    stats_loop_t loops[STATS_MAX_LOOPS];
+    uint32_t cpu_interval_us; // time cpu_permille was measured over
+    uint8_t irq_count;
+    stats_irq_t irqs[STATS_MAX_IRQS]; // in irq_source_t order
+    stats_reflex_t ir_reflex;
+} stats_report_t;
+
+struct loop_timer_t_;
+void stats_watch_buffer(const char *name, void *message_buffer, size_t size);
+void stats_watch_loop(const struct loop_timer_t_ *timer);
+void stats_fill(stats_report_t *report);
+int stats_format(const stats_report_t *report, char *text, size_t size);
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "udp_telemetry.h"
+
+static struct udp_pcb *telemetry_pcb = NULL;
+static ip_addr_t telemetry_addr;
+static uint16_t telemetry_port = UDP_TELEMETRY_PORT;
+static volatile uint16_t telemetry_rate = 0; // 0 when the stream is off
+static uint32_t telemetry_seq = 0;
+
+volatile uint32_t udp_telemetry_sent = 0;
+volatile uint32_t udp_telemetry_failed = 0;
+
+// Start streaming if a destination was given at build time
+void udp_telemetry_init(void)
+{
+#ifdef UDP_TELEMETRY_HOST
+    if (!udp_telemetry_start(UDP_TELEMETRY_HOST, UDP_TELEMETRY_PORT, UDP_TELEMETRY_RATE_HZ))
+        printf("Failed to start UDP telemetry to %s\n", UDP_TELEMETRY_HOST);
+#endif
+}
+
+// Point the stream at host:port and send rate_hz samples per second
+bool udp_telemetry_start(const char *host, uint16_t port, uint16_t rate_hz)
+{
+    ip_addr_t addr;
+    if (!ipaddr_aton(host, &addr) || port == 0 || rate_hz == 0)
+        return false;
+    if (rate_hz > UDP_TELEMETRY_MAX_RATE_HZ)
+        rate_hz = UDP_TELEMETRY_MAX_RATE_HZ;
+
+    // stop the stream first, udp_telemetry_send reads the destination under the lwIP lock
+    telemetry_rate = 0;
+    cyw43_arch_lwip_begin();
+    if (telemetry_pcb == NULL)
+        telemetry_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (telemetry_pcb != NULL)
+    {
+        telemetry_addr = addr;
+        telemetry_port = port;
+        telemetry_seq = 0;
+    }
+    cyw43_arch_lwip_end();
+    if (telemetry_pcb == NULL)
+        return false;
+    telemetry_rate = rate_hz;
+    printf("UDP telemetry to %s:%u at %u Hz\n", host, port, rate_hz);
+    return true;
+}
+
+void udp_telemetry_stop(void)
+{
+    telemetry_rate = 0;
+}
+
+bool udp_telemetry_enabled(void)
+{
+    return telemetry_rate != 0;
+}
+
+uint16_t udp_telemetry_rate(void)
+{
+    return telemetry_rate;
+}
+
+// Stamp the header fields of sample and send it as one datagram. Never blocks,
+// a sample that cannot get a pbuf is counted as failed and its sequence number
+// is still used so the receiver sees the gap. The pbuf comes from lwIP's fixed
+// size pool rather than its heap, a constant time take with no fragmentation.
+bool udp_telemetry_send(udp_sample_t *sample)
+{
+    if (!udp_telemetry_enabled())
+        return false;
+    sample->magic = UDP_TELEMETRY_MAGIC;
+    sample->version = UDP_TELEMETRY_VERSION;
+    sample->rate_hz = telemetry_rate;
+
+    cyw43_arch_lwip_begin();
+    sample->seq = telemetry_seq++;
+    err_t err = ERR_MEM;
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(*sample), PBUF_POOL);
+    if (p)
+    {
+        memcpy(p->payload, sample, sizeof(*sample));
+        err = udp_sendto(telemetry_pcb, p, &telemetry_addr, telemetry_port);
+        pbuf_free(p);
+    }
+    cyw43_arch_lwip_end();
+
+    if (err != ERR_OK)
+    {
+        udp_telemetry_failed++;
+        return false;
+    }
+    udp_telemetry_sent++;
+    return true;
+}
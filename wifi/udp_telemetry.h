@@ -0,0 +1,43 @@
+#ifndef UDP_TELEMETRY_H
+#define UDP_TELEMETRY_H
+// High-rate control-state telemetry over UDP. Commands stay on the TCP server,
+// this channel only streams samples to one configured host.
+// This header is shared with the host tools, keep it free of Pico includes.
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UDP_TELEMETRY_MAGIC 0x54383555 // "U58T" on the wire
+#define UDP_TELEMETRY_VERSION 1
+#define UDP_TELEMETRY_PORT 4243
+#define UDP_TELEMETRY_RATE_HZ 500
+#define UDP_TELEMETRY_MAX_RATE_HZ 1000
+
+// One sample per datagram, little endian
+typedef struct __attribute__((packed)) udp_sample_t_
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rate_hz;      // configured send rate
+    uint32_t seq;          // increases by one for every datagram sent
+    uint64_t timestamp_us; // robot time when the sample was taken
+    int32_t left_code;     // wheel encoder counts
+    int32_t right_code;
+    int16_t bearing;        // current heading in degrees
+    int16_t target_bearing; // heading move_task is steering to
+    uint16_t ultrasonic_cm;
+    uint16_t speed; // pwm level
+    uint8_t ir;     // bit 0 left IR on black, bit 1 right IR on black
+    char mode;      // move_task mode, see motion_mode()
+} udp_sample_t;
+
+void udp_telemetry_init(void);
+bool udp_telemetry_start(const char *host, uint16_t port, uint16_t rate_hz);
+void udp_telemetry_stop(void);
+bool udp_telemetry_enabled(void);
+uint16_t udp_telemetry_rate(void);
+bool udp_telemetry_send(udp_sample_t *sample);
+
+extern volatile uint32_t udp_telemetry_sent;
+extern volatile uint32_t udp_telemetry_failed;
+
+#endif
@@ -3,75 +3,299 @@
  * From pico examples
  * Updated as needed
  */
+#include <inttypes.h>
 #include "wifi.h"
+#include "udp_telemetry.h"
+#include "stats.h"
+#include "pico/async_context_freertos.h"
+#include "static_alloc.h"
+#include "dlog.h"
 
 TCP_SERVER_T *myServer = NULL;
-MessageBufferHandle_t wifiMsgBuffer;
-MessageBufferHandle_t wifiMsgBufferFromISR;
+MessageBufferHandle_t wifiCmdBuffer;
+#define WIFI_CMD_BUFFER_SIZE (4 * sizeof(queued_cmd_t))
+STATIC_MESSAGE_BUFFER(wifi_cmd_buffer, WIFI_CMD_BUFFER_SIZE);
+static TCP_SERVER_T server_state;
+static async_context_freertos_t network_context; // takes static storage for its task when configSUPPORT_STATIC_ALLOCATION is set
+volatile uint32_t wifi_cmd_dropped = 0; // Commands lost because wifiCmdBuffer was full.
+static TickType_t stats_period = 0;       // Ticks between binary stats reports, 0 when off.
+static stats_report_t stats_report;
+static char stats_text[2048];
 
-// Initialize the TCP server state
+// Initialize the TCP server state, there is only ever one server
 static TCP_SERVER_T *tcp_server_init(void)
 {
-    TCP_SERVER_T *state = calloc(1, sizeof(TCP_SERVER_T)); // Allocate memory for the server state.
-    if (!state)
-    { // Check if memory allocation failed.
-        return NULL;
+    memset(&server_state, 0, sizeof(server_state));
+    return &server_state;
+}
+
+// Release a client slot and close its connection if it is still open
+static void tcp_server_client_close(TCP_CLIENT_T *client)
+{
+    if (client->pcb == NULL)
+    {
+        return;
     }
-    return state;
+    tcp_arg(client->pcb, NULL);
+    tcp_recv(client->pcb, NULL);
+    tcp_err(client->pcb, NULL);
+    if (tcp_close(client->pcb) != ERR_OK)
+    {
+        tcp_abort(client->pcb); // Out of memory for the FIN, drop the connection instead.
+    }
+    client->pcb = NULL;
+    DLOG_INFO(DLOG_CLIENT_DISCONNECTED);
 }
 
 // Handle TCP server errors
 static void tcp_server_err(void *arg, err_t err)
 {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T *)arg;
     if (err != ERR_ABRT)
     {                                    // Check if the error is not an abort error.
-        printf("Error code: %d\n", err); // Print the error code.
+        DLOG_WARN(DLOG_CLIENT_ERROR, err); // Log the error code.
+    }
+    if (client)
+    {
+        client->pcb = NULL; // lwIP has already freed the pcb.
     }
 }
 
-// Send data over the TCP connection
-err_t tcp_server_send_data(struct pbuf *p, TCP_SERVER_T *state)
+// Send a message to every client subscribed to topic. The message is formatted
+// once by the producer and copied into each client's send queue; a client
+// without room for the whole message misses it instead of holding up the rest.
+void tcp_server_broadcast(TCP_SERVER_T *state, uint8_t topic, const char *data, uint16_t len)
 {
-    if (state == NULL)
+    if (state == NULL || len == 0)
     {
-        return ERR_OK;
+        return;
     }
-    if (state->connected == false)
+    cyw43_arch_lwip_begin(); // Aquire lock for wifi
+    for (int i = 0; i < MAX_CLIENTS; i++)
     {
-        return ERR_OK;
+        TCP_CLIENT_T *client = &state->clients[i];
+        if (client->pcb == NULL || !(client->topics & topic))
+        {
+            continue;
+        }
+        if (tcp_sndbuf(client->pcb) < len || tcp_sndqueuelen(client->pcb) >= TCP_SND_QUEUELEN)
+        {
+            client->dropped++; // Slow client, skip it.
+            continue;
+        }
+        if (tcp_write(client->pcb, data, len, TCP_WRITE_FLAG_COPY) != ERR_OK)
+        {
+            client->dropped++;
+            continue;
+        }
+        tcp_output(client->pcb);
     }
-    int len = p->tot_len;
-    if (p->tot_len > BUF_SIZE)
-        len = BUF_SIZE;
-    strncpy(state->buffer_sent, p->payload, len); // Copy "ok" to the send buffer.
+    cyw43_arch_lwip_end(); // release the locks
+}
 
-    cyw43_arch_lwip_begin();                                                                // Aquire lock for wifi
-    cyw43_arch_lwip_check();                                                                // Check the lwIP stack for readiness.
-    err_t err = tcp_write(state->client_pcb, state->buffer_sent, len, TCP_WRITE_FLAG_COPY); // Write data to the TCP connection.
-    cyw43_arch_lwip_end();                                                                  // release the locks
+// Send a reply to the client a command came from, generation is the slot's when the command arrived
+err_t tcp_server_reply(TCP_CLIENT_T *client, uint32_t generation, const char *msg)
+{
+    err_t err = ERR_CONN;
+    cyw43_arch_lwip_begin();
+    // The client may have gone since it sent the command, and another one may have taken its slot.
+    if (client->pcb != NULL && client->generation == generation)
+    {
+        err = tcp_write(client->pcb, msg, strlen(msg), TCP_WRITE_FLAG_COPY);
+        if (err == ERR_OK)
+        {
+            tcp_output(client->pcb);
+        }
+    }
+    cyw43_arch_lwip_end();
+    return err;
+}
+
+// Whether any client is connected, read without the lwIP lock by tasks that only log it
+bool tcp_server_connected(void)
+{
+    if (myServer == NULL)
+    {
+        return false;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (myServer->clients[i].pcb != NULL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parse a list of topic names such as "motion heading" into a TOPIC_* mask
+static uint8_t parse_topics(const char *text, uint16_t len)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t mask;
+    } topic_names[] = {
+        {"motion", TOPIC_MOTION},
+        {"heading", TOPIC_HEADING},
+        {"calibration", TOPIC_CALIBRATION},
+        {"barcode", TOPIC_BARCODE},
+        {"mission", TOPIC_MISSION},
+        {"stats", TOPIC_STATS},
+        {"all", TOPIC_ALL},
+    };
+    uint8_t mask = 0;
+    uint16_t i = 0;
+    while (i < len)
+    {
+        while (i < len && (text[i] == ' ' || text[i] == '\r' || text[i] == '\n'))
+            i++;
+        uint16_t start = i;
+        while (i < len && text[i] != ' ' && text[i] != '\r' && text[i] != '\n')
+            i++;
+        for (size_t t = 0; t < sizeof(topic_names) / sizeof(topic_names[0]); t++)
+        {
+            if (strlen(topic_names[t].name) == i - start && strncmp(text + start, topic_names[t].name, i - start) == 0)
+                mask |= topic_names[t].mask;
+        }
+    }
+    return mask;
+}
 
-    if (err != ERR_OK)
-    {                                      // Check if the write operation failed.
-        printf("Failed to write data!\n"); // Print an error message.
-        return err;
+// Receive data from a client. This runs in the lwIP thread, so it only copies
+// the command into wifiCmdBuffer for network_task and never blocks.
+static err_t tcp_server_client_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+    TCP_CLIENT_T *client = (TCP_CLIENT_T *)arg;
+    if (!p)
+    { // The client closed the connection.
+        tcp_server_client_close(client);
+        return ERR_OK;
     }
+    queued_cmd_t cmd;
+    cmd.rx_us = time_us_32();
+    cmd.client = client - myServer->clients; // Slot of the client, for the reply.
+    cmd.generation = client->generation;
+    uint16_t len = pbuf_copy_partial(p, cmd.text, CMD_SIZE, 0);
+    if (xMessageBufferSend(wifiCmdBuffer, &cmd, offsetof(queued_cmd_t, text) + len, 0) == 0)
+    {
+        wifi_cmd_dropped++; // network_task is behind, the client will see no ack.
+    }
+    tcp_recved(tpcb, p->tot_len); // Reopen the receive window.
+    pbuf_free(p);
     return ERR_OK;
 }
 
+// Format the acknowledgement for a command. Commands sent as "#<id> <command>"
+// get their id echoed with the robot timestamps (time_us_32) of receipt,
+// dispatch and first actuation, 0 for stages the command does not have.
+int tcp_server_format_ack(char *text, size_t size, const cmd_trace_t *trace, uint32_t act_us)
+{
+    if (!trace->has_id)
+        return snprintf(text, size, "ack\n");
+    return snprintf(text, size, "ack #%" PRIu32 " rx:%" PRIu32 " dsp:%" PRIu32 " act:%" PRIu32 "\n", trace->id, trace->rx_us, trace->dsp_us, act_us);
+}
+
+// Acknowledge a command that is finished without reaching move_task
+void tcp_server_ack(TCP_CLIENT_T *client, const cmd_trace_t *trace)
+{
+    char text[64];
+    tcp_server_format_ack(text, sizeof(text), trace, 0);
+    tcp_server_reply(client, trace->generation, text);
+}
+
+// Change a client's subscriptions, unless another client has taken its slot
+// since the command arrived. The lwIP lock keeps out the accept callback,
+// which resets the subscriptions of a new client.
+static void tcp_server_change_topics(TCP_CLIENT_T *client, uint32_t generation, uint8_t add, uint8_t remove)
+{
+    cyw43_arch_lwip_begin();
+    if (client->generation == generation)
+        client->topics = (client->topics & ~remove) | add;
+    cyw43_arch_lwip_end();
+}
+
+// Handle one queued command. Subscriptions are the server's own business,
+// everything else is passed on to the application's tcp_server_command.
+static void tcp_server_handle_command(TCP_CLIENT_T *client, char *cmd, size_t len, cmd_trace_t *trace)
+{
+    if (cmd[0] == '#')
+    { // Optional correlation id
+        char *end;
+        trace->id = strtoul(cmd + 1, &end, 10);
+        trace->has_id = end != cmd + 1;
+        while (*end == ' ')
+            end++;
+        len -= end - cmd;
+        cmd = end;
+    }
+    if (len > 6 && strncmp(cmd, "unsub ", 6) == 0)
+    {
+        tcp_server_change_topics(client, trace->generation, 0, parse_topics(cmd + 6, len - 6));
+        tcp_server_ack(client, trace);
+        return;
+    }
+    if (len > 4 && strncmp(cmd, "sub ", 4) == 0)
+    {
+        tcp_server_change_topics(client, trace->generation, parse_topics(cmd + 4, len - 4), 0);
+        tcp_server_ack(client, trace);
+        return;
+    }
+    if (strncmp(cmd, "stats", 5) == 0)
+    {
+        unsigned period_ms = 0;
+        if (strncmp(cmd, "stats off", 9) == 0)
+        {
+            stats_period = 0;
+        }
+        else if (sscanf(cmd, "stats on %u", &period_ms) == 1 && period_ms > 0)
+        {
+            stats_period = MAX(pdMS_TO_TICKS(period_ms), 1);
+            tcp_server_change_topics(client, trace->generation, TOPIC_STATS, 0);
+        }
+        else
+        {
+            stats_fill(&stats_report);
+            stats_format(&stats_report, stats_text, sizeof(stats_text));
+            tcp_server_reply(client, trace->generation, stats_text);
+        }
+        tcp_server_ack(client, trace);
+        return;
+    }
+    tcp_server_command(client, cmd, len, trace);
+}
+
 static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err)
 {                                              // Handle incoming client connections.
     TCP_SERVER_T *state = (TCP_SERVER_T *)arg; // Retrieve the server state from the argument.
     if (err != ERR_OK || client_pcb == NULL)
     {                                  // Check for errors or invalid client protocol control block.
-        printf("Failure in accept\n"); // Print an error message.
+        DLOG_WARN(DLOG_ACCEPT_FAILED); // Log an error message.
         return ERR_VAL;
     }
-    printf("Client connected\n");          // Print a message indicating a successful client connection.
-    state->client_pcb = client_pcb;        // Store the client's protocol control block.
-    tcp_arg(client_pcb, state);            // Set the argument for the client's TCP connection.
-    tcp_recv(client_pcb, tcp_server_recv); // Set the callback for receiving data on the client connection.
-    tcp_err(client_pcb, tcp_server_err);   // Set the callback for handling errors on the client connection.
-    state->connected = true;
+    TCP_CLIENT_T *client = NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (state->clients[i].pcb == NULL)
+        {
+            client = &state->clients[i];
+            break;
+        }
+    }
+    if (client == NULL)
+    {
+        DLOG_WARN(DLOG_TOO_MANY_CLIENTS);
+        tcp_abort(client_pcb);
+        return ERR_ABRT;
+    }
+    DLOG_INFO(DLOG_CLIENT_CONNECTED);             // Log a successful client connection.
+    client->pcb = client_pcb;                     // Store the client's protocol control block.
+    client->topics = TOPIC_ALL;                   // New clients get everything until they unsubscribe.
+    client->dropped = 0;
+    client->generation++;                         // Replies still queued for the slot's last client are not ours.
+    tcp_arg(client_pcb, client);                  // Set the argument for the client's TCP connection.
+    tcp_recv(client_pcb, tcp_server_client_recv); // Set the callback for receiving data on the client connection.
+    tcp_err(client_pcb, tcp_server_err);          // Set the callback for handling errors on the client connection.
     return ERR_OK;
 }
 
@@ -91,7 +315,7 @@ static bool tcp_server_open(void *arg)
         printf("Failed to bind to port %u\n", TCP_PORT); // Print an error message.
         return false;
     }
-    state->server_pcb = tcp_listen_with_backlog(pcb, 1); // Listen for incoming connections with a backlog of 1.
+    state->server_pcb = tcp_listen_with_backlog(pcb, MAX_CLIENTS); // Listen for incoming connections.
     if (!state->server_pcb)
     {                                 // Check if listening failed.
         printf("Failed to listen\n"); // Print an error message.
@@ -101,7 +325,6 @@ static bool tcp_server_open(void *arg)
         }
         return false;
     }
-    state->connected = false;
     tcp_arg(state->server_pcb, state);                // Set the argument for the server PCB.
     tcp_accept(state->server_pcb, tcp_server_accept); // Set the callback for accepting client connections.
     myServer = state;
@@ -116,7 +339,10 @@ void start_server(__unused void *params)
         printf("Failed to allocate state\n"); // Print an error message.
         return;
     }
-    if (!tcp_server_open(state))
+    cyw43_arch_lwip_begin();
+    bool opened = tcp_server_open(state);
+    cyw43_arch_lwip_end();
+    if (!opened)
     {                                       // Start the TCP server.
         printf("Failed to start server\n"); // Print an error message on server start failure.
         return;
@@ -124,17 +350,80 @@ void start_server(__unused void *params)
     printf("complete server setup!\n");
 }
 
+// Bring up the cyw43 driver and lwIP. Both run in FreeRTOS tasks created here
+// (the async context task and lwIP's tcpip thread) at NETWORK_STACK_PRIORITY.
+// Must be called from a task once the scheduler is running.
 void initWifi()
 {
+    async_context_freertos_config_t config = async_context_freertos_default_config();
+    config.task_priority = NETWORK_STACK_PRIORITY;
+#if configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+    config.task_core_id = NETWORK_TASK_CORE;
+#endif
+    if (!async_context_freertos_init(&network_context, &config))
+    {
+        printf("Failed to create network context\n");
+        return;
+    }
+    cyw43_arch_set_async_context(&network_context.core);
     if (cyw43_arch_init())
     {                                     // Initialize a specific hardware component.
         printf("Failed to initialise\n"); // Print an error message.
         return;
     }
+#if configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+    // lwIP creates its tcpip thread without an affinity, keep it with the rest of the network stack
+    TaskHandle_t tcpip_thread = xTaskGetHandle(TCPIP_THREAD_NAME);
+    if (tcpip_thread)
+        vTaskCoreAffinitySet(tcpip_thread, 1 << NETWORK_TASK_CORE);
+#endif
     cyw43_arch_enable_sta_mode();       // Enable a specific Wi-Fi mode.
     printf("Connecting to Wi-Fi...\n"); // Print a message indicating a Wi-Fi connection attempt.
     while (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, 30000))
     {                                   // Attempt to connect to Wi-Fi.
         printf("Failed to connect.\n"); // Print an error message on Wi-Fi connection failure.
     }
-}
\ No newline at end of file
+}
+
+// Run a command queued by tcp_server_client_recv, len is what wifiCmdBuffer gave for it
+void tcp_server_run_queued(queued_cmd_t *cmd, size_t len)
+{
+    if (len <= offsetof(queued_cmd_t, text) || myServer == NULL)
+        return;
+    len -= offsetof(queued_cmd_t, text);
+    cmd->text[len] = '\0';
+    cmd_trace_t trace = {.client = cmd->client, .generation = cmd->generation, .rx_us = cmd->rx_us};
+    tcp_server_handle_command(&myServer->clients[cmd->client], cmd->text, len, &trace);
+}
+
+// Network task: brings up Wi-Fi and the servers, then runs the commands the
+// lwIP callback queued, so parsing, printing and replying happen here instead
+// of in the lwIP thread.
+void network_task(__unused void *params)
+{
+    wifiCmdBuffer = static_message_buffer_create(wifi_cmd_buffer);
+    stats_watch_buffer("wifi_cmd", wifiCmdBuffer, WIFI_CMD_BUFFER_SIZE);
+    initWifi();
+    start_server(NULL);
+    udp_telemetry_init();
+
+    queued_cmd_t cmd;
+    TickType_t next_report = xTaskGetTickCount();
+    while (1)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (stats_period)
+        {
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(next_report - now) <= 0)
+            {
+                stats_fill(&stats_report);
+                tcp_server_broadcast(myServer, TOPIC_STATS, (const char *)&stats_report, sizeof(stats_report));
+                next_report = now + stats_period;
+            }
+            wait = next_report - now;
+        }
+        size_t len = xMessageBufferReceive(wifiCmdBuffer, &cmd, sizeof(cmd) - 1, wait);
+        tcp_server_run_queued(&cmd, len);
+    }
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>  // Include the standard input/output library for I/O operations.
 #include <string.h>  // Include the string library for string operations.
 #include <stdlib.h>  // Include the standard library for memory allocation and other functions.
+#include <stddef.h>  // Include offsetof for the queued command layout.
 #include "hardware/gpio.h"  // Include the Pico hardware GPIO library.
 
 #include "pico/stdlib.h"  // Include the Pico standard library for Pico-specific functions.
@@ -18,33 +19,79 @@
 
 #define TCP_PORT 4242  // Define a constant for the TCP port number the server will use.
 #define BUF_SIZE 2048  // Define a constant for the size of the data buffer.
+#define MAX_CLIENTS 4  // Number of clients that can be connected at the same time (must fit MEMP_NUM_TCP_PCB).
+#define CMD_SIZE 64  // Longest command taken from a client, the rest of a packet is ignored.
+
+// Telemetry topics, a client picks them with "sub <topic>..." and "unsub <topic>..."
+#define TOPIC_MOTION 0x01  // [P] and [MOV] updates from move_task
+#define TOPIC_HEADING 0x02  // [MOV] updates from move_task while turning
+#define TOPIC_CALIBRATION 0x04  // [CAL] updates from calibrate_task
+#define TOPIC_BARCODE 0x08  // decoded barcodes from the barcode ISR
+#define TOPIC_MISSION 0x20  // [MSN] mission script status from move_task
+#define TOPIC_ALL (TOPIC_MOTION | TOPIC_HEADING | TOPIC_CALIBRATION | TOPIC_BARCODE | TOPIC_MISSION)
+#define TOPIC_STATS 0x10  // binary stats_report_t frames, only sent when asked for by name
 
 #ifndef RUN_FREERTOS_ON_CORE
 #define RUN_FREERTOS_ON_CORE 0
 #endif
 
+// Placement of network_task, the cyw43 async context task and lwIP's tcpip thread.
+// NETWORK_STACK_PRIORITY is shared with lwipopts.h, keep it below move_task and sense_task.
+#ifndef NETWORK_TASK_PRIORITY
+#define NETWORK_TASK_PRIORITY 1
+#endif
+#ifndef NETWORK_TASK_CORE
+#define NETWORK_TASK_CORE 1  // Only used by SMP builds with core affinity.
+#endif
+
+typedef struct TCP_CLIENT_T_ {  // One connected client.
+    struct tcp_pcb *pcb;  // Client's TCP protocol control block, NULL if the slot is free.
+    uint8_t topics;  // Mask of subscribed TOPIC_* values.
+    uint32_t dropped;  // Messages skipped because the client could not keep up.
+    uint32_t generation;  // Counts the connections that took the slot, replies carry it to find their client.
+} TCP_CLIENT_T;
+
+// Where a command came from and when, for "#<id> <command>" latency tracing.
+typedef struct cmd_trace_t_ {
+    uint32_t id;  // Correlation id sent by the client.
+    bool has_id;  // false for plain commands, which get a plain "ack".
+    uint8_t client;  // Slot in TCP_SERVER_T.clients the ack goes to.
+    uint32_t generation;  // The slot's generation when the command arrived.
+    uint32_t rx_us;  // time_us_32() when lwIP handed over the command.
+    uint32_t dsp_us;  // time_us_32() when it was dispatched to move_task.
+} cmd_trace_t;
+
+// A command as queued by the lwIP callback for network_task.
+typedef struct queued_cmd_t_ {
+    uint8_t client;
+    uint32_t generation;  // A client in the same slot that connected since is not the sender.
+    uint32_t rx_us;
+    char text[CMD_SIZE + 1];  // Room for the terminator added by network_task.
+} queued_cmd_t;
+
 typedef struct TCP_SERVER_T_ {  // Define a custom data structure for the TCP server.
     struct tcp_pcb *server_pcb;  // Pointer to the server's TCP protocol control block.
-    struct tcp_pcb *client_pcb;  // Pointer to the client's TCP protocol control block.
-    bool connected;  // Flag to indicate completion.
-    char buffer_sent[BUF_SIZE];  // Buffer for sent data.
-    uint8_t buffer_recv[BUF_SIZE];  // Buffer for received data.
-    int sent_len;  // Length of sent data.
-    int recv_len;  // Length of received data.
+    TCP_CLIENT_T clients[MAX_CLIENTS];  // Connected clients.
 } TCP_SERVER_T;
 
 static TCP_SERVER_T* tcp_server_init(void);
 static void tcp_server_err(void *arg, err_t err);
-err_t tcp_server_send_data(struct pbuf *p, TCP_SERVER_T *state);
-extern err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+void tcp_server_broadcast(TCP_SERVER_T *state, uint8_t topic, const char *data, uint16_t len);
+err_t tcp_server_reply(TCP_CLIENT_T *client, uint32_t generation, const char *msg);
+int tcp_server_format_ack(char *text, size_t size, const cmd_trace_t *trace, uint32_t act_us);
+void tcp_server_ack(TCP_CLIENT_T *client, const cmd_trace_t *trace);
+void tcp_server_run_queued(queued_cmd_t *cmd, size_t len);
+bool tcp_server_connected(void);
+extern void tcp_server_command(TCP_CLIENT_T *client, char *cmd, size_t len, cmd_trace_t *trace);
 static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err);
 static bool tcp_server_open(void *arg);
 void start_server(__unused void *params);
 void ServerForwardTask();
 void ServerForwardTaskFromISR();
 void initWifi();
+void network_task(__unused void *params);
 
 extern TCP_SERVER_T *myServer;
-extern MessageBufferHandle_t wifiMsgBuffer;
-extern MessageBufferHandle_t wifiMsgBufferFromISR;
+extern MessageBufferHandle_t wifiCmdBuffer;
+extern volatile uint32_t wifi_cmd_dropped;
 #endif
\ No newline at end of file